@@ -0,0 +1,590 @@
+
+
+//Headless benchmark of the zone loading pipeline
+//Runs each stage of loading a zone on the CPU only (no Ogre Root, render system or window) and prints the
+//wall time, allocations and bytes of every stage as JSON
+//usage: zeq_bench <directory> [zone shortname ...]; with no zones given, every <name>.s3d in the directory is used
+
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <new>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <boost/atomic.hpp>
+#include "type.h"
+#include "exception.h"
+#include "s3d_archive.h"
+#include "worker_pool.h"
+#include "gfx_loaders.h"
+#include "zone_data.h"
+#include "fragment_view.h"
+#include "mesh_builder.h"
+#include "mesh_simplify.h"
+#include "skinning.h"
+#include "texture_decode.h"
+
+//frames of animation skinned per character model
+#define ZEQ_BENCH_SKIN_FRAMES 100
+
+//every allocation made through operator new, from any thread
+//Ogre's own allocators go straight to malloc and aren't counted
+static boost::atomic<uint32> gAllocCount(0);
+static boost::atomic<size_t> gAllocBytes(0);
+
+void* operator new(size_t size)
+{
+	gAllocCount.fetch_add(1,boost::memory_order_relaxed);
+	gAllocBytes.fetch_add(size,boost::memory_order_relaxed);
+	void* ptr = malloc(size ? size : 1);
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) throw()
+{
+	gAllocCount.fetch_add(1,boost::memory_order_relaxed);
+	gAllocBytes.fetch_add(size,boost::memory_order_relaxed);
+	return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& nt) throw()
+{
+	return operator new(size,nt);
+}
+
+void operator delete(void* ptr) throw() { free(ptr); }
+void operator delete[](void* ptr) throw() { free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) throw() { free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) throw() { free(ptr); }
+
+
+enum Stage
+{
+	STAGE_OPEN,
+	STAGE_INFLATE,
+	STAGE_WLD_PARSE,
+	STAGE_SPRITES,
+	STAGE_TEXTURE_DECODE,
+	STAGE_MESH_BUILD,
+	STAGE_OBJECT_BATCH,
+	STAGE_LOD_BUILD,
+	STAGE_BVH_BUILD,
+	STAGE_SKINNING,
+	STAGE_COUNT
+};
+
+static const char* StageNames[STAGE_COUNT] = {
+	"open",
+	"inflate",
+	"wld_parse",
+	"sprites",
+	"texture_decode",
+	"mesh_build",
+	"object_batch",
+	"lod_build",
+	"bvh_build",
+	"skinning"
+};
+
+struct StageStats
+{
+	uint64_t micros;
+	uint32 allocs;
+	size_t allocBytes;
+	size_t bytes; //data the stage produced: inflated files, decoded pixels, built or merged vertices and indices, skinned vertices
+	uint32 items;
+};
+
+//Accumulates into one stage for as long as it is in scope
+class StageTimer
+{
+public:
+	StageTimer(StageStats& stats) : mStats(stats)
+	{
+		mAllocs = gAllocCount.load();
+		mAllocBytes = gAllocBytes.load();
+		mStart = mTimer.getMicroseconds();
+	}
+	~StageTimer()
+	{
+		mStats.micros += mTimer.getMicroseconds() - mStart;
+		mStats.allocs += gAllocCount.load() - mAllocs;
+		mStats.allocBytes += gAllocBytes.load() - mAllocBytes;
+	}
+private:
+	StageStats& mStats;
+	Ogre::Timer mTimer;
+	unsigned long mStart;
+	uint32 mAllocs;
+	size_t mAllocBytes;
+};
+
+//what the skinning stage needs from a character mesh, copied out before the archive's fragments go away
+struct SkinMesh
+{
+	std::vector<float> vertices; //y, z, x like SkeletonSet's
+	std::vector<float> normals;
+	std::vector<VertexPiece> pieces;
+	uint16 boneCount;
+};
+
+struct ZoneResult
+{
+	std::string name;
+	StageStats stages[STAGE_COUNT];
+	std::string error;
+};
+
+//every mesh is kept, as ZoneData::BuildZoneMeshes does, for the level of detail and collision stages
+static void BuildZoneMeshes(ZoneData* zone_data, std::vector<MeshBuildData>& out, StageStats& stats)
+{
+	for (auto itr = zone_data->mZoneMeshFrags.begin(); itr != zone_data->mZoneMeshFrags.end(); itr++)
+	{
+		MeshFragmentView mesh(*itr);
+		auto sprites = zone_data->mSpriteList.find(mesh.GetTextureListing());
+		if (sprites == zone_data->mSpriteList.end())
+			continue;
+		out.push_back(MeshBuildData());
+		MeshBuildData& data = out.back();
+		if (!zone_data->mMeshBuilder.Build(mesh,sprites->second,data))
+		{
+			out.pop_back();
+			continue;
+		}
+		stats.bytes += data.mVertices.size() * sizeof(MeshVertex) + data.mIndices.size() * sizeof(uint16);
+		stats.items++;
+	}
+}
+
+static void BuildObjectMeshes(ZoneData* zone_data, MeshBuildData& out, StageStats& stats)
+{
+	for (auto itr = zone_data->mModelFrags.begin(); itr != zone_data->mModelFrags.end(); itr++)
+	{
+		ModelView model(*itr);
+		if (model.GetRefCount() < 1)
+			continue;
+		Fragment* frag = zone_data->GetFragment(model.GetRef(0));
+		if (!frag || frag->mType != 0x2D)
+			continue;
+		frag = zone_data->GetFragment(RefView(frag).GetRef());
+		if (!frag || frag->mType != 0x36)
+			continue;
+
+		MeshFragmentView mesh(frag);
+		auto sprites = zone_data->mSpriteList.find(mesh.GetTextureListing());
+		if (sprites == zone_data->mSpriteList.end())
+			continue;
+		if (!zone_data->mMeshBuilder.Build(mesh,sprites->second,out))
+			continue;
+		zone_data->mObjectBatcher.AddModel((*itr)->mName,out);
+		stats.bytes += out.mVertices.size() * sizeof(MeshVertex) + out.mIndices.size() * sizeof(uint16);
+		stats.items++;
+	}
+}
+
+//merges the placed objects the same way ZoneData::BuildObjectMeshes does; items is the number of draws left
+static void BatchObjects(ZoneData* zone_data, std::vector<MeshBuildData>& batches, StageStats& stats)
+{
+	//the placements come from the main archive, loaded before this one
+	zone_data->SaveObjectPlacements();
+	for (auto itr = zone_data->mObjectPlacements.begin(); itr != zone_data->mObjectPlacements.end(); itr++)
+	{
+		zone_data->mObjectBatcher.AddPlacement(itr->model.c_str(),itr->position,itr->rotation,itr->scale);
+	}
+	zone_data->mObjectPlacements.clear();
+
+	size_t first = batches.size();
+	uint32 before = zone_data->mObjectBatcher.GetBatchesAfter();
+	zone_data->mObjectBatcher.Build(batches);
+	zone_data->mObjectBatcher.Clear();
+	for (auto itr = batches.begin() + first; itr != batches.end(); itr++)
+	{
+		stats.bytes += itr->mVertices.size() * sizeof(MeshVertex) + itr->mIndices.size() * sizeof(uint16);
+	}
+	stats.items += zone_data->mObjectBatcher.GetBatchesAfter() - before;
+}
+
+//items is the number of reduced levels made, bytes their indices
+static void SimplifyMeshes(std::vector<MeshBuildData>& meshes, StageStats& stats)
+{
+	MeshSimplifier::SimplifyAll(meshes);
+	for (auto itr = meshes.begin(); itr != meshes.end(); itr++)
+	{
+		for (auto lod = itr->mLods.begin(); lod != itr->mLods.end(); lod++)
+		{
+			stats.bytes += lod->mIndices.size() * sizeof(uint16);
+			stats.items++;
+		}
+	}
+}
+
+static void GatherSkinMeshes(ZoneData* zone_data, std::vector<SkinMesh>& out)
+{
+	for (auto itr = zone_data->mModelFrags.begin(); itr != zone_data->mModelFrags.end(); itr++)
+	{
+		ModelView model(*itr);
+		for (int32 i = 0; i < model.GetRefCount(); ++i)
+		{
+			Fragment* frag = zone_data->GetFragment(model.GetRef(i));
+			if (!frag || frag->mType != 0x11)
+				continue;
+			frag = zone_data->GetFragment(RefView(frag).GetRef());
+			if (!frag || frag->mType != 0x10)
+				continue;
+
+			SkeletonTrackSetView track(frag);
+			for (int32 j = 0; j < track.GetMeshRefCount(); ++j)
+			{
+				frag = zone_data->GetFragment(track.GetMeshRef(j));
+				if (!frag || frag->mType != 0x2D)
+					continue;
+				frag = zone_data->GetFragment(RefView(frag).GetRef());
+				if (!frag || frag->mType != 0x36)
+					continue;
+
+				MeshFragmentView mesh(frag);
+				out.push_back(SkinMesh());
+				SkinMesh& skin = out.back();
+				skin.boneCount = track.GetEntryCount();
+				int16 vertexCount = mesh.GetVertexCount();
+				for (int16 v = 0; v < vertexCount; ++v)
+				{
+					Vector3 vert = mesh.GetVertex(v);
+					Vector3 norm = (v < mesh.GetNormalCount()) ? mesh.GetNormal(v) : Vector3();
+					skin.vertices.push_back(vert.y);
+					skin.vertices.push_back(vert.z);
+					skin.vertices.push_back(vert.x);
+					skin.normals.push_back(norm.y);
+					skin.normals.push_back(norm.z);
+					skin.normals.push_back(norm.x);
+				}
+				for (int16 p = 0; p < mesh.GetVertexPieceCount(); ++p)
+					skin.pieces.push_back(mesh.GetVertexPiece(p));
+			}
+		}
+	}
+}
+
+static void SkinMeshes(const std::vector<SkinMesh>& meshes, StageStats& stats)
+{
+	std::vector<SkinMatrix> bones;
+	std::vector<float> vtarget, ntarget;
+	for (auto itr = meshes.begin(); itr != meshes.end(); itr++)
+	{
+		const SkinMesh& mesh = *itr;
+		uint32 vertexCount = mesh.vertices.size() / 3;
+		if (vertexCount == 0 || mesh.boneCount == 0)
+			continue;
+		bones.resize(mesh.boneCount);
+		vtarget.resize(mesh.vertices.size());
+		ntarget.resize(mesh.normals.size());
+
+		for (uint32 f = 0; f < ZEQ_BENCH_SKIN_FRAMES; ++f)
+		{
+			//a new pose every frame, so matrix setup is measured along with the vertex work
+			float angle = f * 0.01f;
+			for (uint16 b = 0; b < mesh.boneCount; ++b)
+				bones[b].Set(angle,angle * 0.5f,-angle,b * 0.1f,0.0f,0.0f);
+
+			uint32 pos = 0;
+			for (auto p = mesh.pieces.begin(); p != mesh.pieces.end() && pos < vertexCount; p++)
+			{
+				uint32 count = std::min<uint32>(p->mCount,vertexCount - pos);
+				const SkinMatrix& mat = bones[(uint16)p->mIndex < mesh.boneCount ? p->mIndex : 0];
+				mat.Transform(&mesh.vertices[pos * 3],&mesh.normals[pos * 3],&vtarget[pos * 3],&ntarget[pos * 3],count);
+				pos += count;
+			}
+			stats.bytes += pos * 6 * sizeof(float);
+			stats.items += pos;
+		}
+	}
+}
+
+//Loads one archive the way S3D::LoadContents does, minus anything that needs a render system
+//Palettized BMPs are expanded to BGRA but never uploaded; other texture formats are left to Ogre and skipped
+static void RunArchive(const std::string& path, ZoneData& zone_data, ZoneResult& result, int kind, std::vector<MeshBuildData>& staticMeshes,
+	std::vector<SkinMesh>& skinMeshes)
+{
+	S3DArchive archive;
+	bool opened;
+	{
+		StageTimer t(result.stages[STAGE_OPEN]);
+		opened = archive.Open(path.c_str());
+	}
+	if (!opened)
+		return;
+	result.stages[STAGE_OPEN].items++;
+
+	std::vector<uint32> wlds;
+	for (uint32 i = 0; i < archive.GetFileCount(); ++i)
+	{
+		const char* extension = strstr(archive.GetFileName(i),".");
+		if (extension && strcmp(extension,".wld") == 0)
+			wlds.push_back(i);
+	}
+
+	{
+		StageTimer t(result.stages[STAGE_INFLATE]);
+		archive.Preload(wlds);
+	}
+
+	for (auto itr = wlds.begin(); itr != wlds.end(); itr++)
+	{
+		S3DFileEntry* entry = archive.GetFile(*itr);
+		result.stages[STAGE_INFLATE].bytes += entry->mDataSize;
+		result.stages[STAGE_INFLATE].items++;
+		{
+			StageTimer t(result.stages[STAGE_WLD_PARSE]);
+			WLD wld(entry,&zone_data,nullptr,kind == 0,kind == 1);
+		}
+		result.stages[STAGE_WLD_PARSE].bytes += entry->mDataSize;
+		result.stages[STAGE_WLD_PARSE].items++;
+		{
+			StageTimer t(result.stages[STAGE_SPRITES]);
+			zone_data.LoadSprites();
+		}
+		result.stages[STAGE_SPRITES].items = zone_data.mSpriteList.size();
+	}
+
+	std::vector<uint32> bitmaps;
+	for (uint32 i = 0; i < archive.GetFileCount(); ++i)
+	{
+		const char* extension = strstr(archive.GetFileName(i),".");
+		if (extension && strcmp(extension,".bmp") == 0)
+			bitmaps.push_back(i);
+	}
+
+	{
+		StageTimer t(result.stages[STAGE_INFLATE]);
+		archive.Preload(bitmaps);
+	}
+
+	std::vector<uint8> pixels;
+	for (auto itr = bitmaps.begin(); itr != bitmaps.end(); itr++)
+	{
+		S3DFileEntry* entry = archive.GetFile(*itr);
+		result.stages[STAGE_INFLATE].bytes += entry->mDataSize;
+		result.stages[STAGE_INFLATE].items++;
+		{
+			StageTimer t(result.stages[STAGE_TEXTURE_DECODE]);
+			PalettedBitmap bmp;
+			if (bmp.Init(entry->mData,entry->mDataSize))
+			{
+				pixels.resize(bmp.GetWidth() * bmp.GetHeight() * 4);
+				bmp.Decode(pixels.data());
+				result.stages[STAGE_TEXTURE_DECODE].bytes += pixels.size();
+				result.stages[STAGE_TEXTURE_DECODE].items++;
+			}
+		}
+		archive.Release(entry);
+	}
+
+	{
+		StageTimer t(result.stages[STAGE_MESH_BUILD]);
+		if (kind == 0)
+			BuildZoneMeshes(&zone_data,staticMeshes,result.stages[STAGE_MESH_BUILD]);
+		else if (kind == 1)
+			BuildObjectMeshes(&zone_data,zone_data.mMeshBuildData,result.stages[STAGE_MESH_BUILD]);
+	}
+	if (kind == 1)
+	{
+		StageTimer t(result.stages[STAGE_OBJECT_BATCH]);
+		BatchObjects(&zone_data,staticMeshes,result.stages[STAGE_OBJECT_BATCH]);
+	}
+	if (kind == 1)
+	{
+		StageTimer t(result.stages[STAGE_LOD_BUILD]);
+		SimplifyMeshes(staticMeshes,result.stages[STAGE_LOD_BUILD]);
+	}
+	if (kind == 1)
+	{
+		//over the zone's meshes and the merged objects, as ZoneLoader does before the characters; items is triangles
+		StageTimer t(result.stages[STAGE_BVH_BUILD]);
+		for (auto itr = staticMeshes.begin(); itr != staticMeshes.end(); itr++)
+			zone_data.mCollision.AddMesh(*itr);
+		zone_data.mCollision.Build();
+		result.stages[STAGE_BVH_BUILD].items = zone_data.mCollision.GetTriangleCount();
+	}
+	if (kind == 2)
+		GatherSkinMeshes(&zone_data,skinMeshes);
+
+	zone_data.ClearFragments();
+	for (auto itr = wlds.begin(); itr != wlds.end(); itr++)
+		archive.Release(archive.GetFile(*itr));
+}
+
+static void RunZone(const std::string& dir, ZoneResult& result)
+{
+	static const char* suffixes[3] = {".s3d","_obj.s3d","_chr.s3d"};
+	std::vector<MeshBuildData> staticMeshes;
+	std::vector<SkinMesh> skinMeshes;
+	memset(result.stages,0,sizeof(result.stages));
+
+	try
+	{
+		//one ZoneData for all three archives, like ZoneLoader
+		ZoneData zone_data(nullptr);
+		for (int kind = 0; kind < 3; ++kind)
+			RunArchive(dir + result.name + suffixes[kind],zone_data,result,kind,staticMeshes,skinMeshes);
+
+		StageTimer t(result.stages[STAGE_SKINNING]);
+		SkinMeshes(skinMeshes,result.stages[STAGE_SKINNING]);
+	}
+	catch (std::exception& e)
+	{
+		result.error = e.what();
+	}
+}
+
+static void FindZones(const std::string& dir, std::vector<std::string>& out)
+{
+	//zone archives are <shortname>.s3d; the _obj, _chr and other extra archives all have an underscore
+#ifdef WIN32
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA((dir + "*.s3d").c_str(),&data);
+	if (find == INVALID_HANDLE_VALUE)
+		return;
+	do
+	{
+		std::string name = data.cFileName;
+		if (name.find('_') == std::string::npos)
+			out.push_back(name.substr(0,name.size() - 4));
+	}
+	while (FindNextFileA(find,&data));
+	FindClose(find);
+#else
+	DIR* d = opendir(dir.c_str());
+	if (!d)
+		return;
+	while (dirent* ent = readdir(d))
+	{
+		std::string name = ent->d_name;
+		if (name.size() > 4 && name.compare(name.size() - 4,4,".s3d") == 0 && name.find('_') == std::string::npos)
+			out.push_back(name.substr(0,name.size() - 4));
+	}
+	closedir(d);
+#endif
+	std::sort(out.begin(),out.end());
+}
+
+static void PrintStats(const StageStats& s)
+{
+	printf("{\"ms\": %.3f, \"allocs\": %u, \"alloc_bytes\": %lu, \"bytes\": %lu, \"items\": %u}",
+		s.micros / 1000.0,s.allocs,(unsigned long)s.allocBytes,(unsigned long)s.bytes,s.items);
+}
+
+static void PrintString(const std::string& str)
+{
+	//zone names come from the command line and errors from exceptions, so neither is safe to print raw
+	putchar('"');
+	for (uint32 i = 0; i < str.size(); ++i)
+	{
+		byte c = str[i];
+		switch (c)
+		{
+		case '"':
+			fputs("\\\"",stdout);
+			break;
+		case '\\':
+			fputs("\\\\",stdout);
+			break;
+		case '\n':
+			fputs("\\n",stdout);
+			break;
+		case '\r':
+			fputs("\\r",stdout);
+			break;
+		case '\t':
+			fputs("\\t",stdout);
+			break;
+		default:
+			if (c < 0x20)
+				printf("\\u%04x",c);
+			else
+				putchar(c);
+			break;
+		}
+	}
+	putchar('"');
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr,"usage: %s <directory> [zone shortname ...]\n",argv[0]);
+		return 1;
+	}
+
+	std::string dir = argv[1];
+	if (!dir.empty() && dir[dir.size() - 1] != '/' && dir[dir.size() - 1] != '\\')
+		dir += '/';
+
+	std::vector<std::string> zones;
+	for (int i = 2; i < argc; ++i)
+		zones.push_back(argv[i]);
+	if (zones.empty())
+		FindZones(dir,zones);
+
+	//Ogre logs through its LogManager, which has to exist even without a Root
+	Ogre::LogManager* logMgr = new Ogre::LogManager();
+	logMgr->createLog("zeq_bench.log",true,false,true);
+
+	printf("{\n\t\"threads\": %u,\n\t\"skin_frames\": %u,\n\t\"zones\": [",WorkerPool::GetShared().GetThreadCount() + 1,ZEQ_BENCH_SKIN_FRAMES);
+	int failed = 0;
+	for (uint32 i = 0; i < zones.size(); ++i)
+	{
+		ZoneResult result;
+		result.name = zones[i];
+		RunZone(dir,result);
+
+		StageStats total;
+		memset(&total,0,sizeof(total));
+		for (int s = 0; s < STAGE_COUNT; ++s)
+		{
+			total.micros += result.stages[s].micros;
+			total.allocs += result.stages[s].allocs;
+			total.allocBytes += result.stages[s].allocBytes;
+		}
+
+		printf("%s\n\t\t{\n\t\t\t\"zone\": ",i ? "," : "");
+		PrintString(result.name);
+		printf(",\n");
+		if (!result.error.empty())
+		{
+			printf("\t\t\t\"error\": ");
+			PrintString(result.error);
+			printf(",\n");
+			failed++;
+		}
+		printf("\t\t\t\"total\": ");
+		PrintStats(total);
+		printf(",\n\t\t\t\"stages\": {");
+		for (int s = 0; s < STAGE_COUNT; ++s)
+		{
+			printf("%s\n\t\t\t\t\"%s\": ",s ? "," : "",StageNames[s]);
+			PrintStats(result.stages[s]);
+		}
+		printf("\n\t\t\t}\n\t\t}");
+	}
+	printf("\n\t]\n}\n");
+
+	delete logMgr;
+	return failed ? 2 : 0;
+}
@@ -0,0 +1,720 @@
+
+//Loopback stand-in for an EQ session server, for running EQSession over a lossy, reordering link
+//The server end lives on a local UDP port in the same process. It drops a share of datagrams each way, holds some
+//back so they arrive late, compresses about half of what it sends, and echoes every application packet back
+//reliably. The client end is a plain EQSession; it sends a run of packets of mixed sizes, many of them fragmented,
+//and checks that every echo comes back whole and in order
+//usage: zeq_loopback [seed] [loss percent] [packets]; exits non-zero if anything went missing, arrived corrupt or
+//out of order, or the session closed
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <deque>
+#include <vector>
+#include <boost/chrono.hpp>
+#include "type.h"
+#include "exception.h"
+#include "socket.h"
+#include "net_reactor.h"
+#include "eq_session.h"
+#include "compression.h"
+#include "crc.h"
+
+//datagram size the server offers in its session response
+#define ZEQ_LOOPBACK_MAX_LENGTH 512
+#define ZEQ_LOOPBACK_KEY 0x12345678
+//percent of the datagrams that get through which are held back and sent later instead
+#define ZEQ_LOOPBACK_REORDER 10
+//percent chance, each tick, that the oldest held datagram is let go when nothing newer has carried it along
+#define ZEQ_LOOPBACK_RELEASE 10
+//the server resends anything unacked for this long, in milliseconds
+#define ZEQ_LOOPBACK_RESEND 200
+//the run fails if it hasn't finished in this long
+#define ZEQ_LOOPBACK_TIMEOUT 30000
+//largest application packet the client sends; the size of each one cycles up to this
+#define ZEQ_LOOPBACK_PACKET_MAX 3000
+//packets the client has waiting on their echo at once; at up to seven datagrams each this stays within ZEQ_SESSION_WINDOW
+#define ZEQ_LOOPBACK_OUTSTANDING 128
+//opcodes of the packets the server greets the client with, in one app-combined packet, and of the client's own
+#define ZEQ_LOOPBACK_GREETING_OP 0x4000
+#define ZEQ_LOOPBACK_GREETING_COUNT 5
+#define ZEQ_LOOPBACK_GREETING_LONG_OP 0x4100
+#define ZEQ_LOOPBACK_ECHO_OP 0x6000
+//most packets the client can be asked to send, so its opcodes stay clear of everything else
+#define ZEQ_LOOPBACK_COUNT_MAX 4096
+
+static inline uint16 ReadBE16(const byte* p)
+{
+	return (uint16)((p[0] << 8) | p[1]);
+}
+
+static inline uint32 ReadBE32(const byte* p)
+{
+	return ((uint32)p[0] << 24) | ((uint32)p[1] << 16) | ((uint32)p[2] << 8) | p[3];
+}
+
+static inline void PushBE16(std::vector<byte>& v, uint16 x)
+{
+	v.push_back(x >> 8);
+	v.push_back(x & 0xff);
+}
+
+static inline void PushBE32(std::vector<byte>& v, uint32 x)
+{
+	PushBE16(v,x >> 16);
+	PushBE16(v,x & 0xffff);
+}
+
+static void CloseSocket(SOCKET sock)
+{
+#ifdef WIN32
+	closesocket(sock);
+#else
+	close(sock);
+#endif
+}
+
+static uint32 Now()
+{
+	return (uint32)boost::chrono::duration_cast<boost::chrono::milliseconds>(
+		boost::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//Size and contents of the i'th packet the client sends, so its echo can be checked without keeping a copy
+static uint32 EchoLength(uint32 i)
+{
+	return (i * 37) % ZEQ_LOOPBACK_PACKET_MAX;
+}
+
+static byte EchoByte(uint32 i, uint32 pos)
+{
+	return (byte)((i + pos) & 0xff);
+}
+
+//xorshift, so a seed gives the same run everywhere
+class Random
+{
+public:
+	Random(uint32 seed) : mState(seed ? seed : 1) { }
+	uint32 Next()
+	{
+		mState ^= mState << 13;
+		mState ^= mState >> 17;
+		mState ^= mState << 5;
+		return mState;
+	}
+	bool Percent(uint32 percent) { return Next() % 100 < percent; }
+private:
+	uint32 mState;
+};
+
+//Server end of an EQ session, just enough of one to echo back whatever the client sends
+class LoopbackServer
+{
+public:
+	LoopbackServer(uint32 seed, uint32 loss);
+	~LoopbackServer();
+	uint16	GetPort() const { return mPort; }
+	//Handles every datagram waiting on the socket
+	void	Receive(uint32 now);
+	//Sends a due ack, resends whatever has gone unacked too long, and lets some held datagrams go
+	void	Tick(uint32 now);
+	uint32	GetReceived() const { return mReceived; }
+	uint32	GetDropped() const { return mDropped; }
+	uint32	GetHeld() const { return mHeldCount; }
+
+private:
+	struct Outgoing
+	{
+		std::vector<byte> packet;
+		uint32 sentAt;
+	};
+
+	//not copyable
+	LoopbackServer(const LoopbackServer&);
+	LoopbackServer& operator=(const LoopbackServer&);
+
+	void	HandleDatagram(const byte* data, uint32 len);
+	void	HandleSessionRequest(const byte* data, uint32 len);
+	void	HandleProtocol(const byte* data, uint32 len);
+	void	HandleSequenced(const byte* data, uint32 len);
+	//Payload of a sequenced packet or a whole fragmented one
+	void	HandlePayload(const byte* data, uint32 len);
+	//Echoes an application packet, opcode first
+	void	Deliver(const byte* data, uint32 len);
+	//Sends an application packet reliably, fragmenting it if it doesn't fit
+	void	SendReliable(const std::vector<byte>& app);
+	void	SendSequenced(std::vector<byte>& packet);
+	void	SendProtocol(const std::vector<byte>& packet);
+	void	SendRaw(const byte* data, uint32 len, bool lossy);
+	//Copy of opcode and data laid out as an application packet
+	static std::vector<byte> AppPacket(uint16 opcode, const byte* data, uint32 len);
+
+	SOCKET		mSocket;
+	uint16		mPort;
+	sockaddr_in	mPeer;
+	bool		mHavePeer;
+	Random		mRandom;
+	uint32		mLoss;
+	uint32		mNow;
+	uint32		mKeyCrc;
+	Deflater	mDeflater;
+	Inflater	mInflater;
+	byte		mInflate[ZEQ_SESSION_INFLATE_MAX];
+
+	uint16		mNextOutSeq;
+	std::map<uint16,Outgoing> mUnacked;
+	std::deque< std::vector<byte> > mHeld;
+	uint32		mHeldCount;
+
+	uint16		mNextInSeq;
+	bool		mAckDue;
+	std::map<uint16,std::vector<byte> > mEarly; //sequenced packets that arrived ahead of a gap
+	std::vector<byte> mFragment;
+	uint32		mFragmentTotal; //0 unless a fragmented packet is being put back together
+
+	uint32		mReceived;
+	uint32		mDropped;
+};
+
+LoopbackServer::LoopbackServer(uint32 seed, uint32 loss) :
+mRandom(seed)
+{
+	mLoss = loss;
+	mNow = 0;
+	mHavePeer = false;
+	mNextOutSeq = 0;
+	mHeldCount = 0;
+	mNextInSeq = 0;
+	mAckDue = false;
+	mFragmentTotal = 0;
+	mReceived = 0;
+	mDropped = 0;
+
+	byte key[4] = { ZEQ_LOOPBACK_KEY & 0xff, (ZEQ_LOOPBACK_KEY >> 8) & 0xff, (ZEQ_LOOPBACK_KEY >> 16) & 0xff, ZEQ_LOOPBACK_KEY >> 24 };
+	mKeyCrc = Crc32(0,key,4);
+
+	mSocket = socket(AF_INET,SOCK_DGRAM,IPPROTO_UDP);
+	if (mSocket == SOCKET_ERROR)
+	{
+		throw ZEQException("Could not open the loopback server socket");
+	}
+	sockaddr_in addr;
+	memset(&addr,0,sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	socklen_t addrLen = sizeof(addr);
+#ifdef WIN32
+	unsigned long nonblock = 1;
+	bool failed = ioctlsocket(mSocket,FIONBIO,&nonblock) == SOCKET_ERROR;
+#else
+	bool failed = fcntl(mSocket,F_SETFL,O_NONBLOCK) == SOCKET_ERROR;
+#endif
+	if (failed || bind(mSocket,(sockaddr*)&addr,sizeof(addr)) == SOCKET_ERROR ||
+		getsockname(mSocket,(sockaddr*)&addr,&addrLen) == SOCKET_ERROR)
+	{
+		CloseSocket(mSocket);
+		throw ZEQException("Could not bind the loopback server socket");
+	}
+	mPort = ntohs(addr.sin_port);
+}
+
+LoopbackServer::~LoopbackServer()
+{
+	CloseSocket(mSocket);
+}
+
+void LoopbackServer::Receive(uint32 now)
+{
+	mNow = now;
+	byte buf[ZEQ_UDP_SLOT_SIZE];
+	for (;;)
+	{
+		sockaddr_in from;
+		socklen_t fromLen = sizeof(from);
+		int len = recvfrom(mSocket,(char*)buf,sizeof(buf),0,(sockaddr*)&from,&fromLen);
+		if (len <= 0)
+			return;
+		if (len >= 2 && buf[0] == 0 && buf[1] == EQ_OP_SESSION_REQUEST)
+		{
+			mPeer = from;
+			mHavePeer = true;
+			HandleSessionRequest(buf,len);
+			continue;
+		}
+		if (!mHavePeer)
+			continue;
+		if (mRandom.Percent(mLoss))
+		{
+			mDropped++;
+			continue;
+		}
+		HandleDatagram(buf,len);
+	}
+}
+
+void LoopbackServer::Tick(uint32 now)
+{
+	mNow = now;
+	if (!mHavePeer)
+		return;
+	if (mAckDue)
+	{
+		std::vector<byte> ack;
+		ack.push_back(0);
+		ack.push_back(EQ_OP_ACK);
+		PushBE16(ack,mNextInSeq - 1);
+		SendProtocol(ack);
+		mAckDue = false;
+	}
+	for (auto itr = mUnacked.begin(); itr != mUnacked.end(); itr++)
+	{
+		if (mNow - itr->second.sentAt < ZEQ_LOOPBACK_RESEND)
+			continue;
+		itr->second.sentAt = mNow;
+		SendProtocol(itr->second.packet);
+	}
+	if (!mHeld.empty() && mRandom.Percent(ZEQ_LOOPBACK_RELEASE))
+	{
+		//sending it can let more of the held ones go after it
+		std::vector<byte> late;
+		late.swap(mHeld.front());
+		mHeld.pop_front();
+		SendRaw(&late[0],late.size(),false);
+	}
+}
+
+void LoopbackServer::HandleSessionRequest(const byte* data, uint32 len)
+{
+	if (len < 10)
+		return;
+	//a new session starts everything over
+	mNextOutSeq = 0;
+	mNextInSeq = 0;
+	mAckDue = false;
+	mFragmentTotal = 0;
+	mUnacked.clear();
+	mEarly.clear();
+	mHeld.clear();
+
+	std::vector<byte> response;
+	response.push_back(0);
+	response.push_back(EQ_OP_SESSION_RESPONSE);
+	response.insert(response.end(),data + 6,data + 10);
+	PushBE32(response,ZEQ_LOOPBACK_KEY);
+	response.push_back(2); //crc bytes
+	response.push_back(ZEQ_SESSION_FORMAT_COMPRESSED);
+	response.push_back(0);
+	PushBE32(response,ZEQ_LOOPBACK_MAX_LENGTH);
+	PushBE32(response,0);
+	SendRaw(&response[0],response.size(),false);
+
+	//the greeting is one app-combined packet, the last entry long enough to need the 0xff length form
+	std::vector<byte> combined;
+	combined.push_back(0);
+	combined.push_back(EQ_OP_APP_COMBINED);
+	byte zeros[300];
+	memset(zeros,0,sizeof(zeros));
+	for (uint32 i = 0; i < ZEQ_LOOPBACK_GREETING_COUNT; ++i)
+	{
+		std::vector<byte> app = AppPacket(ZEQ_LOOPBACK_GREETING_OP + i,zeros,10);
+		combined.push_back(app.size());
+		combined.insert(combined.end(),app.begin(),app.end());
+	}
+	std::vector<byte> app = AppPacket(ZEQ_LOOPBACK_GREETING_LONG_OP,zeros,sizeof(zeros));
+	combined.push_back(0xff);
+	PushBE16(combined,app.size());
+	combined.insert(combined.end(),app.begin(),app.end());
+	SendReliable(combined);
+}
+
+void LoopbackServer::HandleDatagram(const byte* data, uint32 len)
+{
+	if (len < 5)
+		return;
+	len -= 2;
+	if (ReadBE16(data + len) != (Crc32(mKeyCrc,data,len) & 0xffff))
+		return;
+	//the compression flag follows the protocol opcode, or the first byte of an application one
+	uint32 flagPos = (data[0] == 0) ? 2 : 1;
+	memcpy(mInflate,data,flagPos);
+	uint32 inflated = len - flagPos - 1;
+	if (data[flagPos] == ZEQ_SESSION_FLAG_COMPRESSED)
+	{
+		inflated = ZEQ_SESSION_INFLATE_MAX - flagPos;
+		if (!mInflater.Inflate(data + flagPos + 1,len - flagPos - 1,mInflate + flagPos,inflated))
+			return;
+	}
+	else
+	{
+		memcpy(mInflate + flagPos,data + flagPos + 1,inflated);
+	}
+	HandleProtocol(mInflate,flagPos + inflated);
+}
+
+void LoopbackServer::HandleProtocol(const byte* data, uint32 len)
+{
+	if (len < 2 || data[0] != 0)
+	{
+		Deliver(data,len);
+		return;
+	}
+	switch (data[1])
+	{
+	case EQ_OP_COMBINED:
+	{
+		uint32 pos = 2;
+		while (pos < len && pos + 1 + data[pos] <= len)
+		{
+			HandleProtocol(data + pos + 1,data[pos]);
+			pos += 1 + data[pos];
+		}
+		break;
+	}
+	case EQ_OP_APP_COMBINED:
+	{
+		uint32 pos = 2;
+		while (pos < len)
+		{
+			uint32 size = data[pos++];
+			if (size == 0xff)
+			{
+				if (pos + 2 > len)
+					return;
+				size = ReadBE16(data + pos);
+				pos += 2;
+			}
+			if (pos + size > len)
+				return;
+			Deliver(data + pos,size);
+			pos += size;
+		}
+		break;
+	}
+	case EQ_OP_PACKET:
+	case EQ_OP_FRAGMENT:
+		HandleSequenced(data,len);
+		break;
+	case EQ_OP_ACK:
+	{
+		if (len < 4)
+			return;
+		uint16 seq = ReadBE16(data + 2);
+		for (auto itr = mUnacked.begin(); itr != mUnacked.end();)
+		{
+			if ((int16)(seq - itr->first) >= 0)
+				mUnacked.erase(itr++);
+			else
+				itr++;
+		}
+		break;
+	}
+	case EQ_OP_OUT_OF_ORDER_ACK:
+		if (len >= 4)
+			mUnacked.erase(ReadBE16(data + 2));
+		break;
+	default:
+		break;
+	}
+}
+
+void LoopbackServer::HandleSequenced(const byte* data, uint32 len)
+{
+	if (len < 4)
+		return;
+	uint16 seq = ReadBE16(data + 2);
+	int16 ahead = (int16)(seq - mNextInSeq);
+	if (ahead < 0)
+	{
+		//a resend of something already had; the ack for it must have been lost
+		mAckDue = true;
+		return;
+	}
+	if (ahead > 0)
+	{
+		mEarly[seq].assign(data,data + len);
+		std::vector<byte> ack;
+		ack.push_back(0);
+		ack.push_back(EQ_OP_OUT_OF_ORDER_ACK);
+		PushBE16(ack,seq);
+		SendProtocol(ack);
+		return;
+	}
+
+	std::vector<byte> packet(data,data + len);
+	for (;;)
+	{
+		mNextInSeq++;
+		if (packet[1] == EQ_OP_PACKET)
+		{
+			if (packet.size() > 4)
+				HandlePayload(&packet[4],packet.size() - 4);
+		}
+		else if (mFragmentTotal == 0)
+		{
+			if (packet.size() >= 8)
+			{
+				mFragmentTotal = ReadBE32(&packet[4]);
+				mFragment.assign(packet.begin() + 8,packet.end());
+			}
+		}
+		else
+		{
+			mFragment.insert(mFragment.end(),packet.begin() + 4,packet.end());
+		}
+		if (mFragmentTotal && mFragment.size() >= mFragmentTotal)
+		{
+			std::vector<byte> whole;
+			whole.swap(mFragment);
+			mFragmentTotal = 0;
+			HandlePayload(&whole[0],whole.size());
+		}
+
+		auto next = mEarly.find(mNextInSeq);
+		if (next == mEarly.end())
+			break;
+		packet.swap(next->second);
+		mEarly.erase(next);
+	}
+	mAckDue = true;
+}
+
+void LoopbackServer::HandlePayload(const byte* data, uint32 len)
+{
+	//an app-combined packet can come inside a sequenced one
+	if (len >= 2 && data[0] == 0 && data[1] == EQ_OP_APP_COMBINED)
+		HandleProtocol(data,len);
+	else
+		Deliver(data,len);
+}
+
+void LoopbackServer::Deliver(const byte* data, uint32 len)
+{
+	//an opcode whose low byte is 0 goes out with a 0 ahead of it, so it isn't taken for a protocol one
+	if (len > 0 && data[0] == 0)
+	{
+		data++;
+		len--;
+	}
+	if (len < 2)
+		return;
+	mReceived++;
+	uint16 opcode = data[0] | (data[1] << 8);
+	SendReliable(AppPacket(opcode,data + 2,len - 2));
+}
+
+std::vector<byte> LoopbackServer::AppPacket(uint16 opcode, const byte* data, uint32 len)
+{
+	std::vector<byte> app;
+	if ((opcode & 0xff) == 0)
+		app.push_back(0);
+	app.push_back(opcode & 0xff);
+	app.push_back(opcode >> 8);
+	app.insert(app.end(),data,data + len);
+	return app;
+}
+
+void LoopbackServer::SendReliable(const std::vector<byte>& app)
+{
+	//opcode, sequence, compression flag and crc
+	uint32 room = ZEQ_LOOPBACK_MAX_LENGTH - 7;
+	if (app.size() <= room)
+	{
+		std::vector<byte> packet;
+		packet.push_back(0);
+		packet.push_back(EQ_OP_PACKET);
+		PushBE16(packet,mNextOutSeq);
+		packet.insert(packet.end(),app.begin(),app.end());
+		SendSequenced(packet);
+		return;
+	}
+	//the first fragment carries the whole length ahead of its share
+	uint32 pos = 0;
+	while (pos < app.size())
+	{
+		std::vector<byte> packet;
+		packet.push_back(0);
+		packet.push_back(EQ_OP_FRAGMENT);
+		PushBE16(packet,mNextOutSeq);
+		uint32 chunk = room;
+		if (pos == 0)
+		{
+			PushBE32(packet,app.size());
+			chunk -= 4;
+		}
+		chunk = std::min<uint32>(chunk,app.size() - pos);
+		packet.insert(packet.end(),app.begin() + pos,app.begin() + pos + chunk);
+		pos += chunk;
+		SendSequenced(packet);
+	}
+}
+
+void LoopbackServer::SendSequenced(std::vector<byte>& packet)
+{
+	Outgoing& out = mUnacked[mNextOutSeq++];
+	out.packet.swap(packet);
+	out.sentAt = mNow;
+	SendProtocol(out.packet);
+}
+
+void LoopbackServer::SendProtocol(const std::vector<byte>& packet)
+{
+	byte out[ZEQ_UDP_SLOT_SIZE];
+	uint32 len = packet.size();
+	out[0] = packet[0];
+	out[1] = packet[1];
+	//about half of what's worth compressing is sent compressed, so the client sees both
+	uint32 deflated = 0;
+	if (mRandom.Percent(50))
+		deflated = mDeflater.Deflate(&packet[2],len - 2,out + 3,len - 3);
+	if (deflated > 0)
+	{
+		out[2] = ZEQ_SESSION_FLAG_COMPRESSED;
+		len = 3 + deflated;
+	}
+	else
+	{
+		out[2] = ZEQ_SESSION_FLAG_UNCOMPRESSED;
+		memcpy(out + 3,&packet[2],len - 2);
+		len++;
+	}
+	uint16 crc = Crc32(mKeyCrc,out,len) & 0xffff;
+	out[len++] = crc >> 8;
+	out[len++] = crc & 0xff;
+	SendRaw(out,len,true);
+}
+
+void LoopbackServer::SendRaw(const byte* data, uint32 len, bool lossy)
+{
+	if (lossy)
+	{
+		if (mRandom.Percent(mLoss))
+		{
+			mDropped++;
+			return;
+		}
+		if (mRandom.Percent(ZEQ_LOOPBACK_REORDER))
+		{
+			mHeld.push_back(std::vector<byte>(data,data + len));
+			mHeldCount++;
+			return;
+		}
+	}
+	sendto(mSocket,(const char*)data,len,0,(const sockaddr*)&mPeer,sizeof(mPeer));
+	//whatever was held back tends to follow something newer
+	while (!mHeld.empty() && mRandom.Percent(50))
+	{
+		sendto(mSocket,(const char*)&mHeld.front()[0],mHeld.front().size(),0,(const sockaddr*)&mPeer,sizeof(mPeer));
+		mHeld.pop_front();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	uint32 seed = (argc > 1) ? strtoul(argv[1],nullptr,10) : 1;
+	uint32 loss = (argc > 2) ? strtoul(argv[2],nullptr,10) : 15;
+	uint32 count = (argc > 3) ? strtoul(argv[3],nullptr,10) : 300;
+	if (loss >= 100 || count == 0 || count > ZEQ_LOOPBACK_COUNT_MAX)
+	{
+		fprintf(stderr,"usage: %s [seed] [loss percent] [packets]\n",argv[0]);
+		return 1;
+	}
+
+	try
+	{
+#ifdef WIN32
+		Socket::InitializeSocketLib();
+#endif
+		LoopbackServer server(seed,loss);
+		char port[8];
+		snprintf(port,8,"%u",server.GetPort());
+		UDPSocket socket("127.0.0.1",port);
+		NetReactor reactor;
+		reactor.SetErrorHandler([](Socket*, const char* error) {
+			fprintf(stderr,"socket error: %s\n",error);
+		});
+		reactor.Add(&socket);
+
+		EQSession session(&socket);
+		session.SetLogHandler([](const char* message) {
+			printf("%s\n",message);
+		});
+		uint32 greetings = 0;
+		uint32 echoes = 0;
+		uint32 corrupt = 0;
+		uint32 misordered = 0;
+		session.SetHandler([&](uint16 opcode, const byte* data, uint32 len) {
+			if (opcode >= ZEQ_LOOPBACK_ECHO_OP && opcode < ZEQ_LOOPBACK_ECHO_OP + count)
+			{
+				uint32 i = opcode - ZEQ_LOOPBACK_ECHO_OP;
+				if (i != echoes)
+					misordered++;
+				bool whole = (len == EchoLength(i));
+				for (uint32 pos = 0; whole && pos < len; ++pos)
+					whole = (data[pos] == EchoByte(i,pos));
+				if (!whole)
+					corrupt++;
+				echoes++;
+			}
+			else if ((opcode >= ZEQ_LOOPBACK_GREETING_OP && opcode < ZEQ_LOOPBACK_GREETING_OP + ZEQ_LOOPBACK_GREETING_COUNT) ||
+				opcode == ZEQ_LOOPBACK_GREETING_LONG_OP)
+			{
+				greetings++;
+			}
+			else
+			{
+				corrupt++;
+			}
+		});
+
+		uint32 start = Now();
+		session.Connect(start);
+		uint32 sent = 0;
+		std::vector<byte> buf(ZEQ_LOOPBACK_PACKET_MAX);
+		while (Now() - start < ZEQ_LOOPBACK_TIMEOUT)
+		{
+			uint32 now = Now();
+			server.Receive(now);
+			server.Tick(now);
+			reactor.Poll(1);
+			session.Process(Now());
+			if (session.GetState() == EQSession::STATE_CLOSED)
+				break;
+			if (session.GetState() == EQSession::STATE_ESTABLISHED && sent < count &&
+				sent - echoes < ZEQ_LOOPBACK_OUTSTANDING)
+			{
+				uint32 len = EchoLength(sent);
+				for (uint32 pos = 0; pos < len; ++pos)
+					buf[pos] = EchoByte(sent,pos);
+				session.Send(ZEQ_LOOPBACK_ECHO_OP + sent,&buf[0],len);
+				sent++;
+			}
+			if (echoes == count && greetings == ZEQ_LOOPBACK_GREETING_COUNT + 1)
+				break;
+		}
+
+		bool ok = session.GetState() == EQSession::STATE_ESTABLISHED && echoes == count &&
+			greetings == ZEQ_LOOPBACK_GREETING_COUNT + 1 && corrupt == 0 && misordered == 0;
+		const EQSession::Stats& stats = session.GetStats();
+		printf("seed %u, loss %u%%: %s in %u ms\n",seed,loss,ok ? "ok" : "FAILED",Now() - start);
+		printf("echoes %u/%u, greetings %u/%u, corrupt %u, out of order %u\n",echoes,count,greetings,
+			ZEQ_LOOPBACK_GREETING_COUNT + 1,corrupt,misordered);
+		printf("client: sent %u, received %u, retransmits %u, duplicates %u, out of order %u, bad crc %u, rto %u\n",
+			stats.datagramsSent,stats.datagramsReceived,stats.retransmits,stats.duplicates,stats.outOfOrder,stats.badCrc,
+			session.GetRto());
+		printf("server: received %u, dropped %u, held back %u\n",server.GetReceived(),server.GetDropped(),server.GetHeld());
+		session.Disconnect();
+#ifdef WIN32
+		Socket::CloseSocketLib();
+#endif
+		return ok ? 0 : 1;
+	}
+	catch (ZEQException& e)
+	{
+		fprintf(stderr,"%s\n",e.what());
+		return 1;
+	}
+}
@@ -0,0 +1,79 @@
+
+#include "compression.h"
+
+boost::thread_specific_ptr<Inflater> Inflater::sLocal;
+
+Inflater::Inflater()
+{
+	//zeroed, zlib uses its own allocator
+	memset(&mStream,0,sizeof(mStream));
+
+	if (inflateInit(&mStream) != Z_OK)
+	{
+		throw ZEQException("ZLib inflation setup failed");
+	}
+}
+
+Inflater::~Inflater()
+{
+	inflateEnd(&mStream);
+}
+
+Inflater& Inflater::GetLocal()
+{
+	Inflater* inflater = sLocal.get();
+	if (!inflater)
+	{
+		inflater = new Inflater();
+		sLocal.reset(inflater);
+	}
+	return *inflater;
+}
+
+bool Inflater::Inflate(const byte* src, uint32 slen, byte* dst, uint32& dlen)
+{
+	if (inflateReset(&mStream) != Z_OK)
+		return false;
+
+	mStream.next_in = const_cast<byte*>(src);
+	mStream.avail_in = slen;
+	mStream.next_out = dst;
+	mStream.avail_out = dlen;
+
+	int ret = inflate(&mStream,Z_FINISH);
+	dlen -= mStream.avail_out;
+	return ret == Z_STREAM_END;
+}
+
+
+Deflater::Deflater(int level)
+{
+	//zeroed, zlib uses its own allocator
+	memset(&mStream,0,sizeof(mStream));
+
+	if (deflateInit(&mStream,level) != Z_OK)
+	{
+		throw ZEQException("ZLib deflation setup failed");
+	}
+}
+
+Deflater::~Deflater()
+{
+	deflateEnd(&mStream);
+}
+
+uint32 Deflater::Deflate(const byte* src, uint32 slen, byte* dst, uint32 dlen)
+{
+	if (slen < ZEQ_COMPRESS_MIN || deflateReset(&mStream) != Z_OK)
+		return 0;
+
+	mStream.next_in = const_cast<byte*>(src);
+	mStream.avail_in = slen;
+	mStream.next_out = dst;
+	mStream.avail_out = dlen;
+
+	//anything short of the whole stream means it ran out of room
+	if (deflate(&mStream,Z_FINISH) != Z_STREAM_END)
+		return 0;
+	return dlen - mStream.avail_out;
+}
@@ -0,0 +1,58 @@
+
+#ifndef ZEQ_COMPRESSION_H
+#define ZEQ_COMPRESSION_H
+
+#include <boost/thread.hpp>
+#include "type.h"
+#include "exception.h"
+#include "zlib.h"
+
+//payloads shorter than this are sent as they are; zlib's own header and checksum would eat most of what it saves
+#define ZEQ_COMPRESS_MIN 30
+//packets are deflated one at a time as they go out, where speed counts for more than the last few bytes
+#define ZEQ_COMPRESS_LEVEL Z_BEST_SPEED
+
+//Inflates whole zlib streams, one after another, through the same z_stream
+//Setting a stream up allocates its state and window; resetting it between streams keeps both, so after the
+//first one inflating costs only the inflating. Not thread safe; each thread or session keeps its own
+class Inflater
+{
+public:
+	Inflater();
+	~Inflater();
+	//Inflates the whole stream in src into dst, which holds dlen bytes; dlen is set to how many were written
+	//Returns false if the stream is corrupt or doesn't fit
+	bool	Inflate(const byte* src, uint32 slen, byte* dst, uint32& dlen);
+
+	//The calling thread's own, made the first time it asks
+	static Inflater& GetLocal();
+
+private:
+	//not copyable
+	Inflater(const Inflater&);
+	Inflater& operator=(const Inflater&);
+
+	z_stream mStream;
+
+	static boost::thread_specific_ptr<Inflater> sLocal;
+};
+
+//Deflates whole zlib streams through the same z_stream, reset between them just as Inflater does
+class Deflater
+{
+public:
+	Deflater(int level = ZEQ_COMPRESS_LEVEL);
+	~Deflater();
+	//Deflates src into dst, which holds dlen bytes, and returns how many were written
+	//Returns 0 if src is shorter than ZEQ_COMPRESS_MIN or doesn't deflate into dlen, and should go as it is
+	uint32	Deflate(const byte* src, uint32 slen, byte* dst, uint32 dlen);
+
+private:
+	//not copyable
+	Deflater(const Deflater&);
+	Deflater& operator=(const Deflater&);
+
+	z_stream mStream;
+};
+
+#endif
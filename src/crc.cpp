@@ -0,0 +1,203 @@
+
+#include "crc.h"
+
+#ifdef ZEQ_CRC_PCLMUL
+#include <emmintrin.h>
+#include <smmintrin.h>
+#include <wmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define ZEQ_CRC_TARGET
+#else
+#include <cpuid.h>
+//only the folding function is built for these; the rest of the program doesn't assume them
+#define ZEQ_CRC_TARGET __attribute__((target("pclmul,sse4.1")))
+#endif
+#endif
+
+typedef uint32 (*CrcFunc)(uint32 crc, const byte* data, size_t len);
+
+static uint32 sTables[8][256]; //sTables[n][b] is byte b followed by n zero bytes
+static uint32 sMsbTable[256];
+static CrcFunc sCrc32;
+
+//Works on the inverted value, as all the implementations here do
+static uint32 Crc32Slice8(uint32 crc, const byte* data, size_t len)
+{
+	while (len > 0 && ((size_t)data & 7) != 0)
+	{
+		crc = sTables[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+		len--;
+	}
+#ifndef ZEQ_ENDIAN_CHECK
+	//eight bytes at a time, each looked up in the table that carries it past the bytes after it
+	while (len >= 8)
+	{
+		uint32 one;
+		uint32 two;
+		memcpy(&one,data,4);
+		memcpy(&two,data + 4,4);
+		one ^= crc;
+		crc = sTables[7][one & 0xff] ^ sTables[6][(one >> 8) & 0xff] ^ sTables[5][(one >> 16) & 0xff] ^ sTables[4][one >> 24] ^
+			sTables[3][two & 0xff] ^ sTables[2][(two >> 8) & 0xff] ^ sTables[1][(two >> 16) & 0xff] ^ sTables[0][two >> 24];
+		data += 8;
+		len -= 8;
+	}
+#endif
+	while (len > 0)
+	{
+		crc = sTables[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+		len--;
+	}
+	return crc;
+}
+
+#ifdef ZEQ_CRC_PCLMUL
+//Folds len bytes, a multiple of 16 and at least 64, four lanes of 128 bits at a time and Barrett reduces what is left,
+//after Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction"
+ZEQ_CRC_TARGET
+static uint32 Crc32Fold(uint32 crc, const byte* data, size_t len)
+{
+	//x^(n) mod P for the fold distances, bit reflected, then P and its Barrett constant
+	const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL,0x0154442bd4LL);
+	const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL,0x01751997d0LL);
+	const __m128i k5k0 = _mm_set_epi64x(0,0x0163cd6124LL);
+	const __m128i poly = _mm_set_epi64x(0x01f7011641LL,0x01db710641LL);
+	const __m128i low32 = _mm_setr_epi32(~0,0,~0,0);
+
+	__m128i x1 = _mm_loadu_si128((const __m128i*)(data + 0x00));
+	__m128i x2 = _mm_loadu_si128((const __m128i*)(data + 0x10));
+	__m128i x3 = _mm_loadu_si128((const __m128i*)(data + 0x20));
+	__m128i x4 = _mm_loadu_si128((const __m128i*)(data + 0x30));
+	x1 = _mm_xor_si128(x1,_mm_cvtsi32_si128(crc));
+	data += 64;
+	len -= 64;
+
+	while (len >= 64)
+	{
+		__m128i x5 = _mm_clmulepi64_si128(x1,k1k2,0x00);
+		__m128i x6 = _mm_clmulepi64_si128(x2,k1k2,0x00);
+		__m128i x7 = _mm_clmulepi64_si128(x3,k1k2,0x00);
+		__m128i x8 = _mm_clmulepi64_si128(x4,k1k2,0x00);
+		x1 = _mm_clmulepi64_si128(x1,k1k2,0x11);
+		x2 = _mm_clmulepi64_si128(x2,k1k2,0x11);
+		x3 = _mm_clmulepi64_si128(x3,k1k2,0x11);
+		x4 = _mm_clmulepi64_si128(x4,k1k2,0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1,x5),_mm_loadu_si128((const __m128i*)(data + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2,x6),_mm_loadu_si128((const __m128i*)(data + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3,x7),_mm_loadu_si128((const __m128i*)(data + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4,x8),_mm_loadu_si128((const __m128i*)(data + 0x30)));
+		data += 64;
+		len -= 64;
+	}
+
+	//four lanes into one
+	__m128i x5 = _mm_clmulepi64_si128(x1,k3k4,0x00);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1,k3k4,0x11),x2),x5);
+	x5 = _mm_clmulepi64_si128(x1,k3k4,0x00);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1,k3k4,0x11),x3),x5);
+	x5 = _mm_clmulepi64_si128(x1,k3k4,0x00);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1,k3k4,0x11),x4),x5);
+
+	while (len >= 16)
+	{
+		x5 = _mm_clmulepi64_si128(x1,k3k4,0x00);
+		x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1,k3k4,0x11),_mm_loadu_si128((const __m128i*)data)),x5);
+		data += 16;
+		len -= 16;
+	}
+
+	//128 bits down to 64
+	x2 = _mm_clmulepi64_si128(x1,k3k4,0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1,8),x2);
+	x2 = _mm_srli_si128(x1,4);
+	x1 = _mm_and_si128(x1,low32);
+	x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1,k5k0,0x00),x2);
+
+	//and 64 to 32
+	x2 = _mm_and_si128(x1,low32);
+	x2 = _mm_clmulepi64_si128(x2,poly,0x10);
+	x2 = _mm_and_si128(x2,low32);
+	x2 = _mm_clmulepi64_si128(x2,poly,0x00);
+	x1 = _mm_xor_si128(x1,x2);
+	return _mm_extract_epi32(x1,1);
+}
+
+static uint32 Crc32Pclmul(uint32 crc, const byte* data, size_t len)
+{
+	if (len >= ZEQ_CRC_PCLMUL_MIN)
+	{
+		size_t folded = len & ~(size_t)15;
+		crc = Crc32Fold(crc,data,folded);
+		data += folded;
+		len -= folded;
+	}
+	return Crc32Slice8(crc,data,len);
+}
+
+static bool HasPclmul()
+{
+	//PCLMULQDQ is ECX bit 1 of leaf 1, and SSE4.1, for the final extract, bit 19
+	uint32 ecx;
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info,1);
+	ecx = info[2];
+#else
+	uint32 eax, ebx, edx;
+	if (!__get_cpuid(1,&eax,&ebx,&ecx,&edx))
+		return false;
+#endif
+	return (ecx & (1 << 1)) && (ecx & (1 << 19));
+}
+#endif //ZEQ_CRC_PCLMUL
+
+//Fills the tables and picks an implementation before main, so nothing needs a lock to use them
+//Nothing else computes a CRC while the program is still starting up, which is the one thing this relies on
+static struct CrcInit
+{
+	CrcInit()
+	{
+		for (uint32 i = 0; i < 256; ++i)
+		{
+			uint32 c = i;
+			uint32 m = i << 24;
+			for (uint32 k = 0; k < 8; ++k)
+			{
+				c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+				m = (m & 0x80000000) ? 0x04c11db7 ^ (m << 1) : m << 1;
+			}
+			sTables[0][i] = c;
+			sMsbTable[i] = m;
+		}
+		for (uint32 i = 0; i < 256; ++i)
+		{
+			for (uint32 n = 1; n < 8; ++n)
+			{
+				uint32 c = sTables[n - 1][i];
+				sTables[n][i] = sTables[0][c & 0xff] ^ (c >> 8);
+			}
+		}
+
+		sCrc32 = Crc32Slice8;
+#ifdef ZEQ_CRC_PCLMUL
+		if (HasPclmul())
+			sCrc32 = Crc32Pclmul;
+#endif
+	}
+} sInit;
+
+uint32 Crc32(uint32 crc, const byte* data, size_t len)
+{
+	return ~sCrc32(~crc,data,len);
+}
+
+uint32 Crc32Msb(uint32 crc, const byte* data, size_t len)
+{
+	while (len > 0)
+	{
+		crc = sMsbTable[((crc >> 24) ^ *data++) & 0xff] ^ (crc << 8);
+		len--;
+	}
+	return crc;
+}
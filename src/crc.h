@@ -0,0 +1,24 @@
+
+#ifndef ZEQ_CRC_H
+#define ZEQ_CRC_H
+
+#include <string.h>
+#include "type.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define ZEQ_CRC_PCLMUL
+#endif
+
+//data shorter than this is left to the tables; folding only starts on a whole 64 byte block
+#define ZEQ_CRC_PCLMUL_MIN 64
+
+//CRC-32 with the polynomial and conventions zlib's crc32 uses, so the two give the same results and start the
+//same way, from 0. Runs of 64 bytes or more are folded with carry-less multiplies on CPUs that have them,
+//picked once at startup; everything else goes through slice-by-8 tables
+uint32	Crc32(uint32 crc, const byte* data, size_t len);
+
+//The same polynomial fed most significant bit first, with no inversion before or after
+//PFS archives key their directory entries with this over each file name, terminator included
+uint32	Crc32Msb(uint32 crc, const byte* data, size_t len);
+
+#endif
@@ -0,0 +1,809 @@
+
+#include "eq_session.h"
+
+//the protocol's own fields are all big-endian
+static inline uint16 ReadBE16(const byte* p)
+{
+	return (uint16)((p[0] << 8) | p[1]);
+}
+
+static inline uint32 ReadBE32(const byte* p)
+{
+	return ((uint32)p[0] << 24) | ((uint32)p[1] << 16) | ((uint32)p[2] << 8) | p[3];
+}
+
+static inline void WriteBE16(byte* p, uint16 v)
+{
+	p[0] = v >> 8;
+	p[1] = v & 0xff;
+}
+
+static inline void WriteBE32(byte* p, uint32 v)
+{
+	p[0] = v >> 24;
+	p[1] = (v >> 16) & 0xff;
+	p[2] = (v >> 8) & 0xff;
+	p[3] = v & 0xff;
+}
+
+#define ZEQ_SESSION_WINDOW_MASK (ZEQ_SESSION_WINDOW - 1)
+#define ZEQ_SESSION_DUE_MASK (ZEQ_SESSION_WINDOW * 2 - 1)
+
+EQSession::EQSession(UDPSocket* socket) :
+mOut(ZEQ_UDP_BATCH,ZEQ_SESSION_MAX_LENGTH)
+{
+	mSocket = socket;
+	mState = STATE_CLOSED;
+	mNow = 0;
+	mMaxLength = ZEQ_SESSION_MAX_LENGTH;
+	mFormat = 0;
+	mCrcBytes = 0;
+
+	mSend.resize(ZEQ_SESSION_WINDOW);
+	mRecv.resize(ZEQ_SESSION_WINDOW);
+	mSendBuffers = new byte[ZEQ_SESSION_WINDOW * ZEQ_SESSION_MAX_LENGTH];
+	mRecvBuffers = new byte[ZEQ_SESSION_WINDOW * ZEQ_SESSION_MAX_LENGTH];
+	for (uint32 i = 0; i < ZEQ_SESSION_WINDOW; ++i)
+	{
+		mSend[i].data = mSendBuffers + i * ZEQ_SESSION_MAX_LENGTH;
+		mRecv[i].data = mRecvBuffers + i * ZEQ_SESSION_MAX_LENGTH;
+	}
+	//twice the window, since acked entries stay in it until a flush passes them
+	mDue.resize(ZEQ_SESSION_WINDOW * 2);
+	memset(&mStats,0,sizeof(mStats));
+}
+
+EQSession::~EQSession()
+{
+	delete[] mSendBuffers;
+	delete[] mRecvBuffers;
+}
+
+void EQSession::Connect(uint32 now)
+{
+	mNow = now;
+	mSessionId = ((uint32)rand() << 16) ^ (uint32)rand() ^ now;
+	mKey = 0;
+	mKeyCrc = 0;
+	mMaxLength = ZEQ_SESSION_MAX_LENGTH;
+	mFormat = 0;
+	mCrcBytes = 0;
+	mConnectAttempts = 0;
+	mLastRecv = now;
+	mLastSend = now;
+
+	mNextOutSeq = 0;
+	mOldestUnacked = 0;
+	mNextUnsent = 0;
+	mDueHead = 0;
+	mDueCount = 0;
+	mNextInSeq = 0;
+	mAckDue = false;
+	mOutOfOrderCount = 0;
+	mFragmentTotal = 0;
+	for (uint32 i = 0; i < ZEQ_SESSION_WINDOW; ++i)
+	{
+		SendSlot& slot = mSend[i];
+		slot.inUse = false;
+		slot.due = false;
+		slot.acked = false;
+		slot.wheelSlot = -1;
+		mRecv[i].filled = false;
+	}
+	for (uint32 i = 0; i < ZEQ_SESSION_WHEEL_SLOTS; ++i)
+	{
+		mWheel[i] = -1;
+	}
+	mWheelTick = now / ZEQ_SESSION_WHEEL_TICK;
+	mRto = ZEQ_SESSION_RTO_INITIAL;
+	mSrtt = 0;
+	mRttVar = 0;
+	mCombineLen = 0;
+	mCombineCount = 0;
+
+	mState = STATE_CONNECTING;
+	SendSessionRequest();
+}
+
+void EQSession::SendSessionRequest()
+{
+	byte request[14];
+	request[0] = 0;
+	request[1] = EQ_OP_SESSION_REQUEST;
+	WriteBE32(&request[2],2); //protocol version
+	WriteBE32(&request[6],mSessionId);
+	WriteBE32(&request[10],ZEQ_SESSION_MAX_LENGTH);
+	SendUnsequenced(request,sizeof(request));
+	mConnectAttempts++;
+}
+
+void EQSession::Disconnect()
+{
+	if (mState != STATE_ESTABLISHED)
+		return;
+	Flush();
+	byte disconnect[6];
+	disconnect[0] = 0;
+	disconnect[1] = EQ_OP_SESSION_DISCONNECT;
+	WriteBE32(&disconnect[2],mSessionId);
+	SendUnsequenced(disconnect,sizeof(disconnect));
+	Close("disconnected");
+}
+
+void EQSession::Close(const char* reason)
+{
+	mState = STATE_CLOSED;
+	char log[128];
+	snprintf(log,128,"SESSION: %08x closed: %s",mSessionId,reason);
+	Log(log);
+}
+
+void EQSession::Log(const char* message)
+{
+	if (mLogHandler)
+		mLogHandler(message);
+	else
+		Ogre::LogManager::getSingleton().logMessage(message);
+}
+
+uint32 EQSession::GetCapacity() const
+{
+	return mMaxLength - mCrcBytes - ((mFormat & ZEQ_SESSION_FORMAT_COMPRESSED) ? 1 : 0);
+}
+
+uint16 EQSession::CalcCrc(const byte* data, uint32 len) const
+{
+	//CRC32 of the key, low byte first, then the packet; only the low 16 bits are sent
+	return Crc32(mKeyCrc,data,len) & 0xffff;
+}
+
+void EQSession::Send(uint16 opcode, const byte* data, uint32 len)
+{
+	if (mState != STATE_ESTABLISHED)
+	{
+		throw ZEQException("Session is not established");
+	}
+
+	//app packets lead with their opcode, low byte first; one whose low byte is 0 gets another 0 in front of it
+	//so it can't be taken for a protocol packet
+	byte prefix[3];
+	uint32 prefixLen = 0;
+	if ((opcode & 0xff) == 0)
+		prefix[prefixLen++] = 0;
+	prefix[prefixLen++] = opcode & 0xff;
+	prefix[prefixLen++] = opcode >> 8;
+	uint32 total = prefixLen + len;
+
+	//protocol opcode and sequence number take the first four bytes of each
+	uint32 room = GetCapacity() - 4;
+	uint16 seq;
+	if (total <= room)
+	{
+		SendSlot& slot = QueueSequenced(EQ_OP_PACKET,seq);
+		memcpy(slot.data + 4,prefix,prefixLen);
+		memcpy(slot.data + 4 + prefixLen,data,len);
+		slot.len = 4 + total;
+		return;
+	}
+
+	//too big for one datagram, so it goes as a chain of fragments, the first of which also carries the total length
+	uint32 fragments = 1 + (total - (room - 4) + room - 1) / room;
+	uint32 window = ZEQ_SESSION_WINDOW - (uint16)(mNextOutSeq - mOldestUnacked);
+	if (fragments > window)
+	{
+		throw ZEQException("Session send window is full");
+	}
+	uint32 done = 0;
+	while (done < total)
+	{
+		SendSlot& slot = QueueSequenced(EQ_OP_FRAGMENT,seq);
+		uint32 pos = 4;
+		if (done == 0)
+		{
+			WriteBE32(slot.data + 4,total);
+			pos = 8;
+		}
+		uint32 chunk = std::min(total - done,GetCapacity() - pos);
+		for (uint32 i = 0; i < chunk; ++i)
+		{
+			uint32 from = done + i;
+			slot.data[pos + i] = (from < prefixLen) ? prefix[from] : data[from - prefixLen];
+		}
+		slot.len = pos + chunk;
+		done += chunk;
+	}
+}
+
+EQSession::SendSlot& EQSession::QueueSequenced(uint8 op, uint16& seq)
+{
+	if ((uint16)(mNextOutSeq - mOldestUnacked) >= ZEQ_SESSION_WINDOW)
+	{
+		throw ZEQException("Session send window is full");
+	}
+	seq = mNextOutSeq++;
+	SendSlot& slot = mSend[seq & ZEQ_SESSION_WINDOW_MASK];
+	slot.seq = seq;
+	slot.inUse = true;
+	slot.due = false;
+	slot.acked = false;
+	slot.retries = 0;
+	slot.data[0] = 0;
+	slot.data[1] = op;
+	WriteBE16(slot.data + 2,seq);
+	return slot;
+}
+
+void EQSession::MarkDue(uint16 seq)
+{
+	SendSlot& slot = mSend[seq & ZEQ_SESSION_WINDOW_MASK];
+	if (slot.due || mDueCount == mDue.size())
+		return;
+	slot.due = true;
+	mDue[(mDueHead + mDueCount) & ZEQ_SESSION_DUE_MASK] = seq;
+	mDueCount++;
+}
+
+void EQSession::Schedule(uint32 index, uint32 at)
+{
+	uint32 tick = at / ZEQ_SESSION_WHEEL_TICK;
+	if ((int32)(tick - mWheelTick) <= 0)
+		tick = mWheelTick + 1;
+	if (tick - mWheelTick >= ZEQ_SESSION_WHEEL_SLOTS)
+		tick = mWheelTick + ZEQ_SESSION_WHEEL_SLOTS - 1;
+
+	int32 wheelSlot = tick % ZEQ_SESSION_WHEEL_SLOTS;
+	SendSlot& slot = mSend[index];
+	slot.wheelSlot = wheelSlot;
+	slot.wheelPrev = -1;
+	slot.wheelNext = mWheel[wheelSlot];
+	if (slot.wheelNext != -1)
+		mSend[slot.wheelNext].wheelPrev = index;
+	mWheel[wheelSlot] = index;
+}
+
+void EQSession::Unschedule(uint32 index)
+{
+	SendSlot& slot = mSend[index];
+	if (slot.wheelSlot == -1)
+		return;
+	if (slot.wheelPrev != -1)
+		mSend[slot.wheelPrev].wheelNext = slot.wheelNext;
+	else
+		mWheel[slot.wheelSlot] = slot.wheelNext;
+	if (slot.wheelNext != -1)
+		mSend[slot.wheelNext].wheelPrev = slot.wheelPrev;
+	slot.wheelSlot = -1;
+}
+
+void EQSession::AdvanceWheel(uint32 now)
+{
+	uint32 target = now / ZEQ_SESSION_WHEEL_TICK;
+	if ((int32)(target - mWheelTick) <= 0)
+		return;
+	//after a long stall everything on the wheel is overdue, and one lap finds all of it
+	uint32 steps = std::min<uint32>(target - mWheelTick,ZEQ_SESSION_WHEEL_SLOTS);
+	for (uint32 i = 1; i <= steps; ++i)
+	{
+		uint32 wheelSlot = (mWheelTick + i) % ZEQ_SESSION_WHEEL_SLOTS;
+		int32 index = mWheel[wheelSlot];
+		mWheel[wheelSlot] = -1;
+		while (index != -1)
+		{
+			SendSlot& slot = mSend[index];
+			index = slot.wheelNext;
+			slot.wheelSlot = -1;
+			if (++slot.retries > ZEQ_SESSION_MAX_RETRIES)
+			{
+				Close("too many retransmits");
+				return;
+			}
+			MarkDue(slot.seq);
+		}
+	}
+	mWheelTick = target;
+}
+
+void EQSession::Process(uint32 now)
+{
+	mNow = now;
+	uint32 len;
+	const byte* data;
+	while ((data = mSocket->PeekDatagram(len)) != nullptr)
+	{
+		if (mState != STATE_CLOSED)
+			ProcessDatagram(data,len);
+		mSocket->PopDatagram();
+	}
+
+	if (mState == STATE_CONNECTING && (int32)(now - mLastSend) >= ZEQ_SESSION_CONNECT_RETRY)
+	{
+		if (mConnectAttempts >= ZEQ_SESSION_CONNECT_ATTEMPTS)
+			Close("no response to session request");
+		else
+			SendSessionRequest();
+	}
+	if (mState == STATE_ESTABLISHED)
+	{
+		AdvanceWheel(now);
+		if ((int32)(now - mLastRecv) > ZEQ_SESSION_TIMEOUT)
+			Close("timed out");
+	}
+	if (mState == STATE_ESTABLISHED && (int32)(now - mLastSend) >= ZEQ_SESSION_KEEPALIVE)
+	{
+		byte keepAlive[2] = { 0, EQ_OP_KEEP_ALIVE };
+		Append(keepAlive,sizeof(keepAlive));
+	}
+	Flush();
+}
+
+void EQSession::Flush()
+{
+	if (mState != STATE_ESTABLISHED)
+		return;
+
+	//acks go first, so a datagram full of new packets doesn't hold them up
+	if (mAckDue)
+	{
+		byte ack[4];
+		ack[0] = 0;
+		ack[1] = EQ_OP_ACK;
+		WriteBE16(&ack[2],mNextInSeq - 1);
+		Append(ack,sizeof(ack));
+		mAckDue = false;
+	}
+	for (uint32 i = 0; i < mOutOfOrderCount; ++i)
+	{
+		byte ack[4];
+		ack[0] = 0;
+		ack[1] = EQ_OP_OUT_OF_ORDER_ACK;
+		WriteBE16(&ack[2],mOutOfOrderAcks[i]);
+		Append(ack,sizeof(ack));
+	}
+	mOutOfOrderCount = 0;
+
+	while (mDueCount > 0)
+	{
+		uint16 seq = mDue[mDueHead];
+		mDueHead = (mDueHead + 1) & ZEQ_SESSION_DUE_MASK;
+		mDueCount--;
+		uint32 index = seq & ZEQ_SESSION_WINDOW_MASK;
+		SendSlot& slot = mSend[index];
+		if (!slot.inUse || !slot.due || slot.seq != seq)
+			continue;
+		slot.due = false;
+		Append(slot.data,slot.len);
+		mStats.retransmits++;
+		slot.sentAt = mNow;
+		Unschedule(index);
+		//retries never passes ZEQ_SESSION_MAX_RETRIES, but the shift is kept in range regardless
+		uint32 backoff = mRto << std::min<uint32>(slot.retries,ZEQ_SESSION_MAX_RETRIES);
+		Schedule(index,mNow + std::min<uint32>(backoff,ZEQ_SESSION_RTO_MAX));
+	}
+
+	while (mNextUnsent != mNextOutSeq && (uint16)(mNextUnsent - mOldestUnacked) < ZEQ_SESSION_IN_FLIGHT)
+	{
+		uint32 index = mNextUnsent & ZEQ_SESSION_WINDOW_MASK;
+		SendSlot& slot = mSend[index];
+		Append(slot.data,slot.len);
+		slot.sentAt = mNow;
+		Schedule(index,mNow + mRto);
+		mNextUnsent++;
+	}
+
+	EndDatagram();
+	SendDatagrams();
+}
+
+void EQSession::Append(const byte* packet, uint32 len)
+{
+	uint32 capacity = GetCapacity();
+	bool combinable = len <= 0xff && 3 + len <= capacity;
+	if (mCombineCount > 0 && (!combinable || mCombineLen + 1 + len > capacity))
+		EndDatagram();
+	if (!combinable)
+	{
+		WriteDatagram(packet,len);
+		return;
+	}
+
+	if (mCombineCount == 0)
+	{
+		mCombine[0] = 0;
+		mCombine[1] = EQ_OP_COMBINED;
+		mCombineLen = 2;
+	}
+	mCombine[mCombineLen++] = len;
+	memcpy(&mCombine[mCombineLen],packet,len);
+	mCombineLen += len;
+	mCombineCount++;
+}
+
+void EQSession::EndDatagram()
+{
+	if (mCombineCount == 1)
+		WriteDatagram(&mCombine[3],mCombineLen - 3);
+	else if (mCombineCount > 1)
+		WriteDatagram(mCombine,mCombineLen);
+	mCombineCount = 0;
+}
+
+void EQSession::WriteDatagram(const byte* packet, uint32 len)
+{
+	if (mOut.GetFree() == 0)
+		SendDatagrams();
+
+	uint32 index = mOut.GetCount();
+	byte* out = mOut.GetSlot(index);
+	uint32 pos;
+	if (mFormat & ZEQ_SESSION_FORMAT_COMPRESSED)
+	{
+		out[0] = packet[0];
+		out[1] = packet[1];
+		//only worth it if it comes out smaller, which also keeps it within the datagram
+		uint32 deflated = mDeflater.Deflate(packet + 2,len - 2,out + 3,len - 3);
+		if (deflated > 0)
+		{
+			out[2] = ZEQ_SESSION_FLAG_COMPRESSED;
+			pos = 3 + deflated;
+		}
+		else
+		{
+			out[2] = ZEQ_SESSION_FLAG_UNCOMPRESSED;
+			memcpy(out + 3,packet + 2,len - 2);
+			pos = len + 1;
+		}
+	}
+	else
+	{
+		memcpy(out,packet,len);
+		pos = len;
+	}
+	if (mCrcBytes)
+	{
+		WriteBE16(out + pos,CalcCrc(out,pos));
+		pos += 2;
+	}
+	mOut.SetLen(index,pos);
+	mOut.Commit(1);
+	mLastSend = mNow;
+}
+
+void EQSession::SendDatagrams()
+{
+	uint32 count = mOut.GetCount();
+	if (count == 0)
+		return;
+	const byte* data[ZEQ_UDP_BATCH];
+	uint32 lens[ZEQ_UDP_BATCH];
+	for (uint32 i = 0; i < count; ++i)
+	{
+		data[i] = mOut.GetSlot(i);
+		lens[i] = mOut.GetLen(i);
+	}
+	mSocket->SendBatch(data,lens,count);
+	mOut.Pop(count);
+	mStats.datagramsSent += count;
+}
+
+void EQSession::SendUnsequenced(const byte* packet, uint32 len)
+{
+	EndDatagram();
+	WriteDatagram(packet,len);
+	SendDatagrams();
+}
+
+void EQSession::ProcessDatagram(const byte* data, uint32 len)
+{
+	mStats.datagramsReceived++;
+	if (len < 2)
+		return;
+	//these come before the key is known, so they never have a CRC
+	if (data[0] == 0 && (data[1] == EQ_OP_SESSION_REQUEST || data[1] == EQ_OP_SESSION_RESPONSE))
+	{
+		ProcessProtocol(data,len);
+		return;
+	}
+	if (mState != STATE_ESTABLISHED)
+		return;
+
+	if (mCrcBytes)
+	{
+		if (len < 2u + mCrcBytes)
+			return;
+		len -= mCrcBytes;
+		if (ReadBE16(data + len) != CalcCrc(data,len))
+		{
+			mStats.badCrc++;
+			return;
+		}
+	}
+	mLastRecv = mNow;
+
+	if (mFormat & ZEQ_SESSION_FORMAT_COMPRESSED)
+	{
+		uint32 flagPos = (data[0] == 0) ? 2 : 1;
+		if (len <= flagPos)
+			return;
+		if (data[flagPos] == ZEQ_SESSION_FLAG_COMPRESSED)
+		{
+			memcpy(mInflate,data,flagPos);
+			uint32 inflated = ZEQ_SESSION_INFLATE_MAX - flagPos;
+			if (!mInflater.Inflate(data + flagPos + 1,len - flagPos - 1,mInflate + flagPos,inflated))
+				return;
+			data = mInflate;
+			len = flagPos + inflated;
+		}
+		else if (data[flagPos] == ZEQ_SESSION_FLAG_UNCOMPRESSED)
+		{
+			memcpy(mInflate,data,flagPos);
+			memcpy(mInflate + flagPos,data + flagPos + 1,len - flagPos - 1);
+			data = mInflate;
+			len--;
+		}
+	}
+	ProcessProtocol(data,len);
+}
+
+void EQSession::ProcessProtocol(const byte* data, uint32 len)
+{
+	if (len < 2)
+		return;
+	//bare app packets go unsequenced
+	if (data[0] != 0)
+	{
+		DeliverApp(data,len);
+		return;
+	}
+
+	uint32 pos = 2;
+	switch (data[1])
+	{
+	case EQ_OP_SESSION_RESPONSE:
+		HandleSessionResponse(data,len);
+		break;
+	case EQ_OP_COMBINED:
+		//each one a length byte and a protocol packet
+		while (pos < len)
+		{
+			uint32 sub = data[pos++];
+			if (pos + sub > len)
+				break;
+			ProcessProtocol(data + pos,sub);
+			pos += sub;
+		}
+		break;
+	case EQ_OP_APP_COMBINED:
+		//each one an app packet, with a length byte or, for longer ones, 0xff and a 16 bit length
+		while (pos < len)
+		{
+			uint32 sub = data[pos++];
+			if (sub == 0xff)
+			{
+				if (pos + 2 > len)
+					break;
+				sub = ReadBE16(data + pos);
+				pos += 2;
+			}
+			if (pos + sub > len)
+				break;
+			DeliverApp(data + pos,sub);
+			pos += sub;
+		}
+		break;
+	case EQ_OP_SESSION_DISCONNECT:
+		Close("disconnected by server");
+		break;
+	case EQ_OP_PACKET:
+	case EQ_OP_FRAGMENT:
+		if (len >= 4)
+			ProcessSequenced(ReadBE16(data + 2),data,len);
+		break;
+	case EQ_OP_OUT_OF_ORDER_ACK:
+		if (len >= 4)
+			HandleOutOfOrderAck(ReadBE16(data + 2));
+		break;
+	case EQ_OP_ACK:
+		if (len >= 4)
+			HandleAck(ReadBE16(data + 2));
+		break;
+	default:
+		break;
+	}
+}
+
+void EQSession::HandleSessionResponse(const byte* data, uint32 len)
+{
+	//session, key, CRC bytes, format, unknown, max length, unknown
+	if (mState != STATE_CONNECTING || len < 21 || ReadBE32(data + 2) != mSessionId)
+		return;
+	mKey = ReadBE32(data + 6);
+	//the key part never changes, so it is worked out once and every datagram carries on from it
+	byte key[4];
+	key[0] = mKey & 0xff;
+	key[1] = (mKey >> 8) & 0xff;
+	key[2] = (mKey >> 16) & 0xff;
+	key[3] = mKey >> 24;
+	mKeyCrc = Crc32(0,key,4);
+	mCrcBytes = data[10] ? 2 : 0;
+	mFormat = data[11];
+	uint32 maxLength = ReadBE32(data + 13);
+	if (maxLength < ZEQ_SESSION_MIN_LENGTH)
+	{
+		Close("bad max length");
+		return;
+	}
+	mMaxLength = std::min<uint32>(maxLength,ZEQ_SESSION_MAX_LENGTH);
+	if (mFormat & ZEQ_SESSION_FORMAT_ENCODED)
+	{
+		Close("encoded sessions are not supported");
+		return;
+	}
+	mLastRecv = mNow;
+	mState = STATE_ESTABLISHED;
+
+	char log[128];
+	snprintf(log,128,"SESSION: %08x established, max length %u, format %u",mSessionId,mMaxLength,mFormat);
+	Log(log);
+}
+
+void EQSession::ProcessSequenced(uint16 seq, const byte* data, uint32 len)
+{
+	int16 ahead = (int16)(seq - mNextInSeq);
+	if (ahead == 0)
+	{
+		ProcessInOrder(data,len);
+		mNextInSeq++;
+		//anything held waiting for this one can go now too
+		for (;;)
+		{
+			RecvSlot& slot = mRecv[mNextInSeq & ZEQ_SESSION_WINDOW_MASK];
+			if (!slot.filled)
+				break;
+			slot.filled = false;
+			ProcessInOrder(slot.data,slot.len);
+			mNextInSeq++;
+		}
+		mAckDue = true;
+	}
+	else if (ahead > 0)
+	{
+		//too far ahead, or inflated past what a slot holds; the server sends it again either way
+		if (ahead >= ZEQ_SESSION_WINDOW || len > ZEQ_SESSION_MAX_LENGTH)
+			return;
+		RecvSlot& slot = mRecv[seq & ZEQ_SESSION_WINDOW_MASK];
+		if (!slot.filled)
+		{
+			memcpy(slot.data,data,len);
+			slot.len = len;
+			slot.filled = true;
+			mStats.outOfOrder++;
+		}
+		if (mOutOfOrderCount < ZEQ_SESSION_MAX_OOA)
+			mOutOfOrderAcks[mOutOfOrderCount++] = seq;
+	}
+	else
+	{
+		//already had it, so the ack was lost; send it again
+		mStats.duplicates++;
+		mAckDue = true;
+	}
+}
+
+void EQSession::ProcessInOrder(const byte* data, uint32 len)
+{
+	if (data[1] == EQ_OP_PACKET)
+	{
+		ProcessPayload(data + 4,len - 4);
+		return;
+	}
+
+	const byte* payload = data + 4;
+	uint32 size = len - 4;
+	if (mFragmentTotal == 0)
+	{
+		if (size < 4)
+			return;
+		mFragmentTotal = ReadBE32(payload);
+		payload += 4;
+		size -= 4;
+		mReassembly.clear();
+		if (mFragmentTotal == 0)
+			return;
+	}
+	mReassembly.insert(mReassembly.end(),payload,payload + size);
+	if (mReassembly.size() >= mFragmentTotal)
+	{
+		mFragmentTotal = 0;
+		ProcessPayload(&mReassembly[0],mReassembly.size());
+	}
+}
+
+void EQSession::ProcessPayload(const byte* data, uint32 len)
+{
+	if (len >= 2 && data[0] == 0 && data[1] == EQ_OP_APP_COMBINED)
+		ProcessProtocol(data,len);
+	else
+		DeliverApp(data,len);
+}
+
+void EQSession::DeliverApp(const byte* data, uint32 len)
+{
+	if (len > 0 && data[0] == 0)
+	{
+		data++;
+		len--;
+	}
+	if (len < 2)
+		return;
+	uint16 opcode = data[0] | (data[1] << 8);
+	if (mHandler)
+		mHandler(opcode,data + 2,len - 2);
+}
+
+void EQSession::HandleAck(uint16 seq)
+{
+	//everything up to and including seq has arrived
+	if ((int16)(seq - mOldestUnacked) < 0 || (int16)(seq - mNextUnsent) >= 0)
+		return;
+	int32 sample = -1;
+	while ((int16)(seq - mOldestUnacked) >= 0)
+	{
+		uint32 index = mOldestUnacked & ZEQ_SESSION_WINDOW_MASK;
+		SendSlot& slot = mSend[index];
+		//a packet sent more than once can't say which of them was acked
+		if (slot.retries == 0 && !slot.due && !slot.acked)
+			sample = mNow - slot.sentAt;
+		Unschedule(index);
+		slot.inUse = false;
+		slot.due = false;
+		slot.acked = false;
+		mOldestUnacked++;
+	}
+
+	if (sample >= 0)
+	{
+		if (mSrtt == 0)
+		{
+			mSrtt = std::max(sample,1);
+			mRttVar = sample / 2;
+		}
+		else
+		{
+			mRttVar = (3 * mRttVar + abs(mSrtt - sample)) / 4;
+			mSrtt = (7 * mSrtt + sample) / 8;
+		}
+		int32 rto = mSrtt + std::max(4 * mRttVar,ZEQ_SESSION_WHEEL_TICK);
+		mRto = std::min(std::max(rto,ZEQ_SESSION_RTO_MIN),ZEQ_SESSION_RTO_MAX);
+	}
+}
+
+void EQSession::HandleOutOfOrderAck(uint16 seq)
+{
+	if ((int16)(seq - mOldestUnacked) < 0 || (int16)(seq - mNextUnsent) >= 0)
+		return;
+	//the server has seq itself, so it stays in the window for the cumulative ack but is never resent
+	uint32 seqIndex = seq & ZEQ_SESSION_WINDOW_MASK;
+	SendSlot& acked = mSend[seqIndex];
+	if (acked.inUse && acked.seq == seq)
+	{
+		Unschedule(seqIndex);
+		acked.due = false;
+		acked.acked = true;
+	}
+	//but not everything before it; resend those now, unless they've only just gone
+	uint32 recent = mSrtt ? mSrtt : mRto;
+	for (uint16 s = mOldestUnacked; s != seq; s++)
+	{
+		uint32 index = s & ZEQ_SESSION_WINDOW_MASK;
+		SendSlot& slot = mSend[index];
+		if (!slot.inUse || slot.due || slot.acked || mNow - slot.sentAt < recent)
+			continue;
+		Unschedule(index);
+		if (++slot.retries > ZEQ_SESSION_MAX_RETRIES)
+		{
+			Close("too many retransmits");
+			return;
+		}
+		MarkDue(s);
+	}
+}
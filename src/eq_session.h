@@ -0,0 +1,226 @@
+
+#ifndef ZEQ_EQ_SESSION_H
+#define ZEQ_EQ_SESSION_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include "type.h"
+#include "exception.h"
+#include "socket.h"
+#include "compression.h"
+#include "crc.h"
+
+//largest datagram asked for in the session request; the server may only lower it
+#define ZEQ_SESSION_MAX_LENGTH 512
+//a server offering less than this is refused; the headers alone would eat most of it
+#define ZEQ_SESSION_MIN_LENGTH 64
+//sequenced packets that can be in flight each way; must be a power of two no bigger than 32768
+#define ZEQ_SESSION_WINDOW 1024
+//sent packets that can be waiting on an ack at once; the rest wait their turn rather than flooding the server
+#define ZEQ_SESSION_IN_FLIGHT 128
+//retransmit timer resolution and span, in milliseconds and ticks; the span must cover ZEQ_SESSION_RTO_MAX
+#define ZEQ_SESSION_WHEEL_TICK 10
+#define ZEQ_SESSION_WHEEL_SLOTS 512
+#define ZEQ_SESSION_RTO_INITIAL 500
+#define ZEQ_SESSION_RTO_MIN 100
+#define ZEQ_SESSION_RTO_MAX 5000
+//a packet sent this many times without an ack ends the session
+#define ZEQ_SESSION_MAX_RETRIES 10
+#define ZEQ_SESSION_CONNECT_RETRY 1000
+#define ZEQ_SESSION_CONNECT_ATTEMPTS 5
+//nothing heard for this long ends the session
+#define ZEQ_SESSION_TIMEOUT 30000
+//something is sent at least this often so the server knows we're still here
+#define ZEQ_SESSION_KEEPALIVE 5000
+//out of order acks held until the next flush; past this the server's retransmit timer covers it
+#define ZEQ_SESSION_MAX_OOA 32
+//largest protocol packet a compressed datagram inflates to
+#define ZEQ_SESSION_INFLATE_MAX 8192
+
+//Protocol-level opcodes; these follow a 0x00 byte, which is how they're told apart from application packets
+enum EQProtocolOp
+{
+	EQ_OP_SESSION_REQUEST		= 0x01,
+	EQ_OP_SESSION_RESPONSE		= 0x02,
+	EQ_OP_COMBINED				= 0x03,
+	EQ_OP_SESSION_DISCONNECT	= 0x05,
+	EQ_OP_KEEP_ALIVE			= 0x06,
+	EQ_OP_SESSION_STAT_REQUEST	= 0x07,
+	EQ_OP_SESSION_STAT_RESPONSE	= 0x08,
+	EQ_OP_PACKET				= 0x09,
+	EQ_OP_FRAGMENT				= 0x0d,
+	EQ_OP_OUT_OF_ORDER_ACK		= 0x11,
+	EQ_OP_ACK					= 0x15,
+	EQ_OP_APP_COMBINED			= 0x19
+};
+
+//session response format bits
+#define ZEQ_SESSION_FORMAT_COMPRESSED 0x01
+#define ZEQ_SESSION_FORMAT_ENCODED 0x04
+//compression flag following the protocol opcode in compressed sessions
+#define ZEQ_SESSION_FLAG_COMPRESSED 0x5a
+#define ZEQ_SESSION_FLAG_UNCOMPRESSED 0xa5
+
+//Client end of EQ's reliable UDP stream, layered over a connected UDPSocket
+//Application packets are sequenced, split into fragments when they don't fit a datagram, and retransmitted off a
+//timer wheel until acked. Outbound protocol packets are combined into as few datagrams as will hold them, and inbound
+//ones are put back in order and reassembled. All buffers are sized up front, so steady traffic allocates nothing
+//Time is whatever millisecond clock the caller passes to Process, so the session can be driven from any thread
+class EQSession
+{
+public:
+	//Called for each application packet in order; data is only good for the duration of the call
+	typedef std::function<void(uint16 opcode, const byte* data, uint32 len)> Handler;
+	//Called with each line the session would log; without one it goes straight to Ogre's log
+	typedef std::function<void(const char* message)> LogHandler;
+
+	enum State
+	{
+		STATE_CLOSED,
+		STATE_CONNECTING,
+		STATE_ESTABLISHED
+	};
+
+	struct Stats
+	{
+		uint32 datagramsSent;
+		uint32 datagramsReceived;
+		uint32 retransmits;
+		uint32 duplicates;
+		uint32 outOfOrder;
+		uint32 badCrc;
+	};
+
+	EQSession(UDPSocket* socket);
+	~EQSession();
+	void	SetHandler(const Handler& handler) { mHandler = handler; }
+	void	SetLogHandler(const LogHandler& handler) { mLogHandler = handler; }
+	//Sends the session request; Process carries on from there
+	void	Connect(uint32 now);
+	void	Disconnect();
+	//Queues an application packet to go reliably, in order, on the next Process or Flush
+	void	Send(uint16 opcode, const byte* data, uint32 len);
+	//Handles every datagram waiting on the socket, retransmits whatever has timed out, and sends acks and queued packets
+	void	Process(uint32 now);
+	//Sends acks and queued packets without reading anything
+	void	Flush();
+	State	GetState() const { return mState; }
+	uint32	GetMaxLength() const { return mMaxLength; }
+	uint32	GetRto() const { return mRto; }
+	const Stats& GetStats() const { return mStats; }
+
+private:
+	struct SendSlot
+	{
+		byte*	data;
+		uint16	len;
+		uint16	seq;
+		bool	inUse;
+		bool	due; //waiting in mDue to be sent
+		bool	acked; //out of order acked; never resent, freed once the ack catches up
+		uint8	retries;
+		uint32	sentAt;
+		int32	wheelSlot; //-1 unless scheduled
+		int32	wheelNext;
+		int32	wheelPrev;
+	};
+
+	struct RecvSlot
+	{
+		byte*	data;
+		uint16	len;
+		bool	filled;
+	};
+
+	//not copyable
+	EQSession(const EQSession&);
+	EQSession& operator=(const EQSession&);
+
+	void	ProcessDatagram(const byte* data, uint32 len);
+	//Handles one protocol packet, with the CRC and compression already taken off
+	void	ProcessProtocol(const byte* data, uint32 len);
+	void	ProcessSequenced(uint16 seq, const byte* data, uint32 len);
+	//Handles a sequenced packet whose turn it is
+	void	ProcessInOrder(const byte* data, uint32 len);
+	//Handles the payload of a whole packet or fragment chain, which may itself be an app combined packet
+	void	ProcessPayload(const byte* data, uint32 len);
+	void	DeliverApp(const byte* data, uint32 len);
+	void	HandleSessionResponse(const byte* data, uint32 len);
+	void	HandleAck(uint16 seq);
+	void	HandleOutOfOrderAck(uint16 seq);
+
+	//Takes a new sequenced slot, which goes out once it is within ZEQ_SESSION_IN_FLIGHT of the oldest unacked one
+	SendSlot& QueueSequenced(uint8 op, uint16& seq);
+	void	MarkDue(uint16 seq);
+	void	Schedule(uint32 index, uint32 at);
+	void	Unschedule(uint32 index);
+	void	AdvanceWheel(uint32 now);
+
+	//Adds a protocol packet to the datagram being built, sending that first if it won't fit
+	void	Append(const byte* packet, uint32 len);
+	void	EndDatagram();
+	//Writes a protocol packet out as a datagram, with the compression flag and CRC where the session has them
+	void	WriteDatagram(const byte* packet, uint32 len);
+	void	SendDatagrams();
+	//Sends a protocol packet on its own, right away
+	void	SendUnsequenced(const byte* packet, uint32 len);
+	void	SendSessionRequest();
+	void	Close(const char* reason);
+	//Most a protocol packet can hold once the compression flag and CRC are added
+	uint32	GetCapacity() const;
+	uint16	CalcCrc(const byte* data, uint32 len) const;
+	void	Log(const char* message);
+
+	UDPSocket*	mSocket;
+	Handler		mHandler;
+	LogHandler	mLogHandler;
+	State		mState;
+	uint32		mNow;
+	uint32		mSessionId;
+	uint32		mKey;
+	uint32		mKeyCrc; //CRC of the key bytes, which every datagram's CRC starts from
+	uint32		mMaxLength;
+	uint8		mFormat;
+	uint8		mCrcBytes;
+	uint32		mConnectAttempts;
+	uint32		mLastRecv;
+	uint32		mLastSend;
+
+	uint16		mNextOutSeq;
+	uint16		mOldestUnacked;
+	uint16		mNextUnsent; //new packets from here to mNextOutSeq haven't gone out yet
+	std::vector<SendSlot> mSend; //by sequence number modulo the window
+	byte*		mSendBuffers;
+	std::vector<uint16> mDue; //ring of sequence numbers waiting to be sent again; acked ones are skipped when they come up
+	uint32		mDueHead;
+	uint32		mDueCount;
+
+	uint16		mNextInSeq;
+	std::vector<RecvSlot> mRecv;
+	byte*		mRecvBuffers;
+	bool		mAckDue;
+	uint16		mOutOfOrderAcks[ZEQ_SESSION_MAX_OOA];
+	uint32		mOutOfOrderCount;
+	std::vector<byte> mReassembly; //kept between packets so it only grows to the largest one seen
+	uint32		mFragmentTotal; //0 unless part way through a fragment chain
+
+	int32		mWheel[ZEQ_SESSION_WHEEL_SLOTS];
+	uint32		mWheelTick;
+	uint32		mRto;
+	int32		mSrtt; //smoothed round trip and its variance, 0 until the first sample
+	int32		mRttVar;
+
+	byte		mCombine[ZEQ_SESSION_MAX_LENGTH]; //combined packet being built; one that only gets a single packet goes without it
+	uint32		mCombineLen;
+	uint32		mCombineCount;
+	DatagramRing mOut; //finished datagrams, sent together
+	byte		mInflate[ZEQ_SESSION_INFLATE_MAX];
+	Inflater	mInflater; //the session's own streams, reset rather than set up again for each datagram
+	Deflater	mDeflater;
+	Stats		mStats;
+};
+
+#endif
@@ -8,7 +8,7 @@ class ZEQException : public std::exception
 {
 public:
 	ZEQException(const char* msg) { mMessage = msg; }
-	virtual const char* what() const override { return mMessage; }
+	virtual const char* what() const throw() override { return mMessage; }
 private:
 	const char* mMessage;
 };
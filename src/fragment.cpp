@@ -1,9 +1,12 @@
 
 #include "fragment.h"
 
-Fragment::Fragment(int nameRef, byte* nameList, uint32 type)
+Fragment::Fragment(int nameRef, byte* nameList, uint32 type, const byte* data, int wldVersion)
 {
 	mType = type;
+	mData = data;
+	mNameList = nameList;
+	mVersion = wldVersion;
 	if (nameRef >= 0)
 	{
 		mName = nullptr;
@@ -26,10 +29,8 @@ void Fragment::DecodeName(byte* name, size_t len)
 	}
 }
 
-//todo: fix all frag types to use struct pointers into the data block instead of copying members from the data block
-
 MeshFragment::MeshFragment(int nameRef, byte* nameList, const byte* data, uint32 type, int wldVersion) :
-Fragment(nameRef,nameList,type)
+Fragment(nameRef,nameList,type,data,wldVersion)
 {
 	//loooots of fixed offset stuff to start
 	memcpy(&mFlags,data,sizeof(uint32));
@@ -150,7 +151,7 @@ Fragment(nameRef,nameList,type)
 			//v->v = 0.0f - v->v;
 			int32 d[2];
 			memcpy(d,data,sizeof(int32) * 2);
-			data += sizeof(int32);
+			data += sizeof(int32) * 2;
 #ifdef ZEQ_ENDIAN_CHECK
 			d[0] = endian_int32(d[0]);
 			d[1] = endian_int32(d[1]);
@@ -248,7 +249,7 @@ MeshFragment::~MeshFragment()
 }
 
 TextureListFragment::TextureListFragment(int nameRef, byte* nameList, const byte* data, uint32 type, uint32 index) :
-Fragment(nameRef,nameList,type)
+Fragment(nameRef,nameList,type,data)
 {
 	mIndex = index;
 	memcpy(&mFlags,data,sizeof(uint32));
@@ -280,7 +281,7 @@ TextureListFragment::~TextureListFragment()
 }
 
 TextureRefFragment::TextureRefFragment(int nameRef, byte* nameList, const byte* data, uint32 type) :
-Fragment(nameRef,nameList,type)
+Fragment(nameRef,nameList,type,data)
 {
 	memcpy(&mFlags,data,sizeof(uint32));
 	data += sizeof(uint32);
@@ -301,7 +302,7 @@ Fragment(nameRef,nameList,type)
 }
 
 MeshRefFragment::MeshRefFragment(int nameRef, byte* nameList, const byte* data, uint32 type) :
-Fragment(nameRef,nameList,type)
+Fragment(nameRef,nameList,type,data)
 {
 	memcpy(&mRef,data,sizeof(int32));
 	data += sizeof(int32);
@@ -314,7 +315,7 @@ Fragment(nameRef,nameList,type)
 }
 
 ObjectLocRefFragment::ObjectLocRefFragment(int nameRef, byte* nameList, const byte* data, uint32 type) :
-Fragment(nameRef,nameList,type)
+Fragment(nameRef,nameList,type,data)
 {
 	memcpy(&mRef,data,sizeof(int32));
 	data += sizeof(int32);
@@ -378,7 +379,7 @@ Fragment(nameRef,nameList,type)
 }
 
 ModelFragment::ModelFragment(int nameRef, byte* nameList, const byte* data, uint32 type) :
-Fragment(nameRef,nameList,type)
+Fragment(nameRef,nameList,type,data)
 {
 	memcpy(&mFlags,data,sizeof(uint32));
 	data += sizeof(uint32);
@@ -434,7 +435,7 @@ ModelFragment::~ModelFragment()
 }
 
 SkeletonPieceRefFragment::SkeletonPieceRefFragment(int nameRef, byte* nameList, const byte* data, uint32 type) :
-Fragment(nameRef,nameList,type)
+Fragment(nameRef,nameList,type,data)
 {
 	memcpy(&mRef,data,sizeof(int32));
 	data += sizeof(int32);
@@ -447,7 +448,7 @@ Fragment(nameRef,nameList,type)
 }
 
 SkeletonPieceTrackFragment::SkeletonPieceTrackFragment(int nameRef, byte* nameList, const byte* data, uint32 type) :
-Fragment(nameRef,nameList,type)
+Fragment(nameRef,nameList,type,data)
 {
 	memcpy(&mFlags,data,sizeof(uint32));
 	data += sizeof(uint32);
@@ -503,7 +504,7 @@ SkeletonPieceTrackFragment::~SkeletonPieceTrackFragment()
 }
 
 AnimationRefFragment::AnimationRefFragment(int nameRef, byte* nameList, const byte* data, uint32 type) :
-Fragment(nameRef,nameList,type)
+Fragment(nameRef,nameList,type,data)
 {
 	memcpy(&mRef,data,sizeof(int32));
 	data += sizeof(int32);
@@ -516,7 +517,7 @@ Fragment(nameRef,nameList,type)
 }
 
 SkeletonTrackSetFragment::SkeletonTrackSetFragment(int nameRef, byte* nameList, const byte* data, uint32 type) :
-Fragment(nameRef,nameList,type)
+Fragment(nameRef,nameList,type,data)
 {
 	memcpy(&mFlags,data,sizeof(uint32));
 	data += sizeof(uint32);
@@ -627,7 +628,7 @@ SkeletonTrackSetFragment::~SkeletonTrackSetFragment()
 }
 
 TextureBitmapRefFragment::TextureBitmapRefFragment(int nameRef, byte* nameList, const byte* data, uint32 type) :
-Fragment(nameRef,nameList,type)
+Fragment(nameRef,nameList,type,data)
 {
 	memcpy(&mRef,data,sizeof(uint32));
 	data += sizeof(uint32);
@@ -640,7 +641,7 @@ Fragment(nameRef,nameList,type)
 }
 
 TextureBitmapFragment::TextureBitmapFragment(int nameRef, byte* nameList, const byte* data, uint32 type) :
-Fragment(nameRef,nameList,type)
+Fragment(nameRef,nameList,type,data)
 {
 	memcpy(&mFlags,data,sizeof(uint32));
 	data += sizeof(uint32);
@@ -696,7 +697,7 @@ TextureBitmapFragment::~TextureBitmapFragment()
 }
 
 TextureBitmapNameFragment::TextureBitmapNameFragment(int nameRef, byte* nameList, const byte* data, uint32 type) :
-Fragment(nameRef,nameList,type)
+Fragment(nameRef,nameList,type,data)
 {
 	memcpy(&mNumNames,data,sizeof(int32));
 	data += sizeof(int32);
@@ -742,7 +743,7 @@ TextureBitmapNameFragment::~TextureBitmapNameFragment()
 }
 
 AnimatedMeshFragment::AnimatedMeshFragment(int nameRef, byte* nameList, const byte* data, uint32 type) :
-Fragment(nameRef,nameList,type)
+Fragment(nameRef,nameList,type,data)
 {
 	memcpy(&mFlags,data,sizeof(uint32));
 	data += sizeof(uint32);
@@ -780,7 +781,7 @@ Fragment(nameRef,nameList,type)
 }
 
 AnimatedMeshRefFragment::AnimatedMeshRefFragment(int nameRef, byte* nameList, const byte* data, uint32 type) :
-Fragment(nameRef,nameList,type)
+Fragment(nameRef,nameList,type,data)
 {
 	memcpy(&mRef,data,sizeof(int32));
 	data += sizeof(int32);
@@ -34,14 +34,21 @@ struct VertexPiece
 	int16 mIndex;
 };
 
+//Fragment records are what the WLD loader keeps for each fragment: just the name, type and where the
+//fragment's body sits in the inflated WLD, to be read through the views in fragment_view.h
+//The classes derived from it copy the whole body out into their own members instead; they're kept for
+//anything that needs a fragment to outlive its WLD buffer
 class Fragment
 {
 public:
-	Fragment(int nameRef, byte* nameList, uint32 type);
+	Fragment(int nameRef, byte* nameList, uint32 type, const byte* data = nullptr, int wldVersion = 1);
 	static void DecodeName(byte* src, size_t len);
 
 	const char* mName;
 	uint32 mType;
+	const byte* mData;
+	const byte* mNameList;
+	int mVersion;
 };
 
 class MeshFragment : public Fragment //0x36
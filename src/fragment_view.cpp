@@ -0,0 +1,131 @@
+
+#include "fragment_view.h"
+
+MeshFragmentView::MeshFragmentView(const Fragment* frag)
+{
+	const byte* data = frag->mData;
+	mHeader = reinterpret_cast<const WLDMeshHeader*>(data);
+	mVersion = frag->mVersion;
+	mCenterX = mHeader->centerX;
+	mCenterY = mHeader->centerY;
+	mCenterZ = mHeader->centerZ;
+	mScale = 1.0f / (1 << GetScale());
+	data += sizeof(WLDMeshHeader);
+
+	//the lists follow the header back to back, each sized by its count
+	mVertices = reinterpret_cast<const int16*>(data);
+	data += sizeof(int16) * 3 * GetVertexCount();
+	mTextureCoords = data;
+	data += ((mVersion == 1) ? sizeof(int16) : sizeof(int32)) * 2 * GetTextureCoordCount();
+	mNormals = reinterpret_cast<const int8*>(data);
+	data += sizeof(int8) * 3 * GetNormalCount();
+	mColors = reinterpret_cast<const uint32*>(data);
+	data += sizeof(uint32) * GetColorCount();
+	mPolys = reinterpret_cast<const WLDPolygon*>(data);
+	data += sizeof(WLDPolygon) * GetPolyCount();
+	mVertexPieces = reinterpret_cast<const VertexPiece*>(data);
+	data += sizeof(VertexPiece) * GetVertexPieceCount();
+	mPolyTextures = reinterpret_cast<const PolyTextureEntry*>(data);
+}
+
+TextureListView::TextureListView(const Fragment* frag)
+{
+	mHeader = reinterpret_cast<const WLDRefListHeader*>(frag->mData);
+	mRefs = reinterpret_cast<const int32*>(mHeader + 1);
+}
+
+TextureBitmapView::TextureBitmapView(const Fragment* frag)
+{
+	mHeader = reinterpret_cast<const WLDRefListHeader*>(frag->mData);
+	const int32* data = reinterpret_cast<const int32*>(mHeader + 1);
+	uint32 flags = GetFlags();
+
+	//optional fields
+	mParam[0] = (flags & (1 << 2)) ? WLDValue(*data++) : 0;
+	mParam[1] = (flags & (1 << 3)) ? WLDValue(*data++) : 0;
+	mRefs = data;
+}
+
+ObjectLocRefView::ObjectLocRefView(const Fragment* frag)
+{
+	mLoc = reinterpret_cast<const WLDObjectLocRef*>(frag->mData);
+	mNameList = frag->mNameList;
+}
+
+const char* ObjectLocRefView::GetRefName() const
+{
+	int32 ref = WLDValue(mLoc->ref);
+	if (ref >= 0)
+		return nullptr;
+	return (const char*)&mNameList[-ref];
+}
+
+ModelView::ModelView(const Fragment* frag)
+{
+	mHeader = reinterpret_cast<const WLDModelHeader*>(frag->mData);
+	const byte* data = reinterpret_cast<const byte*>(mHeader + 1);
+	uint32 flags = GetFlags();
+
+	//skip optional fields if they exist
+	if (flags & (1 << 0))
+		data += sizeof(int32);
+	if (flags & (1 << 1))
+		data += sizeof(int32);
+
+	//skipping of various size
+	int32 count = WLDValue(mHeader->size[0]);
+	for (int32 i = 0; i < count; ++i)
+	{
+		int32 size;
+		memcpy(&size,data,sizeof(int32));
+		data += WLDValue(size) * 8 + sizeof(int32);
+	}
+
+	mRefs = reinterpret_cast<const int32*>(data);
+}
+
+SkeletonTrackSetView::SkeletonTrackSetView(const Fragment* frag)
+{
+	mHeader = reinterpret_cast<const WLDSkeletonTrackSetHeader*>(frag->mData);
+	const byte* data = reinterpret_cast<const byte*>(mHeader + 1);
+	uint32 flags = WLDValue(mHeader->flags);
+
+	if (flags & (1 << 0))
+		data += sizeof(int32) * 3;
+	if (flags & (1 << 1))
+		data += sizeof(float);
+
+	mEntries = data;
+	int32 count = GetEntryCount();
+	for (int32 i = 0; i < count; ++i)
+	{
+		const WLDSkeletonTrackEntry* entry = reinterpret_cast<const WLDSkeletonTrackEntry*>(data);
+		data += sizeof(WLDSkeletonTrackEntry) + sizeof(int32) * WLDValue(entry->size);
+	}
+
+	if (flags & (1 << 9))
+	{
+		int32 size;
+		memcpy(&size,data,sizeof(int32));
+		mMeshRefCount = WLDValue(size);
+		mMeshRefs = reinterpret_cast<const int32*>(data + sizeof(int32));
+	}
+	else
+	{
+		mMeshRefCount = 0;
+		mMeshRefs = nullptr;
+	}
+}
+
+void SkeletonTrackSetView::GetEntries(std::vector<SkeletonTrackEntryView>& entries) const
+{
+	const byte* data = mEntries;
+	int32 count = GetEntryCount();
+	entries.reserve(count);
+	for (int32 i = 0; i < count; ++i)
+	{
+		const WLDSkeletonTrackEntry* entry = reinterpret_cast<const WLDSkeletonTrackEntry*>(data);
+		entries.push_back(SkeletonTrackEntryView(entry));
+		data += sizeof(WLDSkeletonTrackEntry) + sizeof(int32) * WLDValue(entry->size);
+	}
+}
@@ -0,0 +1,419 @@
+
+#ifndef ZEQ_FRAGMENT_VIEW_H
+#define ZEQ_FRAGMENT_VIEW_H
+
+#include <vector>
+#include "type.h"
+#include "byte_order.h"
+#include "fragment.h"
+
+//Read-only views over fragments that still live in the inflated WLD buffer
+//Nothing is copied or allocated; each field is decoded from the buffer when it is asked for, so a view
+//is only valid for as long as the WLD entry it was made from stays inflated
+
+//On-disk fragment layouts; fragments are packed back to back, so none of these are aligned
+#pragma pack(push,1)
+struct WLDMeshHeader //0x36
+{
+	uint32 flags;
+	int32 textureListing;
+	int32 animatedVertex;
+	int32 unknown[2];
+	float centerX;
+	float centerY;
+	float centerZ;
+	int32 params[3];
+	float maxDist;
+	float minX;
+	float minY;
+	float minZ;
+	float maxX;
+	float maxY;
+	float maxZ;
+	int16 vertexCount;
+	int16 textureCoordCount;
+	int16 normalCount;
+	int16 colorCount;
+	int16 polyCount;
+	int16 vertexPieceCount;
+	int16 polyTextureCount;
+	int16 vertexTextureCount;
+	int16 size9;
+	int16 scale;
+};
+
+struct WLDPolygon
+{
+	uint16 flags;
+	uint16 index[3];
+};
+
+struct WLDRef //0x05, 0x11, 0x13, 0x2D, 0x2F
+{
+	int32 ref;
+	int32 param;
+};
+
+struct WLDTextureRef //0x30
+{
+	uint32 flags;
+	uint32 paramA;
+	int32 paramB;
+	float paramC[2];
+	int32 ref;
+};
+
+struct WLDRefListHeader //0x31, 0x04
+{
+	uint32 flags;
+	int32 count;
+};
+
+struct WLDObjectLocRef //0x15
+{
+	int32 ref;
+	uint32 flags;
+	int32 refB;
+	float x;
+	float y;
+	float z;
+	float zRotation;
+	float yRotation;
+	float xRotation;
+	float zScale;
+	float yScale;
+	float xScale;
+	int32 refC;
+	int32 param;
+};
+
+struct WLDModelHeader //0x14
+{
+	uint32 flags;
+	int32 ref;
+	int32 size[2];
+	int32 refB;
+};
+
+struct WLDSkeletonPieceTrack //0x12
+{
+	uint32 flags;
+	int32 size;
+	int16 rotationDenominator;
+	int16 rotationX;
+	int16 rotationY;
+	int16 rotationZ;
+	int16 shiftX;
+	int16 shiftY;
+	int16 shiftZ;
+	int16 shiftDenominator;
+};
+
+struct WLDSkeletonTrackSetHeader //0x10
+{
+	uint32 flags;
+	int32 entryCount;
+	int32 ref;
+};
+
+struct WLDSkeletonTrackEntry
+{
+	int32 nameRef;
+	uint32 flags;
+	int32 ref[2];
+	int32 size;
+};
+#pragma pack(pop)
+
+inline uint32 WLDValue(uint32 v)
+{
+#ifdef ZEQ_ENDIAN_CHECK
+	return endian_uint32(v);
+#else
+	return v;
+#endif
+}
+
+inline int32 WLDValue(int32 v)
+{
+#ifdef ZEQ_ENDIAN_CHECK
+	return endian_int32(v);
+#else
+	return v;
+#endif
+}
+
+inline uint16 WLDValue(uint16 v)
+{
+#ifdef ZEQ_ENDIAN_CHECK
+	return endian_uint16(v);
+#else
+	return v;
+#endif
+}
+
+inline int16 WLDValue(int16 v)
+{
+#ifdef ZEQ_ENDIAN_CHECK
+	return endian_int16(v);
+#else
+	return v;
+#endif
+}
+
+class MeshFragmentView //0x36
+{
+public:
+	MeshFragmentView(const Fragment* frag);
+
+	uint32	GetFlags() const { return WLDValue(mHeader->flags); }
+	int32	GetTextureListing() const { return WLDValue(mHeader->textureListing); }
+	int16	GetVertexCount() const { return WLDValue(mHeader->vertexCount); }
+	int16	GetTextureCoordCount() const { return WLDValue(mHeader->textureCoordCount); }
+	int16	GetNormalCount() const { return WLDValue(mHeader->normalCount); }
+	int16	GetColorCount() const { return WLDValue(mHeader->colorCount); }
+	int16	GetPolyCount() const { return WLDValue(mHeader->polyCount); }
+	int16	GetVertexPieceCount() const { return WLDValue(mHeader->vertexPieceCount); }
+	int16	GetPolyTextureCount() const { return WLDValue(mHeader->polyTextureCount); }
+	int16	GetScale() const { return WLDValue(mHeader->scale); }
+
+	Vector3 GetVertex(int16 i) const
+	{
+		const int16* d = &mVertices[i * 3];
+		Vector3 v;
+		v.x = mCenterX + WLDValue(d[0]) * mScale;
+		v.y = mCenterY + WLDValue(d[1]) * mScale;
+		v.z = mCenterZ + WLDValue(d[2]) * mScale;
+		return v;
+	}
+
+	Vector2 GetTextureCoord(int16 i) const
+	{
+		Vector2 v;
+		if (mVersion == 1)
+		{
+			const int16* d = &reinterpret_cast<const int16*>(mTextureCoords)[i * 2];
+			v.u = WLDValue(d[0]) / 256.0f;
+			v.v = WLDValue(d[1]) / 256.0f;
+		}
+		else
+		{
+			const int32* d = &reinterpret_cast<const int32*>(mTextureCoords)[i * 2];
+			v.u = static_cast<float>(WLDValue(d[0]));
+			v.v = static_cast<float>(WLDValue(d[1]));
+		}
+		return v;
+	}
+
+	Vector3 GetNormal(int16 i) const
+	{
+		const int8* d = &mNormals[i * 3];
+		Vector3 v;
+		const float s = 1.0f / 127.0f;
+		v.x = d[0] * s;
+		v.y = d[1] * s;
+		v.z = d[2] * s;
+		return v;
+	}
+
+	uint32	GetColor(int16 i) const { return WLDValue(mColors[i]); }
+
+	ZEQPolygon GetPoly(int16 i) const
+	{
+		const WLDPolygon& d = mPolys[i];
+		ZEQPolygon p;
+		p.index[0] = WLDValue(d.index[0]);
+		p.index[1] = WLDValue(d.index[1]);
+		p.index[2] = WLDValue(d.index[2]);
+		return p;
+	}
+
+	VertexPiece GetVertexPiece(int16 i) const
+	{
+		VertexPiece p;
+		p.mCount = WLDValue(mVertexPieces[i].mCount);
+		p.mIndex = WLDValue(mVertexPieces[i].mIndex);
+		return p;
+	}
+
+	PolyTextureEntry GetPolyTexture(int16 i) const
+	{
+		PolyTextureEntry p;
+		p.mCount = WLDValue(mPolyTextures[i].mCount);
+		p.mTextureID = WLDValue(mPolyTextures[i].mTextureID);
+		return p;
+	}
+
+private:
+	const WLDMeshHeader* mHeader;
+	const int16* mVertices;
+	const byte* mTextureCoords;
+	const int8* mNormals;
+	const uint32* mColors;
+	const WLDPolygon* mPolys;
+	const VertexPiece* mVertexPieces;
+	const PolyTextureEntry* mPolyTextures;
+	float mCenterX;
+	float mCenterY;
+	float mCenterZ;
+	float mScale;
+	int mVersion;
+};
+
+//0x05, 0x11, 0x13, 0x2D and 0x2F are all just a reference to another fragment plus a flags/param field
+class RefView
+{
+public:
+	RefView(const Fragment* frag) { mRef = reinterpret_cast<const WLDRef*>(frag->mData); }
+
+	int32	GetRef() const { return WLDValue(mRef->ref); }
+	int32	GetParam() const { return WLDValue(mRef->param); }
+
+private:
+	const WLDRef* mRef;
+};
+
+class TextureRefView //0x30
+{
+public:
+	TextureRefView(const Fragment* frag) { mRef = reinterpret_cast<const WLDTextureRef*>(frag->mData); }
+
+	uint32	GetFlags() const { return WLDValue(mRef->flags); }
+	int32	GetRef() const { return WLDValue(mRef->ref); }
+
+private:
+	const WLDTextureRef* mRef;
+};
+
+class TextureListView //0x31
+{
+public:
+	TextureListView(const Fragment* frag);
+
+	int32	GetRefCount() const { return WLDValue(mHeader->count); }
+	int32	GetRef(int32 i) const { return WLDValue(mRefs[i]); }
+
+private:
+	const WLDRefListHeader* mHeader;
+	const int32* mRefs;
+};
+
+class TextureBitmapView //0x04
+{
+public:
+	TextureBitmapView(const Fragment* frag);
+
+	uint32	GetFlags() const { return WLDValue(mHeader->flags); }
+	int32	GetRefCount() const { return WLDValue(mHeader->count); }
+	int32	GetRef(int32 i) const { return WLDValue(mRefs[i]); }
+	//param 1 is the frame delay of animated sprites
+	int32	GetParam(int32 i) const { return mParam[i]; }
+
+private:
+	const WLDRefListHeader* mHeader;
+	const int32* mRefs;
+	int32 mParam[2];
+};
+
+class ObjectLocRefView //0x15
+{
+public:
+	ObjectLocRefView(const Fragment* frag);
+
+	//name of the model this is a placement of, or nullptr if it refers to one by index
+	const char* GetRefName() const;
+	float	GetX() const { return mLoc->x; }
+	float	GetY() const { return mLoc->y; }
+	float	GetZ() const { return mLoc->z; }
+	//rotations in degrees
+	float	GetXRotation() const { return mLoc->xRotation / 512.0f * 360.0f; }
+	float	GetYRotation() const { return mLoc->yRotation / 512.0f * 360.0f; }
+	float	GetZRotation() const { return mLoc->zRotation / 512.0f * 360.0f; }
+	float	GetXScale() const { return mLoc->xScale; }
+	float	GetYScale() const { return mLoc->yScale; }
+	float	GetZScale() const { return mLoc->yScale; } //the z scale field is ignored in favour of y
+
+private:
+	const WLDObjectLocRef* mLoc;
+	const byte* mNameList;
+};
+
+class ModelView //0x14
+{
+public:
+	ModelView(const Fragment* frag);
+
+	uint32	GetFlags() const { return WLDValue(mHeader->flags); }
+	int32	GetRefCount() const { return WLDValue(mHeader->size[1]); }
+	int32	GetRef(int32 i) const { return WLDValue(mRefs[i]); }
+
+private:
+	const WLDModelHeader* mHeader;
+	const int32* mRefs;
+};
+
+class SkeletonPieceTrackView //0x12
+{
+public:
+	SkeletonPieceTrackView(const Fragment* frag) { mTrack = reinterpret_cast<const WLDSkeletonPieceTrack*>(frag->mData); }
+
+	//rotations in radians; a zero denominator means the piece has no rotation or shift of its own
+	float	GetRotationX() const { return Rotation(mTrack->rotationX); }
+	float	GetRotationY() const { return Rotation(mTrack->rotationY); }
+	float	GetRotationZ() const { return Rotation(mTrack->rotationZ); }
+	float	GetShiftX() const { return Shift(mTrack->shiftX); }
+	float	GetShiftY() const { return Shift(mTrack->shiftY); }
+	float	GetShiftZ() const { return Shift(mTrack->shiftZ); }
+
+private:
+	float	Rotation(int16 v) const
+	{
+		int16 denom = WLDValue(mTrack->rotationDenominator);
+		if (denom == 0)
+			return 0.0f;
+		return WLDValue(v) / static_cast<float>(denom) * 3.14159f * 0.5f;
+	}
+
+	float	Shift(int16 v) const
+	{
+		int16 denom = WLDValue(mTrack->shiftDenominator);
+		if (denom == 0)
+			return 0.0f;
+		return WLDValue(v) / static_cast<float>(denom);
+	}
+
+	const WLDSkeletonPieceTrack* mTrack;
+};
+
+class SkeletonTrackEntryView
+{
+public:
+	SkeletonTrackEntryView(const WLDSkeletonTrackEntry* entry) { mEntry = entry; }
+
+	int32	GetRef(int i) const { return WLDValue(mEntry->ref[i]); }
+	int32	GetSize() const { return WLDValue(mEntry->size); }
+	int32	GetIndex(int32 i) const { return WLDValue(reinterpret_cast<const int32*>(mEntry + 1)[i]); }
+
+private:
+	const WLDSkeletonTrackEntry* mEntry;
+};
+
+class SkeletonTrackSetView //0x10
+{
+public:
+	SkeletonTrackSetView(const Fragment* frag);
+
+	int32	GetEntryCount() const { return WLDValue(mHeader->entryCount); }
+	//entries vary in length, so they can only be found by walking the list
+	void	GetEntries(std::vector<SkeletonTrackEntryView>& entries) const;
+	int32	GetMeshRefCount() const { return mMeshRefCount; }
+	int32	GetMeshRef(int32 i) const { return WLDValue(mMeshRefs[i]); }
+
+private:
+	const WLDSkeletonTrackSetHeader* mHeader;
+	const byte* mEntries;
+	const int32* mMeshRefs;
+	int32 mMeshRefCount;
+};
+
+#endif
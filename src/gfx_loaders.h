@@ -13,6 +13,7 @@
 #include <vector>
 #include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <list>
 #include <string>
 #include <utility>
@@ -24,20 +25,19 @@
 #include "sprite.h"
 #include "byte_order.h"
 #include "zone_data.h"
+#include "s3d_archive.h"
+#include "texture_staging.h"
 
 
-struct S3DFileEntry
-{
-	const char* mFileName;
-	uint32 mDataSize;
-	byte* mData;
-};
-
 class S3D
 {
 public:
-	S3D(FILE* fp, ZoneData* zone_data, Ogre::SceneManager* sceneMgr, bool is_main = false, bool is_obj = false);
-	void LoadContents(ZoneData* zone_data, std::vector<S3DFileEntry>* fileEntries, Ogre::SceneManager* sceneMgr, bool is_main = false, bool is_obj = false);
+	S3D(S3DArchive* archive, ZoneData* zone_data, Ogre::SceneManager* sceneMgr, bool is_main = false, bool is_obj = false);
+	void LoadContents(ZoneData* zone_data, S3DArchive* archive, Ogre::SceneManager* sceneMgr, bool is_main = false, bool is_obj = false);
+	//must be called on the render thread
+	static void UploadTexture(const char* name, const Ogre::Image& img, int mipmaps, ZoneData* zone_data);
+	//material every mesh run using the texture refers to, named after it with "_Material" appended
+	static void CreateMaterial(const char* texture_name);
 };
 
 class WLD
@@ -0,0 +1,89 @@
+
+#include "mapped_file.h"
+
+MappedFile::MappedFile()
+{
+#ifdef WIN32
+	mFileHandle = INVALID_HANDLE_VALUE;
+	mMapHandle = nullptr;
+#endif
+	mData = nullptr;
+	mLen = 0;
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const char* path)
+{
+	Close();
+#ifdef WIN32
+	mFileHandle = CreateFileA(path,GENERIC_READ,FILE_SHARE_READ,nullptr,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS,nullptr);
+	if (mFileHandle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(mFileHandle,&size) || size.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+
+	mMapHandle = CreateFileMappingA(mFileHandle,nullptr,PAGE_READONLY,0,0,nullptr);
+	if (mMapHandle == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	void* view = MapViewOfFile(mMapHandle,FILE_MAP_READ,0,0,0);
+	if (view == nullptr)
+	{
+		Close();
+		return false;
+	}
+	mData = static_cast<const byte*>(view);
+	mLen = static_cast<size_t>(size.QuadPart);
+#else
+	int fd = open(path,O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd,&st) != 0 || st.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	void* view = mmap(nullptr,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+	//the mapping holds its own reference to the file
+	close(fd);
+	if (view == MAP_FAILED)
+		return false;
+	mData = static_cast<const byte*>(view);
+	mLen = static_cast<size_t>(st.st_size);
+#endif
+	return true;
+}
+
+void MappedFile::Close()
+{
+#ifdef WIN32
+	if (mData)
+		UnmapViewOfFile(mData);
+	if (mMapHandle)
+		CloseHandle(mMapHandle);
+	if (mFileHandle != INVALID_HANDLE_VALUE)
+		CloseHandle(mFileHandle);
+	mMapHandle = nullptr;
+	mFileHandle = INVALID_HANDLE_VALUE;
+#else
+	if (mData)
+		munmap(const_cast<byte*>(mData),mLen);
+#endif
+	mData = nullptr;
+	mLen = 0;
+}
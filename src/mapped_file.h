@@ -0,0 +1,45 @@
+
+#ifndef ZEQ_MAPPED_FILE_H
+#define ZEQ_MAPPED_FILE_H
+
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <stddef.h>
+#include "type.h"
+
+//Read-only memory mapping of an entire file
+//Pages are only brought in by the OS as they are touched, so opening a large archive costs next to nothing
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+	//Returns false if the file does not exist, is empty or could not be mapped
+	bool	Open(const char* path);
+	void	Close();
+	bool	IsOpen() const { return mData != nullptr; }
+	const byte* GetData() const { return mData; }
+	size_t	GetLen() const { return mLen; }
+private:
+	//not copyable; the mapping is released on destruction
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+#ifdef WIN32
+	HANDLE	mFileHandle;
+	HANDLE	mMapHandle;
+#endif
+	const byte* mData;
+	size_t	mLen;
+};
+
+#endif
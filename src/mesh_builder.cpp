@@ -0,0 +1,242 @@
+
+#include "mesh_builder.h"
+
+MeshBuilder::MeshBuilder()
+{
+	mColourType = Ogre::VertexElement::getBestColourVertexElementType();
+}
+
+bool MeshBuilder::Build(const MeshFragmentView& mesh, std::unordered_map<int16,Sprite*>& spriteList, MeshBuildData& out) const
+{
+	out.mVertices.clear();
+	out.mIndices.clear();
+	out.mRuns.clear();
+	out.mLods.clear();
+	out.mBounds.setNull();
+
+	int16 vertexCount = mesh.GetVertexCount();
+	int16 polyCount = mesh.GetPolyCount();
+	int16 textureCoordCount = mesh.GetTextureCoordCount();
+	int16 normalCount = mesh.GetNormalCount();
+	int16 colorCount = mesh.GetColorCount();
+	int16 polyTextureCount = mesh.GetPolyTextureCount();
+	if (vertexCount <= 0 || polyCount <= 0 || polyTextureCount <= 0)
+		return false;
+
+	//vertices, swapping from EQ's axes to Ogre's
+	out.mVertices.resize(vertexCount);
+	float minX = 99999, minY = 99999, minZ = 99999, maxX = -99999, maxY = -99999, maxZ = -99999;
+	Ogre::ColourValue cv;
+	for (int16 i = 0; i < vertexCount; ++i)
+	{
+		MeshVertex& mv = out.mVertices[i];
+		Vector3 vert = mesh.GetVertex(i);
+		mv.x = vert.y;
+		mv.y = vert.z;
+		mv.z = vert.x;
+
+		if (i < normalCount)
+		{
+			Vector3 norm = mesh.GetNormal(i);
+			mv.nx = norm.y;
+			mv.ny = norm.z;
+			mv.nz = norm.x;
+		}
+		else
+		{
+			mv.nx = mv.ny = mv.nz = 0.0f;
+		}
+
+		//not every mesh has vertex colors; those without are drawn unshaded
+		cv.setAsRGBA((i < colorCount) ? mesh.GetColor(i) : 0xFFFFFFFF);
+		mv.colour = Ogre::VertexElement::convertColourValue(cv,mColourType);
+
+		if (i < textureCoordCount)
+		{
+			Vector2 text = mesh.GetTextureCoord(i);
+			mv.u = text.u;
+			mv.v = text.v;
+		}
+		else
+		{
+			mv.u = mv.v = 0.0f;
+		}
+
+		minX = std::min(minX,mv.x);
+		minY = std::min(minY,mv.y);
+		minZ = std::min(minZ,mv.z);
+		maxX = std::max(maxX,mv.x);
+		maxY = std::max(maxY,mv.y);
+		maxZ = std::max(maxZ,mv.z);
+	}
+	out.mBounds.setExtents(minX,minY,minZ,maxX,maxY,maxZ);
+
+	//indices, one run per texture; polygons whose texture isn't loaded are drawn with the run before them,
+	//the same as the old ManualObject path
+	out.mIndices.reserve(polyCount * 3);
+	//0x31 fragment contains a list of indices to 0x30 fragments
+	//pte contains a list of indices to the 0x31 fragments' lists and shareTextureCount values
+	//when shareTextureCount reaches 0, we get the 0x30 fragment index at pt_index in 0x31's list,
+	//incrementing pt_index by 1 and setting shareTextureCount,
+	//then retrieving the corresponding 0x30 fragment by index from the wld's lookup table
+	//0x30's name is the name of our desired texture from the s3d, which is already loaded
+	//with "_Material" appended to this name
+	int16 pt_index = 0;
+	int16 shareTextureCount = 0;
+	MeshRun* run = nullptr;
+	for (int16 i = 0; i < polyCount; ++i)
+	{
+		if (shareTextureCount <= 0 && pt_index < polyTextureCount)
+		{
+			PolyTextureEntry pte = mesh.GetPolyTexture(pt_index++);
+			shareTextureCount = pte.mCount;
+			auto sprite = spriteList.find(pte.mTextureID);
+			if (sprite != spriteList.end())
+			{
+				MeshRun add;
+				add.mMaterial = sprite->second->mTextureNameList[0];
+				add.mIndexStart = out.mIndices.size();
+				add.mIndexCount = 0;
+				out.mRuns.push_back(add);
+				run = &out.mRuns.back();
+			}
+		}
+		shareTextureCount--;
+
+		if (!run)
+			continue; //nothing to draw these with yet
+
+		ZEQPolygon p = mesh.GetPoly(i);
+		if (p.index[0] >= vertexCount || p.index[1] >= vertexCount || p.index[2] >= vertexCount)
+			continue;
+		//EQ winds the other way
+		out.mIndices.push_back(p.index[2]);
+		out.mIndices.push_back(p.index[1]);
+		out.mIndices.push_back(p.index[0]);
+		run->mIndexCount += 3;
+	}
+
+	return !out.mIndices.empty();
+}
+
+Ogre::MeshPtr MeshBuilder::Upload(const MeshBuildData& data, const char* name) const
+{
+	return Upload(&data.mVertices[0],data.mVertices.size(),&data.mIndices[0],data.mIndices.size(),data.mRuns,data.mLods,data.mBounds,name);
+}
+
+Ogre::MeshPtr MeshBuilder::Upload(const MeshVertex* vertices, uint32 vertexCount, const uint16* indices, uint32 indexCount,
+	const std::vector<MeshRun>& runs, const std::vector<MeshLod>& lods, const Ogre::AxisAlignedBox& bounds, const char* name) const
+{
+	Ogre::HardwareBufferManager* hardwareMgr = Ogre::HardwareBufferManager::getSingletonPtr();
+	Ogre::MeshPtr mesh = Ogre::MeshManager::getSingleton().createManual(name,Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+
+	//single interleaved source, matching MeshVertex
+	Ogre::VertexData* vdata = new Ogre::VertexData();
+	mesh->sharedVertexData = vdata;
+	vdata->vertexStart = 0;
+	vdata->vertexCount = vertexCount;
+	Ogre::VertexDeclaration* decl = vdata->vertexDeclaration;
+	size_t offset = 0;
+	offset += decl->addElement(0,offset,Ogre::VET_FLOAT3,Ogre::VES_POSITION).getSize();
+	offset += decl->addElement(0,offset,Ogre::VET_FLOAT3,Ogre::VES_NORMAL).getSize();
+	offset += decl->addElement(0,offset,mColourType,Ogre::VES_DIFFUSE).getSize();
+	offset += decl->addElement(0,offset,Ogre::VET_FLOAT2,Ogre::VES_TEXTURE_COORDINATES).getSize();
+
+	//keep the mesh's shadow buffer setting; StaticGeometry reads the geometry back when it builds its regions
+	Ogre::HardwareVertexBufferSharedPtr vbuf = hardwareMgr->createVertexBuffer(sizeof(MeshVertex),vertexCount,
+		mesh->getVertexBufferUsage(),mesh->isVertexBufferShadowed());
+	vbuf->writeData(0,vbuf->getSizeInBytes(),vertices,true);
+	vdata->vertexBufferBinding->setBinding(0,vbuf);
+
+	Ogre::HardwareIndexBufferSharedPtr ibuf = hardwareMgr->createIndexBuffer(Ogre::HardwareIndexBuffer::IT_16BIT,indexCount,
+		mesh->getIndexBufferUsage(),mesh->isIndexBufferShadowed());
+	ibuf->writeData(0,ibuf->getSizeInBytes(),indices,true);
+
+	for (auto itr = runs.begin(); itr != runs.end(); itr++)
+	{
+		const MeshRun& run = *itr;
+		if (run.mIndexCount == 0)
+			continue;
+		Ogre::SubMesh* subMesh = mesh->createSubMesh();
+		subMesh->setMaterialName(run.mMaterial);
+		subMesh->useSharedVertices = true;
+		subMesh->indexData->indexBuffer = ibuf;
+		subMesh->indexData->indexStart = run.mIndexStart;
+		subMesh->indexData->indexCount = run.mIndexCount;
+	}
+
+	mesh->_setBounds(bounds);
+	mesh->_setBoundingSphereRadius(bounds.getHalfSize().length());
+	AttachLods(mesh.get(),runs,lods);
+	mesh->load();
+	return mesh;
+}
+
+void MeshBuilder::AttachLods(Ogre::Mesh* mesh, const std::vector<MeshRun>& runs, const std::vector<MeshLod>& lods)
+{
+	if (lods.empty())
+		return;
+
+	//every level is one more index buffer, with each submesh drawing its run's range of it
+	Ogre::HardwareBufferManager* hardwareMgr = Ogre::HardwareBufferManager::getSingletonPtr();
+	const Ogre::LodStrategy* strategy = mesh->getLodStrategy();
+	mesh->_setLodInfo(lods.size() + 1,false);
+	for (uint32 level = 0; level < lods.size(); ++level)
+	{
+		const MeshLod& lod = lods[level];
+		Ogre::MeshLodUsage usage;
+		usage.userValue = lod.mDistance;
+		usage.value = strategy->transformUserValue(lod.mDistance);
+		mesh->_setLodUsage(level + 1,usage);
+
+		Ogre::HardwareIndexBufferSharedPtr ibuf;
+		if (!lod.mIndices.empty())
+		{
+			ibuf = hardwareMgr->createIndexBuffer(Ogre::HardwareIndexBuffer::IT_16BIT,lod.mIndices.size(),
+				mesh->getIndexBufferUsage(),mesh->isIndexBufferShadowed());
+			ibuf->writeData(0,ibuf->getSizeInBytes(),&lod.mIndices[0],true);
+		}
+
+		uint16 subMesh = 0;
+		for (uint32 r = 0; r < runs.size() && r < lod.mRuns.size(); ++r)
+		{
+			if (runs[r].mIndexCount == 0)
+				continue;
+			//a run reduced away entirely keeps drawing whatever the level before it did
+			Ogre::IndexData* data;
+			if (lod.mRuns[r].mIndexCount == 0)
+			{
+				const Ogre::SubMesh* sub = mesh->getSubMesh(subMesh);
+				data = (level == 0 ? sub->indexData : sub->mLodFaceList[level - 1])->clone(false);
+			}
+			else
+			{
+				data = OGRE_NEW Ogre::IndexData();
+				data->indexBuffer = ibuf;
+				data->indexStart = lod.mRuns[r].mIndexStart;
+				data->indexCount = lod.mRuns[r].mIndexCount;
+			}
+			mesh->_setSubMeshLodFaceList(subMesh++,level + 1,data);
+		}
+	}
+}
+
+void MeshBuilder::ShareLods(Ogre::Mesh* mesh, const Ogre::Mesh* base)
+{
+	uint16 levels = base->getNumLodLevels();
+	if (levels <= 1)
+		return;
+
+	mesh->_setLodInfo(levels,false);
+	for (uint16 level = 1; level < levels; ++level)
+	{
+		Ogre::MeshLodUsage usage = base->getLodLevel(level);
+		usage.edgeData = nullptr; //owned by base
+		mesh->_setLodUsage(level,usage);
+		for (uint16 j = 0; j < base->getNumSubMeshes() && j < mesh->getNumSubMeshes(); ++j)
+		{
+			//a new binding over the same buffer, as the full level's index data is
+			mesh->_setSubMeshLodFaceList(j,level,base->getSubMesh(j)->mLodFaceList[level - 1]->clone(false));
+		}
+	}
+}
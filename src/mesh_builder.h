@@ -0,0 +1,69 @@
+
+#ifndef ZEQ_MESH_BUILDER_H
+#define ZEQ_MESH_BUILDER_H
+
+#include <vector>
+#include <unordered_map>
+#include "type.h"
+#include "fragment_view.h"
+#include "sprite.h"
+
+//one interleaved vertex, already in Ogre's axes
+struct MeshVertex
+{
+	float x, y, z;
+	float nx, ny, nz;
+	uint32 colour; //packed in the render system's colour order
+	float u, v;
+};
+
+//a run of polygons sharing a material, as a range of the index list
+struct MeshRun
+{
+	const char* mMaterial;
+	uint32 mIndexStart;
+	uint32 mIndexCount;
+};
+
+//a reduced copy of a mesh's index list over the same vertices, drawn once the camera is mDistance away
+struct MeshLod
+{
+	float mDistance;
+	std::vector<uint16> mIndices;
+	std::vector<MeshRun> mRuns; //one for each of the full mesh's runs, in the same order; some may be empty
+};
+
+struct MeshBuildData
+{
+	std::vector<MeshVertex> mVertices;
+	std::vector<uint16> mIndices;
+	std::vector<MeshRun> mRuns;
+	std::vector<MeshLod> mLods; //nearest first; empty unless the mesh has been simplified
+	Ogre::AxisAlignedBox mBounds;
+};
+
+//Builds indexed meshes from 0x36 fragments
+//Each vertex of the fragment is written exactly once, and each run of polygons sharing a texture becomes a
+//submesh over one 16bit index buffer; Build only touches CPU memory, Upload creates the Ogre mesh from it
+class MeshBuilder
+{
+public:
+	MeshBuilder();
+	//Returns false if none of the fragment's polygons have a texture in spriteList
+	bool	Build(const MeshFragmentView& mesh, std::unordered_map<int16,Sprite*>& spriteList, MeshBuildData& out) const;
+	Ogre::MeshPtr Upload(const MeshBuildData& data, const char* name) const;
+	//same as above, for geometry that doesn't live in a MeshBuildData (such as a mapped zone cache)
+	Ogre::MeshPtr Upload(const MeshVertex* vertices, uint32 vertexCount, const uint16* indices, uint32 indexCount,
+		const std::vector<MeshRun>& runs, const std::vector<MeshLod>& lods, const Ogre::AxisAlignedBox& bounds, const char* name) const;
+	//Gives a mesh whose submeshes were made from runs, skipping empty ones, the reduced levels in lods; before it is loaded
+	static void AttachLods(Ogre::Mesh* mesh, const std::vector<MeshRun>& runs, const std::vector<MeshLod>& lods);
+	//Copies base's reduced levels onto a mesh whose submeshes were made one for one from base's, sharing its index
+	//buffers; before it is loaded
+	static void ShareLods(Ogre::Mesh* mesh, const Ogre::Mesh* base);
+	Ogre::VertexElementType GetColourType() const { return mColourType; }
+
+private:
+	Ogre::VertexElementType mColourType;
+};
+
+#endif
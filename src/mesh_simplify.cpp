@@ -0,0 +1,338 @@
+
+#include "mesh_simplify.h"
+
+void MeshSimplifier::Quadric::AddPlane(double a, double b, double c, double d)
+{
+	a2 += a * a; ab += a * b; ac += a * c; ad += a * d;
+	b2 += b * b; bc += b * c; bd += b * d;
+	c2 += c * c; cd += c * d;
+	d2 += d * d;
+}
+
+void MeshSimplifier::Quadric::Add(const Quadric& q)
+{
+	a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+	b2 += q.b2; bc += q.bc; bd += q.bd;
+	c2 += q.c2; cd += q.cd;
+	d2 += q.d2;
+}
+
+double MeshSimplifier::Quadric::Evaluate(const Ogre::Vector3& p) const
+{
+	double x = p.x, y = p.y, z = p.z;
+	return a2 * x * x + 2.0 * ab * x * y + 2.0 * ac * x * z + 2.0 * ad * x +
+		b2 * y * y + 2.0 * bc * y * z + 2.0 * bd * y +
+		c2 * z * z + 2.0 * cd * z + d2;
+}
+
+void MeshSimplifier::Simplify(MeshBuildData& data)
+{
+	data.mLods.clear();
+	if (data.mIndices.empty())
+		return;
+	Simplify(reinterpret_cast<const byte*>(&data.mVertices[0]),sizeof(MeshVertex),data.mVertices.size(),&data.mIndices[0],data.mRuns,data.mLods);
+}
+
+void MeshSimplifier::SimplifyAll(std::vector<MeshBuildData>& meshes)
+{
+	WorkerPool::GetShared().ParallelFor(meshes.size(),4,[&meshes](uint32 begin, uint32 end) {
+		MeshSimplifier simplifier;
+		for (uint32 i = begin; i < end; ++i)
+		{
+			simplifier.Simplify(meshes[i]);
+		}
+	});
+}
+
+void MeshSimplifier::Simplify(const byte* positions, uint32 stride, uint32 vertexCount, const uint16* indices,
+	const std::vector<MeshRun>& runs, std::vector<MeshLod>& out)
+{
+	out.clear();
+	Setup(positions,stride,vertexCount,indices,runs);
+	if (mLiveTris < ZEQ_LOD_MIN_TRIS)
+		return;
+
+	uint32 full = mLiveTris;
+	uint32 previous = mLiveTris;
+	float distance = ZEQ_LOD_DISTANCE;
+	for (uint32 level = 0; level < ZEQ_LOD_LEVELS; ++level, distance *= 2.0f)
+	{
+		//each level carries on from the last, with a looser error allowed the further away it is drawn
+		double maxError = distance / ZEQ_LOD_ERROR_SCALE;
+		Reduce(full >> (level + 1),maxError * maxError);
+		if (mLiveTris > previous * (1.0f - ZEQ_LOD_MIN_GAIN))
+			continue;
+		Emit(runs,distance,out);
+		previous = mLiveTris;
+	}
+}
+
+void MeshSimplifier::Setup(const byte* positions, uint32 stride, uint32 vertexCount, const uint16* indices, const std::vector<MeshRun>& runs)
+{
+	mPositions.resize(vertexCount);
+	for (uint32 i = 0; i < vertexCount; ++i)
+	{
+		const float* p = reinterpret_cast<const float*>(positions + i * stride);
+		mPositions[i] = Ogre::Vector3(p[0],p[1],p[2]);
+	}
+
+	mTris.clear();
+	mTriRun.clear();
+	mQuadrics.resize(vertexCount);
+	for (uint32 i = 0; i < vertexCount; ++i)
+	{
+		mQuadrics[i].Clear();
+	}
+	//a vertex used by more than one run sits on the border between two textures
+	std::vector<int32> firstRun(vertexCount,-1);
+	mLocked.assign(vertexCount,0);
+	for (uint32 r = 0; r < runs.size(); ++r)
+	{
+		uint32 end = runs[r].mIndexStart + runs[r].mIndexCount;
+		for (uint32 i = runs[r].mIndexStart; i + 2 < end; i += 3)
+		{
+			uint32 a = indices[i], b = indices[i + 1], c = indices[i + 2];
+			if (a >= vertexCount || b >= vertexCount || c >= vertexCount || a == b || b == c || a == c)
+				continue;
+			mTris.push_back(a);
+			mTris.push_back(b);
+			mTris.push_back(c);
+			mTriRun.push_back(r);
+
+			Ogre::Vector3 n = (mPositions[b] - mPositions[a]).crossProduct(mPositions[c] - mPositions[a]);
+			if (n.normalise() > 0.0f)
+			{
+				double d = -n.dotProduct(mPositions[a]);
+				for (uint32 k = 0; k < 3; ++k)
+				{
+					mQuadrics[mTris[mTris.size() - 3 + k]].AddPlane(n.x,n.y,n.z,d);
+				}
+			}
+			for (uint32 k = 0; k < 3; ++k)
+			{
+				uint32 v = mTris[mTris.size() - 3 + k];
+				if (firstRun[v] == -1)
+					firstRun[v] = r;
+				else if (firstRun[v] != (int32)r)
+					mLocked[v] = 1;
+			}
+		}
+	}
+	mLiveTris = mTriRun.size();
+
+	//an edge used by anything other than exactly two triangles is an open border (or worse), and stays put
+	mEdges.clear();
+	for (uint32 t = 0; t < mLiveTris; ++t)
+	{
+		for (uint32 k = 0; k < 3; ++k)
+		{
+			uint32 a = mTris[t * 3 + k];
+			uint32 b = mTris[t * 3 + (k + 1) % 3];
+			mEdges.push_back(((uint64)std::min(a,b) << 32) | std::max(a,b));
+		}
+	}
+	std::sort(mEdges.begin(),mEdges.end());
+	for (uint32 i = 0; i < mEdges.size();)
+	{
+		uint32 j = i + 1;
+		while (j < mEdges.size() && mEdges[j] == mEdges[i])
+			j++;
+		if (j - i != 2)
+		{
+			mLocked[(uint32)(mEdges[i] >> 32)] = 1;
+			mLocked[(uint32)mEdges[i]] = 1;
+		}
+		i = j;
+	}
+}
+
+void MeshSimplifier::Reduce(uint32 target, double maxCost)
+{
+	while (mLiveTris > target)
+	{
+		if (ReducePass(target,maxCost) == 0)
+			break;
+	}
+}
+
+void MeshSimplifier::BuildAdjacency()
+{
+	uint32 vertexCount = mPositions.size();
+	mAdjStart.assign(vertexCount + 1,0);
+	for (uint32 t = 0; t < mTriRun.size(); ++t)
+	{
+		if (mTriRun[t] < 0)
+			continue;
+		for (uint32 k = 0; k < 3; ++k)
+			mAdjStart[mTris[t * 3 + k] + 1]++;
+	}
+	for (uint32 v = 0; v < vertexCount; ++v)
+	{
+		mAdjStart[v + 1] += mAdjStart[v];
+	}
+
+	//fill from the front of each vertex's range, using the start of the next as a cursor
+	mAdjTris.resize(mAdjStart[vertexCount]);
+	std::vector<uint32> cursor(mAdjStart.begin(),mAdjStart.end() - 1);
+	for (uint32 t = 0; t < mTriRun.size(); ++t)
+	{
+		if (mTriRun[t] < 0)
+			continue;
+		for (uint32 k = 0; k < 3; ++k)
+			mAdjTris[cursor[mTris[t * 3 + k]]++] = t;
+	}
+}
+
+uint32 MeshSimplifier::ReducePass(uint32 target, double maxCost)
+{
+	BuildAdjacency();
+
+	//the cheapest neighbour for every vertex free to move
+	mCollapses.clear();
+	uint32 vertexCount = mPositions.size();
+	for (uint32 from = 0; from < vertexCount; ++from)
+	{
+		if (mLocked[from] || mAdjStart[from] == mAdjStart[from + 1])
+			continue;
+		Collapse best;
+		best.cost = maxCost;
+		best.from = from;
+		best.to = from;
+		for (uint32 a = mAdjStart[from]; a < mAdjStart[from + 1]; ++a)
+		{
+			const uint32* tri = &mTris[mAdjTris[a] * 3];
+			for (uint32 k = 0; k < 3; ++k)
+			{
+				uint32 to = tri[k];
+				if (to == from)
+					continue;
+				Quadric q = mQuadrics[from];
+				q.Add(mQuadrics[to]);
+				double cost = q.Evaluate(mPositions[to]);
+				if (cost <= best.cost)
+				{
+					best.cost = cost;
+					best.to = to;
+				}
+			}
+		}
+		if (best.to != from)
+			mCollapses.push_back(best);
+	}
+	std::sort(mCollapses.begin(),mCollapses.end());
+
+	//every collapse changes the triangles around both its vertices, so neither can take part in another this pass
+	mTouched.assign(vertexCount,0);
+	uint32 collapsed = 0;
+	for (auto itr = mCollapses.begin(); itr != mCollapses.end() && mLiveTris > target; itr++)
+	{
+		uint32 from = itr->from;
+		uint32 to = itr->to;
+		if (mTouched[from] || mTouched[to] || !CanCollapse(from,to))
+			continue;
+
+		for (uint32 a = mAdjStart[from]; a < mAdjStart[from + 1]; ++a)
+		{
+			uint32 t = mAdjTris[a];
+			if (mTriRun[t] < 0)
+				continue;
+			uint32* tri = &mTris[t * 3];
+			if (tri[0] == to || tri[1] == to || tri[2] == to)
+			{
+				mTriRun[t] = -1;
+				mLiveTris--;
+				continue;
+			}
+			for (uint32 k = 0; k < 3; ++k)
+			{
+				if (tri[k] == from)
+					tri[k] = to;
+			}
+		}
+		mQuadrics[to].Add(mQuadrics[from]);
+		mTouched[from] = 1;
+		mTouched[to] = 1;
+		collapsed++;
+	}
+	return collapsed;
+}
+
+bool MeshSimplifier::CanCollapse(uint32 from, uint32 to)
+{
+	//the triangles that survive the collapse mustn't turn over or fold flat
+	uint32 shared = 0;
+	mNeighbours.clear();
+	for (uint32 a = mAdjStart[from]; a < mAdjStart[from + 1]; ++a)
+	{
+		uint32 t = mAdjTris[a];
+		if (mTriRun[t] < 0)
+			continue;
+		const uint32* tri = &mTris[t * 3];
+		if (tri[0] == to || tri[1] == to || tri[2] == to)
+		{
+			shared++;
+			continue;
+		}
+
+		Ogre::Vector3 p[3], q[3];
+		for (uint32 k = 0; k < 3; ++k)
+		{
+			p[k] = mPositions[tri[k]];
+			q[k] = mPositions[tri[k] == from ? to : tri[k]];
+			if (tri[k] != from)
+				mNeighbours.push_back(tri[k]);
+		}
+		Ogre::Vector3 before = (p[1] - p[0]).crossProduct(p[2] - p[0]);
+		Ogre::Vector3 after = (q[1] - q[0]).crossProduct(q[2] - q[0]);
+		if (before.dotProduct(after) <= 0.2f * before.length() * after.length())
+			return false;
+	}
+
+	//nor may it pinch the surface: the only vertices next to both ends should be the far corners of the triangles
+	//being removed, or two triangles would end up on the same edge
+	std::sort(mNeighbours.begin(),mNeighbours.end());
+	mNeighbours.erase(std::unique(mNeighbours.begin(),mNeighbours.end()),mNeighbours.end());
+	uint32 common = 0;
+	for (uint32 a = mAdjStart[to]; a < mAdjStart[to + 1]; ++a)
+	{
+		uint32 t = mAdjTris[a];
+		if (mTriRun[t] < 0)
+			continue;
+		const uint32* tri = &mTris[t * 3];
+		if (tri[0] == from || tri[1] == from || tri[2] == from)
+			continue;
+		for (uint32 k = 0; k < 3; ++k)
+		{
+			if (tri[k] != to && std::binary_search(mNeighbours.begin(),mNeighbours.end(),tri[k]))
+				common++;
+		}
+	}
+	//each far corner is also reached through one other triangle around to, on a manifold mesh
+	return common <= shared;
+}
+
+void MeshSimplifier::Emit(const std::vector<MeshRun>& runs, float distance, std::vector<MeshLod>& out) const
+{
+	out.push_back(MeshLod());
+	MeshLod& lod = out.back();
+	lod.mDistance = distance;
+	lod.mIndices.reserve(mLiveTris * 3);
+	lod.mRuns.resize(runs.size());
+	//triangles were taken run by run, so each run's survivors are already together and in order
+	uint32 t = 0;
+	for (uint32 r = 0; r < runs.size(); ++r)
+	{
+		MeshRun& run = lod.mRuns[r];
+		run.mMaterial = runs[r].mMaterial;
+		run.mIndexStart = lod.mIndices.size();
+		for (; t < mTriRun.size() && (mTriRun[t] < 0 || mTriRun[t] <= (int32)r); ++t)
+		{
+			if (mTriRun[t] < 0)
+				continue;
+			lod.mIndices.push_back(mTris[t * 3]);
+			lod.mIndices.push_back(mTris[t * 3 + 1]);
+			lod.mIndices.push_back(mTris[t * 3 + 2]);
+		}
+		run.mIndexCount = lod.mIndices.size() - run.mIndexStart;
+	}
+}
@@ -0,0 +1,80 @@
+
+#ifndef ZEQ_MESH_SIMPLIFY_H
+#define ZEQ_MESH_SIMPLIFY_H
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "type.h"
+#include "mesh_builder.h"
+#include "worker_pool.h"
+
+//reduced levels made for each mesh, each with about half the triangles of the one before
+#define ZEQ_LOD_LEVELS 3
+//distance the first reduced level is drawn from; each level after it starts twice as far away
+#define ZEQ_LOD_DISTANCE 150.0f
+//a level may move the surface by at most its distance over this, which is about two pixels on a 1080 line screen
+#define ZEQ_LOD_ERROR_SCALE 600.0f
+//meshes with fewer triangles than this aren't worth reducing
+#define ZEQ_LOD_MIN_TRIS 32
+//a level is only kept if it drops at least this fraction of the triangles of the level before it
+#define ZEQ_LOD_MIN_GAIN 0.2f
+
+//Makes reduced levels of detail for meshes by quadric error edge collapse
+//Each collapse moves a vertex onto one of its neighbours, so the levels are just new index lists over the mesh's own
+//vertices. Vertices on an open edge or shared between runs never move, which keeps UV seams, the borders between
+//textures and the edges where separate zone meshes meet exactly where they were
+class MeshSimplifier
+{
+public:
+	//Replaces data.mLods with reduced levels of data's triangles
+	void	Simplify(MeshBuildData& data);
+	//Same, for geometry kept elsewhere; positions are three floats every stride bytes
+	void	Simplify(const byte* positions, uint32 stride, uint32 vertexCount, const uint16* indices,
+		const std::vector<MeshRun>& runs, std::vector<MeshLod>& out);
+	//Simplifies every mesh in the list, spread across the worker pool
+	static void SimplifyAll(std::vector<MeshBuildData>& meshes);
+
+private:
+	//sum of squared distances to a set of planes, as the upper half of a symmetric 4x4 matrix
+	struct Quadric
+	{
+		double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+		void	Clear() { a2 = ab = ac = ad = b2 = bc = bd = c2 = cd = d2 = 0.0; }
+		void	AddPlane(double a, double b, double c, double d);
+		void	Add(const Quadric& q);
+		double	Evaluate(const Ogre::Vector3& p) const;
+	};
+
+	struct Collapse
+	{
+		double cost;
+		uint32 from;
+		uint32 to;
+		bool operator<(const Collapse& o) const { return cost < o.cost; }
+	};
+
+	void	Setup(const byte* positions, uint32 stride, uint32 vertexCount, const uint16* indices, const std::vector<MeshRun>& runs);
+	//Collapses the cheapest edges until only target triangles are left or nothing costs less than maxCost
+	void	Reduce(uint32 target, double maxCost);
+	//One round of collapses, none of which touch the same vertex twice; returns how many were made
+	uint32	ReducePass(uint32 target, double maxCost);
+	void	BuildAdjacency();
+	bool	CanCollapse(uint32 from, uint32 to);
+	void	Emit(const std::vector<MeshRun>& runs, float distance, std::vector<MeshLod>& out) const;
+
+	std::vector<Ogre::Vector3> mPositions;
+	std::vector<Quadric> mQuadrics;
+	std::vector<uint8> mLocked; //never moves
+	std::vector<uint8> mTouched; //collapsed into or out of this pass
+	std::vector<uint32> mTris; //three vertices each
+	std::vector<int32> mTriRun; //-1 once collapsed away
+	std::vector<uint32> mAdjStart; //each vertex's triangles are mAdjTris[mAdjStart[v], mAdjStart[v + 1])
+	std::vector<uint32> mAdjTris;
+	std::vector<Collapse> mCollapses;
+	std::vector<uint64> mEdges;
+	std::vector<uint32> mNeighbours;
+	uint32	mLiveTris;
+};
+
+#endif
@@ -0,0 +1,190 @@
+
+#include "net_reactor.h"
+
+NetReactor::NetReactor()
+{
+#ifndef WIN32
+	mEpoll = epoll_create(16);
+	if (mEpoll == -1)
+	{
+		throw ZEQException("Could not create network reactor");
+	}
+#endif
+}
+
+NetReactor::~NetReactor()
+{
+	for (auto itr = mSockets.begin(); itr != mSockets.end(); itr++)
+	{
+		(*itr)->mReactor = nullptr;
+	}
+#ifndef WIN32
+	close(mEpoll);
+#endif
+}
+
+void NetReactor::Add(Socket* sock)
+{
+	if (sock->mReactor)
+	{
+		throw ZEQException("Socket is already in a reactor");
+	}
+	if (sock->IsBlocking() || !sock->IsOpen())
+	{
+		throw ZEQException("Only open, non-blocking sockets can be added to a reactor");
+	}
+#ifndef WIN32
+	epoll_event ev;
+	memset(&ev,0,sizeof(ev));
+	ev.events = EPOLLIN | (sock->HasPendingSend() ? (uint32_t)EPOLLOUT : 0);
+	ev.data.ptr = sock;
+	if (epoll_ctl(mEpoll,EPOLL_CTL_ADD,sock->GetHandle(),&ev) == -1)
+	{
+		throw ZEQException("Could not add socket to reactor");
+	}
+#endif
+	sock->mReactor = this;
+	mSockets.push_back(sock);
+}
+
+void NetReactor::Remove(Socket* sock)
+{
+	auto itr = std::find(mSockets.begin(),mSockets.end(),sock);
+	if (itr == mSockets.end())
+		return;
+	mSockets.erase(itr);
+	sock->mReactor = nullptr;
+#ifndef WIN32
+	epoll_event ev;
+	memset(&ev,0,sizeof(ev));
+	epoll_ctl(mEpoll,EPOLL_CTL_DEL,sock->GetHandle(),&ev);
+#endif
+
+	//it may still be waiting its turn in the poll that removed it
+	for (auto ready = mReady.begin(); ready != mReady.end(); ready++)
+	{
+		if (ready->sock == sock)
+			ready->sock = nullptr;
+	}
+}
+
+void NetReactor::Update(Socket* sock)
+{
+#ifndef WIN32
+	//select builds its sets fresh every poll, so only epoll needs telling
+	epoll_event ev;
+	memset(&ev,0,sizeof(ev));
+	ev.events = EPOLLIN | (sock->HasPendingSend() ? (uint32_t)EPOLLOUT : 0);
+	ev.data.ptr = sock;
+	if (epoll_ctl(mEpoll,EPOLL_CTL_MOD,sock->GetHandle(),&ev) == -1)
+	{
+		throw ZEQException("Could not update socket in reactor");
+	}
+#endif
+}
+
+uint32 NetReactor::Poll(uint32 timeout)
+{
+	uint32 count = Wait(timeout);
+	for (uint32 i = 0; i < count; ++i)
+	{
+		Dispatch(i);
+	}
+	mReady.clear();
+	return count;
+}
+
+#ifdef WIN32
+uint32 NetReactor::Wait(uint32 timeout)
+{
+	mReady.clear();
+	//select fails outright on empty sets, but the caller still expects to have waited
+	if (mSockets.empty())
+	{
+		Sleep(timeout);
+		return 0;
+	}
+
+	fd_set readSet, writeSet, errorSet;
+	FD_ZERO(&readSet);
+	FD_ZERO(&writeSet);
+	FD_ZERO(&errorSet);
+	for (auto itr = mSockets.begin(); itr != mSockets.end(); itr++)
+	{
+		SOCKET s = (*itr)->GetHandle();
+		FD_SET(s,&readSet);
+		FD_SET(s,&errorSet);
+		if ((*itr)->HasPendingSend())
+			FD_SET(s,&writeSet);
+	}
+
+	timeval tv;
+	tv.tv_sec = timeout / 1000;
+	tv.tv_usec = (timeout % 1000) * 1000;
+	int n = select(0,&readSet,&writeSet,&errorSet,&tv);
+	if (n == SOCKET_ERROR)
+	{
+		throw ZEQException("Network reactor wait failed");
+	}
+
+	for (auto itr = mSockets.begin(); itr != mSockets.end() && n > 0; itr++)
+	{
+		SOCKET s = (*itr)->GetHandle();
+		Ready ready;
+		ready.sock = *itr;
+		//errors surface from the recv that follows, the same as on epoll
+		ready.readable = FD_ISSET(s,&readSet) || FD_ISSET(s,&errorSet);
+		ready.writable = FD_ISSET(s,&writeSet) != 0;
+		if (ready.readable || ready.writable)
+			mReady.push_back(ready);
+	}
+	return mReady.size();
+}
+#else
+uint32 NetReactor::Wait(uint32 timeout)
+{
+	mReady.clear();
+	mEvents.resize(std::max<size_t>(mSockets.size(),1));
+	int n;
+	do
+	{
+		n = epoll_wait(mEpoll,&mEvents[0],mEvents.size(),timeout);
+	} while (n == -1 && errno == EINTR);
+	if (n == -1)
+	{
+		throw ZEQException("Network reactor wait failed");
+	}
+
+	for (int i = 0; i < n; ++i)
+	{
+		Ready ready;
+		ready.sock = (Socket*)mEvents[i].data.ptr;
+		ready.readable = (mEvents[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) != 0;
+		ready.writable = (mEvents[i].events & EPOLLOUT) != 0;
+		mReady.push_back(ready);
+	}
+	return mReady.size();
+}
+#endif
+
+void NetReactor::Dispatch(uint32 index)
+{
+	Socket* sock = mReady[index].sock;
+	if (!sock)
+		return;
+	try
+	{
+		if (mReady[index].readable)
+			sock->Receive();
+		//a socket closed by its own Receive has already been taken out
+		if (mReady[index].sock && mReady[index].writable)
+			sock->Flush();
+	}
+	catch (ZEQException& e)
+	{
+		//the reactor may be polled off the render thread, so it leaves reporting to whoever owns it
+		if (mErrorHandler)
+			mErrorHandler(sock,e.what());
+		sock->Close();
+	}
+}
@@ -0,0 +1,62 @@
+
+#ifndef ZEQ_NET_REACTOR_H
+#define ZEQ_NET_REACTOR_H
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include "type.h"
+#include "exception.h"
+#include "socket.h"
+
+#ifndef WIN32
+#include <sys/epoll.h>
+#endif
+
+//Waits on every open connection at once and hands readiness to the sockets themselves
+//Readable sockets get Receive(), and those with sends the kernel had no room for get Flush() once it does. Uses epoll
+//where there is one and select on Windows, which is plenty for the handful of connections a client keeps open
+class NetReactor
+{
+public:
+	//Called with a socket that threw while being serviced, just before it is closed
+	typedef std::function<void(Socket* sock, const char* error)> ErrorHandler;
+
+	NetReactor();
+	~NetReactor();
+	//The socket must be non-blocking, and stays in the reactor until it is removed or closed
+	void	Add(Socket* sock);
+	void	Remove(Socket* sock);
+	//Called by a socket when whether it has sends pending changes
+	void	Update(Socket* sock);
+	void	SetErrorHandler(const ErrorHandler& handler) { mErrorHandler = handler; }
+	//Waits at most timeout milliseconds for any socket to be ready, services all that are, and returns how many
+	//A socket that throws while being serviced is passed to the error handler and closed rather than stopping the others
+	uint32	Poll(uint32 timeout);
+	uint32	GetSocketCount() const { return mSockets.size(); }
+
+private:
+	struct Ready
+	{
+		Socket* sock; //nullptr if it was removed by an earlier handler this poll
+		bool readable;
+		bool writable;
+	};
+
+	//not copyable
+	NetReactor(const NetReactor&);
+	NetReactor& operator=(const NetReactor&);
+
+	uint32	Wait(uint32 timeout);
+	void	Dispatch(uint32 index);
+
+	std::vector<Socket*> mSockets;
+	std::vector<Ready> mReady;
+	ErrorHandler mErrorHandler;
+#ifndef WIN32
+	int		mEpoll;
+	std::vector<epoll_event> mEvents;
+#endif
+};
+
+#endif
@@ -0,0 +1,240 @@
+
+#include "network_thread.h"
+
+NetworkThread::NetworkThread() :
+mInbound(ZEQ_NET_INBOUND_SIZE),
+mOutbound(ZEQ_NET_OUTBOUND_SIZE)
+{
+	for (uint32 i = 0; i < ZEQ_NET_MAX_SESSIONS; ++i)
+	{
+		mStates[i] = SESSION_FREE;
+		mConnections[i].socket = nullptr;
+		mConnections[i].session = nullptr;
+	}
+	mReactor = nullptr;
+	mShutdown = false;
+	mThread = new boost::thread(&NetworkThread::ThreadLoop,this);
+}
+
+NetworkThread::~NetworkThread()
+{
+	mShutdown = true;
+	mThread->join();
+	delete mThread;
+}
+
+uint32 NetworkThread::Now()
+{
+	return (uint32)boost::chrono::duration_cast<boost::chrono::milliseconds>(
+		boost::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint32 NetworkThread::Connect(const char* host, const char* port)
+{
+	uint32 id = 0;
+	while (id < ZEQ_NET_MAX_SESSIONS && mStates[id] != SESSION_FREE)
+		id++;
+	if (id == ZEQ_NET_MAX_SESSIONS)
+	{
+		throw ZEQException("Too many network sessions open");
+	}
+
+	char address[256];
+	int len = snprintf(address,256,"%s:%s",host,port);
+	if (len < 0 || len >= 256 || !mOutbound.Push(ZEQ_NET_CONTROL | id,CONTROL_CONNECT,(const byte*)address,len))
+	{
+		throw ZEQException("Could not queue network session");
+	}
+	mStates[id] = SESSION_CONNECTING;
+	return id;
+}
+
+void NetworkThread::Disconnect(uint32 session)
+{
+	//the session stays open on this side until the network thread says it has closed
+	while (!mOutbound.Push(ZEQ_NET_CONTROL | session,CONTROL_DISCONNECT,nullptr,0))
+		boost::this_thread::yield();
+}
+
+bool NetworkThread::Send(uint32 session, uint16 opcode, const byte* data, uint32 len)
+{
+	return mOutbound.Push(session,opcode,data,len);
+}
+
+uint32 NetworkThread::Dispatch(const Handler& handler)
+{
+	uint32 count = 0;
+	uint16 channel;
+	uint16 opcode;
+	const byte* data;
+	uint32 len;
+	while (mInbound.Peek(channel,opcode,data,len))
+	{
+		if (channel & ZEQ_NET_CONTROL)
+		{
+			uint32 id = channel & ~ZEQ_NET_CONTROL;
+			if (opcode == CONTROL_LOG)
+				Ogre::LogManager::getSingleton().logMessage(std::string((const char*)data,len));
+			else
+				mStates[id] = (opcode == CONTROL_ESTABLISHED) ? SESSION_ESTABLISHED : SESSION_FREE;
+		}
+		else
+		{
+			handler(channel,opcode,data,len);
+			count++;
+		}
+		mInbound.Pop();
+	}
+	return count;
+}
+
+void NetworkThread::Publish(uint16 channel, uint16 opcode, const byte* data, uint32 len)
+{
+	if (len > mInbound.GetMaxLength())
+	{
+		char log[128];
+		snprintf(log,128,"NETWORK: dropped %u byte packet %04x, too big for the inbound ring",len,opcode);
+		Log(channel & ~ZEQ_NET_CONTROL,log);
+		return;
+	}
+	//the stream is reliable, so a packet can't just be dropped; this only happens if the game thread stops taking them
+	while (!mInbound.Push(channel,opcode,data,len))
+	{
+		if (mShutdown)
+			return;
+		boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+	}
+}
+
+void NetworkThread::Log(uint32 id, const char* message)
+{
+	Publish(ZEQ_NET_CONTROL | id,CONTROL_LOG,(const byte*)message,strlen(message));
+}
+
+void NetworkThread::Open(uint32 id, const byte* data, uint32 len)
+{
+	std::string address((const char*)data,len);
+	size_t colon = address.rfind(':');
+	Connection& conn = mConnections[id];
+	try
+	{
+		if (colon == std::string::npos)
+		{
+			throw ZEQException("Network address has no port");
+		}
+		conn.socket = new UDPSocket(address.substr(0,colon).c_str(),address.substr(colon + 1).c_str());
+		conn.session = new EQSession(conn.socket);
+		conn.session->SetHandler([this,id](uint16 opcode, const byte* payload, uint32 size) { Publish(id,opcode,payload,size); });
+		conn.session->SetLogHandler([this,id](const char* message) { Log(id,message); });
+		mReactor->Add(conn.socket);
+		conn.session->Connect(Now());
+		conn.state = EQSession::STATE_CONNECTING;
+	}
+	catch (ZEQException& e)
+	{
+		char log[128];
+		snprintf(log,128,"NETWORK: could not open session %u: %s",id,e.what());
+		Log(id,log);
+		Close(id);
+	}
+}
+
+void NetworkThread::Close(uint32 id)
+{
+	Connection& conn = mConnections[id];
+	delete conn.session;
+	delete conn.socket;
+	conn.session = nullptr;
+	conn.socket = nullptr;
+	Publish(ZEQ_NET_CONTROL | id,CONTROL_CLOSED,nullptr,0);
+}
+
+void NetworkThread::HandleOutbound()
+{
+	uint16 channel;
+	uint16 opcode;
+	const byte* data;
+	uint32 len;
+	while (mOutbound.Peek(channel,opcode,data,len))
+	{
+		uint32 id = channel & ~ZEQ_NET_CONTROL;
+		Connection& conn = mConnections[id];
+		if (channel & ZEQ_NET_CONTROL)
+		{
+			if (opcode == CONTROL_CONNECT)
+				Open(id,data,len);
+			else if (opcode == CONTROL_DISCONNECT && conn.session)
+				conn.session->Disconnect();
+		}
+		else if (conn.session && conn.session->GetState() == EQSession::STATE_ESTABLISHED)
+		{
+			try
+			{
+				conn.session->Send(opcode,data,len);
+			}
+			catch (ZEQException& e)
+			{
+				char log[128];
+				snprintf(log,128,"NETWORK: dropped packet %04x for session %u: %s",opcode,id,e.what());
+				Log(id,log);
+			}
+		}
+		mOutbound.Pop();
+	}
+}
+
+void NetworkThread::ThreadLoop()
+{
+	NetReactor reactor;
+	reactor.SetErrorHandler([this](Socket* sock, const char* error)
+	{
+		for (uint32 i = 0; i < ZEQ_NET_MAX_SESSIONS; ++i)
+		{
+			if (mConnections[i].socket != sock)
+				continue;
+			char log[128];
+			snprintf(log,128,"NETWORK: closing session %u: %s",i,error);
+			Log(i,log);
+		}
+	});
+	mReactor = &reactor;
+	while (!mShutdown)
+	{
+		HandleOutbound();
+		reactor.Poll(ZEQ_NET_POLL_TIMEOUT);
+
+		uint32 now = Now();
+		for (uint32 i = 0; i < ZEQ_NET_MAX_SESSIONS; ++i)
+		{
+			Connection& conn = mConnections[i];
+			if (!conn.session)
+				continue;
+			//a socket the reactor had to close takes its session with it
+			if (!conn.socket->IsOpen())
+			{
+				Close(i);
+				continue;
+			}
+			conn.session->Process(now);
+
+			EQSession::State state = conn.session->GetState();
+			if (state == conn.state)
+				continue;
+			conn.state = state;
+			if (state == EQSession::STATE_ESTABLISHED)
+				Publish(ZEQ_NET_CONTROL | i,CONTROL_ESTABLISHED,nullptr,0);
+			else if (state == EQSession::STATE_CLOSED)
+				Close(i);
+		}
+	}
+
+	for (uint32 i = 0; i < ZEQ_NET_MAX_SESSIONS; ++i)
+	{
+		if (mConnections[i].session)
+		{
+			mConnections[i].session->Disconnect();
+			Close(i);
+		}
+	}
+	mReactor = nullptr;
+}
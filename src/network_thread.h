@@ -0,0 +1,100 @@
+
+#ifndef ZEQ_NETWORK_THREAD_H
+#define ZEQ_NETWORK_THREAD_H
+
+#include <stdio.h>
+#include <string>
+#include <functional>
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include "type.h"
+#include "exception.h"
+#include "socket.h"
+#include "net_reactor.h"
+#include "eq_session.h"
+#include "packet_ring.h"
+
+//sessions open at once: login, world, zone and chat, with room to spare
+#define ZEQ_NET_MAX_SESSIONS 8
+//bytes of application packets waiting to be handled by the game thread, and to be sent by the network thread
+#define ZEQ_NET_INBOUND_SIZE (4 * 1024 * 1024)
+#define ZEQ_NET_OUTBOUND_SIZE (256 * 1024)
+//longest the network thread waits on its sockets, which is also how late a packet queued by the game thread can go
+#define ZEQ_NET_POLL_TIMEOUT 2
+//set on the channel of ring entries that aren't application packets
+#define ZEQ_NET_CONTROL 0x8000
+
+//Runs every session on a thread of its own, so acks, retransmits and bursts of traffic are handled as they come
+//rather than once a frame. The game thread hands it packets to send and takes received ones back through a pair of
+//lock-free rings; opening and closing sessions goes through the same rings, so nothing is shared between the two
+//threads but them
+class NetworkThread
+{
+public:
+	//Called for each received application packet; data is only good for the duration of the call
+	typedef std::function<void(uint32 session, uint16 opcode, const byte* data, uint32 len)> Handler;
+
+	NetworkThread();
+	//Disconnects every session and stops the thread
+	~NetworkThread();
+	//Game thread: opens a session to host:port and returns its id, which is good until it is closed
+	uint32	Connect(const char* host, const char* port);
+	void	Disconnect(uint32 session);
+	//Game thread: queues an application packet for a session; false if the outbound ring has no room left
+	bool	Send(uint32 session, uint16 opcode, const byte* data, uint32 len);
+	//Game thread: hands every packet received so far to handler, in order, and returns how many there were
+	uint32	Dispatch(const Handler& handler);
+	//Game thread: as of the last Dispatch
+	bool	IsEstablished(uint32 session) const { return mStates[session] == SESSION_ESTABLISHED; }
+	bool	IsOpen(uint32 session) const { return mStates[session] != SESSION_FREE; }
+
+private:
+	enum SessionState
+	{
+		SESSION_FREE,
+		SESSION_CONNECTING,
+		SESSION_ESTABLISHED
+	};
+
+	enum Control
+	{
+		CONTROL_CONNECT, //game to network, with "host:port" as its data
+		CONTROL_DISCONNECT,
+		CONTROL_ESTABLISHED, //network to game
+		CONTROL_CLOSED,
+		CONTROL_LOG //network to game, with a line for Ogre's log as its data
+	};
+
+	//everything the network thread keeps for a session
+	struct Connection
+	{
+		UDPSocket* socket;
+		EQSession* session;
+		EQSession::State state; //as last published
+	};
+
+	//not copyable
+	NetworkThread(const NetworkThread&);
+	NetworkThread& operator=(const NetworkThread&);
+
+	void	ThreadLoop();
+	void	HandleOutbound();
+	void	Open(uint32 id, const byte* data, uint32 len);
+	void	Close(uint32 id);
+	//Network thread: passes a packet to the game thread, waiting for room if it has fallen that far behind
+	void	Publish(uint16 channel, uint16 opcode, const byte* data, uint32 len);
+	//Network thread: has the game thread log a line, since Ogre's log can't be used from here
+	void	Log(uint32 id, const char* message);
+	static uint32 Now();
+
+	PacketRing mInbound; //network thread to game thread
+	PacketRing mOutbound; //game thread to network thread
+	SessionState mStates[ZEQ_NET_MAX_SESSIONS]; //game thread only
+	Connection mConnections[ZEQ_NET_MAX_SESSIONS]; //network thread only
+	NetReactor* mReactor; //made on the network thread
+	boost::thread* mThread;
+	boost::atomic<bool> mShutdown;
+};
+
+#endif
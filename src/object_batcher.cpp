@@ -0,0 +1,156 @@
+
+#include "object_batcher.h"
+
+ObjectBatcher::ObjectBatcher()
+{
+	mBatchesBefore = 0;
+	mBatchesAfter = 0;
+}
+
+void ObjectBatcher::AddModel(const char* name, const MeshBuildData& data)
+{
+	mModels[name] = data;
+}
+
+void ObjectBatcher::AddPlacement(const char* name, const Ogre::Vector3& pos, const Ogre::Quaternion& rot, const Ogre::Vector3& scale)
+{
+	auto itr = mModels.find(name);
+	if (itr == mModels.end())
+		return;
+
+	Placement add;
+	add.model = &itr->second;
+	add.pos = pos;
+	add.rot = rot;
+	add.scale = scale;
+	add.regionX = (int32)floor(pos.x / ZEQ_BATCH_REGION_SIZE);
+	add.regionZ = (int32)floor(pos.z / ZEQ_BATCH_REGION_SIZE);
+	mPlacements.push_back(add);
+}
+
+bool ObjectBatcher::CompareRegion(const Placement& a, const Placement& b)
+{
+	if (a.regionX != b.regionX)
+		return a.regionX < b.regionX;
+	return a.regionZ < b.regionZ;
+}
+
+void ObjectBatcher::Build(std::vector<MeshBuildData>& out)
+{
+	std::sort(mPlacements.begin(),mPlacements.end(),CompareRegion);
+
+	std::map<const char*,std::vector<Piece>,CompareMaterial> byMaterial;
+	auto start = mPlacements.begin();
+	while (start != mPlacements.end())
+	{
+		auto stop = start;
+		while (stop != mPlacements.end() && stop->regionX == start->regionX && stop->regionZ == start->regionZ)
+			stop++;
+
+		//every run of every placement in the region, sorted by material
+		byMaterial.clear();
+		for (auto itr = start; itr != stop; itr++)
+		{
+			const std::vector<MeshRun>& runs = itr->model->mRuns;
+			for (auto run = runs.begin(); run != runs.end(); run++)
+			{
+				if (run->mIndexCount == 0)
+					continue;
+				Piece piece;
+				piece.placement = &(*itr);
+				piece.run = &(*run);
+				byMaterial[run->mMaterial].push_back(piece);
+				mBatchesBefore++;
+			}
+		}
+
+		//each region starts a fresh mesh, so none of them span two regions
+		size_t first = out.size();
+		out.push_back(MeshBuildData());
+		for (auto mat = byMaterial.begin(); mat != byMaterial.end(); mat++)
+		{
+			for (auto piece = mat->second.begin(); piece != mat->second.end(); piece++)
+			{
+				AddPiece(*piece,out);
+			}
+		}
+		if (out.back().mIndices.empty())
+			out.pop_back();
+		for (size_t i = first; i < out.size(); ++i)
+		{
+			mBatchesAfter += out[i].mRuns.size();
+		}
+
+		start = stop;
+	}
+	mPlacements.clear();
+}
+
+void ObjectBatcher::AddPiece(const Piece& piece, std::vector<MeshBuildData>& out)
+{
+	const Placement& place = *piece.placement;
+	const MeshBuildData& model = *place.model;
+	const MeshRun& run = *piece.run;
+	uint32 end = run.mIndexStart + run.mIndexCount;
+
+	//count the run's vertices first, so the whole run goes into one mesh
+	mRemap.assign(model.mVertices.size(),-1);
+	uint32 needed = 0;
+	for (uint32 i = run.mIndexStart; i < end; ++i)
+	{
+		int32& remap = mRemap[model.mIndices[i]];
+		if (remap == -1)
+		{
+			remap = 0;
+			needed++;
+		}
+	}
+	if (out.back().mVertices.size() + needed > ZEQ_BATCH_MAX_VERTICES)
+		out.push_back(MeshBuildData());
+
+	MeshBuildData& mesh = out.back();
+	if (mesh.mRuns.empty() || strcmp(mesh.mRuns.back().mMaterial,run.mMaterial) != 0)
+	{
+		MeshRun add;
+		add.mMaterial = run.mMaterial;
+		add.mIndexStart = mesh.mIndices.size();
+		add.mIndexCount = 0;
+		mesh.mRuns.push_back(add);
+	}
+
+	//normals take the inverse scale, so they stay perpendicular under non-uniform scaling
+	Ogre::Vector3 normalScale(
+		place.scale.x != 0.0f ? 1.0f / place.scale.x : 0.0f,
+		place.scale.y != 0.0f ? 1.0f / place.scale.y : 0.0f,
+		place.scale.z != 0.0f ? 1.0f / place.scale.z : 0.0f);
+
+	mRemap.assign(model.mVertices.size(),-1);
+	for (uint32 i = run.mIndexStart; i < end; ++i)
+	{
+		uint16 index = model.mIndices[i];
+		if (mRemap[index] < 0)
+		{
+			MeshVertex v = model.mVertices[index];
+			Ogre::Vector3 pos = place.pos + place.rot * (Ogre::Vector3(v.x,v.y,v.z) * place.scale);
+			Ogre::Vector3 norm = place.rot * (Ogre::Vector3(v.nx,v.ny,v.nz) * normalScale);
+			norm.normalise(); //leaves a zero normal alone
+			v.x = pos.x;
+			v.y = pos.y;
+			v.z = pos.z;
+			v.nx = norm.x;
+			v.ny = norm.y;
+			v.nz = norm.z;
+			mRemap[index] = mesh.mVertices.size();
+			mesh.mVertices.push_back(v);
+			mesh.mBounds.merge(pos);
+		}
+		mesh.mIndices.push_back(mRemap[index]);
+	}
+	mesh.mRuns.back().mIndexCount += run.mIndexCount;
+}
+
+void ObjectBatcher::Clear()
+{
+	mModels.clear();
+	mPlacements.clear();
+}
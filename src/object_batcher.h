@@ -0,0 +1,73 @@
+
+#ifndef ZEQ_OBJECT_BATCHER_H
+#define ZEQ_OBJECT_BATCHER_H
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include "type.h"
+#include "mesh_builder.h"
+
+//matches the dimensions of the static geometry's regions, so every merged mesh falls in exactly one of them
+#define ZEQ_BATCH_REGION_SIZE 1000.0f
+//a merged mesh is split once it reaches this many vertices, to keep its indices 16 bit
+#define ZEQ_BATCH_MAX_VERTICES 0xFFFF
+
+//Merges placed static objects into a few large meshes, with their vertices already moved into world space
+//Placements are grouped by region and then by material, so every region draws each of its materials at most once,
+//plus one more draw for each further 64K vertices of that material; the old path drew every submesh of every placement
+class ObjectBatcher
+{
+public:
+	ObjectBatcher();
+	//Keeps a copy of an object model's built geometry; its runs should already refer to their final materials,
+	//and the material names have to stay valid until Build
+	void	AddModel(const char* name, const MeshBuildData& data);
+	bool	HasModel(const char* name) const { return mModels.count(name) != 0; }
+	//Queues a placement of a model added earlier, with the same transform the scene node would have had
+	void	AddPlacement(const char* name, const Ogre::Vector3& pos, const Ogre::Quaternion& rot, const Ogre::Vector3& scale);
+	//Merges every placement queued so far into out, one entry per mesh to create, and forgets the placements
+	void	Build(std::vector<MeshBuildData>& out);
+	//Draws the placements would have taken as separate entities, and the draws of the merged meshes, over every Build
+	uint32	GetBatchesBefore() const { return mBatchesBefore; }
+	uint32	GetBatchesAfter() const { return mBatchesAfter; }
+	//Drops the models, once their archive is done with
+	void	Clear();
+
+private:
+	struct Placement
+	{
+		const MeshBuildData* model;
+		Ogre::Vector3 pos;
+		Ogre::Quaternion rot;
+		Ogre::Vector3 scale;
+		int32 regionX;
+		int32 regionZ;
+	};
+
+	struct Piece
+	{
+		const Placement* placement;
+		const MeshRun* run;
+	};
+
+	struct CompareMaterial
+	{
+		bool operator()(const char* a, const char* b) const { return strcmp(a,b) < 0; }
+	};
+
+	static bool CompareRegion(const Placement& a, const Placement& b);
+	void	AddPiece(const Piece& piece, std::vector<MeshBuildData>& out);
+
+	std::unordered_map<std::string,MeshBuildData> mModels;
+	std::vector<Placement> mPlacements;
+	std::vector<int32> mRemap; //model vertex to merged vertex, for the piece being added
+	uint32	mBatchesBefore;
+	uint32	mBatchesAfter;
+};
+
+#endif
@@ -0,0 +1,48 @@
+
+#include "opcode_dispatch.h"
+
+OpcodeDispatcher::OpcodeDispatcher()
+{
+	memset(mTable,0,sizeof(mTable));
+	memset(&mStats,0,sizeof(mStats));
+}
+
+void OpcodeDispatcher::RegisterRaw(uint16 opcode, uint32 minLen, const RawHandler& handler)
+{
+	if (mTable[opcode] != 0)
+	{
+		Entry& entry = mEntries[mTable[opcode] - 1];
+		entry.handler = handler;
+		entry.minLen = minLen;
+		return;
+	}
+	if (mEntries.size() >= 0xFFFF)
+	{
+		throw ZEQException("Too many opcode handlers registered");
+	}
+	Entry entry;
+	entry.handler = handler;
+	entry.minLen = minLen;
+	mEntries.push_back(entry);
+	mTable[opcode] = mEntries.size();
+}
+
+bool OpcodeDispatcher::Dispatch(uint16 opcode, const byte* data, uint32 len)
+{
+	uint16 index = mTable[opcode];
+	if (index == 0)
+	{
+		mStats.unhandled++;
+		return false;
+	}
+	const Entry& entry = mEntries[index - 1];
+	//the server is as likely as anything to send a malformed packet, which shouldn't take the client down with it
+	if (len < entry.minLen)
+	{
+		mStats.tooShort++;
+		return true;
+	}
+	mStats.dispatched++;
+	entry.handler(data,len);
+	return true;
+}
@@ -0,0 +1,112 @@
+
+#ifndef ZEQ_OPCODE_DISPATCH_H
+#define ZEQ_OPCODE_DISPATCH_H
+
+#include <string.h>
+#include <deque>
+#include <functional>
+#include "type.h"
+#include "exception.h"
+#include "packet.h"
+
+//application opcodes are 16 bits, so every one of them has a slot
+#define ZEQ_OPCODE_COUNT 65536
+
+//Read-only typed view over an application packet that still lives in the buffer it arrived in
+//T is the packet's packed fixed layout; whatever follows it (names, chat text, arrays of entries) is reached through
+//the tail accessors, which never read past the end of the packet. Nothing is copied, so a view is only valid for
+//as long as the data it was made from
+template<typename T>
+class PacketView
+{
+public:
+	PacketView(const byte* data, uint32 len) : mData(data), mLen(len) { }
+	PacketView(const Packet* packet) : mData(packet->GetData()), mLen(packet->GetLen()) { }
+
+	//True if the packet holds at least a whole T; the dispatcher only hands on views that do
+	bool	IsValid() const { return mLen >= sizeof(T); }
+	const T& Get() const { return *reinterpret_cast<const T*>(mData); }
+	const T* operator->() const { return reinterpret_cast<const T*>(mData); }
+	const byte* GetData() const { return mData; }
+	uint32	GetLen() const { return mLen; }
+
+	//Bytes following the fixed layout
+	const byte* GetTail() const { return mData + sizeof(T); }
+	uint32	GetTailLen() const { return mLen - sizeof(T); }
+
+	//Element i of an array of E starting offset bytes into the tail, or nullptr if it runs past the end of the packet
+	template<typename E>
+	const E* GetElement(uint32 i, uint32 offset = 0) const
+	{
+		uint64 end = (uint64)offset + ((uint64)i + 1) * sizeof(E);
+		if (end > GetTailLen())
+			return nullptr;
+		return reinterpret_cast<const E*>(GetTail() + offset + i * sizeof(E));
+	}
+
+	//String starting offset bytes into the tail; returns its length, up to the terminator or the end of the packet
+	//if there isn't one, so str is not necessarily null terminated
+	uint32	GetString(uint32 offset, const char*& str) const
+	{
+		if (offset >= GetTailLen())
+		{
+			str = "";
+			return 0;
+		}
+		str = (const char*)GetTail() + offset;
+		const void* end = memchr(str,0,GetTailLen() - offset);
+		return end ? (const char*)end - str : GetTailLen() - offset;
+	}
+
+private:
+	const byte*	mData;
+	uint32		mLen;
+};
+
+//Routes application packets to their handlers by opcode
+//Opcodes index a flat table straight to the handler's entry, so dispatch costs the same for every opcode and
+//allocates nothing. Handlers are registered against the packed layout their packet starts with, and packets too
+//short to hold it are dropped and counted rather than handed on
+class OpcodeDispatcher
+{
+public:
+	typedef std::function<void(const byte* data, uint32 len)> RawHandler;
+
+	struct Stats
+	{
+		uint32 dispatched;
+		uint32 unhandled;
+		uint32 tooShort;
+	};
+
+	OpcodeDispatcher();
+	//Handler is called with a view over each packet of this opcode; registering an opcode again replaces its handler
+	template<typename T>
+	void	Register(uint16 opcode, const std::function<void(const PacketView<T>& view)>& handler)
+	{
+		RegisterRaw(opcode,sizeof(T),[handler](const byte* data, uint32 len) { handler(PacketView<T>(data,len)); });
+	}
+	//For packets with no fixed layout, or ones handled by hand; those shorter than minLen are dropped
+	void	RegisterRaw(uint16 opcode, uint32 minLen, const RawHandler& handler);
+	//False if nothing is registered for the opcode
+	bool	Dispatch(uint16 opcode, const byte* data, uint32 len);
+	bool	IsRegistered(uint16 opcode) const { return mTable[opcode] != 0; }
+	const Stats& GetStats() const { return mStats; }
+
+private:
+	struct Entry
+	{
+		RawHandler handler;
+		uint32 minLen;
+	};
+
+	//not copyable
+	OpcodeDispatcher(const OpcodeDispatcher&);
+	OpcodeDispatcher& operator=(const OpcodeDispatcher&);
+
+	uint16	mTable[ZEQ_OPCODE_COUNT]; //0 for none, otherwise one past the opcode's index in mEntries
+	std::deque<Entry> mEntries; //a deque so a handler registering another can't move the one being called
+	Stats	mStats;
+};
+
+#endif
@@ -1,47 +1,177 @@
 
 #include "packet.h"
 
-Packet::~Packet()
+PacketPool::PacketPool()
 {
-	delete[] mData;
+	uint32 sizes[ZEQ_PACKET_CLASSES] = ZEQ_PACKET_CLASS_SIZES;
+	for (uint32 i = 0; i < ZEQ_PACKET_CLASSES; ++i)
+	{
+		mClasses[i].blockSize = sizes[i];
+		mClasses[i].free = nullptr;
+	}
 }
 
+PacketPool::~PacketPool()
+{
+	for (uint32 i = 0; i < ZEQ_PACKET_CLASSES; ++i)
+	{
+		std::vector<byte*>& slabs = mClasses[i].slabs;
+		for (auto itr = slabs.begin(); itr != slabs.end(); itr++)
+		{
+			delete[] *itr;
+		}
+	}
+}
 
-TCPPacket::TCPPacket(const byte* data, size_t len, bool inbound)
+PacketPool& PacketPool::GetShared()
 {
-	if (inbound) {
-		//just copy data
-		mData = new byte[len];
-		memcpy(mData,data,len);
-		mLen = len;
+	static PacketPool pool;
+	return pool;
+}
+
+void* PacketPool::Allocate(uint32& size, uint8& sizeClass)
+{
+	uint32 i = 0;
+	while (i < ZEQ_PACKET_CLASSES && mClasses[i].blockSize < size)
+		i++;
+	if (i == ZEQ_PACKET_CLASSES)
+	{
+		sizeClass = ZEQ_PACKET_UNPOOLED;
+		return new byte[size];
+	}
+
+	sizeClass = i;
+	SizeClass& sc = mClasses[i];
+	size = sc.blockSize;
+	boost::lock_guard<boost::mutex> lock(sc.mutex);
+	if (!sc.free)
+	{
+		//thread a new slab's blocks onto the free list
+		uint32 count = std::max<uint32>(ZEQ_PACKET_SLAB_SIZE / sc.blockSize,4);
+		byte* slab = new byte[count * sc.blockSize];
+		sc.slabs.push_back(slab);
+		for (uint32 j = count; j > 0; --j)
+		{
+			FreeBlock* block = (FreeBlock*)(slab + (j - 1) * sc.blockSize);
+			block->next = sc.free;
+			sc.free = block;
+		}
+	}
+	FreeBlock* block = sc.free;
+	sc.free = block->next;
+	return block;
+}
+
+void PacketPool::Free(void* block, uint8 sizeClass)
+{
+	if (sizeClass == ZEQ_PACKET_UNPOOLED)
+	{
+		delete[] (byte*)block;
+		return;
 	}
-	else {
-		//outbound, must add header
-		mData = new byte[len + ZEQ_TCP_HEADER_SIZE];
-		//set header fields
-		//...
-		//set data
-		memcpy(&mData[ZEQ_TCP_HEADER_SIZE],data,len);
-		mLen = len + ZEQ_TCP_HEADER_SIZE;
+	SizeClass& sc = mClasses[sizeClass];
+	boost::lock_guard<boost::mutex> lock(sc.mutex);
+	FreeBlock* free = (FreeBlock*)block;
+	free->next = sc.free;
+	sc.free = free;
+}
+
+
+Packet* Packet::Create(uint32 len, uint32 headroom)
+{
+	uint32 size = sizeof(Packet) + headroom + len;
+	uint8 sizeClass;
+	//whatever the block has past what was asked for is left for the data to grow into
+	void* block = PacketPool::GetShared().Allocate(size,sizeClass);
+
+	Packet* packet = new (block) Packet();
+	packet->mRefs.store(1,boost::memory_order_relaxed);
+	packet->mData = (byte*)(packet + 1) + headroom;
+	packet->mEnd = (byte*)block + size;
+	packet->mLen = len;
+	packet->mSizeClass = sizeClass;
+	return packet;
+}
+
+Packet* Packet::Create(const byte* data, uint32 len, uint32 headroom)
+{
+	Packet* packet = Create(len,headroom);
+	memcpy(packet->mData,data,len);
+	return packet;
+}
+
+void Packet::Release()
+{
+	if (mRefs.fetch_sub(1,boost::memory_order_release) == 1)
+	{
+		//everything the other threads did with it happens before it goes back
+		boost::atomic_thread_fence(boost::memory_order_acquire);
+		uint8 sizeClass = mSizeClass;
+		this->~Packet();
+		PacketPool::GetShared().Free(this,sizeClass);
+	}
+}
+
+void Packet::SetLen(uint32 len)
+{
+	if (len > GetCapacity())
+	{
+		throw ZEQException("Packet length past the end of its block");
+	}
+	mLen = len;
+}
+
+byte* Packet::Prepend(uint32 len)
+{
+	if (len > GetHeadroom())
+	{
+		throw ZEQException("Not enough headroom in packet");
+	}
+	mData -= len;
+	mLen += len;
+	return mData;
+}
+
+void Packet::Strip(uint32 len)
+{
+	if (len > mLen)
+	{
+		throw ZEQException("Stripped past the end of a packet");
+	}
+	mData += len;
+	mLen -= len;
+}
+
+
+Packet* TCPPacket::Create(const byte* data, size_t len, bool inbound)
+{
+	if (inbound)
+	{
+		//just copy data
+		return Packet::Create(data,len,0);
 	}
+	//outbound, the header goes in front in place
+	Packet* packet = Packet::Create(data,len);
+	byte* header = packet->Prepend(ZEQ_TCP_HEADER_SIZE);
+	//set header fields
+	//...
+	memset(header,0,ZEQ_TCP_HEADER_SIZE);
+	return packet;
 }
 
 
-UDPPacket::UDPPacket(const byte* data, size_t len, bool inbound)
+Packet* UDPPacket::Create(const byte* data, size_t len, bool inbound)
 {
-	if (inbound) {
+	if (inbound)
+	{
 		//just copy data
-		mData = new byte[len];
-		memcpy(mData,data,len);
-		mLen = len;
-	}
-	else {
-		//outbound, must add header
-		mData = new byte[len + ZEQ_UDP_HEADER_SIZE];
-		//set header fields
-		//...
-		//set data
-		memcpy(&mData[ZEQ_UDP_HEADER_SIZE],data,len);
-		mLen = len + ZEQ_UDP_HEADER_SIZE;
+		return Packet::Create(data,len,0);
 	}
+	//outbound, the header goes in front in place
+	Packet* packet = Packet::Create(data,len);
+	byte* header = packet->Prepend(ZEQ_UDP_HEADER_SIZE);
+	//set header fields
+	//...
+	memset(header,0,ZEQ_UDP_HEADER_SIZE);
+	return packet;
 }
@@ -1,35 +1,108 @@
-
 #ifndef ZEQ_PACKET_H
 #define ZEQ_PACKET_H
 
 #include <cstring>
+#include <vector>
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
 #include "type.h"
+#include "exception.h"
 
 #define ZEQ_TCP_HEADER_SIZE 8 //made up numbers, look up later
 #define ZEQ_UDP_HEADER_SIZE 12
+//room left in front of every packet's data so protocol layers can prepend their headers in place
+#define ZEQ_PACKET_HEADROOM 16
+//block sizes the pool hands out, packet bookkeeping and headroom included; anything bigger is allocated on its own
+#define ZEQ_PACKET_CLASSES 5
+#define ZEQ_PACKET_CLASS_SIZES { 256, 1024, 4096, 16384, 65536 }
+//memory taken from the system at a time for a size class
+#define ZEQ_PACKET_SLAB_SIZE (256 * 1024)
+#define ZEQ_PACKET_UNPOOLED 0xff
+
+//Size-classed slabs of fixed blocks that packets are carved out of
+//Freed blocks go back on their class's free list, so after warming up a steady stream of packets allocates nothing
+//Packets can be freed on a different thread than they were made on, so each class has its own lock
+class PacketPool
+{
+public:
+	PacketPool();
+	~PacketPool();
+	//Returns a block of at least size bytes, with size raised to what the block really holds and the class to give
+	//back with it
+	void*	Allocate(uint32& size, uint8& sizeClass);
+	void	Free(void* block, uint8 sizeClass);
+
+	static PacketPool& GetShared();
+
+private:
+	struct FreeBlock
+	{
+		FreeBlock* next;
+	};
 
+	struct SizeClass
+	{
+		uint32 blockSize;
+		FreeBlock* free;
+		std::vector<byte*> slabs;
+		boost::mutex mutex;
+	};
+
+	//not copyable
+	PacketPool(const PacketPool&);
+	PacketPool& operator=(const PacketPool&);
+
+	SizeClass mClasses[ZEQ_PACKET_CLASSES];
+};
+
+//Reference counted packet whose bookkeeping, headroom and data share one pooled block
+//One packet can be queued to send, held for retransmit and logged at once without being copied; the last Release
+//hands its block back to the pool. Data starts ZEQ_PACKET_HEADROOM bytes in, and Prepend grows it back toward the start
 class Packet
 {
 public:
-	virtual ~Packet();
+	//A packet with room for len bytes after headroom bytes of headroom; its one reference belongs to the caller
+	static Packet* Create(uint32 len, uint32 headroom = ZEQ_PACKET_HEADROOM);
+	static Packet* Create(const byte* data, uint32 len, uint32 headroom = ZEQ_PACKET_HEADROOM);
+	void	AddRef() { mRefs.fetch_add(1,boost::memory_order_relaxed); }
+	void	Release();
 	const byte* GetData() const { return mData; }
-	const size_t GetLen() const { return mLen; }
-protected:
+	byte*	GetData() { return mData; }
+	size_t	GetLen() const { return mLen; }
+	uint32	GetHeadroom() const { return mData - (byte*)(this + 1); }
+	//Most the data can grow to from where it starts now
+	uint32	GetCapacity() const { return mEnd - mData; }
+	void	SetLen(uint32 len);
+	//Moves the start back over len bytes of headroom and returns it, for the caller to write a header into
+	byte*	Prepend(uint32 len);
+	//Moves the start forward past a header that has been read
+	void	Strip(uint32 len);
+
+private:
+	//only made and destroyed through Create and Release
+	Packet() {}
+	~Packet() {}
+	Packet(const Packet&);
+	Packet& operator=(const Packet&);
+
+	boost::atomic<uint32> mRefs;
 	byte*	mData;
-	size_t	mLen;
+	byte*	mEnd;
+	uint32	mLen;
+	uint8	mSizeClass; //ZEQ_PACKET_UNPOOLED if it was too big for any of them
 };
 
-class TCPPacket : public Packet
+class TCPPacket
 {
 public:
-	TCPPacket(const byte* data, size_t len, bool inbound = false);
+	//Inbound packets are copied as they are; outbound ones get a header prepended in front of the data
+	static Packet* Create(const byte* data, size_t len, bool inbound = false);
 };
 
-class UDPPacket : public Packet
+class UDPPacket
 {
 public:
-	UDPPacket(const byte* data, size_t len, bool inbound = false);
-	void SetAckReq();
+	static Packet* Create(const byte* data, size_t len, bool inbound = false);
 };
 
 #endif
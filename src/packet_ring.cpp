@@ -0,0 +1,93 @@
+
+#include "packet_ring.h"
+
+#define ZEQ_RING_WRAP 0xFFFFFFFF
+
+PacketRing::PacketRing(uint32 capacity)
+{
+	if (capacity < 64 || (capacity & (capacity - 1)) != 0)
+	{
+		throw ZEQException("Packet ring capacity must be a power of two");
+	}
+	mData = new byte[capacity];
+	mCapacity = capacity;
+	mMask = capacity - 1;
+	mTail.store(0,boost::memory_order_relaxed);
+	mHead.store(0,boost::memory_order_relaxed);
+	mHeadCache = 0;
+	mTailCache = 0;
+	mPeekSize = 0;
+}
+
+PacketRing::~PacketRing()
+{
+	delete[] mData;
+}
+
+bool PacketRing::Push(uint16 channel, uint16 opcode, const byte* data, uint32 len)
+{
+	if (len > GetMaxLength())
+		return false;
+
+	uint32 tail = mTail.load(boost::memory_order_relaxed);
+	uint32 offset = tail & mMask;
+	uint32 size = RecordSize(len);
+	//a packet is never split, so one that would run off the end starts over at the beginning instead
+	uint32 skip = (size > mCapacity - offset) ? mCapacity - offset : 0;
+	if (skip + size > mCapacity - (tail - mHeadCache))
+	{
+		mHeadCache = mHead.load(boost::memory_order_acquire);
+		if (skip + size > mCapacity - (tail - mHeadCache))
+			return false;
+	}
+
+	if (skip)
+	{
+		//records are 8 byte aligned, so there is always room for the marker
+		((Record*)(mData + offset))->len = ZEQ_RING_WRAP;
+		tail += skip;
+		offset = 0;
+	}
+	Record* record = (Record*)(mData + offset);
+	record->len = len;
+	record->channel = channel;
+	record->opcode = opcode;
+	if (len)
+		memcpy(record + 1,data,len);
+	mTail.store(tail + size,boost::memory_order_release);
+	return true;
+}
+
+bool PacketRing::Peek(uint16& channel, uint16& opcode, const byte*& data, uint32& len)
+{
+	uint32 head = mHead.load(boost::memory_order_relaxed);
+	if (head == mTailCache)
+	{
+		mTailCache = mTail.load(boost::memory_order_acquire);
+		if (head == mTailCache)
+			return false;
+	}
+
+	uint32 offset = head & mMask;
+	Record* record = (Record*)(mData + offset);
+	if (record->len == ZEQ_RING_WRAP)
+	{
+		//the producer only wraps to write a packet, so there is one waiting at the start
+		head += mCapacity - offset;
+		mHead.store(head,boost::memory_order_release);
+		record = (Record*)mData;
+	}
+	channel = record->channel;
+	opcode = record->opcode;
+	data = (const byte*)(record + 1);
+	len = record->len;
+	mPeekSize = RecordSize(len);
+	return true;
+}
+
+void PacketRing::Pop()
+{
+	uint32 head = mHead.load(boost::memory_order_relaxed);
+	mHead.store(head + mPeekSize,boost::memory_order_release);
+	mPeekSize = 0;
+}
@@ -0,0 +1,60 @@
+
+#ifndef ZEQ_PACKET_RING_H
+#define ZEQ_PACKET_RING_H
+
+#include <string.h>
+#include <boost/atomic.hpp>
+#include "type.h"
+#include "exception.h"
+
+//keeps the producer's and consumer's indices from sharing a cache line
+#define ZEQ_CACHE_LINE 64
+
+//Bounded lock-free ring of variable length packets between exactly one producer thread and one consumer thread
+//Each packet is copied in once, contiguously, so the consumer reads it in place until it pops it. Each side only
+//reads the other's index when its own cached copy says the ring is full or empty
+class PacketRing
+{
+public:
+	//capacity is in bytes and must be a power of two
+	PacketRing(uint32 capacity);
+	~PacketRing();
+	//Producer: copies a packet in; false if there isn't room for it yet
+	bool	Push(uint16 channel, uint16 opcode, const byte* data, uint32 len);
+	//Consumer: the oldest packet, if there is one; data is good until it is popped
+	bool	Peek(uint16& channel, uint16& opcode, const byte*& data, uint32& len);
+	void	Pop();
+	//Largest packet that can ever be pushed
+	uint32	GetMaxLength() const { return mCapacity / 2 - sizeof(Record); }
+
+private:
+	struct Record
+	{
+		uint32 len; //ZEQ_RING_WRAP where the producer skipped to the start
+		uint16 channel;
+		uint16 opcode;
+	};
+
+	//not copyable
+	PacketRing(const PacketRing&);
+	PacketRing& operator=(const PacketRing&);
+
+	static uint32 RecordSize(uint32 len) { return (sizeof(Record) + len + 7) & ~7u; }
+
+	byte*	mData;
+	uint32	mCapacity;
+	uint32	mMask;
+
+	char	mPad0[ZEQ_CACHE_LINE];
+	boost::atomic<uint32> mTail; //bytes ever written; only the producer stores it
+	uint32	mHeadCache; //producer's last look at mHead
+
+	char	mPad1[ZEQ_CACHE_LINE];
+	boost::atomic<uint32> mHead; //bytes ever consumed; only the consumer stores it
+	uint32	mTailCache; //consumer's last look at mTail
+	uint32	mPeekSize; //bytes the peeked packet takes, popped along with it
+
+	char	mPad2[ZEQ_CACHE_LINE];
+};
+
+#endif
@@ -0,0 +1,108 @@
+
+#include "pose_cache.h"
+
+PoseCache::PoseCache(SkeletonSet* skeleSet)
+{
+	mSkeletonSet = skeleSet;
+	mBones.resize(skeleSet->GetBoneNum());
+
+	uint16 maxVertices = 0;
+	for (uint8 i = 0; i < skeleSet->GetMeshNum(); ++i)
+		maxVertices = std::max(maxVertices,skeleSet->GetMeshData(i)->vertexCount);
+	mVertexScratch.resize(maxVertices * 3);
+	mNormalScratch.resize(maxVertices * 3);
+}
+
+PoseCache::~PoseCache()
+{
+	//instances must be destroyed first, but the poses go either way
+	for (auto itr = mPoses.begin(); itr != mPoses.end(); itr++)
+		delete itr->second;
+}
+
+SkinnedPose* PoseCache::Acquire(Animation* anim, uint32 frame)
+{
+	std::pair<Animation*,uint32> key(anim,frame);
+	auto found = mPoses.find(key);
+	if (found != mPoses.end())
+	{
+		SkinnedPose* pose = found->second;
+		if (pose->mUsers++ == 0)
+			mIdle.erase(pose->mIdlePos);
+		return pose;
+	}
+
+	//reuse the buffers of the oldest pose nobody is drawing once we are keeping enough of them
+	SkinnedPose* pose;
+	if (mIdle.size() >= ZEQ_POSE_CACHE_IDLE)
+	{
+		pose = mIdle.front();
+		mIdle.pop_front();
+		mPoses.erase(std::make_pair(pose->mAnimation,pose->mFrame));
+	}
+	else
+	{
+		pose = CreatePose();
+	}
+
+	pose->mAnimation = anim;
+	pose->mFrame = frame;
+	pose->mUsers = 1;
+	SkinPose(pose);
+	mPoses[key] = pose;
+	return pose;
+}
+
+void PoseCache::Release(SkinnedPose* pose)
+{
+	if (--pose->mUsers > 0)
+		return;
+	mIdle.push_back(pose);
+	pose->mIdlePos = --mIdle.end();
+
+	while (mIdle.size() > ZEQ_POSE_CACHE_IDLE)
+	{
+		SkinnedPose* old = mIdle.front();
+		mIdle.pop_front();
+		mPoses.erase(std::make_pair(old->mAnimation,old->mFrame));
+		delete old;
+	}
+}
+
+SkinnedPose* PoseCache::CreatePose()
+{
+	Ogre::HardwareBufferManager* hardwareMgr = Ogre::HardwareBufferManager::getSingletonPtr();
+	SkinnedPose* pose = new SkinnedPose();
+	uint8 meshNum = mSkeletonSet->GetMeshNum();
+	pose->mVertexBuffers.resize(meshNum);
+	pose->mNormalBuffers.resize(meshNum);
+
+	for (uint8 i = 0; i < meshNum; ++i)
+	{
+		MeshData* meshdata = mSkeletonSet->GetMeshData(i);
+		if (meshdata->mesh.isNull())
+			continue;
+		//same layout as sources 0 and 1 of the set's meshes
+		pose->mVertexBuffers[i] = hardwareMgr->createVertexBuffer(sizeof(float) * 3,meshdata->vertexCount,Ogre::HardwareBuffer::HBU_DYNAMIC_WRITE_ONLY);
+		pose->mNormalBuffers[i] = hardwareMgr->createVertexBuffer(sizeof(float) * 3,meshdata->vertexCount,Ogre::HardwareBuffer::HBU_DYNAMIC_WRITE_ONLY);
+	}
+
+	return pose;
+}
+
+void PoseCache::SkinPose(SkinnedPose* pose)
+{
+	mSkeletonSet->GetPose(pose->mAnimation,pose->mFrame,&mBones[0]);
+
+	for (uint8 i = 0; i < mSkeletonSet->GetMeshNum(); ++i)
+	{
+		if (pose->mVertexBuffers[i].isNull())
+			continue;
+		mSkeletonSet->Skin(&mBones[0],i,&mVertexScratch[0],&mNormalScratch[0]);
+
+		Ogre::HardwareVertexBufferSharedPtr& vbuf = pose->mVertexBuffers[i];
+		Ogre::HardwareVertexBufferSharedPtr& nbuf = pose->mNormalBuffers[i];
+		vbuf->writeData(0,vbuf->getSizeInBytes(),&mVertexScratch[0],true);
+		nbuf->writeData(0,nbuf->getSizeInBytes(),&mNormalScratch[0],true);
+	}
+}
@@ -0,0 +1,49 @@
+
+#ifndef ZEQ_POSE_CACHE_H
+#define ZEQ_POSE_CACHE_H
+
+#include <vector>
+#include <list>
+#include <map>
+#include "type.h"
+#include "skeleton.h"
+
+//poses no instance is using that are kept around per cache before their buffers are reused
+#define ZEQ_POSE_CACHE_IDLE 64
+
+//One skinned frame of a SkeletonSet, as position and normal buffers per mesh of the set
+struct SkinnedPose
+{
+	std::vector<Ogre::HardwareVertexBufferSharedPtr> mVertexBuffers; //null where the set has no mesh
+	std::vector<Ogre::HardwareVertexBufferSharedPtr> mNormalBuffers;
+	Animation* mAnimation;
+	uint32 mFrame;
+	uint32 mUsers;
+	std::list<SkinnedPose*>::iterator mIdlePos; //only valid while mUsers is 0
+};
+
+//Skinned poses of one SkeletonSet, keyed by animation and quantized frame
+//A frame is skinned the first time an instance reaches it and shared by every instance on it afterwards
+class PoseCache
+{
+public:
+	PoseCache(SkeletonSet* skeleSet);
+	~PoseCache();
+	SkeletonSet* GetSkeletonSet() const { return mSkeletonSet; }
+	//Every pose returned must be given back with Release once the caller is done drawing it
+	SkinnedPose* Acquire(Animation* anim, uint32 frame);
+	void	Release(SkinnedPose* pose);
+
+private:
+	SkinnedPose* CreatePose();
+	void	SkinPose(SkinnedPose* pose);
+
+	SkeletonSet* mSkeletonSet;
+	std::map<std::pair<Animation*,uint32>,SkinnedPose*> mPoses;
+	std::list<SkinnedPose*> mIdle; //least recently used first
+	std::vector<SkinMatrix> mBones;
+	std::vector<float> mVertexScratch;
+	std::vector<float> mNormalScratch;
+};
+
+#endif
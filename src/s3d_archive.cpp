@@ -0,0 +1,363 @@
+
+#include "s3d_archive.h"
+
+static void Decompress(const byte* src, byte* dst, uint32 slen, uint32 dlen)
+{
+	//blocks are inflated on whichever thread gets them, each through its own long-lived stream
+	if (!Inflater::GetLocal().Inflate(src,slen,dst,dlen))
+	{
+		throw ZEQException("ZLib inflation failed");
+	}
+}
+
+//Headers only used during initial loading
+struct S3DHeader
+{
+	uint32 dirOffset;
+	char magicWord[4];
+	uint32 unknown;
+};
+
+struct S3DBlockHeader
+{
+	uint32 deflatedLen;
+	uint32 inflatedLen;
+};
+
+struct S3DDirEntry
+{
+	uint32 CRC;
+	uint32 offset;
+	uint32 inflatedLen;
+};
+
+S3DArchive::S3DArchive()
+{
+	mNameData = nullptr;
+	mParallel = true;
+	mCRCLookup = false;
+}
+
+S3DArchive::~S3DArchive()
+{
+	Close();
+}
+
+bool S3DArchive::Open(const char* path)
+{
+	Close();
+	if (!mFile.Open(path))
+		return false;
+
+	try
+	{
+		const byte* data = mFile.GetData();
+		size_t len = mFile.GetLen();
+
+		S3DHeader header;
+		if (len < sizeof(S3DHeader))
+			throw ZEQException("Invalid S3D file header");
+		memcpy(&header,data,sizeof(S3DHeader));
+		if (header.magicWord[0] != 'P' || header.magicWord[1] != 'F' || header.magicWord[2] != 'S' || header.magicWord[3] != ' ')
+		{
+			throw ZEQException("Invalid S3D file header");
+		}
+#ifdef ZEQ_ENDIAN_CHECK
+		header.dirOffset = endian_uint32(header.dirOffset);
+#endif
+
+		uint32 nDirEntries;
+		if (header.dirOffset > len - sizeof(uint32))
+			throw ZEQException("Truncated S3D directory");
+		memcpy(&nDirEntries,&data[header.dirOffset],sizeof(uint32));
+#ifdef ZEQ_ENDIAN_CHECK
+		nDirEntries = endian_uint32(nDirEntries);
+#endif
+		size_t pos = header.dirOffset + sizeof(uint32);
+		if (nDirEntries == 0 || (len - pos) / sizeof(S3DDirEntry) < nDirEntries)
+			throw ZEQException("Truncated S3D directory");
+
+		mEntries.resize(nDirEntries);
+		for (uint32 i = 0; i < nDirEntries; ++i)
+		{
+			S3DDirEntry dirEntry;
+			memcpy(&dirEntry,&data[pos],sizeof(S3DDirEntry));
+			pos += sizeof(S3DDirEntry);
+#ifdef ZEQ_ENDIAN_CHECK
+			dirEntry.CRC = endian_uint32(dirEntry.CRC);
+			dirEntry.offset = endian_uint32(dirEntry.offset);
+			dirEntry.inflatedLen = endian_uint32(dirEntry.inflatedLen);
+#endif
+			Entry& entry = mEntries[i];
+			entry.mCRC = dirEntry.CRC;
+			entry.mOffset = dirEntry.offset;
+			entry.mInflatedLen = dirEntry.inflatedLen;
+			entry.mFile.mFileName = "";
+			entry.mFile.mDataSize = dirEntry.inflatedLen;
+			entry.mFile.mData = nullptr;
+		}
+
+		//S3D Directory Entries are listed in order of CRC, but the list of file names are in order of entry offset
+		std::sort(mEntries.begin(),mEntries.end(),CompareOffset);
+
+		//final file entry contains file names; it is the only entry we always inflate
+		Entry& nameEntry = mEntries.back();
+		Inflate(nameEntry);
+		mNameData = nameEntry.mFile.mData;
+		uint32 nameDataLen = nameEntry.mInflatedLen;
+		mEntries.pop_back();
+
+		uint32 nNames;
+		if (nameDataLen < sizeof(uint32))
+			throw ZEQException("Truncated S3D file name list");
+		memcpy(&nNames,mNameData,sizeof(uint32));
+#ifdef ZEQ_ENDIAN_CHECK
+		nNames = endian_uint32(nNames);
+#endif
+		if (nNames > mEntries.size())
+			nNames = mEntries.size();
+
+		//the directory is keyed by the CRC of each name, so if ours agree lookups can go straight to it
+		mCRCLookup = true;
+		pos = sizeof(uint32);
+		for (uint32 i = 0; i < nNames; ++i)
+		{
+			//pascal-style strings with 32bit len field
+			uint32 nameLen;
+			if (pos + sizeof(uint32) > nameDataLen)
+				throw ZEQException("Truncated S3D file name list");
+			memcpy(&nameLen,&mNameData[pos],sizeof(uint32));
+#ifdef ZEQ_ENDIAN_CHECK
+			nameLen = endian_uint32(nameLen);
+#endif
+			pos += sizeof(uint32);
+			if (nameLen == 0 || nameLen > nameDataLen - pos)
+				throw ZEQException("Truncated S3D file name list");
+			char* nameptr = (char*)&mNameData[pos];
+			nameptr[nameLen - 1] = '\0';
+			pos += nameLen;
+
+			//make sure name is all lowercase
+			strlwr(nameptr);
+
+			mEntries[i].mFile.mFileName = nameptr;
+			if (mCRCLookup && Crc32Msb(0,(const byte*)nameptr,nameLen) != mEntries[i].mCRC)
+				mCRCLookup = false;
+		}
+
+		if (!mCRCLookup)
+		{
+			for (uint32 i = 0; i < nNames; ++i)
+			{
+				mNameIndex[mEntries[i].mFile.mFileName] = i;
+			}
+		}
+
+		mEntriesByCRC.reserve(mEntries.size());
+		for (auto itr = mEntries.begin(); itr != mEntries.end(); itr++)
+		{
+			mEntriesByCRC.push_back(&(*itr));
+		}
+		std::sort(mEntriesByCRC.begin(),mEntriesByCRC.end(),[](const Entry* a, const Entry* b) { return a->mCRC < b->mCRC; });
+	}
+	catch (ZEQException&)
+	{
+		Close();
+		throw;
+	}
+
+	return true;
+}
+
+void S3DArchive::Close()
+{
+	for (auto itr = mEntries.begin(); itr != mEntries.end(); itr++)
+	{
+		Entry& entry = *itr;
+		if (entry.mFile.mData)
+			delete[] entry.mFile.mData;
+	}
+	mEntries.clear();
+	mEntriesByCRC.clear();
+	mNameIndex.clear();
+	mCRCLookup = false;
+	if (mNameData)
+	{
+		delete[] mNameData;
+		mNameData = nullptr;
+	}
+	mFile.Close();
+}
+
+const char* S3DArchive::GetFileName(uint32 index) const
+{
+	if (index >= mEntries.size())
+		return nullptr;
+	return mEntries[index].mFile.mFileName;
+}
+
+S3DFileEntry* S3DArchive::GetFile(uint32 index)
+{
+	if (index >= mEntries.size())
+		return nullptr;
+	Entry& entry = mEntries[index];
+	Inflate(entry);
+	return &entry.mFile;
+}
+
+S3DFileEntry* S3DArchive::GetFile(const char* name)
+{
+	int32 index = FindFile(name);
+	if (index < 0)
+		return nullptr;
+	return GetFile(index);
+}
+
+S3DFileEntry* S3DArchive::GetFileByCRC(uint32 crc)
+{
+	auto itr = std::lower_bound(mEntriesByCRC.begin(),mEntriesByCRC.end(),crc,CompareCRC);
+	if (itr == mEntriesByCRC.end() || (*itr)->mCRC != crc)
+		return nullptr;
+	Entry& entry = **itr;
+	Inflate(entry);
+	return &entry.mFile;
+}
+
+int32 S3DArchive::FindFile(const char* name) const
+{
+	if (mCRCLookup)
+	{
+		//names can share a CRC, so each entry with it is checked in turn
+		uint32 crc = Crc32Msb(0,(const byte*)name,strlen(name) + 1);
+		for (auto itr = std::lower_bound(mEntriesByCRC.begin(),mEntriesByCRC.end(),crc,CompareCRC); itr != mEntriesByCRC.end() && (*itr)->mCRC == crc; itr++)
+		{
+			if (strcmp((*itr)->mFile.mFileName,name) == 0)
+				return static_cast<int32>(*itr - &mEntries[0]);
+		}
+		return -1;
+	}
+
+	auto itr = mNameIndex.find(name);
+	if (itr == mNameIndex.end())
+		return -1;
+	return static_cast<int32>(itr->second);
+}
+
+void S3DArchive::Preload(const std::vector<uint32>& indices)
+{
+	std::vector<Block> blocks;
+	std::vector<Entry*> pending;
+
+	//allocate every destination buffer and work out where each block lands before inflating anything
+	try
+	{
+		for (auto itr = indices.begin(); itr != indices.end(); itr++)
+		{
+			if (*itr >= mEntries.size())
+				continue;
+			Entry& entry = mEntries[*itr];
+			if (entry.mFile.mData)
+				continue;
+			entry.mFile.mData = new byte[entry.mInflatedLen];
+			pending.push_back(&entry);
+			ScanBlocks(entry,entry.mFile.mData,blocks);
+		}
+
+		InflateBlocks(blocks);
+	}
+	catch (ZEQException&)
+	{
+		for (auto itr = pending.begin(); itr != pending.end(); itr++)
+		{
+			Release(&(*itr)->mFile);
+		}
+		throw;
+	}
+}
+
+void S3DArchive::Release(S3DFileEntry* file)
+{
+	if (file && file->mData)
+	{
+		delete[] file->mData;
+		file->mData = nullptr;
+	}
+}
+
+void S3DArchive::Inflate(Entry& entry)
+{
+	if (entry.mFile.mData)
+		return;
+
+	byte* dst = new byte[entry.mInflatedLen];
+	try
+	{
+		std::vector<Block> blocks;
+		ScanBlocks(entry,dst,blocks);
+		InflateBlocks(blocks);
+	}
+	catch (ZEQException&)
+	{
+		delete[] dst;
+		throw;
+	}
+	entry.mFile.mData = dst;
+}
+
+void S3DArchive::ScanBlocks(const Entry& entry, byte* dst, std::vector<Block>& blocks)
+{
+	//every entry is a chain of independently deflated blocks; walking just the block headers tells us
+	//where each one's output goes, so they can all be inflated straight into their final position
+	const byte* data = mFile.GetData();
+	size_t len = mFile.GetLen();
+	size_t offset = entry.mOffset;
+	uint32 infLenRead = 0;
+
+	while (infLenRead < entry.mInflatedLen)
+	{
+		S3DBlockHeader blockHeader;
+		if (offset > len || len - offset < sizeof(S3DBlockHeader))
+			throw ZEQException("Truncated S3D file block");
+		memcpy(&blockHeader,&data[offset],sizeof(S3DBlockHeader));
+#ifdef ZEQ_ENDIAN_CHECK
+		blockHeader.deflatedLen = endian_uint32(blockHeader.deflatedLen);
+		blockHeader.inflatedLen = endian_uint32(blockHeader.inflatedLen);
+#endif
+		offset += sizeof(S3DBlockHeader);
+		if (blockHeader.deflatedLen > len - offset || blockHeader.inflatedLen > entry.mInflatedLen - infLenRead)
+			throw ZEQException("Malformed S3D file block");
+
+		Block block;
+		block.mSrc = &data[offset];
+		block.mDst = &dst[infLenRead];
+		block.mDeflatedLen = blockHeader.deflatedLen;
+		block.mInflatedLen = blockHeader.inflatedLen;
+		blocks.push_back(block);
+
+		offset += blockHeader.deflatedLen;
+		infLenRead += blockHeader.inflatedLen;
+	}
+}
+
+void S3DArchive::InflateBlocks(const std::vector<Block>& blocks)
+{
+	if (!mParallel)
+	{
+		for (auto itr = blocks.begin(); itr != blocks.end(); itr++)
+		{
+			const Block& block = *itr;
+			Decompress(block.mSrc,block.mDst,block.mDeflatedLen,block.mInflatedLen);
+		}
+		return;
+	}
+
+	//blocks are at most a few KB inflated, so hand them out a few at a time
+	const Block* list = blocks.data();
+	WorkerPool::GetShared().ParallelFor(blocks.size(),ZEQ_S3D_BLOCKS_PER_TASK,[list](uint32 begin, uint32 end) {
+		for (uint32 i = begin; i < end; ++i)
+		{
+			const Block& block = list[i];
+			Decompress(block.mSrc,block.mDst,block.mDeflatedLen,block.mInflatedLen);
+		}
+	});
+}
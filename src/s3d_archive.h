@@ -0,0 +1,87 @@
+
+#ifndef ZEQ_S3D_ARCHIVE_H
+#define ZEQ_S3D_ARCHIVE_H
+
+#include <string.h>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include "zlib.h"
+#include "compression.h"
+#include "crc.h"
+#include "type.h"
+#include "exception.h"
+#include "byte_order.h"
+#include "mapped_file.h"
+#include "worker_pool.h"
+
+#define ZEQ_S3D_BLOCKS_PER_TASK 4
+
+struct S3DFileEntry
+{
+	const char* mFileName;
+	uint32 mDataSize;
+	byte* mData;
+};
+
+//Random-access reader for S3D (PFS) archives
+//The archive is memory-mapped and its directory is read once when opened; the contents of an entry
+//are only inflated the first time it is requested, and the returned entry stays valid until it is
+//released or the archive is closed
+class S3DArchive
+{
+public:
+	S3DArchive();
+	~S3DArchive();
+	//Returns false if the file could not be opened; throws on a malformed archive
+	bool	Open(const char* path);
+	void	Close();
+	uint32	GetFileCount() const { return mEntries.size(); }
+	//File names are lowercase and available without inflating anything
+	const char* GetFileName(uint32 index) const;
+	S3DFileEntry* GetFile(uint32 index);
+	S3DFileEntry* GetFile(const char* name);
+	S3DFileEntry* GetFileByCRC(uint32 crc);
+	//Returns the index of the named file, or -1 if it is not in the archive
+	int32	FindFile(const char* name) const;
+	//Inflates a batch of entries at once; with parallel inflation on, every block of every entry is spread across the worker pool
+	void	Preload(const std::vector<uint32>& indices);
+	//Parallel inflation is on by default; turning it off uses the plain serial block loop
+	void	SetParallelInflation(bool parallel) { mParallel = parallel; }
+	//Frees the inflated contents of an entry; requesting it again will re-inflate it
+	void	Release(S3DFileEntry* file);
+
+private:
+	struct Entry
+	{
+		uint32 mCRC;
+		uint32 mOffset;
+		uint32 mInflatedLen;
+		S3DFileEntry mFile;
+	};
+
+	struct Block
+	{
+		const byte* mSrc;
+		byte* mDst;
+		uint32 mDeflatedLen;
+		uint32 mInflatedLen;
+	};
+
+	static bool CompareOffset(const Entry& a, const Entry& b) { return a.mOffset < b.mOffset; }
+	static bool CompareCRC(const Entry* a, uint32 crc) { return a->mCRC < crc; }
+	void	Inflate(Entry& entry);
+	void	ScanBlocks(const Entry& entry, byte* dst, std::vector<Block>& blocks);
+	void	InflateBlocks(const std::vector<Block>& blocks);
+
+	MappedFile mFile;
+	std::vector<Entry> mEntries; //in order of offset, which is also the order of the name list
+	std::vector<Entry*> mEntriesByCRC; //in directory order, which is sorted by CRC
+	std::unordered_map<std::string,uint32> mNameIndex; //only for archives whose directory CRCs don't match their names
+	bool	mCRCLookup; //names are found through mEntriesByCRC
+	byte* mNameData;
+	bool	mParallel;
+};
+
+#endif
@@ -1,5 +1,7 @@
 
 #include "skeleton.h"
+#include "pose_cache.h"
+#include "mesh_builder.h"
 
 SkeletonSet::SkeletonSet(Skeleton* baseSkele, uint8 numMeshes)
 {
@@ -7,12 +9,22 @@ SkeletonSet::SkeletonSet(Skeleton* baseSkele, uint8 numMeshes)
 	mMeshArray = new MeshData[numMeshes];
 	mMeshNum = numMeshes;
 	mBoneAssignments = new std::vector<BoneAssignment>[numMeshes];
+	//not every slot gets a mesh
+	for (uint8 i = 0; i < numMeshes; ++i)
+	{
+		MeshData& d = mMeshArray[i];
+		d.baseVertexData = nullptr;
+		d.baseNormalData = nullptr;
+		d.vertexCount = 0;
+	}
 }
 
 Skeleton::Skeleton(uint16 numBones)
 {
 	mBoneArray = new Bone*[numBones];
 	mBoneNum = numBones;
+	for (uint16 i = 0; i < numBones; ++i)
+		mBoneArray[i] = nullptr;
 }
 
 Skeleton::~Skeleton()
@@ -31,8 +43,6 @@ SkeletonSet::~SkeletonSet()
 		MeshData& d = mMeshArray[i];
 		delete[] d.baseVertexData;
 		delete[] d.baseNormalData;
-		delete[] d.targetVertexBuffer;
-		delete[] d.targetNormalBuffer;
 		//ogre handles getting rid of the meshes themselves
 	}
 	delete[] mMeshArray;
@@ -87,15 +97,30 @@ void SkeletonSet::AddMesh(Ogre::MeshPtr& mesh, uint8 pos, float* vertices, float
 	data.mesh = mesh;
 	data.baseVertexData = vertices;
 	data.baseNormalData = normals;
-	data.targetVertexBuffer = new float[numVertices * 3];
-	data.targetNormalBuffer = new float[numVertices * 3];
+	data.vertexCount = numVertices;
 }
 
 void SkeletonSet::Complete()
 {
+	std::vector<SkinMatrix> bones(GetBoneNum());
+	std::vector<float> vtarget, ntarget;
+	GetPose(mBaseSkeleton,mBaseSkeleton,0.0f,&bones[0]);
 	for (uint8 i = 0; i < mMeshNum; ++i)
 	{
 		mBoneAssignments[i].shrink_to_fit();
+
+		MeshData& meshdata = mMeshArray[i];
+		if (meshdata.mesh.isNull())
+			continue;
+		vtarget.resize(meshdata.vertexCount * 3);
+		ntarget.resize(meshdata.vertexCount * 3);
+		Skin(&bones[0],i,&vtarget[0],&ntarget[0]);
+
+		Ogre::VertexBufferBinding* bind = meshdata.mesh->sharedVertexData->vertexBufferBinding;
+		Ogre::HardwareVertexBufferSharedPtr vbuf = bind->getBuffer(0);
+		Ogre::HardwareVertexBufferSharedPtr nbuf = bind->getBuffer(1);
+		vbuf->writeData(0,vbuf->getSizeInBytes(),&vtarget[0],true);
+		nbuf->writeData(0,nbuf->getSizeInBytes(),&ntarget[0],true);
 	}
 }
 
@@ -103,89 +128,147 @@ void SkeletonSet::Test(Ogre::SceneManager* sceneMgr)
 {
 	mNode = sceneMgr->getRootSceneNode()->createChildSceneNode();
 	mNode->setPosition(0,0,0);
-	Skeleton* skele = mBaseSkeleton;
 
 	for (uint8 i = 0; i < mMeshNum; ++i)
 	{
 		MeshData& meshdata = mMeshArray[i];
+		if (meshdata.mesh.isNull())
+			continue;
 		Ogre::Entity* ent = sceneMgr->createEntity(meshdata.mesh);
 		mNode->attachObject(ent);
+	}
+}
 
-		float* vdata = meshdata.baseVertexData;
-		float* ndata = meshdata.baseNormalData;
-		float* vtarget = meshdata.targetVertexBuffer;
-		float* ntarget = meshdata.targetNormalBuffer;
+const Bone* SkeletonSet::GetPoseBone(const Skeleton* skele, uint16 id) const
+{
+	const Bone* bone = skele->GetBone(id);
+	return bone ? bone : mBaseSkeleton->GetBone(id);
+}
 
-		for (auto itr = mBoneAssignments[i].begin(); itr != mBoneAssignments[i].end(); itr++)
+void SkeletonSet::GetPose(const Skeleton* cur, const Skeleton* next, float percent, SkinMatrix* bones) const
+{
+	uint16 boneNum = GetBoneNum();
+	for (uint16 i = 0; i < boneNum; ++i)
+	{
+		const Bone* curBone = GetPoseBone(cur,i);
+		const Bone* nextBone = GetPoseBone(next,i);
+		if (!curBone || !nextBone)
 		{
-			BoneAssignment& ba = *itr;
-
-			Bone* bone = skele->GetBone(ba.boneIndex);
-			float xrot = bone->mXRotation;
-			float yrot = bone->mYRotation;
-			float zrot = bone->mZRotation;
-			float xtrans = bone->mXShift;
-			float ytrans = bone->mYShift;
-			float ztrans = bone->mZShift;
-			for (uint16 j = 0; j < ba.vertexCount; ++j)
+			bones[i].Set(0.0f,0.0f,0.0f,0.0f,0.0f,0.0f);
+			continue;
+		}
+
+		//interpolate between cur frame skeleton and next frame skeleton
+		float xrot = curBone->mXRotation + (nextBone->mXRotation - curBone->mXRotation) * percent;
+		float yrot = curBone->mYRotation + (nextBone->mYRotation - curBone->mYRotation) * percent;
+		float zrot = curBone->mZRotation + (nextBone->mZRotation - curBone->mZRotation) * percent;
+		float xtrans = curBone->mXShift + (nextBone->mXShift - curBone->mXShift) * percent;
+		float ytrans = curBone->mYShift + (nextBone->mYShift - curBone->mYShift) * percent;
+		float ztrans = curBone->mZShift + (nextBone->mZShift - curBone->mZShift) * percent;
+		bones[i].Set(xrot,yrot,zrot,xtrans,ytrans,ztrans);
+	}
+}
+
+void SkeletonSet::GetPose(const Animation* anim, uint32 frame, SkinMatrix* bones) const
+{
+	uint16 boneNum = GetBoneNum();
+	if (anim->IsBaked())
+	{
+		const BakedBone* baked = anim->GetBakedFrame(frame);
+		for (uint16 i = 0; i < boneNum; ++i)
+			bones[i].Set(baked[i].rotation,baked[i].xShift,baked[i].yShift,baked[i].zShift);
+		return;
+	}
+
+	Skeleton* cur;
+	Skeleton* next;
+	float percent;
+	anim->GetFrame(frame / ZEQ_POSE_FRAME_RATE,cur,next,percent);
+	GetPose(cur,next,percent,bones);
+}
+
+void SkeletonSet::Skin(const SkinMatrix* bones, uint8 meshNum, float* vtarget, float* ntarget) const
+{
+	const MeshData& meshdata = mMeshArray[meshNum];
+	const std::vector<BoneAssignment>& vba = mBoneAssignments[meshNum];
+	const float* vdata = meshdata.baseVertexData;
+	const float* ndata = meshdata.baseNormalData;
+	uint32 remaining = meshdata.vertexCount;
+	uint16 boneNum = GetBoneNum();
+
+	for (auto itr = vba.begin(); itr != vba.end() && remaining > 0; itr++)
+	{
+		const BoneAssignment& ba = *itr;
+		if (ba.boneIndex >= boneNum)
+			throw ZEQException("Attempt to skin vertices to out-of-bounds bone id");
+		uint32 count = std::min<uint32>(ba.vertexCount,remaining);
+
+		bones[ba.boneIndex].Transform(vdata,ndata,vtarget,ntarget,count);
+		uint32 advance = count * 3;
+		vdata += advance;
+		ndata += advance;
+		vtarget += advance;
+		ntarget += advance;
+		remaining -= count;
+	}
+
+	//vertices not assigned to any bone stay where they are
+	memcpy(vtarget,vdata,remaining * 3 * sizeof(float));
+	memcpy(ntarget,ndata,remaining * 3 * sizeof(float));
+}
+
+uint32 SkeletonSet::Bake(uint32 budget)
+{
+	uint16 boneNum = GetBoneNum();
+	uint32 used = 0;
+	std::vector<BakedBone> track;
+
+	for (auto itr = mAnimations.begin(); itr != mAnimations.end(); itr++)
+	{
+		Animation* anim = itr->second;
+		uint32 frames = anim->GetFrameCount();
+		uint32 size = frames * boneNum * sizeof(BakedBone);
+		if (anim->IsBaked() || used + size > budget)
+			continue;
+
+		track.resize(frames * boneNum);
+		BakedBone* out = &track[0];
+		for (uint32 f = 0; f < frames; ++f)
+		{
+			Skeleton* cur;
+			Skeleton* next;
+			float percent;
+			anim->GetFrame(f / ZEQ_POSE_FRAME_RATE,cur,next,percent);
+
+			for (uint16 i = 0; i < boneNum; ++i, ++out)
 			{
-				//order is y, z, x
-				float tempY = *vdata++;
-				float z = *vdata++;
-				float tempX = *vdata++;
-				float x, y;
-				//x axis
-				y = (cos(xrot) * tempY) - (sin(xrot) * z);
-				z = (sin(xrot) * tempY) + (cos(xrot) * z);
-				//y axis
-				x = (cos(yrot) * tempX) + (sin(yrot) * z);
-				z = -(sin(yrot) * tempX) + (cos(yrot) * z);
-				//z axis
-				tempX = x;
-				x = (cos(zrot) * tempX) - (sin(zrot) * y);
-				y = (sin(zrot) * tempX) + (cos(zrot) * y);
-				//add shifts
-				x += xtrans;
-				y += ytrans;
-				z += ztrans;
-				
-				//write them into the vertex buffer
-				*vtarget++ = y;
-				*vtarget++ = z;
-				*vtarget++ = x;
-
-				//normals
-				tempY = *ndata++;
-				z = *ndata++;
-				tempX = *ndata++;
-				//x axis
-				y = (cos(xrot) * tempY) - (sin(xrot) * z);
-				z = (sin(xrot) * tempY) + (cos(xrot) * z);
-				//y axis
-				x = (cos(yrot) * tempX) + (sin(yrot) * z);
-				z = -(sin(yrot) * tempX) + (cos(yrot) * z);
-				//z axis
-				tempX = x;
-				x = (cos(zrot) * tempX) - (sin(zrot) * y);
-				y = (sin(zrot) * tempX) + (cos(zrot) * y);
-				//add shifts
-				x += xtrans;
-				y += ytrans;
-				z += ztrans;
-
-				//write them into the normal buffer
-				*ntarget++ = y;
-				*ntarget++ = z;
-				*ntarget++ = x;
+				const Bone* curBone = GetPoseBone(cur,i);
+				const Bone* nextBone = GetPoseBone(next,i);
+				if (!curBone || !nextBone)
+				{
+					out->rotation = Ogre::Quaternion::IDENTITY;
+					out->xShift = out->yShift = out->zShift = 0.0f;
+					continue;
+				}
+
+				//the same euler interpolation GetPose does, turned into a rotation once here
+				float xrot = curBone->mXRotation + (nextBone->mXRotation - curBone->mXRotation) * percent;
+				float yrot = curBone->mYRotation + (nextBone->mYRotation - curBone->mYRotation) * percent;
+				float zrot = curBone->mZRotation + (nextBone->mZRotation - curBone->mZRotation) * percent;
+				out->rotation = Ogre::Quaternion(Ogre::Radian(zrot),Ogre::Vector3::UNIT_Z) *
+					Ogre::Quaternion(Ogre::Radian(yrot),Ogre::Vector3::UNIT_Y) *
+					Ogre::Quaternion(Ogre::Radian(xrot),Ogre::Vector3::UNIT_X);
+				out->xShift = curBone->mXShift + (nextBone->mXShift - curBone->mXShift) * percent;
+				out->yShift = curBone->mYShift + (nextBone->mYShift - curBone->mYShift) * percent;
+				out->zShift = curBone->mZShift + (nextBone->mZShift - curBone->mZShift) * percent;
 			}
 		}
 
-		Ogre::VertexBufferBinding* bind = meshdata.mesh->sharedVertexData->vertexBufferBinding;
-		Ogre::HardwareVertexBufferSharedPtr vbuf = bind->getBuffer(0);
-		Ogre::HardwareVertexBufferSharedPtr nbuf = bind->getBuffer(1);
-		vbuf->writeData(0,vbuf->getSizeInBytes(),meshdata.targetVertexBuffer,true);
-		nbuf->writeData(0,nbuf->getSizeInBytes(),meshdata.targetNormalBuffer,true);
+		anim->SetBakedTrack(track,boneNum);
+		used += size;
 	}
+
+	return used;
 }
 
 
@@ -228,6 +311,11 @@ Bone::Bone(float xRot, float yRot, float zRot, float xTrans, float yTrans, float
 	}
 }
 
+Animation::Animation()
+{
+	mBakedBones = 0;
+}
+
 void Animation::AddSkeleton(Skeleton* skele, float time)
 {
 	AnimationKeyframe key;
@@ -250,6 +338,58 @@ AnimationKeyframe* Animation::GetKeyframe(uint16 frameNum)
 	return nullptr;
 }
 
+float Animation::GetDuration() const
+{
+	if (mKeyframes.empty())
+		return 0.0f;
+	return mKeyframes.back().time;
+}
+
+uint32 Animation::GetFrameCount() const
+{
+	return (uint32)(GetDuration() * ZEQ_POSE_FRAME_RATE) + 1;
+}
+
+void Animation::SetBakedTrack(std::vector<BakedBone>& track, uint16 numBones)
+{
+	mBaked.swap(track);
+	mBaked.shrink_to_fit();
+	mBakedBones = numBones;
+	track.clear();
+}
+
+const BakedBone* Animation::GetBakedFrame(uint32 frame) const
+{
+	uint32 frames = mBaked.size() / mBakedBones;
+	if (frame >= frames)
+		frame = frames - 1;
+	return &mBaked[frame * mBakedBones];
+}
+
+void Animation::GetFrame(float time, Skeleton*& cur, Skeleton*& next, float& percent) const
+{
+	if (mKeyframes.empty())
+		throw ZEQException("Attempt to get a frame of an animation with no keyframes");
+
+	//only a handful of keyframes per animation
+	uint32 count = mKeyframes.size();
+	uint32 i = 0;
+	while (i + 1 < count && time >= mKeyframes[i + 1].time)
+		++i;
+
+	const AnimationKeyframe& a = mKeyframes[i];
+	if (i + 1 == count)
+	{
+		cur = next = a.skeleton;
+		percent = 0.0f;
+		return;
+	}
+	const AnimationKeyframe& b = mKeyframes[i + 1];
+	cur = a.skeleton;
+	next = b.skeleton;
+	percent = (time - a.time) / (b.time - a.time);
+}
+
 
 MeshData* SkeletonSet::GetMeshData(uint8 num) const
 {
@@ -266,163 +406,115 @@ std::vector<BoneAssignment>* SkeletonSet::GetBoneAssignments(uint8 meshNum)
 }
 
 
-MobInstance::MobInstance(SkeletonSet* skeleSet, const char* animName, Ogre::SceneManager* sceneMgr)
+MobInstance::MobInstance(PoseCache* poseCache, const char* animName, Ogre::SceneManager* sceneMgr)
 {
-	mSkeletonSet = skeleSet;
+	static uint32 instanceNum = 0;
+	Ogre::MeshManager* meshMgr = Ogre::MeshManager::getSingletonPtr();
+	SkeletonSet* skeleSet = poseCache->GetSkeletonSet();
+
+	mPoseCache = poseCache;
 	mCurAnim = skeleSet->GetAnimation(animName);
-	mCurKeyframe = mCurAnim->GetKeyframe(0);
-	mNextKeyframe = mCurAnim->GetKeyframe(1);
+	if (!mCurAnim)
+		throw ZEQException("Attempt to create mob instance with an animation its skeleton set does not have");
 	mAnimTime = 0;
-	mNextFrameNum = 1;
+	mFrame = 0xFFFFFFFF;
+	mPose = nullptr;
+	mSceneMgr = sceneMgr;
 	mNode = sceneMgr->getRootSceneNode()->createChildSceneNode();
 	mNode->setPosition(0,0,0);
+
+	char name[128];
 	uint8 meshNum = skeleSet->GetMeshNum();
 	for (uint8 i = 0; i < meshNum; ++i)
 	{
-		Ogre::Entity* ent = sceneMgr->createEntity(skeleSet->GetMeshData(i)->mesh);
-		mNode->attachObject(ent);
+		MeshData* meshdata = skeleSet->GetMeshData(i);
+		Ogre::MeshPtr mesh;
+		Ogre::Entity* ent = nullptr;
+		if (!meshdata->mesh.isNull())
+		{
+			Ogre::MeshPtr& base = meshdata->mesh;
+			snprintf(name,128,"%s_inst%u",base->getName().c_str(),instanceNum);
+			mesh = meshMgr->createManual(name,Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+			//new binding over the same buffers; the texture coordinates and indices are never copied
+			mesh->sharedVertexData = base->sharedVertexData->clone(false);
+			for (uint16 j = 0; j < base->getNumSubMeshes(); ++j)
+			{
+				Ogre::SubMesh* src = base->getSubMesh(j);
+				Ogre::SubMesh* subMesh = mesh->createSubMesh();
+				subMesh->setMaterialName(src->getMaterialName());
+				subMesh->useSharedVertices = true;
+				subMesh->indexData->indexBuffer = src->indexData->indexBuffer;
+				subMesh->indexData->indexStart = src->indexData->indexStart;
+				subMesh->indexData->indexCount = src->indexData->indexCount;
+			}
+			MeshBuilder::ShareLods(mesh.get(),base.get());
+			mesh->_setBounds(base->getBounds());
+			mesh->_setBoundingSphereRadius(base->getBoundingSphereRadius());
+			mesh->load();
+
+			ent = sceneMgr->createEntity(mesh);
+			mNode->attachObject(ent);
+		}
+		mMeshes.push_back(mesh);
+		mEntities.push_back(ent);
 	}
+	instanceNum++;
+
 	AddAnimTime(0);
 }
 
-void MobInstance::AddAnimTime(float time)
+MobInstance::~MobInstance()
 {
-	mAnimTime += time;
-	//advance frame if needed
-	while (mAnimTime >= mNextKeyframe->time)
+	if (mPose)
+		mPoseCache->Release(mPose);
+	for (auto itr = mEntities.begin(); itr != mEntities.end(); itr++)
 	{
-		AnimationKeyframe* temp = mCurAnim->GetKeyframe(++mNextFrameNum);
-		if (temp)
-		{
-			mCurKeyframe = mNextKeyframe;
-			mNextKeyframe = temp;
-		}
-		else
-		{
-			//mAnimTime -= mNextKeyframe->time;
-			mAnimTime = 0;
-			mCurKeyframe = mCurAnim->GetKeyframe(0);
-			mNextKeyframe = mCurAnim->GetKeyframe(1);
-			mNextFrameNum = 1;
-		}
+		if (*itr)
+			mSceneMgr->destroyEntity(*itr);
 	}
-
-	//interpolate between cur frame skeleton and next frame skeleton
-	float curtime = mCurKeyframe->time;
-	float percent = (mAnimTime - curtime) / (mNextKeyframe->time - curtime);
-	SkeletonSet* skeleSet = mSkeletonSet;
-	Skeleton* curSkele = mCurKeyframe->skeleton;
-	Skeleton* nextSkele = mNextKeyframe->skeleton;
-	for (uint8 i = 0; i < skeleSet->GetMeshNum(); ++i)
+	for (auto itr = mMeshes.begin(); itr != mMeshes.end(); itr++)
 	{
-		MeshData* meshdata = skeleSet->GetMeshData(i);
-		std::vector<BoneAssignment>* vba = skeleSet->GetBoneAssignments(i);
-
-		float* vdata = meshdata->baseVertexData;
-		float* ndata = meshdata->baseNormalData;
-		float* vtarget = meshdata->targetVertexBuffer;
-		float* ntarget = meshdata->targetNormalBuffer;
+		if (!itr->isNull())
+			Ogre::MeshManager::getSingleton().remove((*itr)->getHandle());
+	}
+	mSceneMgr->destroySceneNode(mNode);
+}
 
-		for (auto itr = vba->begin(); itr != vba->end(); itr++)
-		{
-			BoneAssignment& ba = *itr;
-
-			Bone* curBone = curSkele->GetBone(ba.boneIndex);
-			Bone* nextBone = nextSkele->GetBone(ba.boneIndex);
-			float xrot = curBone->mXRotation + (nextBone->mXRotation - curBone->mXRotation) * percent;
-			float yrot = curBone->mYRotation + (nextBone->mYRotation - curBone->mYRotation) * percent;
-			float zrot = curBone->mZRotation + (nextBone->mZRotation - curBone->mZRotation) * percent;
-			float xtrans = curBone->mXShift + (nextBone->mXShift - curBone->mXShift) * percent;
-			float ytrans = curBone->mYShift + (nextBone->mYShift - curBone->mYShift) * percent;
-			float ztrans = curBone->mZShift + (nextBone->mZShift - curBone->mZShift) * percent;
-			//try interpolating the final x y z values instead ...
-			//or are target keyframes not complete positions, but just differences already ?
-			for (uint16 j = 0; j < ba.vertexCount; ++j)
-			{
-				//order is y, z, x
-				float tempY = *vdata++;
-				float z = *vdata++;
-				float tempX = *vdata++;
-
-				/*float ay = tempY;
-				float az = z;
-				float ax = tempX;*/
-
-				float x, y;
-				//x axis
-				y = (cos(xrot) * tempY) - (sin(xrot) * z);
-				z = (sin(xrot) * tempY) + (cos(xrot) * z);
-				//y axis
-				x = (cos(yrot) * tempX) + (sin(yrot) * z);
-				z = -(sin(yrot) * tempX) + (cos(yrot) * z);
-				//z axis
-				tempX = x;
-				x = (cos(zrot) * tempX) - (sin(zrot) * y);
-				y = (sin(zrot) * tempX) + (cos(zrot) * y);
-				//add shifts
-				x += xtrans;
-				y += ytrans;
-				z += ztrans;
-
-				/*tempY = ay;
-				tempX = ax;
-				float rot = nextBone->mXRotation;
-				//x axis
-				ay = (cos(rot) * tempY) - (sin(rot) * az);
-				az = (sin(rot) * tempY) + (cos(rot) * az);
-				//y axis
-				rot = nextBone->mYRotation;
-				ax = (cos(rot) * tempX) + (sin(rot) * az);
-				az = -(sin(rot) * tempX) + (cos(rot) * az);
-				//z axis
-				rot = nextBone->mZRotation;
-				tempX = ax;
-				ax = (cos(rot) * tempX) - (sin(rot) * ay);
-				ay = (sin(rot) * tempX) + (cos(rot) * ay);
-				//add shifts
-				ax += nextBone->mXShift;
-				ay += nextBone->mYShift;
-				az += nextBone->mZShift;
-
-				x += (ax - x) * percent;
-				y += (ay - y) * percent;
-				z += (az - z) * percent;*/
-				
-				//write them into the vertex buffer
-				*vtarget++ = y;
-				*vtarget++ = z;
-				*vtarget++ = x;
-
-				//normals
-				tempY = *ndata++;
-				z = *ndata++;
-				tempX = *ndata++;
-				//x axis
-				y = (cos(xrot) * tempY) - (sin(xrot) * z);
-				z = (sin(xrot) * tempY) + (cos(xrot) * z);
-				//y axis
-				x = (cos(yrot) * tempX) + (sin(yrot) * z);
-				z = -(sin(yrot) * tempX) + (cos(yrot) * z);
-				//z axis
-				tempX = x;
-				x = (cos(zrot) * tempX) - (sin(zrot) * y);
-				y = (sin(zrot) * tempX) + (cos(zrot) * y);
-				//add shifts
-				x += xtrans;
-				y += ytrans;
-				z += ztrans;
-
-				//write them into the normal buffer
-				*ntarget++ = y;
-				*ntarget++ = z;
-				*ntarget++ = x;
-			}
-		}
+void MobInstance::SetAnimation(const char* animName)
+{
+	Animation* anim = mPoseCache->GetSkeletonSet()->GetAnimation(animName);
+	if (!anim)
+		throw ZEQException("Attempt to play an animation the mob's skeleton set does not have");
+	mCurAnim = anim;
+	mAnimTime = 0;
+	mFrame = 0xFFFFFFFF;
+	AddAnimTime(0);
+}
 
-		Ogre::VertexBufferBinding* bind = meshdata->mesh->sharedVertexData->vertexBufferBinding;
-		Ogre::HardwareVertexBufferSharedPtr vbuf = bind->getBuffer(0);
-		Ogre::HardwareVertexBufferSharedPtr nbuf = bind->getBuffer(1);
-		vbuf->writeData(0,vbuf->getSizeInBytes(),meshdata->targetVertexBuffer,true);
-		nbuf->writeData(0,nbuf->getSizeInBytes(),meshdata->targetNormalBuffer,true);
+void MobInstance::AddAnimTime(float time)
+{
+	mAnimTime += time;
+	float duration = mCurAnim->GetDuration();
+	if (duration > 0.0f && mAnimTime >= duration)
+		mAnimTime = fmod(mAnimTime,duration);
+
+	//nothing to do until we reach the next shared frame
+	uint32 frame = (uint32)(mAnimTime * ZEQ_POSE_FRAME_RATE);
+	if (frame == mFrame)
+		return;
+
+	SkinnedPose* pose = mPoseCache->Acquire(mCurAnim,frame);
+	if (mPose)
+		mPoseCache->Release(mPose);
+	mPose = pose;
+	mFrame = frame;
+
+	for (uint32 i = 0; i < mMeshes.size(); ++i)
+	{
+		if (mMeshes[i].isNull())
+			continue;
+		Ogre::VertexBufferBinding* bind = mMeshes[i]->sharedVertexData->vertexBufferBinding;
+		bind->setBinding(0,pose->mVertexBuffers[i]);
+		bind->setBinding(1,pose->mNormalBuffers[i]);
 	}
 }
@@ -7,10 +7,18 @@
 #include <unordered_map>
 #include "type.h"
 #include "exception.h"
+#include "skinning.h"
+
+//animations are sampled at this rate so instances playing the same one land on the same frames
+#define ZEQ_POSE_FRAME_RATE 30.0f
+//most memory a SkeletonSet's baked animation tracks may take
+#define ZEQ_ANIM_BAKE_BUDGET (4 * 1024 * 1024)
 
 class Bone;
 class SkeletonSet;
 class MobInstance;
+class PoseCache;
+struct SkinnedPose;
 
 class Skeleton
 {
@@ -38,7 +46,6 @@ private:
 	float mYShift;
 	float mZShift;
 	friend class SkeletonSet;
-	friend class MobInstance;
 };
 
 
@@ -58,14 +65,36 @@ struct AnimationKeyframe
 	float time;
 };
 
+//one bone of a baked frame; the rotation is the same x, then y, then z rotation a Bone describes
+struct BakedBone
+{
+	Ogre::Quaternion rotation;
+	float xShift;
+	float yShift;
+	float zShift;
+};
+
 class Animation
 {
 public:
+	Animation();
 	void	AddSkeleton(Skeleton* skele, float time);
 	Skeleton* GetSkeletonByKeyframe(uint16 frameNum);
 	AnimationKeyframe* GetKeyframe(uint16 frameNum);
+	float	GetDuration() const;
+	//the keyframe skeletons on either side of time, and how far between them it is
+	void	GetFrame(float time, Skeleton*& cur, Skeleton*& next, float& percent) const;
+	//number of ZEQ_POSE_FRAME_RATE frames from the first keyframe to the last, inclusive
+	uint32	GetFrameCount() const;
+	//takes the contents of track: numBones entries for each of GetFrameCount frames, frame major
+	void	SetBakedTrack(std::vector<BakedBone>& track, uint16 numBones);
+	bool	IsBaked() const { return !mBaked.empty(); }
+	//numBones entries for the given frame, clamped to the end of the track
+	const BakedBone* GetBakedFrame(uint32 frame) const;
 private:
 	std::vector<AnimationKeyframe> mKeyframes;
+	std::vector<BakedBone> mBaked;
+	uint16 mBakedBones;
 };
 
 
@@ -80,10 +109,11 @@ struct MeshData
 	Ogre::MeshPtr mesh;
 	float* baseVertexData;
 	float* baseNormalData;
-	float* targetVertexBuffer;
-	float* targetNormalBuffer;
+	uint16 vertexCount;
 };
 
+//Everything about a mob model that doesn't change once it is loaded; after Complete it is only read from,
+//so any number of MobInstances and PoseCaches may share one
 class SkeletonSet
 {
 public:
@@ -91,8 +121,20 @@ public:
 	~SkeletonSet();
 	void	AddMesh(Ogre::MeshPtr& mesh, uint8 pos, float* vertices, float* normals, uint16 numVertices);
 	void	AddBoneAssignment(uint16 bone_id, uint16 count, uint8 mesh_id);
+	//also skins the set's own meshes into the base pose
 	void	Complete();
 	void	Test(Ogre::SceneManager* sceneMgr);
+	//Samples each animation at ZEQ_POSE_FRAME_RATE into a quaternion and shift per bone per frame, so playing
+	//a frame needs no interpolation or trig; stops once budget bytes are used, the rest are interpolated as before
+	//Returns the number of bytes used
+	uint32	Bake(uint32 budget = ZEQ_ANIM_BAKE_BUDGET);
+	uint16	GetBoneNum() const { return mBaseSkeleton->GetNumBones(); }
+	//fills one matrix per bone, interpolated between two keyframe skeletons
+	void	GetPose(const Skeleton* cur, const Skeleton* next, float percent, SkinMatrix* bones) const;
+	//fills one matrix per bone for a ZEQ_POSE_FRAME_RATE frame of anim, from its baked track if it has one
+	void	GetPose(const Animation* anim, uint32 frame, SkinMatrix* bones) const;
+	//skins one mesh into vtarget and ntarget, which must hold vertexCount * 3 floats each
+	void	Skin(const SkinMatrix* bones, uint8 meshNum, float* vtarget, float* ntarget) const;
 	bool	HasAnimation(const char* name);
 	Animation* GetAnimation(const char* name);
 	void	AddAnimation(Animation* anim, const char* name);
@@ -100,6 +142,9 @@ public:
 	MeshData* GetMeshData(uint8 num) const;
 	std::vector<BoneAssignment>* GetBoneAssignments(uint8 meshNum);
 private:
+	//keyframe skeletons only hold the bones that move; the rest stay where the base skeleton has them
+	const Bone* GetPoseBone(const Skeleton* skele, uint16 id) const;
+
 	Skeleton* mBaseSkeleton;
 	std::unordered_map<std::string,Animation*> mAnimations;
 	std::vector<BoneAssignment>* mBoneAssignments;
@@ -109,19 +154,27 @@ private:
 };
 
 
+//One mob on screen: just an animation, a time and a scene node
+//Its meshes share everything with the SkeletonSet's except the position and normal buffers, which are bound
+//to whichever pose of the PoseCache its time falls on, so instances on the same frame share one skinning pass
 class MobInstance
 {
 public:
-	MobInstance(SkeletonSet* skeleSet, const char* animName, Ogre::SceneManager* sceneMgr);
+	MobInstance(PoseCache* poseCache, const char* animName, Ogre::SceneManager* sceneMgr);
+	~MobInstance();
 	void	AddAnimTime(float time);
+	void	SetAnimation(const char* animName);
+	Ogre::SceneNode* GetNode() const { return mNode; }
 private:
-	SkeletonSet* mSkeletonSet;
+	PoseCache* mPoseCache;
 	Animation* mCurAnim;
-	AnimationKeyframe* mCurKeyframe;
-	AnimationKeyframe* mNextKeyframe;
-	uint16 mNextFrameNum;
 	float mAnimTime;
+	uint32 mFrame;
+	SkinnedPose* mPose;
+	std::vector<Ogre::MeshPtr> mMeshes; //null where the set has no mesh
+	std::vector<Ogre::Entity*> mEntities;
 	Ogre::SceneNode* mNode;
+	Ogre::SceneManager* mSceneMgr;
 };
 
 #endif
@@ -0,0 +1,119 @@
+
+#include "skinning.h"
+
+#ifdef ZEQ_SKIN_SSE
+#include <xmmintrin.h>
+#endif
+
+void SkinMatrix::Set(float xRot, float yRot, float zRot, float xShift, float yShift, float zShift)
+{
+	float sx = sin(xRot), cx = cos(xRot);
+	float sy = sin(yRot), cy = cos(yRot);
+	float sz = sin(zRot), cz = cos(zRot);
+
+	//y row
+	m[0][0] = sz * sy * sx + cz * cx;
+	m[0][1] = sz * sy * cx - cz * sx;
+	m[0][2] = sz * cy;
+	m[0][3] = yShift;
+	//z row
+	m[1][0] = cy * sx;
+	m[1][1] = cy * cx;
+	m[1][2] = -sy;
+	m[1][3] = zShift;
+	//x row
+	m[2][0] = cz * sy * sx - sz * cx;
+	m[2][1] = cz * sy * cx + sz * sx;
+	m[2][2] = cz * cy;
+	m[2][3] = xShift;
+}
+
+void SkinMatrix::Set(const Ogre::Quaternion& rot, float xShift, float yShift, float zShift)
+{
+	float x2 = rot.x + rot.x, y2 = rot.y + rot.y, z2 = rot.z + rot.z;
+	float wx = rot.w * x2, wy = rot.w * y2, wz = rot.w * z2;
+	float xx = rot.x * x2, xy = rot.x * y2, xz = rot.x * z2;
+	float yy = rot.y * y2, yz = rot.y * z2, zz = rot.z * z2;
+
+	//the usual rotation matrix with its rows and columns moved into y, z, x order
+	m[0][0] = 1.0f - (xx + zz);
+	m[0][1] = yz - wx;
+	m[0][2] = xy + wz;
+	m[0][3] = yShift;
+	m[1][0] = yz + wx;
+	m[1][1] = 1.0f - (xx + yy);
+	m[1][2] = xz - wy;
+	m[1][3] = zShift;
+	m[2][0] = xy - wz;
+	m[2][1] = xz + wy;
+	m[2][2] = 1.0f - (yy + zz);
+	m[2][3] = xShift;
+}
+
+void SkinMatrix::Transform(const float* srcVerts, const float* srcNorms, float* dstVerts, float* dstNorms, uint32 count) const
+{
+	uint32 i = 0;
+
+#ifdef ZEQ_SKIN_SSE
+	__m128 m00 = _mm_set1_ps(m[0][0]), m01 = _mm_set1_ps(m[0][1]), m02 = _mm_set1_ps(m[0][2]), m03 = _mm_set1_ps(m[0][3]);
+	__m128 m10 = _mm_set1_ps(m[1][0]), m11 = _mm_set1_ps(m[1][1]), m12 = _mm_set1_ps(m[1][2]), m13 = _mm_set1_ps(m[1][3]);
+	__m128 m20 = _mm_set1_ps(m[2][0]), m21 = _mm_set1_ps(m[2][1]), m22 = _mm_set1_ps(m[2][2]), m23 = _mm_set1_ps(m[2][3]);
+
+	//four vertices at a time: three registers of packed y,z,x are split into one register per component,
+	//transformed, then packed back
+	for (; i + 4 <= count; i += 4)
+	{
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			const float* src = (pass == 0) ? srcVerts : srcNorms;
+			float* dst = (pass == 0) ? dstVerts : dstNorms;
+
+			__m128 a0 = _mm_loadu_ps(src + i * 3);		//y0 z0 x0 y1
+			__m128 a1 = _mm_loadu_ps(src + i * 3 + 4);	//z1 x1 y2 z2
+			__m128 a2 = _mm_loadu_ps(src + i * 3 + 8);	//x2 y3 z3 x3
+
+			__m128 u = _mm_shuffle_ps(a1,a2,_MM_SHUFFLE(1,0,3,2));	//y2 z2 x2 y3
+			__m128 v = _mm_shuffle_ps(a0,a1,_MM_SHUFFLE(1,0,2,1));	//z0 x0 z1 x1
+			__m128 w = _mm_shuffle_ps(a1,a2,_MM_SHUFFLE(3,2,3,2));	//y2 z2 z3 x3
+			__m128 y = _mm_shuffle_ps(a0,u,_MM_SHUFFLE(3,0,3,0));
+			__m128 z = _mm_shuffle_ps(v,w,_MM_SHUFFLE(2,1,2,0));
+			__m128 x = _mm_shuffle_ps(v,_mm_shuffle_ps(u,w,_MM_SHUFFLE(3,3,2,2)),_MM_SHUFFLE(2,0,3,1));
+
+			__m128 oy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00,y),_mm_mul_ps(m01,z)),_mm_mul_ps(m02,x));
+			__m128 oz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m10,y),_mm_mul_ps(m11,z)),_mm_mul_ps(m12,x));
+			__m128 ox = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m20,y),_mm_mul_ps(m21,z)),_mm_mul_ps(m22,x));
+			if (pass == 0)
+			{
+				oy = _mm_add_ps(oy,m03);
+				oz = _mm_add_ps(oz,m13);
+				ox = _mm_add_ps(ox,m23);
+			}
+
+			__m128 yz01 = _mm_unpacklo_ps(oy,oz);	//y0 z0 y1 z1
+			__m128 yz23 = _mm_unpackhi_ps(oy,oz);	//y2 z2 y3 z3
+			__m128 b0 = _mm_shuffle_ps(yz01,_mm_shuffle_ps(ox,oy,_MM_SHUFFLE(1,1,0,0)),_MM_SHUFFLE(2,0,1,0));
+			__m128 b1 = _mm_shuffle_ps(_mm_shuffle_ps(oz,ox,_MM_SHUFFLE(1,1,1,1)),yz23,_MM_SHUFFLE(1,0,2,0));
+			__m128 b2 = _mm_shuffle_ps(_mm_shuffle_ps(ox,oy,_MM_SHUFFLE(3,3,2,2)),_mm_shuffle_ps(oz,ox,_MM_SHUFFLE(3,3,3,3)),_MM_SHUFFLE(2,0,2,0));
+			_mm_storeu_ps(dst + i * 3,b0);
+			_mm_storeu_ps(dst + i * 3 + 4,b1);
+			_mm_storeu_ps(dst + i * 3 + 8,b2);
+		}
+	}
+#endif
+
+	for (; i < count; ++i)
+	{
+		const float* v = srcVerts + i * 3;
+		const float* n = srcNorms + i * 3;
+		float* vo = dstVerts + i * 3;
+		float* no = dstNorms + i * 3;
+
+		vo[0] = m[0][0] * v[0] + m[0][1] * v[1] + m[0][2] * v[2] + m[0][3];
+		vo[1] = m[1][0] * v[0] + m[1][1] * v[1] + m[1][2] * v[2] + m[1][3];
+		vo[2] = m[2][0] * v[0] + m[2][1] * v[1] + m[2][2] * v[2] + m[2][3];
+
+		no[0] = m[0][0] * n[0] + m[0][1] * n[1] + m[0][2] * n[2];
+		no[1] = m[1][0] * n[0] + m[1][1] * n[1] + m[1][2] * n[2];
+		no[2] = m[2][0] * n[0] + m[2][1] * n[1] + m[2][2] * n[2];
+	}
+}
@@ -0,0 +1,26 @@
+
+#ifndef ZEQ_SKINNING_H
+#define ZEQ_SKINNING_H
+
+#include <math.h>
+#include "type.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#define ZEQ_SKIN_SSE
+#endif
+
+//Rotation and shift of a bone as a single 3x4 matrix, so skinning a run of vertices costs no trig at all
+//Rows and columns are both in the y, z, x order that mob vertex and normal buffers are stored in
+struct SkinMatrix
+{
+	//Same rotation order as Bone: about x, then y, then z, then shifted
+	void	Set(float xRot, float yRot, float zRot, float xShift, float yShift, float zShift);
+	//rot is in EQ's x, y, z axes
+	void	Set(const Ogre::Quaternion& rot, float xShift, float yShift, float zShift);
+	//Transforms count packed vertices and their normals in one pass; normals are only rotated
+	void	Transform(const float* srcVerts, const float* srcNorms, float* dstVerts, float* dstNorms, uint32 count) const;
+
+	float	m[3][4];
+};
+
+#endif
@@ -1,8 +1,14 @@
 
 #include "socket.h"
+#include "net_reactor.h"
 
 Socket::Socket(bool blocking, const char* host, const char* port, int sock_type)
 {
+	mSocket = ZEQ_SOCKET_CLOSED;
+	mBlocking = blocking;
+	mPendingSend = false;
+	mReactor = nullptr;
+
 	addrinfo hints;
 	memset(&hints,0,sizeof(hints));
 	hints.ai_family = AF_INET;
@@ -39,13 +45,15 @@ Socket::Socket(bool blocking, const char* host, const char* port, int sock_type)
 #else
 			close(mSocket);
 #endif
+			mSocket = ZEQ_SOCKET_CLOSED;
 			continue;
 		}
+		break;
 	}
 
 	freeaddrinfo(res);
 
-	if (mSocket == NULL || mSocket == SOCKET_ERROR)
+	if (mSocket == ZEQ_SOCKET_CLOSED || mSocket == SOCKET_ERROR)
 	{
 		throw ZEQException("Could not establish socket connection");
 	}
@@ -53,6 +61,18 @@ Socket::Socket(bool blocking, const char* host, const char* port, int sock_type)
 
 Socket::~Socket()
 {
+	Close();
+	while (!mPacketQueue.empty())
+	{
+		mPacketQueue.front()->Release();
+		mPacketQueue.pop();
+	}
+}
+
+void Socket::Close()
+{
+	if (mReactor)
+		mReactor->Remove(this);
 	if (mSocket != ZEQ_SOCKET_CLOSED)
 	{
 #ifdef WIN32
@@ -60,9 +80,37 @@ Socket::~Socket()
 #else
 		close(mSocket);
 #endif
+		mSocket = ZEQ_SOCKET_CLOSED;
 	}
 }
 
+Packet* Socket::NextPacket()
+{
+	if (mPacketQueue.empty())
+		return nullptr;
+	Packet* packet = mPacketQueue.front();
+	mPacketQueue.pop();
+	return packet;
+}
+
+bool Socket::WouldBlock()
+{
+#ifdef WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EWOULDBLOCK || errno == EAGAIN;
+#endif
+}
+
+void Socket::SetPendingSend(bool pending)
+{
+	if (pending == mPendingSend)
+		return;
+	mPendingSend = pending;
+	if (mReactor)
+		mReactor->Update(this);
+}
+
 #ifdef WIN32
 void Socket::InitializeSocketLib()
 {
@@ -83,124 +131,321 @@ void Socket::CloseSocketLib()
 TCPSocket::TCPSocket(const char* host, const char* port, bool blocking) :
 Socket(blocking,host,port,SOCK_STREAM)
 {
-	mRecvBuf_pos = mRecvBuf_end = 0;
+	mSendPos = 0;
+}
+
+TCPSocket::~TCPSocket()
+{
+	for (auto itr = mSendQueue.begin(); itr != mSendQueue.end(); itr++)
+	{
+		(*itr)->Release();
+	}
 }
 
 void TCPSocket::Receive()
 {
-	if (mRecvBuf_pos >= mRecvBuf_end)
+	for (;;)
 	{
-		//buffer is empty, get fresh data
+		Packet* packet = Packet::Create(ZEQ_RECVBUF_SIZE,0);
+		int received = recv(mSocket,(char*)packet->GetData(),ZEQ_RECVBUF_SIZE,0);
+		if (received > 0)
+		{
+			packet->SetLen(received);
+			OnData(packet);
+			//a blocking socket would wait on the next read, so stop at whatever arrived together
+			if (mBlocking)
+				return;
+		}
+		else
+		{
+			packet->Release();
+			if (received == 0)
+			{
+				Close();
+				throw ZEQException("Socket remote connection closed");
+			}
+			if (!WouldBlock())
+			{
+				throw ZEQException("Socket receive operation failed");
+			}
+			return;
+		}
 	}
 }
 
+void TCPSocket::OnData(Packet* packet)
+{
+	//no framing yet, so each read is handed on as it came
+	mPacketQueue.push(packet);
+}
+
 void TCPSocket::Send(const byte* data, size_t len)
 {
-	//set header
-	//byte* out_packet = (byte*)alloca(len + ?);
-	for (;;)
+	Packet* packet = Packet::Create(data,len);
+	Send(packet);
+	packet->Release();
+}
+
+void TCPSocket::Send(Packet* packet)
+{
+	packet->AddRef();
+	mSendQueue.push_back(packet);
+	//anything sent now would jump the queue
+	if (mSendQueue.size() == 1)
+		Flush();
+}
+
+void TCPSocket::Flush()
+{
+	while (!mSendQueue.empty())
 	{
-		int sent = send(mSocket,(const char*)data,len,0);
+		Packet* packet = mSendQueue.front();
+		int sent = send(mSocket,(const char*)packet->GetData() + mSendPos,packet->GetLen() - mSendPos,0);
 		if (sent > 0)
 		{
-			return;
+			mSendPos += sent;
+			if (mSendPos == packet->GetLen())
+			{
+				mSendQueue.pop_front();
+				packet->Release();
+				mSendPos = 0;
+			}
 		}
 		else if (sent == 0)
 		{
-			mSocket = ZEQ_SOCKET_CLOSED;
+			Close();
 			throw ZEQException("Socket remote connection closed");
 		}
-		else {
-#ifdef WIN32
-			int err = WSAGetLastError();
-			if (err != WSAEWOULDBLOCK)
-			{
-#else
-			if (errno != EWOULDBLOCK)
+		else
+		{
+			if (!WouldBlock())
 			{
-#endif
 				throw ZEQException("Socket send operation failed");
 			}
+			//the reactor says when there is room again, rather than spinning on it here
+			SetPendingSend(true);
+			return;
 		}
 	}
+	SetPendingSend(false);
 }
 
-void TCPSocket::Send(Packet* packet)
+
+DatagramRing::DatagramRing(uint32 slots, uint32 slotSize)
+{
+	mData = new byte[slots * slotSize];
+	mLens = new uint32[slots];
+	mSlots = slots;
+	mSlotSize = slotSize;
+	mHead = 0;
+	mCount = 0;
+}
+
+DatagramRing::~DatagramRing()
 {
+	delete[] mData;
+	delete[] mLens;
+}
 
+void DatagramRing::Push(const byte* data, uint32 len)
+{
+	memcpy(GetSlot(mCount),data,len);
+	SetLen(mCount,len);
+	Commit(1);
 }
 
 
 UDPSocket::UDPSocket(const char* host, const char* port, bool blocking) :
-Socket(blocking,host,port,SOCK_DGRAM)
+Socket(blocking,host,port,SOCK_DGRAM),
+mRecvRing(ZEQ_UDP_RECV_SLOTS,ZEQ_UDP_SLOT_SIZE),
+mSendQueue(ZEQ_UDP_SEND_QUEUE_MAX,ZEQ_UDP_SLOT_SIZE)
 {
-
+#ifdef ZEQ_HAVE_MMSG
+	memset(mMsgs,0,sizeof(mMsgs));
+	for (uint32 i = 0; i < ZEQ_UDP_BATCH; ++i)
+	{
+		mMsgs[i].msg_hdr.msg_iov = &mIovecs[i];
+		mMsgs[i].msg_hdr.msg_iovlen = 1;
+	}
+#endif
 }
 
 void UDPSocket::Receive()
 {
-	for (;;)
+	//with the ring full the rest stay in the kernel's buffer until the consumer catches up
+	while (mRecvRing.GetFree() > 0)
 	{
-		int received = recv(mSocket,mRecvBuf,ZEQ_RECVBUF_SIZE,0);
-		if (received > 0)
+		uint32 first = mRecvRing.GetCount();
+#ifdef ZEQ_HAVE_MMSG
+		uint32 n = std::min<uint32>(mRecvRing.GetFree(),ZEQ_UDP_BATCH);
+		for (uint32 i = 0; i < n; ++i)
 		{
-			mPacketQueue.push(new UDPPacket((byte*)mRecvBuf,received,true));
+			mIovecs[i].iov_base = mRecvRing.GetSlot(first + i);
+			mIovecs[i].iov_len = mRecvRing.GetSlotSize();
 		}
-		else if (received == SOCKET_ERROR)
+		//a blocking socket only waits for the first one
+		int received = recvmmsg(mSocket,mMsgs,n,mBlocking ? MSG_WAITFORONE : MSG_DONTWAIT,nullptr);
+		if (received == SOCKET_ERROR)
 		{
-#ifdef WIN32
-			int err = WSAGetLastError();
-			if (err != WSAEWOULDBLOCK)
+			if (!WouldBlock())
 			{
+				throw ZEQException("Socket receive operation failed");
+			}
+			return;
+		}
+		for (int i = 0; i < received; ++i)
+		{
+			mRecvRing.SetLen(first + i,mMsgs[i].msg_len);
+		}
+		mRecvRing.Commit(received);
+		if (mBlocking || (uint32)received < n)
+			return;
 #else
-			if (errno != EWOULDBLOCK)
-			{
+		int received = recv(mSocket,(char*)mRecvRing.GetSlot(first),mRecvRing.GetSlotSize(),0);
+		if (received == SOCKET_ERROR)
+		{
+#ifdef WIN32
+			//cut short, the same as recvmmsg would leave it
+			if (WSAGetLastError() == WSAEMSGSIZE)
+				received = mRecvRing.GetSlotSize();
+			else
 #endif
+			if (!WouldBlock())
+			{
 				throw ZEQException("Socket receive operation failed");
 			}
-			return;
+			else
+			{
+				return;
+			}
 		}
+		mRecvRing.SetLen(first,received);
+		mRecvRing.Commit(1);
+		if (mBlocking)
+			return;
+#endif
 	}
 }
 
-void UDPSocket::Send(const byte* data, size_t len, bool ack_req)
+const byte* UDPSocket::PeekDatagram(uint32& len)
 {
-	//set ack_req field if needed
-	if (ack_req)
-	{
-		//alloca(); ?
-	}
-	for (;;)
+	if (mRecvRing.GetCount() == 0)
+		return nullptr;
+	len = mRecvRing.GetLen(0);
+	return mRecvRing.GetSlot(0);
+}
+
+uint32 UDPSocket::SendMany(const byte* const* data, const uint32* lens, uint32 count)
+{
+	uint32 done = 0;
+	while (done < count)
 	{
-		int sent = send(mSocket,(const char*)data,len,0);
-		if (sent > 0)
-			return;
-#ifdef WIN32
-		int err = WSAGetLastError();
-		if (err != WSAEWOULDBLOCK)
+#ifdef ZEQ_HAVE_MMSG
+		uint32 n = std::min<uint32>(count - done,ZEQ_UDP_BATCH);
+		for (uint32 i = 0; i < n; ++i)
 		{
+			mIovecs[i].iov_base = (void*)data[done + i];
+			mIovecs[i].iov_len = lens[done + i];
+		}
+		int sent = sendmmsg(mSocket,mMsgs,n,0);
 #else
-		if (errno != EWOULDBLOCK)
-		{
+		int sent = send(mSocket,(const char*)data[done],lens[done],0);
+		if (sent != SOCKET_ERROR)
+			sent = 1;
 #endif
-			throw ZEQException("Socket send operation failed");
+		if (sent == SOCKET_ERROR)
+		{
+			if (!WouldBlock())
+			{
+				throw ZEQException("Socket send operation failed");
+			}
+			break;
 		}
+		done += sent;
+	}
+	return done;
+}
+
+void UDPSocket::Enqueue(const byte* data, uint32 len)
+{
+	if (len > mSendQueue.GetSlotSize())
+	{
+		throw ZEQException("Datagram too large for the send queue");
+	}
+	//a datagram is worth less the longer it waits, so the oldest go first when the queue is full
+	if (mSendQueue.GetFree() == 0)
+		mSendQueue.Pop();
+	mSendQueue.Push(data,len);
+	SetPendingSend(true);
+}
+
+void UDPSocket::Send(const byte* data, size_t len)
+{
+	uint32 len32 = len;
+	if (mSendQueue.GetCount() == 0 && SendMany(&data,&len32,1) == 1)
+		return;
+	Enqueue(data,len32);
+}
+
+void UDPSocket::SendBatch(const byte* const* data, const uint32* lens, uint32 count)
+{
+	//anything sent now would jump the queue
+	uint32 sent = (mSendQueue.GetCount() == 0) ? SendMany(data,lens,count) : 0;
+	for (uint32 i = sent; i < count; ++i)
+	{
+		Enqueue(data[i],lens[i]);
 	}
 }
 
-void UDPSocket::Send(Packet* packet, bool ack_req)
+void UDPSocket::Flush()
 {
+	const byte* data[ZEQ_UDP_BATCH];
+	uint32 lens[ZEQ_UDP_BATCH];
+	while (mSendQueue.GetCount() > 0)
+	{
+		uint32 n = std::min<uint32>(mSendQueue.GetCount(),ZEQ_UDP_BATCH);
+		for (uint32 i = 0; i < n; ++i)
+		{
+			data[i] = mSendQueue.GetSlot(i);
+			lens[i] = mSendQueue.GetLen(i);
+		}
+		uint32 sent = SendMany(data,lens,n);
+		mSendQueue.Pop(sent);
+		if (sent < n)
+			return;
+	}
+	SetPendingSend(false);
+}
 
+void UDPSocket::Send(Packet* packet)
+{
+	Send(packet->GetData(),packet->GetLen());
 }
 
 
 HTTPSocket::HTTPSocket(const char* host, bool blocking) :
 TCPSocket(host,"80",blocking)
 {
-
+	mComplete = false;
 }
 
 void HTTPSocket::Receive()
 {
+	//the server closing the connection is how the response ends, so that isn't an error here
+	try
+	{
+		TCPSocket::Receive();
+	}
+	catch (ZEQException&)
+	{
+		if (IsOpen())
+			throw;
+		mComplete = true;
+	}
+}
 
+void HTTPSocket::OnData(Packet* packet)
+{
+	mResponse.append((const char*)packet->GetData(),packet->GetLen());
+	packet->Release();
 }
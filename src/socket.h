@@ -1,4 +1,3 @@
-
 #ifndef ZEQ_SOCKET_H
 #define ZEQ_SOCKET_H
 
@@ -13,28 +12,68 @@
 #include <arpa/inet.h>
 #include <sys/wait.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/uio.h>
+#define ZEQ_HAVE_MMSG
+#endif
+typedef int SOCKET;
+#define SOCKET_ERROR -1
 #endif
 
 #include <queue>
+#include <deque>
+#include <vector>
+#include <string>
+#include <algorithm>
 #include "packet.h"
 #include "exception.h"
 
 #define ZEQ_RECVBUF_SIZE 8192
 #define ZEQ_SOCKET_CLOSED 0
+//largest datagram a UDP socket handles; anything longer is cut short on receive
+#define ZEQ_UDP_SLOT_SIZE 1536
+//datagrams a UDP socket can hold received but not yet consumed; past this they wait in the kernel
+#define ZEQ_UDP_RECV_SLOTS 512
+//datagrams held for a UDP socket whose send buffer is full; the oldest are dropped past this
+#define ZEQ_UDP_SEND_QUEUE_MAX 256
+//most datagrams moved by one recvmmsg or sendmmsg call
+#define ZEQ_UDP_BATCH 64
 
-class Socket 
+class NetReactor;
+
+class Socket
 {
 public:
 	Socket(bool blocking, const char* host, const char* port, int sock_type);
 	virtual ~Socket();
+	//Called when the socket is readable; reads until it would block
 	virtual void Receive() = 0;
+	//Called when the socket is writable; sends whatever is pending until it would block
+	virtual void Flush() = 0;
+	bool	HasPendingSend() const { return mPendingSend; }
+	bool	IsOpen() const { return mSocket != ZEQ_SOCKET_CLOSED; }
+	bool	IsBlocking() const { return mBlocking; }
+	SOCKET	GetHandle() const { return mSocket; }
+	void	Close();
+	//Next received packet, or nullptr; the caller holds its reference and releases it when done
+	Packet*	NextPacket();
 #ifdef WIN32
 	static void InitializeSocketLib();
 	static void CloseSocketLib();
 #endif
 protected:
+	static bool WouldBlock();
+	//Sends still waiting for the kernel change whether the reactor watches for writability
+	void	SetPendingSend(bool pending);
+
+	friend class NetReactor;
+
 	SOCKET mSocket;
-	char mRecvBuf[ZEQ_RECVBUF_SIZE];
+	bool mBlocking;
+	bool mPendingSend;
+	NetReactor* mReactor; //nullptr unless added to one
 	std::queue<Packet*> mPacketQueue;
 };
 
@@ -42,21 +81,77 @@ class TCPSocket : public Socket
 {
 public:
 	TCPSocket(const char* host, const char* port, bool blocking = false);
+	virtual ~TCPSocket();
 	virtual void Receive() override;
+	virtual void Flush() override;
 	virtual void Send(const byte* raw_data, size_t len);
+	//Queues the packet itself rather than a copy, holding a reference until it has all gone
 	virtual void Send(Packet* packet);
 protected:
-	uint16 mRecvBuf_pos;
-	uint32 mRecvBuf_end;
+	//Called with each chunk of the stream as it arrives, read straight into a pooled packet; takes the reference
+	virtual void OnData(Packet* packet);
+
+	std::deque<Packet*> mSendQueue; //packets the kernel hasn't taken all of yet
+	size_t mSendPos; //bytes of the front packet already sent
+};
+
+//Fixed number of equally sized datagram buffers, used first in, first out, so a burst costs no allocation
+//Slot i counts from the oldest datagram; slots from GetCount() on are free to be written and then committed
+class DatagramRing
+{
+public:
+	DatagramRing(uint32 slots, uint32 slotSize);
+	~DatagramRing();
+	uint32	GetCount() const { return mCount; }
+	uint32	GetFree() const { return mSlots - mCount; }
+	uint32	GetSlotSize() const { return mSlotSize; }
+	byte*	GetSlot(uint32 i) { return mData + ((mHead + i) % mSlots) * mSlotSize; }
+	uint32	GetLen(uint32 i) const { return mLens[(mHead + i) % mSlots]; }
+	void	SetLen(uint32 i, uint32 len) { mLens[(mHead + i) % mSlots] = len; }
+	//Makes the first count free slots part of the ring
+	void	Commit(uint32 count) { mCount += count; }
+	//Drops the oldest count datagrams
+	void	Pop(uint32 count = 1) { mHead = (mHead + count) % mSlots; mCount -= count; }
+	//Copies a datagram in at the back
+	void	Push(const byte* data, uint32 len);
+private:
+	//not copyable
+	DatagramRing(const DatagramRing&);
+	DatagramRing& operator=(const DatagramRing&);
+
+	byte*	mData;
+	uint32*	mLens;
+	uint32	mSlots;
+	uint32	mSlotSize;
+	uint32	mHead;
+	uint32	mCount;
 };
 
 class UDPSocket : public Socket
 {
 public:
 	UDPSocket(const char* host, const char* port, bool blocking = false);
+	//Reads as many waiting datagrams as there are free slots, a batch per call where the platform allows
 	void Receive() override;
-	void Send(const byte* raw_data, size_t len, bool ack_req = false);
-	void Send(Packet* packet, bool ack_req = false);
+	void Flush() override;
+	void Send(const byte* raw_data, size_t len);
+	void Send(Packet* packet);
+	//Sends count datagrams in as few calls as possible; whatever the kernel has no room for is queued, in order
+	void SendBatch(const byte* const* data, const uint32* lens, uint32 count);
+	//Oldest received datagram, or nullptr; it points into the socket's own buffers and is good until it is popped
+	const byte* PeekDatagram(uint32& len);
+	void PopDatagram() { mRecvRing.Pop(); }
+protected:
+	void Enqueue(const byte* data, uint32 len);
+	//Sends from the first of count datagrams on until the kernel is full; returns how many went
+	uint32 SendMany(const byte* const* data, const uint32* lens, uint32 count);
+
+	DatagramRing mRecvRing;
+	DatagramRing mSendQueue; //datagrams the kernel had no room for
+#ifdef ZEQ_HAVE_MMSG
+	mmsghdr mMsgs[ZEQ_UDP_BATCH];
+	iovec mIovecs[ZEQ_UDP_BATCH];
+#endif
 };
 
 class HTTPSocket : public TCPSocket
@@ -64,6 +159,15 @@ class HTTPSocket : public TCPSocket
 public:
 	HTTPSocket(const char* host, bool blocking = false);
 	void Receive() override;
+	//Everything received so far, headers included
+	const std::string& GetResponse() const { return mResponse; }
+	//True once the server has closed the connection
+	bool IsComplete() const { return mComplete; }
+protected:
+	void OnData(Packet* packet) override;
+
+	std::string mResponse;
+	bool mComplete;
 };
 
 #endif
@@ -0,0 +1,89 @@
+
+#include "texture_decode.h"
+
+#ifdef ZEQ_TEXTURE_SSE
+#include <emmintrin.h>
+#endif
+
+bool PalettedBitmap::Init(const byte* data, uint32 len)
+{
+	if (len < sizeof(BMPFileHeader) + sizeof(BMPInfoHeader))
+		return false;
+
+	BMPFileHeader file;
+	BMPInfoHeader info;
+	memcpy(&file,data,sizeof(BMPFileHeader));
+	memcpy(&info,data + sizeof(BMPFileHeader),sizeof(BMPInfoHeader));
+	if (file.type != 0x4D42 || info.bitCount != 8 || info.compression != 0 || info.width <= 0 || info.height == 0)
+		return false;
+
+	mWidth = info.width;
+	mBottomUp = info.height > 0;
+	mHeight = mBottomUp ? info.height : -info.height;
+	mStride = (mWidth + 3) & ~3;
+
+	uint32 colours = (info.clrUsed == 0 || info.clrUsed > 256) ? 256 : info.clrUsed;
+	uint64_t paletteStart = (uint64_t)sizeof(BMPFileHeader) + info.size;
+	if (info.size < sizeof(BMPInfoHeader) || paletteStart + colours * 4 > len)
+		return false;
+	if ((uint64_t)file.offBits + (uint64_t)mStride * mHeight > len)
+		return false;
+
+	//entries are stored blue, green, red, unused, which is already our output order once alpha is filled in
+	const uint8* palette = data + paletteStart;
+	for (uint32 i = 0; i < colours; ++i)
+	{
+		const uint8* entry = palette + i * 4;
+		uint8 pixel[4];
+		pixel[0] = entry[0];
+		pixel[1] = entry[1];
+		pixel[2] = entry[2];
+		pixel[3] = (entry[0] == palette[0] && entry[1] == palette[1] && entry[2] == palette[2]) ? 0 : 255;
+		memcpy(&mTable[i],pixel,4);
+	}
+	//indices past the end of a short palette shouldn't appear, but they come out transparent black if they do
+	if (colours < 256)
+		memset(&mTable[colours],0,(256 - colours) * sizeof(uint32));
+
+	mIndices = data + file.offBits;
+	return true;
+}
+
+void PalettedBitmap::DecodeRows(uint8* dst, uint32 begin, uint32 end) const
+{
+	const uint32* table = mTable;
+	for (uint32 y = begin; y < end; ++y)
+	{
+		const uint8* src = mIndices + (mBottomUp ? mHeight - 1 - y : y) * mStride;
+		uint32* out = reinterpret_cast<uint32*>(dst + y * mWidth * 4);
+		uint32 x = 0;
+
+#ifdef ZEQ_TEXTURE_SSE
+		//SSE2 has no gather, so the lookups stay scalar; the win is building whole pixels and storing 8 at a time
+		for (; x + 8 <= mWidth; x += 8)
+		{
+			__m128i lo = _mm_setr_epi32(table[src[x]],table[src[x + 1]],table[src[x + 2]],table[src[x + 3]]);
+			__m128i hi = _mm_setr_epi32(table[src[x + 4]],table[src[x + 5]],table[src[x + 6]],table[src[x + 7]]);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x),lo);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x + 4),hi);
+		}
+#endif
+		for (; x < mWidth; ++x)
+			out[x] = table[src[x]];
+	}
+}
+
+void PalettedBitmap::Decode(uint8* dst) const
+{
+	if ((uint64_t)mWidth * mHeight < ZEQ_TEXTURE_PARALLEL_PIXELS)
+	{
+		DecodeRows(dst,0,mHeight);
+		return;
+	}
+
+	//rows are independent, so each task writes its own slice of dst
+	const PalettedBitmap* self = this;
+	WorkerPool::GetShared().ParallelFor(mHeight,ZEQ_TEXTURE_ROWS_PER_TASK,[self,dst](uint32 begin, uint32 end) {
+		self->DecodeRows(dst,begin,end);
+	});
+}
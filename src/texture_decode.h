@@ -0,0 +1,67 @@
+
+#ifndef ZEQ_TEXTURE_DECODE_H
+#define ZEQ_TEXTURE_DECODE_H
+
+#include <string.h>
+#include <stdint.h>
+#include "type.h"
+#include "worker_pool.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define ZEQ_TEXTURE_SSE
+#endif
+
+//images with fewer pixels than this are expanded on the calling thread; a 256x256 texture isn't worth handing out
+#define ZEQ_TEXTURE_PARALLEL_PIXELS (512 * 512)
+#define ZEQ_TEXTURE_ROWS_PER_TASK 64
+
+//Our own copies of the BMP headers, so decoding doesn't depend on windows.h
+#pragma pack(push,1)
+struct BMPFileHeader
+{
+	uint16 type; //"BM"
+	uint32 size;
+	uint16 reserved[2];
+	uint32 offBits;
+};
+
+struct BMPInfoHeader
+{
+	uint32 size;
+	int32 width;
+	int32 height; //negative for top down images
+	uint16 planes;
+	uint16 bitCount;
+	uint32 compression;
+	uint32 sizeImage;
+	int32 xPelsPerMeter;
+	int32 yPelsPerMeter;
+	uint32 clrUsed;
+	uint32 clrImportant;
+};
+#pragma pack(pop)
+
+//An 8 bit palettized BMP, expanded to 32 bit BGRA through a lookup table built once per image
+//Anything matching the colour of palette entry 0 is transparent
+class PalettedBitmap
+{
+public:
+	//Returns false if data isn't an uncompressed 8 bit BMP, or is too short for what its headers claim
+	bool	Init(const byte* data, uint32 len);
+	uint32	GetWidth() const { return mWidth; }
+	uint32	GetHeight() const { return mHeight; }
+	//Expands output rows [begin, end), top row first, into dst, which holds the whole image at width * 4 bytes a row
+	void	DecodeRows(uint8* dst, uint32 begin, uint32 end) const;
+	//Expands the whole image, split by rows across the shared worker pool when it is large enough
+	void	Decode(uint8* dst) const;
+
+private:
+	uint32	mTable[256]; //BGRA in memory, alpha baked in
+	const uint8* mIndices;
+	uint32	mWidth;
+	uint32	mHeight;
+	uint32	mStride; //source rows are padded to 4 bytes
+	bool	mBottomUp;
+};
+
+#endif
@@ -0,0 +1,388 @@
+
+#include "texture_registry.h"
+#include "gfx_loaders.h"
+
+bool TextureRegistry::ImageKey::operator<(const ImageKey& o) const
+{
+	if (crc != o.crc) return crc < o.crc;
+	if (adler != o.adler) return adler < o.adler;
+	if (size != o.size) return size < o.size;
+	if (width != o.width) return width < o.width;
+	if (height != o.height) return height < o.height;
+	if (depth != o.depth) return depth < o.depth;
+	if (format != o.format) return format < o.format;
+	return mipmaps < o.mipmaps;
+}
+
+TextureRegistry::TextureRegistry()
+{
+	mAliasCount = 0;
+}
+
+TextureRegistry::~TextureRegistry()
+{
+	for (auto itr = mPending.begin(); itr != mPending.end(); itr++)
+	{
+		delete *itr;
+	}
+	for (auto itr = mPacked.begin(); itr != mPacked.end(); itr++)
+	{
+		delete *itr;
+	}
+}
+
+void TextureRegistry::Add(const char* name, const Ogre::Image& img, int mipmaps, ZoneData* zone_data, bool atlas)
+{
+	//two independent checksums plus the size stand in for comparing pixels, so we never have to keep them around
+	ImageKey key;
+	key.width = img.getWidth();
+	key.height = img.getHeight();
+	key.depth = img.getDepth();
+	key.format = img.getFormat();
+	key.mipmaps = mipmaps;
+	key.size = img.getSize();
+	key.crc = Crc32(0,img.getData(),key.size);
+	key.adler = adler32(1,img.getData(),key.size);
+
+	std::string material(name);
+	material += "_Material";
+
+	auto itr = mImages.find(key);
+	if (itr != mImages.end())
+	{
+		//same pixels as a texture already up, so its material will do just as well
+		mMaterials[material] = itr->second + "_Material";
+		mAliasCount++;
+		return;
+	}
+
+	mImages[key] = name;
+	mMaterials[material] = material;
+
+#ifdef ZEQ_TEXTURE_ATLAS
+	//pages are plain BGRA with no mipmaps, so only textures the same can be packed onto one
+	if (atlas && img.getFormat() == Ogre::PF_BYTE_BGRA && img.getDepth() == 1 && img.getNumMipmaps() == 0 &&
+		key.width <= ZEQ_ATLAS_MAX_TEXTURE && key.height <= ZEQ_ATLAS_MAX_TEXTURE)
+	{
+		PendingTile* tile = new PendingTile;
+		tile->name = name;
+		tile->material = material;
+		tile->mipmaps = mipmaps;
+		tile->image = img; //copies the pixels
+		mPending.push_back(tile);
+		return;
+	}
+#endif
+
+	S3D::UploadTexture(name,img,mipmaps,zone_data);
+}
+
+bool TextureRegistry::Has(const char* name) const
+{
+	std::string material(name);
+	material += "_Material";
+	return mMaterials.count(material) != 0;
+}
+
+const char* TextureRegistry::GetMaterial(const char* material) const
+{
+	auto itr = mMaterials.find(material);
+	if (itr == mMaterials.end())
+		return material;
+	return itr->second.c_str();
+}
+
+const char* TextureRegistry::Require(const char* material, ZoneData* zone_data)
+{
+	const char* actual = GetMaterial(material);
+#ifdef ZEQ_TEXTURE_ATLAS
+	auto tile = mTiles.find(actual);
+	if (tile != mTiles.end() && tile->second.source)
+	{
+		UploadAlone(tile->second.source,zone_data);
+		tile->second.source = nullptr;
+	}
+#endif
+	return actual;
+}
+
+bool TextureRegistry::ComparePending(const PendingTile* a, const PendingTile* b)
+{
+	if (a->image.getHeight() != b->image.getHeight())
+		return a->image.getHeight() > b->image.getHeight();
+	if (a->image.getWidth() != b->image.getWidth())
+		return a->image.getWidth() > b->image.getWidth();
+	//names break ties, so the same archive always packs into the same pages
+	return a->name < b->name;
+}
+
+void TextureRegistry::BuildAtlas(ZoneData* zone_data)
+{
+	//a page holding a single texture saves nothing
+	if (mPending.size() >= 2)
+	{
+		//tallest first, packed into shelves left to right
+		std::stable_sort(mPending.begin(),mPending.end(),ComparePending);
+
+		const uint32 pageBytes = ZEQ_ATLAS_PAGE_SIZE * ZEQ_ATLAS_PAGE_SIZE * 4;
+		const size_t chainBytes = Ogre::Image::calculateSize(ZEQ_ATLAS_MIPMAPS,1,ZEQ_ATLAS_PAGE_SIZE,ZEQ_ATLAS_PAGE_SIZE,1,Ogre::PF_BYTE_BGRA);
+		uint8* pixels = nullptr;
+		std::vector<std::pair<PendingTile*,AtlasTile>> placed;
+		uint32 x = 0, y = 0, shelf = 0;
+		for (auto itr = mPending.begin(); itr != mPending.end(); itr++)
+		{
+			PendingTile* pending = *itr;
+			int32 w = pending->image.getWidth();
+			int32 h = pending->image.getHeight();
+			uint32 tw = (w + ZEQ_ATLAS_GUTTER * 2 + ZEQ_ATLAS_ALIGN - 1) & ~(ZEQ_ATLAS_ALIGN - 1);
+			uint32 th = (h + ZEQ_ATLAS_GUTTER * 2 + ZEQ_ATLAS_ALIGN - 1) & ~(ZEQ_ATLAS_ALIGN - 1);
+
+			if (x + tw > ZEQ_ATLAS_PAGE_SIZE)
+			{
+				x = 0;
+				y += shelf;
+				shelf = 0;
+			}
+			if (!pixels || y + th > ZEQ_ATLAS_PAGE_SIZE)
+			{
+				if (pixels)
+					FinishPage(pixels,placed,zone_data);
+				//room for the mip levels below the page as well; they are built from it once it is full
+				pixels = OGRE_ALLOC_T(uint8,chainBytes,Ogre::MEMCATEGORY_GENERAL);
+				memset(pixels,0,pageBytes);
+				x = y = shelf = 0;
+			}
+
+			//copy the texture in with its edges repeated out into the gutter
+			const uint32* src = reinterpret_cast<const uint32*>(pending->image.getData());
+			uint32* dst = reinterpret_cast<uint32*>(pixels) + y * ZEQ_ATLAS_PAGE_SIZE + x;
+			for (uint32 ty = 0; ty < th; ++ty)
+			{
+				int32 sy = std::min(std::max((int32)ty - ZEQ_ATLAS_GUTTER,0),h - 1);
+				const uint32* srcRow = src + sy * w;
+				uint32* dstRow = dst + ty * ZEQ_ATLAS_PAGE_SIZE;
+				for (uint32 tx = 0; tx < tw; ++tx)
+				{
+					int32 sx = std::min(std::max((int32)tx - ZEQ_ATLAS_GUTTER,0),w - 1);
+					dstRow[tx] = srcRow[sx];
+				}
+			}
+
+			AtlasTile tile;
+			tile.source = pending;
+			tile.uOffset = (float)(x + ZEQ_ATLAS_GUTTER) / ZEQ_ATLAS_PAGE_SIZE;
+			tile.vOffset = (float)(y + ZEQ_ATLAS_GUTTER) / ZEQ_ATLAS_PAGE_SIZE;
+			tile.uScale = (float)w / ZEQ_ATLAS_PAGE_SIZE;
+			tile.vScale = (float)h / ZEQ_ATLAS_PAGE_SIZE;
+			placed.push_back(std::make_pair(pending,tile));
+
+			x += tw;
+			shelf = std::max(shelf,th);
+		}
+		FinishPage(pixels,placed,zone_data);
+
+		//the pixels stay, in case a run that tiles its texture needs it on its own after all
+		mPacked.insert(mPacked.end(),mPending.begin(),mPending.end());
+	}
+	else
+	{
+		for (auto itr = mPending.begin(); itr != mPending.end(); itr++)
+		{
+			UploadAlone(*itr,zone_data);
+			delete *itr;
+		}
+	}
+	mPending.clear();
+}
+
+void TextureRegistry::FinishPage(uint8* pixels, std::vector<std::pair<PendingTile*,AtlasTile>>& placed, ZoneData* zone_data)
+{
+	//pages are named after their contents, so one already up from another zone or its cache is only reused if it is the same
+	const uint32 pageBytes = ZEQ_ATLAS_PAGE_SIZE * ZEQ_ATLAS_PAGE_SIZE * 4;
+	char name[64];
+	snprintf(name,64,"zeq_atlas_%08x",Crc32(0,pixels,pageBytes));
+	BuildPageMipmaps(pixels);
+
+	//the image takes ownership of pixels
+	Ogre::Image img;
+	img.loadDynamicImage(pixels,ZEQ_ATLAS_PAGE_SIZE,ZEQ_ATLAS_PAGE_SIZE,1,Ogre::PF_BYTE_BGRA,true,1,ZEQ_ATLAS_MIPMAPS);
+	if (!Ogre::TextureManager::getSingleton().resourceExists(name))
+		S3D::UploadTexture(name,img,ZEQ_ATLAS_MIPMAPS,zone_data);
+	else if (zone_data->mCacheWriter)
+		zone_data->mCacheWriter->AddTexture(name,img,ZEQ_ATLAS_MIPMAPS);
+
+	std::string material(name);
+	material += "_Material";
+	for (auto itr = placed.begin(); itr != placed.end(); itr++)
+	{
+		AtlasTile& tile = itr->second;
+		tile.material = material;
+		mTiles[itr->first->material] = tile;
+	}
+	placed.clear();
+}
+
+void TextureRegistry::BuildPageMipmaps(uint8* pixels)
+{
+	//each level is a 2x2 box filter of the one before, stored straight after it as Ogre expects; the alignment and
+	//gutter keep every box inside one texture and its own repeated edges
+	uint8* src = pixels;
+	uint32 size = ZEQ_ATLAS_PAGE_SIZE;
+	for (uint32 level = 0; level < ZEQ_ATLAS_MIPMAPS; ++level)
+	{
+		uint32 half = size / 2;
+		uint8* dst = src + size * size * 4;
+		for (uint32 y = 0; y < half; ++y)
+		{
+			const uint8* row0 = src + (y * 2) * size * 4;
+			const uint8* row1 = row0 + size * 4;
+			uint8* out = dst + y * half * 4;
+			for (uint32 x = 0; x < half * 4; ++x)
+			{
+				uint32 i = (x & ~3u) * 2 + (x & 3);
+				out[x] = (row0[i] + row0[i + 4] + row1[i] + row1[i + 4] + 2) >> 2;
+			}
+		}
+		src = dst;
+		size = half;
+	}
+}
+
+void TextureRegistry::Remap(MeshBuildData& data, ZoneData* zone_data, bool atlas)
+{
+	std::vector<MeshRun>& runs = data.mRuns;
+	for (auto itr = runs.begin(); itr != runs.end(); itr++)
+	{
+		itr->mMaterial = GetMaterial(itr->mMaterial);
+	}
+
+#ifdef ZEQ_TEXTURE_ATLAS
+	if (!mTiles.empty())
+	{
+		//the run each vertex belongs to, or -2 if more than one run uses it
+		if (atlas)
+		{
+			mOwner.assign(data.mVertices.size(),-1);
+			for (uint32 r = 0; r < runs.size(); ++r)
+			{
+				const MeshRun& run = runs[r];
+				for (uint32 i = run.mIndexStart; i < run.mIndexStart + run.mIndexCount; ++i)
+				{
+					int32& owner = mOwner[data.mIndices[i]];
+					if (owner == -1)
+						owner = r;
+					else if (owner != (int32)r)
+						owner = -2;
+				}
+			}
+		}
+
+		for (uint32 r = 0; r < runs.size(); ++r)
+		{
+			auto tile = mTiles.find(runs[r].mMaterial);
+			if (tile == mTiles.end())
+				continue;
+			if (atlas && MoveToAtlas(data,runs[r],r,tile->second))
+			{
+				runs[r].mMaterial = tile->second.material.c_str();
+			}
+			else if (tile->second.source)
+			{
+				//this run keeps the texture's own material, which only now has to exist
+				UploadAlone(tile->second.source,zone_data);
+				tile->second.source = nullptr;
+			}
+		}
+	}
+#endif
+
+	//runs sharing a material are drawn as one, so regroup the index list if any do
+	bool shared = false;
+	for (uint32 r = 0; r < runs.size() && !shared; ++r)
+	{
+		for (uint32 s = r + 1; s < runs.size(); ++s)
+		{
+			if (strcmp(runs[r].mMaterial,runs[s].mMaterial) == 0)
+			{
+				shared = true;
+				break;
+			}
+		}
+	}
+	if (!shared)
+		return;
+
+	mIndices.clear();
+	mRuns.clear();
+	for (uint32 r = 0; r < runs.size(); ++r)
+	{
+		if (!runs[r].mMaterial)
+			continue; //already merged into an earlier run
+
+		MeshRun merged;
+		merged.mMaterial = runs[r].mMaterial;
+		merged.mIndexStart = mIndices.size();
+		for (uint32 s = r; s < runs.size(); ++s)
+		{
+			MeshRun& run = runs[s];
+			if (!run.mMaterial || strcmp(run.mMaterial,merged.mMaterial) != 0)
+				continue;
+			mIndices.insert(mIndices.end(),data.mIndices.begin() + run.mIndexStart,data.mIndices.begin() + run.mIndexStart + run.mIndexCount);
+			run.mMaterial = nullptr;
+		}
+		merged.mIndexCount = mIndices.size() - merged.mIndexStart;
+		mRuns.push_back(merged);
+	}
+	data.mIndices.swap(mIndices);
+	runs.swap(mRuns);
+}
+
+bool TextureRegistry::MoveToAtlas(MeshBuildData& data, MeshRun& run, uint32 runIndex, const AtlasTile& tile)
+{
+	//a run that tiles its texture needs the texture to itself
+	uint32 end = run.mIndexStart + run.mIndexCount;
+	uint32 copies = 0;
+	for (uint32 i = run.mIndexStart; i < end; ++i)
+	{
+		uint16 index = data.mIndices[i];
+		const MeshVertex& v = data.mVertices[index];
+		if (v.u < -ZEQ_ATLAS_UV_SLACK || v.u > 1.0f + ZEQ_ATLAS_UV_SLACK || v.v < -ZEQ_ATLAS_UV_SLACK || v.v > 1.0f + ZEQ_ATLAS_UV_SLACK)
+			return false;
+		if (mOwner[index] != (int32)runIndex)
+			copies++;
+	}
+	//vertices shared with other runs are copied rather than moved, and indices are only 16 bits
+	if (data.mVertices.size() + copies > 0x10000)
+		return false;
+
+	mCopies.assign(data.mVertices.size(),-1);
+	for (uint32 i = run.mIndexStart; i < end; ++i)
+	{
+		uint16 index = data.mIndices[i];
+		if (mCopies[index] >= 0)
+		{
+			data.mIndices[i] = mCopies[index];
+			continue;
+		}
+
+		uint32 dst = index;
+		if (mOwner[index] != (int32)runIndex)
+		{
+			MeshVertex copy = data.mVertices[index];
+			dst = data.mVertices.size();
+			data.mVertices.push_back(copy);
+		}
+		MeshVertex& v = data.mVertices[dst];
+		v.u = tile.uOffset + std::min(std::max(v.u,0.0f),1.0f) * tile.uScale;
+		v.v = tile.vOffset + std::min(std::max(v.v,0.0f),1.0f) * tile.vScale;
+		mCopies[index] = dst;
+		data.mIndices[i] = dst;
+	}
+	return true;
+}
+
+void TextureRegistry::UploadAlone(PendingTile* pending, ZoneData* zone_data)
+{
+	S3D::UploadTexture(pending->name.c_str(),pending->image,pending->mipmaps,zone_data);
+	pending->image.freeMemory();
+}
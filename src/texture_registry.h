@@ -0,0 +1,115 @@
+
+#ifndef ZEQ_TEXTURE_REGISTRY_H
+#define ZEQ_TEXTURE_REGISTRY_H
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include "zlib.h"
+#include "crc.h"
+#include "type.h"
+#include "mesh_builder.h"
+
+//comment out to keep every texture on its own, even where it could share an atlas page
+#define ZEQ_TEXTURE_ATLAS
+#define ZEQ_ATLAS_PAGE_SIZE 1024
+//only textures no bigger than this either way are packed; larger ones gain little from sharing a page
+#define ZEQ_ATLAS_MAX_TEXTURE 128
+//mip levels built for each page; textures packed onto one were mipmapped on their own, so it has to be too
+#define ZEQ_ATLAS_MIPMAPS 3
+//edge pixels repeated around each packed texture, so filtering doesn't pick up its neighbours; wide enough to leave
+//two pixels on the smallest mip level
+#define ZEQ_ATLAS_GUTTER (2 << ZEQ_ATLAS_MIPMAPS)
+//packed textures start and end on multiples of this, so each texel of every mip level covers only one of them
+#define ZEQ_ATLAS_ALIGN (1 << ZEQ_ATLAS_MIPMAPS)
+//how far outside [0, 1] a run's UVs may stray and still be treated as not tiling
+#define ZEQ_ATLAS_UV_SLACK 0.001f
+
+struct ZoneData;
+
+//Tracks every texture uploaded for a zone, across its zone, object and character archives
+//Decoded images are hashed, so an image that is identical to one already uploaded becomes an alias for it instead of
+//another texture and material; small static textures can also be packed onto shared atlas pages
+class TextureRegistry
+{
+public:
+	TextureRegistry();
+	~TextureRegistry();
+	//Uploads a decoded texture and creates its material, or makes its name an alias if the same image is already up;
+	//must be called on the render thread. With atlas set, small textures are held back for the next BuildAtlas instead
+	void	Add(const char* name, const Ogre::Image& img, int mipmaps, ZoneData* zone_data, bool atlas);
+	//True if a texture has been added under this name, whether it was uploaded or became an alias
+	bool	Has(const char* name) const;
+	//Maps a "<texture>_Material" name to the material actually created for that image
+	const char* GetMaterial(const char* material) const;
+	//GetMaterial for meshes that don't go through Remap; uploads the texture on its own if it was only packed so far
+	const char* Require(const char* material, ZoneData* zone_data);
+	//Packs the textures held back since the last call onto atlas pages and uploads the pages; a packed texture is
+	//only uploaded on its own if Remap later finds a run that can't use its page
+	void	BuildAtlas(ZoneData* zone_data);
+	//Points a built mesh's runs at the materials actually created; with atlas set, runs whose UVs don't tile are
+	//moved onto their atlas page. Runs that end up sharing a material are merged into one
+	void	Remap(MeshBuildData& data, ZoneData* zone_data, bool atlas);
+	uint32	GetAliasCount() const { return mAliasCount; }
+	uint32	GetTileCount() const { return mTiles.size(); }
+
+private:
+	struct ImageKey
+	{
+		uint32 width;
+		uint32 height;
+		uint32 depth;
+		uint32 format;
+		int32 mipmaps;
+		uint32 size;
+		uint32 crc;
+		uint32 adler;
+		bool operator<(const ImageKey& o) const;
+	};
+
+	struct PendingTile
+	{
+		std::string name;
+		std::string material; //the tile stands in for
+		int mipmaps;
+		Ogre::Image image;
+	};
+
+	struct AtlasTile
+	{
+		std::string material; //of the page
+		PendingTile* source; //not uploaded on its own yet, or null once it is
+		float uOffset;
+		float vOffset;
+		float uScale;
+		float vScale;
+	};
+
+	//not copyable
+	TextureRegistry(const TextureRegistry&);
+	TextureRegistry& operator=(const TextureRegistry&);
+
+	static bool ComparePending(const PendingTile* a, const PendingTile* b);
+	void	FinishPage(uint8* pixels, std::vector<std::pair<PendingTile*,AtlasTile>>& placed, ZoneData* zone_data);
+	static void BuildPageMipmaps(uint8* pixels);
+	bool	MoveToAtlas(MeshBuildData& data, MeshRun& run, uint32 runIndex, const AtlasTile& tile);
+	void	UploadAlone(PendingTile* pending, ZoneData* zone_data);
+
+	std::map<ImageKey,std::string> mImages; //the texture each distinct image was uploaded as
+	std::unordered_map<std::string,std::string> mMaterials; //by the material name meshes use
+	std::unordered_map<std::string,AtlasTile> mTiles; //by the material the tile stands in for
+	std::vector<PendingTile*> mPending;
+	std::vector<PendingTile*> mPacked; //kept until the registry goes, since any later mesh may still need one alone
+	uint32	mAliasCount;
+	//Remap scratch, reused between meshes
+	std::vector<int32> mOwner;
+	std::vector<int32> mCopies;
+	std::vector<uint16> mIndices;
+	std::vector<MeshRun> mRuns;
+};
+
+#endif
@@ -0,0 +1,117 @@
+
+#include "texture_staging.h"
+
+TextureStaging::TextureStaging(S3DArchive* archive)
+{
+	mArchive = archive;
+	mPending = 0;
+}
+
+TextureStaging::~TextureStaging()
+{
+	{
+		boost::unique_lock<boost::mutex> lock(mMutex);
+		while (mPending > 0)
+			mFinished.wait(lock);
+	}
+	for (auto itr = mTextures.begin(); itr != mTextures.end(); itr++)
+	{
+		delete *itr;
+	}
+}
+
+void TextureStaging::Start(const std::vector<uint32>& indices)
+{
+	for (auto itr = indices.begin(); itr != indices.end(); itr++)
+	{
+		StagedTexture* tex = new StagedTexture;
+		tex->index = *itr;
+		tex->name = mArchive->GetFileName(*itr);
+		tex->mipmaps = Ogre::MIP_DEFAULT;
+		mTextures.push_back(tex);
+	}
+
+	{
+		boost::lock_guard<boost::mutex> lock(mMutex);
+		mPending += indices.size();
+	}
+	//queued separately so a big texture doesn't hold up the small ones behind it
+	WorkerPool& pool = WorkerPool::GetShared();
+	for (auto itr = mTextures.end() - indices.size(); itr != mTextures.end(); itr++)
+	{
+		pool.Enqueue(std::bind(&TextureStaging::Run,this,*itr));
+	}
+}
+
+StagedTexture* TextureStaging::Next()
+{
+	StagedTexture* tex;
+	{
+		boost::unique_lock<boost::mutex> lock(mMutex);
+		while (mReady.empty() && mPending > 0)
+			mFinished.wait(lock);
+		if (mReady.empty())
+			return nullptr;
+		tex = mReady.front();
+		mReady.pop_front();
+	}
+
+	if (tex->error)
+		std::rethrow_exception(tex->error);
+	return tex;
+}
+
+void TextureStaging::Run(StagedTexture* tex)
+{
+	//entries are independent of each other, so inflating different ones on different threads is safe
+	try
+	{
+		S3DFileEntry* entry = mArchive->GetFile(tex->index);
+		Decode(entry,tex->image,tex->mipmaps);
+		mArchive->Release(entry);
+	}
+	catch (...)
+	{
+		tex->error = std::current_exception();
+	}
+
+	boost::lock_guard<boost::mutex> lock(mMutex);
+	mReady.push_back(tex);
+	mPending--;
+	mFinished.notify_all();
+}
+
+void TextureStaging::Decode(S3DFileEntry* entry, Ogre::Image& img, int& mipmaps)
+{
+	mipmaps = Ogre::MIP_DEFAULT;
+	char magic = (char)*entry->mData;
+	if (magic == 'D')
+	{
+		//need to alter DDS headers to exclude bad mipmaps
+		uint32 temp = 1;
+		memcpy(&entry->mData[28],&temp,sizeof(uint32));
+		temp = 0x1000;
+		memcpy(&entry->mData[108],&temp,sizeof(uint32));
+	}
+	else
+	{
+		//palettized BMPs have no alpha channel, so we expand them ourselves with one added
+		PalettedBitmap bmp;
+		if (bmp.Init(entry->mData,entry->mDataSize))
+		{
+			uint32 width = bmp.GetWidth();
+			uint32 height = bmp.GetHeight();
+			uint8* ptr = OGRE_ALLOC_T(uint8,width * height * 4,Ogre::MEMCATEGORY_GENERAL);
+			bmp.Decode(ptr);
+
+			//the image takes ownership of ptr
+			img.loadDynamicImage(ptr,width,height,1,Ogre::PF_BYTE_BGRA,true);
+			mipmaps = 0;
+			return;
+		}
+	}
+
+	//the image copies what it needs, so the entry can be released afterwards
+	Ogre::DataStreamPtr data(new Ogre::MemoryDataStream(entry->mData,entry->mDataSize));
+	img.load(data);
+}
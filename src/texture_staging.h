@@ -0,0 +1,59 @@
+
+#ifndef ZEQ_TEXTURE_STAGING_H
+#define ZEQ_TEXTURE_STAGING_H
+
+#include <string.h>
+#include <vector>
+#include <deque>
+#include <exception>
+#include <boost/thread.hpp>
+#include "type.h"
+#include "exception.h"
+#include "s3d_archive.h"
+#include "worker_pool.h"
+#include "texture_decode.h"
+
+//A texture decoded into system memory, waiting for the render thread to upload it
+struct StagedTexture
+{
+	uint32 index;
+	const char* name; //the archive's file name, valid as long as the archive is open
+	Ogre::Image image;
+	int mipmaps; //what to ask of the texture manager
+	std::exception_ptr error;
+};
+
+//Decodes textures from an archive on the worker pool, so they can be decoded while the WLDs are parsed
+//and the render thread only has to upload the results
+class TextureStaging
+{
+public:
+	TextureStaging(S3DArchive* archive);
+	//Waits for any decodes still running, since they use the archive
+	~TextureStaging();
+	//Queues the entries for decoding and returns straight away; each is inflated, decoded and released on a worker
+	//Nothing else may request or release these entries until they have all been taken
+	void	Start(const std::vector<uint32>& indices);
+	//Blocks until another texture has finished and returns it, in the order they finish, or nullptr once all have been taken
+	//The texture stays owned by the staging; if its decode failed, the error is rethrown here instead
+	StagedTexture* Next();
+
+	//Decodes an inflated texture file, whatever its format; safe to call from any thread
+	static void Decode(S3DFileEntry* entry, Ogre::Image& img, int& mipmaps);
+
+private:
+	//not copyable
+	TextureStaging(const TextureStaging&);
+	TextureStaging& operator=(const TextureStaging&);
+
+	void	Run(StagedTexture* tex);
+
+	S3DArchive* mArchive;
+	std::vector<StagedTexture*> mTextures;
+	std::deque<StagedTexture*> mReady;
+	uint32	mPending; //queued and not finished yet
+	boost::mutex mMutex;
+	boost::condition_variable mFinished;
+};
+
+#endif
@@ -9,11 +9,22 @@ typedef signed short int16;
 typedef unsigned short uint16;
 typedef signed int int32;
 typedef unsigned int uint32;
+typedef signed long long int64;
+typedef unsigned long long uint64;
 
 #ifdef WIN32
 #define sprintf _sprintf
 #define snprintf _snprintf
 #define strlwr _strlwr
+#else
+#include <ctype.h>
+//msvc-only; lowercases in place like the original
+inline char* strlwr(char* str)
+{
+	for (char* c = str; *c; ++c)
+		*c = tolower((byte)*c);
+	return str;
+}
 #endif
 
 #endif
@@ -0,0 +1,146 @@
+
+#include "worker_pool.h"
+
+WorkerPool::WorkerPool(uint32 numThreads)
+{
+	mShutdown = false;
+	if (numThreads == 0)
+	{
+		uint32 hw = boost::thread::hardware_concurrency();
+		numThreads = (hw > 1) ? hw - 1 : 0;
+	}
+	for (uint32 i = 0; i < numThreads; ++i)
+	{
+		mThreads.push_back(new boost::thread(&WorkerPool::WorkerLoop,this));
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		boost::lock_guard<boost::mutex> lock(mMutex);
+		mShutdown = true;
+	}
+	mWake.notify_all();
+	for (auto itr = mThreads.begin(); itr != mThreads.end(); itr++)
+	{
+		boost::thread* thread = *itr;
+		thread->join();
+		delete thread;
+	}
+}
+
+WorkerPool& WorkerPool::GetShared()
+{
+	static WorkerPool pool;
+	return pool;
+}
+
+void WorkerPool::Enqueue(const std::function<void()>& task)
+{
+	if (mThreads.empty())
+	{
+		task();
+		return;
+	}
+	{
+		boost::lock_guard<boost::mutex> lock(mMutex);
+		mTasks.push(task);
+	}
+	mWake.notify_one();
+}
+
+void WorkerPool::WorkerLoop()
+{
+	for (;;)
+	{
+		std::function<void()> task;
+		{
+			boost::unique_lock<boost::mutex> lock(mMutex);
+			while (mTasks.empty() && !mShutdown)
+				mWake.wait(lock);
+			if (mTasks.empty())
+				return;
+			task = mTasks.front();
+			mTasks.pop();
+		}
+		task();
+	}
+}
+
+void WorkerPool::ParallelFor(uint32 count, uint32 grain, const std::function<void(uint32 begin, uint32 end)>& func)
+{
+	if (count == 0)
+		return;
+	if (grain == 0)
+		grain = 1;
+
+	uint32 chunks = (count + grain - 1) / grain;
+	if (chunks == 1 || mThreads.empty())
+	{
+		func(0,count);
+		return;
+	}
+
+	//the job is shared with the helper tasks; helpers that only get to run after everything is done find no work
+	//and just drop their reference, so we never have to wait on the queue itself
+	std::shared_ptr<ForJob> job(new ForJob);
+	job->func = func;
+	job->count = count;
+	job->grain = grain;
+	job->next = 0;
+	job->done = 0;
+	job->error = nullptr;
+
+	uint32 helpers = std::min<uint32>(chunks - 1,mThreads.size());
+	for (uint32 i = 0; i < helpers; ++i)
+	{
+		Enqueue(std::bind(&WorkerPool::RunChunks,job));
+	}
+	RunChunks(job);
+
+	{
+		boost::unique_lock<boost::mutex> lock(job->mutex);
+		while (job->done.load() < chunks)
+			job->finished.wait(lock);
+	}
+
+	if (job->error)
+		throw ZEQException(job->error);
+}
+
+void WorkerPool::RunChunks(std::shared_ptr<ForJob> job)
+{
+	uint32 chunks = (job->count + job->grain - 1) / job->grain;
+	for (;;)
+	{
+		uint32 chunk = job->next.fetch_add(1);
+		if (chunk >= chunks)
+			return;
+
+		uint32 begin = chunk * job->grain;
+		uint32 end = std::min(begin + job->grain,job->count);
+		try
+		{
+			job->func(begin,end);
+		}
+		catch (ZEQException& e)
+		{
+			boost::lock_guard<boost::mutex> lock(job->mutex);
+			if (!job->error)
+				job->error = e.what();
+		}
+		catch (...)
+		{
+			boost::lock_guard<boost::mutex> lock(job->mutex);
+			if (!job->error)
+				job->error = "Worker task failed";
+		}
+
+		if (job->done.fetch_add(1) + 1 == chunks)
+		{
+			boost::lock_guard<boost::mutex> lock(job->mutex);
+			job->finished.notify_all();
+		}
+	}
+}
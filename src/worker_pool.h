@@ -0,0 +1,59 @@
+
+#ifndef ZEQ_WORKER_POOL_H
+#define ZEQ_WORKER_POOL_H
+
+#include <vector>
+#include <queue>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+#include "type.h"
+#include "exception.h"
+
+//Fixed set of worker threads for splitting CPU-heavy loading work
+//The calling thread always takes part in a ParallelFor, so a pool with no workers simply runs everything inline
+class WorkerPool
+{
+public:
+	//numThreads of 0 means one worker per hardware thread, minus the caller
+	WorkerPool(uint32 numThreads = 0);
+	~WorkerPool();
+	uint32	GetThreadCount() const { return mThreads.size(); }
+	//Runs func over [0, count) in chunks of at most grain items and blocks until all of them are done
+	//If any chunk throws, the first error is rethrown here as a ZEQException once the rest have finished
+	void	ParallelFor(uint32 count, uint32 grain, const std::function<void(uint32 begin, uint32 end)>& func);
+	//Queues a task to run on a worker thread
+	void	Enqueue(const std::function<void()>& task);
+
+	static WorkerPool& GetShared();
+
+private:
+	struct ForJob
+	{
+		std::function<void(uint32,uint32)> func;
+		uint32 count;
+		uint32 grain;
+		boost::atomic<uint32> next;
+		boost::atomic<uint32> done;
+		const char* error; //ZEQException messages are always literals
+		boost::mutex mutex;
+		boost::condition_variable finished;
+	};
+
+	//not copyable
+	WorkerPool(const WorkerPool&);
+	WorkerPool& operator=(const WorkerPool&);
+
+	void	WorkerLoop();
+	static void RunChunks(std::shared_ptr<ForJob> job);
+
+	std::vector<boost::thread*> mThreads;
+	std::queue<std::function<void()>> mTasks;
+	boost::mutex mMutex;
+	boost::condition_variable mWake;
+	bool	mShutdown;
+};
+
+#endif
@@ -0,0 +1,619 @@
+
+#include "zone_bvh.h"
+
+static float BoundsArea(const float* min, const float* max)
+{
+	float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+	return dx * dy + dy * dz + dz * dx;
+}
+
+ZoneBVH::ZoneBVH()
+{
+	mNodeCount = 0;
+	mMeshCount = 0;
+}
+
+uint32 ZoneBVH::AddMesh(const MeshVertex* vertices, uint32 vertexCount, const uint16* indices, uint32 indexCount)
+{
+	uint32 owner = mMeshCount++;
+	mTris.reserve(mTris.size() + indexCount / 3);
+	for (uint32 i = 0; i + 2 < indexCount; i += 3)
+	{
+		if (indices[i] >= vertexCount || indices[i + 1] >= vertexCount || indices[i + 2] >= vertexCount)
+			continue;
+		const MeshVertex& a = vertices[indices[i]];
+		const MeshVertex& b = vertices[indices[i + 1]];
+		const MeshVertex& c = vertices[indices[i + 2]];
+		Triangle tri;
+		tri.v0 = Ogre::Vector3(a.x,a.y,a.z);
+		tri.v1 = Ogre::Vector3(b.x,b.y,b.z);
+		tri.v2 = Ogre::Vector3(c.x,c.y,c.z);
+		tri.owner = owner;
+		mTris.push_back(tri);
+	}
+	return owner;
+}
+
+void ZoneBVH::Build()
+{
+	mNodes.clear();
+	uint32 count = mTris.size();
+	if (count == 0)
+		return;
+
+	mOrder.resize(count);
+	mCentroids.resize(count);
+	mTriBounds.resize(count);
+	WorkerPool& pool = WorkerPool::GetShared();
+	pool.ParallelFor(count,4096,[this](uint32 begin, uint32 end) {
+		for (uint32 i = begin; i < end; ++i)
+		{
+			const Triangle& tri = mTris[i];
+			Bounds& b = mTriBounds[i];
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				b.min[axis] = std::min(std::min(tri.v0[axis],tri.v1[axis]),tri.v2[axis]);
+				b.max[axis] = std::max(std::max(tri.v0[axis],tri.v1[axis]),tri.v2[axis]);
+			}
+			mCentroids[i] = (tri.v0 + tri.v1 + tri.v2) / 3.0f;
+			mOrder[i] = i;
+		}
+	});
+
+	//a binary tree with at least one triangle per leaf never needs more than 2n - 1 nodes, and reserving them all up
+	//front means subtrees on different threads can take nodes without anything moving under them
+	mNodes.resize(count * 2);
+	mNodeCount = 1;
+	std::vector<BuildTask> deferred;
+	BuildNode(0,0,count,0,&deferred);
+	BuildTask* tasks = deferred.data();
+	pool.ParallelFor(deferred.size(),1,[this,tasks](uint32 begin, uint32 end) {
+		for (uint32 i = begin; i < end; ++i)
+		{
+			BuildNode(tasks[i].node,tasks[i].begin,tasks[i].end,tasks[i].depth,nullptr);
+		}
+	});
+	mNodes.resize(mNodeCount.load());
+
+	//store the triangles in leaf order, so a leaf's triangles sit next to each other
+	std::vector<Triangle> sorted(count);
+	for (uint32 i = 0; i < count; ++i)
+	{
+		sorted[i] = mTris[mOrder[i]];
+	}
+	mTris.swap(sorted);
+
+	std::vector<uint32>().swap(mOrder);
+	std::vector<Ogre::Vector3>().swap(mCentroids);
+	std::vector<Bounds>().swap(mTriBounds);
+}
+
+uint32 ZoneBVH::AllocNodes()
+{
+	return mNodeCount.fetch_add(2);
+}
+
+void ZoneBVH::BuildNode(uint32 index, uint32 begin, uint32 end, uint32 depth, std::vector<BuildTask>* deferred)
+{
+	Node& node = mNodes[index];
+	float cmin[3] = {FLT_MAX,FLT_MAX,FLT_MAX}, cmax[3] = {-FLT_MAX,-FLT_MAX,-FLT_MAX};
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		node.min[axis] = FLT_MAX;
+		node.max[axis] = -FLT_MAX;
+	}
+	for (uint32 i = begin; i < end; ++i)
+	{
+		const Bounds& b = mTriBounds[mOrder[i]];
+		const Ogre::Vector3& c = mCentroids[mOrder[i]];
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			node.min[axis] = std::min(node.min[axis],b.min[axis]);
+			node.max[axis] = std::max(node.max[axis],b.max[axis]);
+			cmin[axis] = std::min(cmin[axis],c[axis]);
+			cmax[axis] = std::max(cmax[axis],c[axis]);
+		}
+	}
+
+	uint32 count = end - begin;
+	if (count <= ZEQ_BVH_LEAF_TRIS)
+	{
+		node.index = begin;
+		node.count = count;
+		return;
+	}
+
+	int axis = 0;
+	if (cmax[1] - cmin[1] > cmax[axis] - cmin[axis])
+		axis = 1;
+	if (cmax[2] - cmin[2] > cmax[axis] - cmin[axis])
+		axis = 2;
+	float extent = cmax[axis] - cmin[axis];
+
+	//past ZEQ_BVH_SAH_DEPTH only even splits are made, which keeps the tree shallow enough for the query stacks
+	uint32* order = &mOrder[0];
+	uint32 mid = begin;
+	if (extent > 1e-5f && depth < ZEQ_BVH_SAH_DEPTH)
+	{
+		//bin the centroids along the longest axis, then take the split with the lowest surface area cost
+		uint32 binCount[ZEQ_BVH_BINS] = {0};
+		Bounds binBounds[ZEQ_BVH_BINS];
+		for (int i = 0; i < ZEQ_BVH_BINS; ++i)
+		{
+			for (int a = 0; a < 3; ++a)
+			{
+				binBounds[i].min[a] = FLT_MAX;
+				binBounds[i].max[a] = -FLT_MAX;
+			}
+		}
+		float scale = ZEQ_BVH_BINS / extent;
+		for (uint32 i = begin; i < end; ++i)
+		{
+			int bin = std::min((int)((mCentroids[order[i]][axis] - cmin[axis]) * scale),ZEQ_BVH_BINS - 1);
+			const Bounds& b = mTriBounds[order[i]];
+			binCount[bin]++;
+			for (int a = 0; a < 3; ++a)
+			{
+				binBounds[bin].min[a] = std::min(binBounds[bin].min[a],b.min[a]);
+				binBounds[bin].max[a] = std::max(binBounds[bin].max[a],b.max[a]);
+			}
+		}
+
+		//cost of splitting after bin i, from both ends
+		float leftCost[ZEQ_BVH_BINS];
+		Bounds acc = binBounds[0];
+		uint32 accCount = 0;
+		for (int i = 0; i < ZEQ_BVH_BINS - 1; ++i)
+		{
+			accCount += binCount[i];
+			for (int a = 0; a < 3; ++a)
+			{
+				acc.min[a] = std::min(acc.min[a],binBounds[i].min[a]);
+				acc.max[a] = std::max(acc.max[a],binBounds[i].max[a]);
+			}
+			leftCost[i] = accCount ? BoundsArea(acc.min,acc.max) * accCount : 0.0f;
+		}
+		float bestCost = FLT_MAX;
+		int bestSplit = -1;
+		acc = binBounds[ZEQ_BVH_BINS - 1];
+		accCount = 0;
+		for (int i = ZEQ_BVH_BINS - 1; i > 0; --i)
+		{
+			accCount += binCount[i];
+			for (int a = 0; a < 3; ++a)
+			{
+				acc.min[a] = std::min(acc.min[a],binBounds[i].min[a]);
+				acc.max[a] = std::max(acc.max[a],binBounds[i].max[a]);
+			}
+			float cost = leftCost[i - 1] + (accCount ? BoundsArea(acc.min,acc.max) * accCount : 0.0f);
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestSplit = i;
+			}
+		}
+
+		const Ogre::Vector3* centroids = &mCentroids[0];
+		float splitAt = cmin[axis] + bestSplit / scale;
+		mid = std::partition(order + begin,order + end,[centroids,axis,splitAt](uint32 tri) {
+			return centroids[tri][axis] < splitAt;
+		}) - order;
+	}
+
+	//all the centroids in one spot, a split that left one side empty, or too deep; just halve the list
+	if (mid == begin || mid == end)
+	{
+		const Ogre::Vector3* centroids = &mCentroids[0];
+		mid = begin + count / 2;
+		std::nth_element(order + begin,order + mid,order + end,[centroids,axis](uint32 a, uint32 b) {
+			return centroids[a][axis] < centroids[b][axis];
+		});
+	}
+
+	uint32 left = AllocNodes();
+	node.index = left;
+	node.count = 0;
+
+	if (deferred && mid - begin < ZEQ_BVH_PARALLEL_TRIS)
+	{
+		BuildTask task = {left,begin,mid,depth + 1};
+		deferred->push_back(task);
+	}
+	else
+	{
+		BuildNode(left,begin,mid,depth + 1,deferred);
+	}
+	if (deferred && end - mid < ZEQ_BVH_PARALLEL_TRIS)
+	{
+		BuildTask task = {left + 1,mid,end,depth + 1};
+		deferred->push_back(task);
+	}
+	else
+	{
+		BuildNode(left + 1,mid,end,depth + 1,deferred);
+	}
+}
+
+Ogre::AxisAlignedBox ZoneBVH::GetBounds() const
+{
+	if (mNodes.empty())
+		return Ogre::AxisAlignedBox();
+	const Node& root = mNodes[0];
+	return Ogre::AxisAlignedBox(root.min[0],root.min[1],root.min[2],root.max[0],root.max[1],root.max[2]);
+}
+
+void ZoneBVH::GetTriangle(uint32 index, Ogre::Vector3& v0, Ogre::Vector3& v1, Ogre::Vector3& v2) const
+{
+	const Triangle& tri = mTris[index];
+	v0 = tri.v0;
+	v1 = tri.v1;
+	v2 = tri.v2;
+}
+
+bool ZoneBVH::RayBox(const Node& node, const Ogre::Vector3& origin, const Ogre::Vector3& invDir, float expand, float maxT)
+{
+	float tmin = 0.0f, tmax = maxT;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		float t0 = (node.min[axis] - expand - origin[axis]) * invDir[axis];
+		float t1 = (node.max[axis] + expand - origin[axis]) * invDir[axis];
+		if (t0 > t1)
+			std::swap(t0,t1);
+		//written so a NaN, from a ray lying in the slab's plane, leaves the range alone
+		tmin = t0 > tmin ? t0 : tmin;
+		tmax = t1 < tmax ? t1 : tmax;
+		if (tmin > tmax)
+			return false;
+	}
+	return true;
+}
+
+bool ZoneBVH::Raycast(const Ogre::Vector3& origin, const Ogre::Vector3& dir, float maxDist, BVHHit& hit) const
+{
+	if (mNodes.empty())
+		return false;
+
+	Ogre::Vector3 invDir(1.0f / dir.x,1.0f / dir.y,1.0f / dir.z);
+	float best = maxDist;
+	int32 bestTri = -1;
+	uint32 stack[ZEQ_BVH_STACK];
+	uint32 top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		const Node& node = mNodes[stack[--top]];
+		if (!RayBox(node,origin,invDir,0.0f,best))
+			continue;
+		if (node.count == 0)
+		{
+			stack[top++] = node.index + 1;
+			stack[top++] = node.index;
+			continue;
+		}
+
+		//Moller-Trumbore, from either side
+		for (uint32 i = node.index; i < node.index + node.count; ++i)
+		{
+			const Triangle& tri = mTris[i];
+			Ogre::Vector3 e1 = tri.v1 - tri.v0;
+			Ogre::Vector3 e2 = tri.v2 - tri.v0;
+			Ogre::Vector3 p = dir.crossProduct(e2);
+			float det = e1.dotProduct(p);
+			if (fabs(det) < 1e-12f)
+				continue;
+			float inv = 1.0f / det;
+			Ogre::Vector3 s = origin - tri.v0;
+			float u = s.dotProduct(p) * inv;
+			if (u < 0.0f || u > 1.0f)
+				continue;
+			Ogre::Vector3 q = s.crossProduct(e1);
+			float v = dir.dotProduct(q) * inv;
+			if (v < 0.0f || u + v > 1.0f)
+				continue;
+			float t = e2.dotProduct(q) * inv;
+			if (t >= 0.0f && t < best)
+			{
+				best = t;
+				bestTri = i;
+			}
+		}
+	}
+
+	if (bestTri < 0)
+		return false;
+	const Triangle& tri = mTris[bestTri];
+	hit.distance = best;
+	hit.triangle = bestTri;
+	hit.owner = tri.owner;
+	hit.position = origin + dir * best;
+	hit.normal = (tri.v1 - tri.v0).crossProduct(tri.v2 - tri.v0);
+	hit.normal.normalise();
+	if (hit.normal.dotProduct(dir) > 0.0f)
+		hit.normal = -hit.normal;
+	return true;
+}
+
+Ogre::Vector3 ZoneBVH::ClosestPoint(const Triangle& tri, const Ogre::Vector3& p)
+{
+	//by which of the triangle's regions p falls in, as in Ericson's Real-Time Collision Detection
+	Ogre::Vector3 ab = tri.v1 - tri.v0, ac = tri.v2 - tri.v0, ap = p - tri.v0;
+	float d1 = ab.dotProduct(ap), d2 = ac.dotProduct(ap);
+	if (d1 <= 0.0f && d2 <= 0.0f)
+		return tri.v0;
+
+	Ogre::Vector3 bp = p - tri.v1;
+	float d3 = ab.dotProduct(bp), d4 = ac.dotProduct(bp);
+	if (d3 >= 0.0f && d4 <= d3)
+		return tri.v1;
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+		return tri.v0 + ab * (d1 / (d1 - d3));
+
+	Ogre::Vector3 cp = p - tri.v2;
+	float d5 = ab.dotProduct(cp), d6 = ac.dotProduct(cp);
+	if (d6 >= 0.0f && d5 <= d6)
+		return tri.v2;
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+		return tri.v0 + ac * (d2 / (d2 - d6));
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+		return tri.v1 + (tri.v2 - tri.v1) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+	float denom = 1.0f / (va + vb + vc);
+	return tri.v0 + ab * (vb * denom) + ac * (vc * denom);
+}
+
+//smallest t >= 0 at which start + delta * t is radius from point, or -1
+static float SweepPoint(const Ogre::Vector3& start, const Ogre::Vector3& delta, const Ogre::Vector3& point, float radius)
+{
+	Ogre::Vector3 m = start - point;
+	float a = delta.dotProduct(delta);
+	float b = m.dotProduct(delta);
+	float c = m.dotProduct(m) - radius * radius;
+	float disc = b * b - a * c;
+	if (a < 1e-12f || disc < 0.0f)
+		return -1.0f;
+	return (-b - sqrt(disc)) / a;
+}
+
+//smallest t >= 0 at which start + delta * t is radius from the segment's interior, or -1
+static float SweepEdge(const Ogre::Vector3& start, const Ogre::Vector3& delta, const Ogre::Vector3& a, const Ogre::Vector3& b, float radius)
+{
+	Ogre::Vector3 ba = b - a, oa = start - a;
+	float baba = ba.dotProduct(ba), bard = ba.dotProduct(delta), baoa = ba.dotProduct(oa);
+	float qa = baba * delta.dotProduct(delta) - bard * bard;
+	float qb = baba * delta.dotProduct(oa) - baoa * bard;
+	float qc = baba * oa.dotProduct(oa) - baoa * baoa - radius * radius * baba;
+	float disc = qb * qb - qa * qc;
+	if (fabs(qa) < 1e-12f || disc < 0.0f)
+		return -1.0f; //moving along the edge; its ends are still tested as points
+	float t = (-qb - sqrt(disc)) / qa;
+	float y = baoa + t * bard;
+	if (y <= 0.0f || y >= baba)
+		return -1.0f;
+	return t;
+}
+
+bool ZoneBVH::SweepTriangle(const Triangle& tri, const Ogre::Vector3& start, const Ogre::Vector3& delta, float radius, float maxT, float& t)
+{
+	//already touching
+	Ogre::Vector3 closest = ClosestPoint(tri,start);
+	if (start.squaredDistance(closest) <= radius * radius)
+	{
+		t = 0.0f;
+		return true;
+	}
+
+	Ogre::Vector3 normal = (tri.v1 - tri.v0).crossProduct(tri.v2 - tri.v0);
+	if (normal.normalise() < 1e-12f)
+		return false;
+
+	//the face: the first time the centre is radius from the plane, if the sphere touches inside the triangle then
+	float best = -1.0f;
+	float dist = (start - tri.v0).dotProduct(normal);
+	float dn = delta.dotProduct(normal);
+	if (dist < 0.0f)
+	{
+		dist = -dist;
+		dn = -dn;
+		normal = -normal;
+	}
+	if (dn < 0.0f)
+	{
+		float tf = (dist - radius) / -dn;
+		if (tf >= 0.0f && tf <= maxT)
+		{
+			Ogre::Vector3 contact = start + delta * tf - normal * radius;
+			if (contact.squaredDistance(ClosestPoint(tri,contact)) < 1e-6f * (1.0f + radius * radius))
+			{
+				t = tf;
+				return true; //nothing on the rim can be reached before the face
+			}
+		}
+	}
+
+	//otherwise it can only touch an edge or a corner first
+	const Ogre::Vector3* verts[3] = {&tri.v0,&tri.v1,&tri.v2};
+	for (int i = 0; i < 3; ++i)
+	{
+		float te = SweepEdge(start,delta,*verts[i],*verts[(i + 1) % 3],radius);
+		if (te >= 0.0f && te <= maxT && (best < 0.0f || te < best))
+			best = te;
+		float tv = SweepPoint(start,delta,*verts[i],radius);
+		if (tv >= 0.0f && tv <= maxT && (best < 0.0f || tv < best))
+			best = tv;
+	}
+	if (best < 0.0f)
+		return false;
+	t = best;
+	return true;
+}
+
+bool ZoneBVH::SphereSweep(const Ogre::Vector3& start, const Ogre::Vector3& end, float radius, BVHHit& hit) const
+{
+	if (mNodes.empty())
+		return false;
+
+	//t runs from 0 at start to 1 at end; nodes are grown by the radius and tested like a ray
+	Ogre::Vector3 delta = end - start;
+	Ogre::Vector3 invDir(1.0f / delta.x,1.0f / delta.y,1.0f / delta.z);
+	float best = 1.0f;
+	int32 bestTri = -1;
+	uint32 stack[ZEQ_BVH_STACK];
+	uint32 top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		const Node& node = mNodes[stack[--top]];
+		if (!RayBox(node,start,invDir,radius,best))
+			continue;
+		if (node.count == 0)
+		{
+			stack[top++] = node.index + 1;
+			stack[top++] = node.index;
+			continue;
+		}
+		for (uint32 i = node.index; i < node.index + node.count; ++i)
+		{
+			float t;
+			if (SweepTriangle(mTris[i],start,delta,radius,best,t) && (bestTri < 0 || t < best))
+			{
+				best = t;
+				bestTri = i;
+			}
+		}
+	}
+
+	if (bestTri < 0)
+		return false;
+	const Triangle& tri = mTris[bestTri];
+	hit.distance = best * delta.length();
+	hit.triangle = bestTri;
+	hit.owner = tri.owner;
+	hit.position = start + delta * best;
+	//pushes the sphere straight back out, whichever part of the triangle it hit
+	hit.normal = hit.position - ClosestPoint(tri,hit.position);
+	if (hit.normal.normalise() < 1e-6f)
+	{
+		hit.normal = (tri.v1 - tri.v0).crossProduct(tri.v2 - tri.v0);
+		hit.normal.normalise();
+		if (hit.normal.dotProduct(delta) > 0.0f)
+			hit.normal = -hit.normal;
+	}
+	return true;
+}
+
+bool ZoneBVH::CapsuleSweep(const Ogre::Vector3& start, const Ogre::Vector3& end, float radius, float height, BVHHit& hit) const
+{
+	radius = std::max(radius,0.0f);
+	float axis = std::max(height - radius * 2.0f,0.0f);
+	//with no radius there is nothing to space the spheres by, so the foot and head are cast as rays instead
+	bool thin = radius == 0.0f;
+	uint32 spheres = thin ? (axis > 0.0f ? 2 : 1) : (uint32)ceil(axis / radius) + 1;
+	Ogre::Vector3 delta = end - start;
+	float length = delta.length();
+	bool found = false;
+	for (uint32 i = 0; i < spheres; ++i)
+	{
+		float y = radius + (spheres > 1 ? axis * i / (spheres - 1) : 0.0f);
+		Ogre::Vector3 offset(0.0f,y,0.0f);
+		BVHHit sphereHit;
+		bool hitThis = thin ? length > 0.0f && Raycast(start + offset,delta / length,length,sphereHit) : SphereSweep(start + offset,end + offset,radius,sphereHit);
+		if (hitThis && (!found || sphereHit.distance < hit.distance))
+		{
+			hit = sphereHit;
+			hit.position -= offset;
+			found = true;
+		}
+	}
+	return found;
+}
+
+void ZoneBVH::QuerySphere(const Ogre::Vector3& centre, float radius, std::vector<uint32>& triangles) const
+{
+	if (mNodes.empty())
+		return;
+
+	float r2 = radius * radius;
+	uint32 stack[ZEQ_BVH_STACK];
+	uint32 top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		const Node& node = mNodes[stack[--top]];
+		float d2 = 0.0f;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			float c = centre[axis];
+			if (c < node.min[axis])
+				d2 += (node.min[axis] - c) * (node.min[axis] - c);
+			else if (c > node.max[axis])
+				d2 += (c - node.max[axis]) * (c - node.max[axis]);
+		}
+		if (d2 > r2)
+			continue;
+		if (node.count == 0)
+		{
+			stack[top++] = node.index + 1;
+			stack[top++] = node.index;
+			continue;
+		}
+		for (uint32 i = node.index; i < node.index + node.count; ++i)
+		{
+			if (centre.squaredDistance(ClosestPoint(mTris[i],centre)) <= r2)
+				triangles.push_back(i);
+		}
+	}
+}
+
+void ZoneBVH::QueryFrustum(const Ogre::Plane* planes, uint32 planeCount, std::vector<uint32>& triangles) const
+{
+	if (mNodes.empty())
+		return;
+
+	//the top bit marks a node already known to be wholly inside, whose whole subtree is taken without further tests
+	const uint32 INSIDE = 0x80000000;
+	uint32 stack[ZEQ_BVH_STACK];
+	uint32 top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		uint32 entry = stack[--top];
+		const Node& node = mNodes[entry & ~INSIDE];
+		bool inside = (entry & INSIDE) != 0;
+		if (!inside)
+		{
+			bool outside = false;
+			inside = true;
+			for (uint32 p = 0; p < planeCount && !outside; ++p)
+			{
+				const Ogre::Vector3& n = planes[p].normal;
+				//the corners furthest along and against the plane's normal
+				Ogre::Vector3 pos(n.x >= 0.0f ? node.max[0] : node.min[0],n.y >= 0.0f ? node.max[1] : node.min[1],n.z >= 0.0f ? node.max[2] : node.min[2]);
+				Ogre::Vector3 neg(n.x >= 0.0f ? node.min[0] : node.max[0],n.y >= 0.0f ? node.min[1] : node.max[1],n.z >= 0.0f ? node.min[2] : node.max[2]);
+				if (n.dotProduct(pos) + planes[p].d < 0.0f)
+					outside = true;
+				else if (n.dotProduct(neg) + planes[p].d < 0.0f)
+					inside = false;
+			}
+			if (outside)
+				continue;
+		}
+
+		if (node.count == 0)
+		{
+			uint32 flag = inside ? INSIDE : 0;
+			stack[top++] = (node.index + 1) | flag;
+			stack[top++] = node.index | flag;
+			continue;
+		}
+		for (uint32 i = node.index; i < node.index + node.count; ++i)
+		{
+			triangles.push_back(i);
+		}
+	}
+}
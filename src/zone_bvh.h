@@ -0,0 +1,113 @@
+
+#ifndef ZEQ_ZONE_BVH_H
+#define ZEQ_ZONE_BVH_H
+
+#include <math.h>
+#include <float.h>
+#include <vector>
+#include <algorithm>
+#include <boost/atomic.hpp>
+#include "type.h"
+#include "mesh_builder.h"
+#include "worker_pool.h"
+
+//triangles per leaf; more makes for a smaller tree that is slower to query
+#define ZEQ_BVH_LEAF_TRIS 4
+//candidate split planes tried along each node's longest axis
+#define ZEQ_BVH_BINS 16
+//subtrees with fewer triangles than this are built on the worker pool rather than split further on the caller
+#define ZEQ_BVH_PARALLEL_TRIS 8192
+//below this depth nodes are split evenly instead of by cost, which bounds the whole tree's depth to this plus log2 of
+//the triangle count; the query stacks are sized to match
+#define ZEQ_BVH_SAH_DEPTH 32
+#define ZEQ_BVH_STACK (ZEQ_BVH_SAH_DEPTH + 34)
+
+struct BVHHit
+{
+	float distance; //along the ray or sweep, in world units
+	uint32 triangle;
+	uint32 owner; //the id the triangle's mesh was added with
+	Ogre::Vector3 position; //of the ray, or the sphere's centre, at contact
+	Ogre::Vector3 normal; //of the triangle, facing back along the ray or sweep
+};
+
+//Bounding volume hierarchy over the static triangles of a zone, for ray casts, sweeps and visibility queries
+//Meshes are added in world space while the zone is built, then Build makes the tree once; the tree is read only
+//after that, so any number of threads can query it at the same time
+class ZoneBVH
+{
+public:
+	ZoneBVH();
+	//Copies a mesh's triangles; returns the owner handed back with every hit on them, which is the number of meshes added before it
+	uint32	AddMesh(const MeshVertex* vertices, uint32 vertexCount, const uint16* indices, uint32 indexCount);
+	uint32	AddMesh(const MeshBuildData& data) { return AddMesh(data.mVertices.empty() ? nullptr : &data.mVertices[0],data.mVertices.size(),data.mIndices.empty() ? nullptr : &data.mIndices[0],data.mIndices.size()); }
+	//Builds the tree over every triangle added so far, splitting the lower levels across the worker pool
+	void	Build();
+	bool	IsBuilt() const { return !mNodes.empty(); }
+	uint32	GetMeshCount() const { return mMeshCount; }
+	uint32	GetTriangleCount() const { return mTris.size(); }
+	uint32	GetNodeCount() const { return mNodes.size(); }
+	Ogre::AxisAlignedBox GetBounds() const;
+	//triangle numbers are in the tree's own order, which isn't the order they were added in
+	void	GetTriangle(uint32 index, Ogre::Vector3& v0, Ogre::Vector3& v1, Ogre::Vector3& v2) const;
+
+	//Nearest triangle hit by the ray within maxDist; dir doesn't have to be normalised, distance is in units of its length
+	bool	Raycast(const Ogre::Vector3& origin, const Ogre::Vector3& dir, float maxDist, BVHHit& hit) const;
+	//First contact of a sphere moved from start to end, if any; distance is how far it got
+	bool	SphereSweep(const Ogre::Vector3& start, const Ogre::Vector3& end, float radius, BVHHit& hit) const;
+	//First contact of an upright capsule, from its foot at start to its foot at end; position is where the foot got to
+	//The capsule is swept as spheres along its axis no more than one radius apart, so only an edge poking into the
+	//narrow gaps between them can be missed. A capsule with no radius is only its axis, and is cast as rays from its foot and head
+	bool	CapsuleSweep(const Ogre::Vector3& start, const Ogre::Vector3& end, float radius, float height, BVHHit& hit) const;
+	//Every triangle touching the sphere
+	void	QuerySphere(const Ogre::Vector3& centre, float radius, std::vector<uint32>& triangles) const;
+	//Every triangle in a leaf whose bounds aren't wholly outside one of the planes; planes face inward, as a camera's do
+	void	QueryFrustum(const Ogre::Plane* planes, uint32 planeCount, std::vector<uint32>& triangles) const;
+
+private:
+	struct Node
+	{
+		float min[3];
+		uint32 index; //first triangle for leaves, left child for inner nodes; the right child always follows it
+		float max[3];
+		uint32 count; //triangles in a leaf, 0 for inner nodes
+	};
+
+	struct Triangle
+	{
+		Ogre::Vector3 v0, v1, v2;
+		uint32 owner;
+	};
+
+	struct Bounds
+	{
+		float min[3];
+		float max[3];
+	};
+
+	struct BuildTask
+	{
+		uint32 node;
+		uint32 begin;
+		uint32 end;
+		uint32 depth;
+	};
+
+	void	BuildNode(uint32 node, uint32 begin, uint32 end, uint32 depth, std::vector<BuildTask>* deferred);
+	uint32	AllocNodes();
+	//earliest t in [0, maxT] at which the sphere moving along delta touches the triangle
+	static bool SweepTriangle(const Triangle& tri, const Ogre::Vector3& start, const Ogre::Vector3& delta, float radius, float maxT, float& t);
+	static Ogre::Vector3 ClosestPoint(const Triangle& tri, const Ogre::Vector3& p);
+	static bool RayBox(const Node& node, const Ogre::Vector3& origin, const Ogre::Vector3& invDir, float expand, float maxT);
+
+	std::vector<Triangle> mTris;
+	std::vector<Node> mNodes;
+	//only used while building
+	std::vector<uint32> mOrder;
+	std::vector<Ogre::Vector3> mCentroids;
+	std::vector<Bounds> mTriBounds;
+	boost::atomic<uint32> mNodeCount;
+	uint32	mMeshCount;
+};
+
+#endif
@@ -0,0 +1,448 @@
+
+#include "zone_cache.h"
+#include "zone_data.h"
+#include "zone_streamer.h"
+#include "gfx_loaders.h"
+
+ZoneCacheWriter::ZoneCacheWriter(const char* mainPath, const char* objPath, Ogre::VertexElementType colourType)
+{
+	memset(&mHeader,0,sizeof(ZoneCacheHeader));
+	mHeader.magic = ZEQ_ZONE_CACHE_MAGIC;
+	mHeader.version = ZEQ_ZONE_CACHE_VERSION;
+	mHeader.colourType = colourType;
+	GetSource(mainPath,mHeader.sources[0]);
+	GetSource(objPath,mHeader.sources[1]);
+	//offset 0 is the empty string
+	mStrings.push_back('\0');
+}
+
+void ZoneCacheWriter::GetSource(const char* path, ZoneCacheSource& out)
+{
+	memset(&out,0,sizeof(ZoneCacheSource));
+	struct stat st;
+	if (stat(path,&st) != 0)
+		return;
+
+	MappedFile file;
+	if (!file.Open(path))
+		return;
+	out.size = file.GetLen();
+	out.mtime = static_cast<uint32>(st.st_mtime);
+	out.crc = Crc32(0,file.GetData(),file.GetLen());
+}
+
+uint32 ZoneCacheWriter::AddString(const char* str)
+{
+	uint32 offset = mStrings.size();
+	mStrings.insert(mStrings.end(),str,str + strlen(str) + 1);
+	return offset;
+}
+
+uint32 ZoneCacheWriter::AddData(const void* data, uint32 len)
+{
+	//keep everything 16 byte aligned within the block, which is itself 16 byte aligned in the file
+	uint32 offset = (mData.size() + 15) & ~15;
+	mData.resize(offset + len);
+	if (len > 0)
+		memcpy(&mData[offset],data,len);
+	return offset;
+}
+
+void ZoneCacheWriter::AddTexture(const char* name, const Ogre::Image& img, int createMipmaps)
+{
+	ZoneCacheTexture tex;
+	tex.name = AddString(name);
+	tex.width = img.getWidth();
+	tex.height = img.getHeight();
+	tex.depth = img.getDepth();
+	tex.format = img.getFormat();
+	tex.numMipmaps = img.getNumMipmaps();
+	tex.createMipmaps = createMipmaps;
+	tex.dataLen = img.getSize();
+	tex.dataOffset = AddData(img.getData(),tex.dataLen);
+	mTextures.push_back(tex);
+}
+
+void ZoneCacheWriter::AddMesh(const char* name, const MeshBuildData& data, bool isZone)
+{
+	ZoneCacheMesh mesh;
+	mesh.name = AddString(name);
+	mesh.flags = isZone ? ZoneCacheMesh::ZONE : 0;
+	mesh.vertexCount = data.mVertices.size();
+	mesh.vertexOffset = AddData(&data.mVertices[0],mesh.vertexCount * sizeof(MeshVertex));
+	mesh.indexCount = data.mIndices.size();
+	mesh.indexOffset = AddData(&data.mIndices[0],mesh.indexCount * sizeof(uint16));
+
+	std::vector<ZoneCacheRun> runs;
+	for (auto itr = data.mRuns.begin(); itr != data.mRuns.end(); itr++)
+	{
+		ZoneCacheRun run;
+		run.material = AddString(itr->mMaterial);
+		run.indexStart = itr->mIndexStart;
+		run.indexCount = itr->mIndexCount;
+		runs.push_back(run);
+	}
+	mesh.runCount = runs.size();
+	mesh.runOffset = AddData(runs.empty() ? nullptr : &runs[0],mesh.runCount * sizeof(ZoneCacheRun));
+
+	mesh.lodCount = data.mLods.size();
+	mesh.lodFirst = mLods.size();
+	for (auto itr = data.mLods.begin(); itr != data.mLods.end(); itr++)
+	{
+		ZoneCacheLod lod;
+		lod.distance = itr->mDistance;
+		lod.indexCount = itr->mIndices.size();
+		lod.indexOffset = AddData(itr->mIndices.empty() ? nullptr : &itr->mIndices[0],lod.indexCount * sizeof(uint16));
+		//same materials as the mesh's own runs
+		for (uint32 i = 0; i < runs.size() && i < itr->mRuns.size(); ++i)
+		{
+			runs[i].indexStart = itr->mRuns[i].mIndexStart;
+			runs[i].indexCount = itr->mRuns[i].mIndexCount;
+		}
+		lod.runOffset = AddData(runs.empty() ? nullptr : &runs[0],mesh.runCount * sizeof(ZoneCacheRun));
+		mLods.push_back(lod);
+	}
+
+	const Ogre::Vector3& min = data.mBounds.getMinimum();
+	const Ogre::Vector3& max = data.mBounds.getMaximum();
+	mesh.bounds[0] = min.x;
+	mesh.bounds[1] = min.y;
+	mesh.bounds[2] = min.z;
+	mesh.bounds[3] = max.x;
+	mesh.bounds[4] = max.y;
+	mesh.bounds[5] = max.z;
+	mMeshes.push_back(mesh);
+}
+
+void ZoneCacheWriter::AddPlacement(const char* mesh, const Ogre::Vector3& pos, const Ogre::Quaternion& rot, const Ogre::Vector3& scale)
+{
+	ZoneCachePlacement place;
+	place.mesh = AddString(mesh);
+	place.position[0] = pos.x;
+	place.position[1] = pos.y;
+	place.position[2] = pos.z;
+	place.orientation[0] = rot.w;
+	place.orientation[1] = rot.x;
+	place.orientation[2] = rot.y;
+	place.orientation[3] = rot.z;
+	place.scale[0] = scale.x;
+	place.scale[1] = scale.y;
+	place.scale[2] = scale.z;
+	mPlacements.push_back(place);
+}
+
+void ZoneCacheWriter::SetZoneHeight(float minY, float maxY)
+{
+	mHeader.minZoneY = minY;
+	mHeader.maxZoneY = maxY;
+}
+
+bool ZoneCacheWriter::Write(const char* path)
+{
+	ZoneCacheHeader header = mHeader;
+	uint32 pos = sizeof(ZoneCacheHeader);
+	header.textureCount = mTextures.size();
+	header.textureOffset = pos;
+	pos += header.textureCount * sizeof(ZoneCacheTexture);
+	header.meshCount = mMeshes.size();
+	header.meshOffset = pos;
+	pos += header.meshCount * sizeof(ZoneCacheMesh);
+	header.placementCount = mPlacements.size();
+	header.placementOffset = pos;
+	pos += header.placementCount * sizeof(ZoneCachePlacement);
+	header.lodCount = mLods.size();
+	header.lodOffset = pos;
+	pos += header.lodCount * sizeof(ZoneCacheLod);
+	header.stringOffset = pos;
+	header.stringLen = mStrings.size();
+	pos += header.stringLen;
+	uint32 dataBase = (pos + 15) & ~15;
+
+	//data offsets become file offsets
+	for (auto itr = mTextures.begin(); itr != mTextures.end(); itr++)
+		itr->dataOffset += dataBase;
+	for (auto itr = mMeshes.begin(); itr != mMeshes.end(); itr++)
+	{
+		itr->vertexOffset += dataBase;
+		itr->indexOffset += dataBase;
+		itr->runOffset += dataBase;
+	}
+	for (auto itr = mLods.begin(); itr != mLods.end(); itr++)
+	{
+		itr->indexOffset += dataBase;
+		itr->runOffset += dataBase;
+	}
+
+	FILE* fp = fopen(path,"wb");
+	if (!fp)
+		return false;
+
+	//the real header goes in last, so a cache that was only partly written never passes Open
+	static const byte zero[16] = {0};
+	ZoneCacheHeader blank;
+	memset(&blank,0,sizeof(ZoneCacheHeader));
+	bool ok = fwrite(&blank,sizeof(ZoneCacheHeader),1,fp) == 1;
+	if (ok && !mTextures.empty())
+		ok = fwrite(&mTextures[0],sizeof(ZoneCacheTexture),mTextures.size(),fp) == mTextures.size();
+	if (ok && !mMeshes.empty())
+		ok = fwrite(&mMeshes[0],sizeof(ZoneCacheMesh),mMeshes.size(),fp) == mMeshes.size();
+	if (ok && !mPlacements.empty())
+		ok = fwrite(&mPlacements[0],sizeof(ZoneCachePlacement),mPlacements.size(),fp) == mPlacements.size();
+	if (ok && !mLods.empty())
+		ok = fwrite(&mLods[0],sizeof(ZoneCacheLod),mLods.size(),fp) == mLods.size();
+	if (ok)
+		ok = fwrite(&mStrings[0],1,mStrings.size(),fp) == mStrings.size();
+	if (ok && dataBase > pos)
+		ok = fwrite(zero,1,dataBase - pos,fp) == dataBase - pos;
+	if (ok && !mData.empty())
+		ok = fwrite(&mData[0],1,mData.size(),fp) == mData.size();
+	if (ok)
+		ok = fseek(fp,0,SEEK_SET) == 0 && fwrite(&header,sizeof(ZoneCacheHeader),1,fp) == 1;
+	if (fclose(fp) != 0)
+		ok = false;
+
+	//put the relative offsets back in case we get written again
+	for (auto itr = mTextures.begin(); itr != mTextures.end(); itr++)
+		itr->dataOffset -= dataBase;
+	for (auto itr = mMeshes.begin(); itr != mMeshes.end(); itr++)
+	{
+		itr->vertexOffset -= dataBase;
+		itr->indexOffset -= dataBase;
+		itr->runOffset -= dataBase;
+	}
+	for (auto itr = mLods.begin(); itr != mLods.end(); itr++)
+	{
+		itr->indexOffset -= dataBase;
+		itr->runOffset -= dataBase;
+	}
+
+	if (!ok)
+		remove(path);
+	return ok;
+}
+
+
+bool ZoneCache::Open(const char* path, const char* mainPath, const char* objPath, Ogre::VertexElementType colourType)
+{
+	mHeader = nullptr;
+	mStrings = nullptr;
+	if (!mFile.Open(path))
+		return false;
+	if (mFile.GetLen() < sizeof(ZoneCacheHeader))
+	{
+		Close();
+		return false;
+	}
+
+	mHeader = reinterpret_cast<const ZoneCacheHeader*>(mFile.GetData());
+	if (mHeader->magic != ZEQ_ZONE_CACHE_MAGIC || mHeader->version != ZEQ_ZONE_CACHE_VERSION ||
+		mHeader->colourType != static_cast<uint32>(colourType) || !Validate())
+	{
+		Close();
+		return false;
+	}
+
+	//the archives the cache was built from must not have changed since
+	ZoneCacheSource source;
+	const char* paths[ZEQ_ZONE_CACHE_SOURCES] = {mainPath,objPath};
+	for (uint32 i = 0; i < ZEQ_ZONE_CACHE_SOURCES; ++i)
+	{
+		ZoneCacheWriter::GetSource(paths[i],source);
+		const ZoneCacheSource& cached = mHeader->sources[i];
+		if (source.size != cached.size || source.mtime != cached.mtime || source.crc != cached.crc)
+		{
+			Close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool ZoneCache::Validate() const
+{
+	const byte* data = mFile.GetData();
+	uint32 len = mFile.GetLen();
+	const ZoneCacheHeader* h = mHeader;
+
+	//every count has to fit in the file before it is multiplied out
+	if (h->textureCount > len / sizeof(ZoneCacheTexture) || !InBounds(h->textureOffset,h->textureCount * sizeof(ZoneCacheTexture)) ||
+		h->meshCount > len / sizeof(ZoneCacheMesh) || !InBounds(h->meshOffset,h->meshCount * sizeof(ZoneCacheMesh)) ||
+		h->placementCount > len / sizeof(ZoneCachePlacement) || !InBounds(h->placementOffset,h->placementCount * sizeof(ZoneCachePlacement)) ||
+		h->lodCount > len / sizeof(ZoneCacheLod) || !InBounds(h->lodOffset,h->lodCount * sizeof(ZoneCacheLod)) ||
+		h->stringLen == 0 || !InBounds(h->stringOffset,h->stringLen))
+		return false;
+
+	const char* strings = reinterpret_cast<const char*>(data + h->stringOffset);
+	if (strings[h->stringLen - 1] != '\0')
+		return false;
+
+	const ZoneCacheTexture* tex = reinterpret_cast<const ZoneCacheTexture*>(data + h->textureOffset);
+	for (uint32 i = 0; i < h->textureCount; ++i, ++tex)
+	{
+		if (tex->name >= h->stringLen || !InBounds(tex->dataOffset,tex->dataLen) || tex->format >= Ogre::PF_COUNT)
+			return false;
+		size_t size = Ogre::Image::calculateSize(tex->numMipmaps,1,tex->width,tex->height,tex->depth,static_cast<Ogre::PixelFormat>(tex->format));
+		if (size > tex->dataLen)
+			return false;
+	}
+
+	const ZoneCacheMesh* mesh = reinterpret_cast<const ZoneCacheMesh*>(data + h->meshOffset);
+	for (uint32 i = 0; i < h->meshCount; ++i, ++mesh)
+	{
+		if (mesh->name >= h->stringLen ||
+			mesh->vertexCount > len / sizeof(MeshVertex) || !InBounds(mesh->vertexOffset,mesh->vertexCount * sizeof(MeshVertex)) ||
+			mesh->indexCount > len / sizeof(uint16) || !InBounds(mesh->indexOffset,mesh->indexCount * sizeof(uint16)) ||
+			mesh->runCount > len / sizeof(ZoneCacheRun) || !InBounds(mesh->runOffset,mesh->runCount * sizeof(ZoneCacheRun)) ||
+			mesh->vertexCount == 0 || mesh->indexCount == 0)
+			return false;
+
+		//an index past the vertices would be read straight off the end of the vertex buffer once uploaded
+		const uint16* indices = reinterpret_cast<const uint16*>(data + mesh->indexOffset);
+		for (uint32 j = 0; j < mesh->indexCount; ++j)
+		{
+			if (indices[j] >= mesh->vertexCount)
+				return false;
+		}
+
+		const ZoneCacheRun* run = reinterpret_cast<const ZoneCacheRun*>(data + mesh->runOffset);
+		for (uint32 j = 0; j < mesh->runCount; ++j, ++run)
+		{
+			if (run->material >= h->stringLen || run->indexStart > mesh->indexCount || run->indexCount > mesh->indexCount - run->indexStart)
+				return false;
+		}
+
+		if (mesh->lodCount > h->lodCount || mesh->lodFirst > h->lodCount - mesh->lodCount)
+			return false;
+		const ZoneCacheLod* lod = reinterpret_cast<const ZoneCacheLod*>(data + h->lodOffset) + mesh->lodFirst;
+		for (uint32 j = 0; j < mesh->lodCount; ++j, ++lod)
+		{
+			if (lod->indexCount > len / sizeof(uint16) || !InBounds(lod->indexOffset,lod->indexCount * sizeof(uint16)) ||
+				!InBounds(lod->runOffset,mesh->runCount * sizeof(ZoneCacheRun)))
+				return false;
+			indices = reinterpret_cast<const uint16*>(data + lod->indexOffset);
+			for (uint32 k = 0; k < lod->indexCount; ++k)
+			{
+				if (indices[k] >= mesh->vertexCount)
+					return false;
+			}
+			run = reinterpret_cast<const ZoneCacheRun*>(data + lod->runOffset);
+			for (uint32 k = 0; k < mesh->runCount; ++k, ++run)
+			{
+				if (run->material >= h->stringLen || run->indexStart > lod->indexCount || run->indexCount > lod->indexCount - run->indexStart)
+					return false;
+			}
+		}
+	}
+
+	const ZoneCachePlacement* place = reinterpret_cast<const ZoneCachePlacement*>(data + h->placementOffset);
+	for (uint32 i = 0; i < h->placementCount; ++i, ++place)
+	{
+		if (place->mesh >= h->stringLen)
+			return false;
+	}
+
+	return true;
+}
+
+void ZoneCache::Load(ZoneData* zone_data, Ogre::SceneManager* sceneMgr, ZoneStreamer* streamer)
+{
+	Ogre::TextureManager* texMgr = Ogre::TextureManager::getSingletonPtr();
+	const byte* data = mFile.GetData();
+	mStrings = reinterpret_cast<const char*>(data + mHeader->stringOffset);
+
+	//textures are handed to Ogre straight out of the mapping
+	const ZoneCacheTexture* tex = reinterpret_cast<const ZoneCacheTexture*>(data + mHeader->textureOffset);
+	for (uint32 i = 0; i < mHeader->textureCount; ++i, ++tex)
+	{
+		const char* name = GetString(tex->name);
+		if (texMgr->resourceExists(name))
+			continue;
+		Ogre::Image img;
+		img.loadDynamicImage(const_cast<byte*>(data + tex->dataOffset),tex->width,tex->height,tex->depth,
+			static_cast<Ogre::PixelFormat>(tex->format),false,1,tex->numMipmaps);
+		texMgr->loadImage(name,Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME,img,Ogre::TEX_TYPE_2D,tex->createMipmaps);
+		S3D::CreateMaterial(name);
+	}
+
+	std::vector<MeshRun> runs;
+	std::vector<MeshLod> lods;
+	for (uint32 i = 0; i < mHeader->meshCount; ++i)
+	{
+		const ZoneCacheMesh* mesh = GetMesh(i);
+		const MeshVertex* vertices = GetVertices(mesh);
+		const uint16* indices = GetIndices(mesh);
+		if (mesh->flags & ZoneCacheMesh::ZONE)
+		{
+			//zone meshes were written in the order they were built, so their triangles get the same owners as on a fresh build
+			zone_data->mCollision.AddMesh(vertices,mesh->vertexCount,indices,mesh->indexCount);
+			if (streamer)
+			{
+				streamer->AddMesh(i);
+				continue;
+			}
+		}
+
+		GetRuns(mesh,runs,lods);
+		Ogre::AxisAlignedBox bounds(mesh->bounds[0],mesh->bounds[1],mesh->bounds[2],mesh->bounds[3],mesh->bounds[4],mesh->bounds[5]);
+		Ogre::MeshPtr ptr = zone_data->mMeshBuilder.Upload(
+			vertices,mesh->vertexCount,indices,mesh->indexCount,
+			runs,lods,bounds,GetString(mesh->name));
+
+		if (mesh->flags & ZoneCacheMesh::ZONE)
+		{
+			Ogre::Entity* ent = sceneMgr->createEntity(ptr);
+			zone_data->mStaticGeometry->addEntity(ent,Ogre::Vector3(0,0,0));
+		}
+	}
+	zone_data->SetZoneHeight(mHeader->minZoneY,mHeader->maxZoneY);
+
+	for (uint32 i = 0; i < mHeader->placementCount; ++i)
+	{
+		if (streamer)
+		{
+			streamer->AddPlacement(i);
+			continue;
+		}
+		const ZoneCachePlacement* place = GetPlacement(i);
+		Ogre::Entity* ent = sceneMgr->createEntity(GetString(place->mesh));
+		zone_data->mStaticGeometry->addEntity(ent,
+			Ogre::Vector3(place->position[0],place->position[1],place->position[2]),
+			Ogre::Quaternion(place->orientation[0],place->orientation[1],place->orientation[2],place->orientation[3]),
+			Ogre::Vector3(place->scale[0],place->scale[1],place->scale[2]));
+	}
+}
+
+void ZoneCache::GetRuns(const ZoneCacheMesh* mesh, std::vector<MeshRun>& runs, std::vector<MeshLod>& lods) const
+{
+	runs.clear();
+	const ZoneCacheRun* run = GetRuns(mesh);
+	for (uint32 j = 0; j < mesh->runCount; ++j, ++run)
+	{
+		MeshRun add;
+		add.mMaterial = GetString(run->material);
+		add.mIndexStart = run->indexStart;
+		add.mIndexCount = run->indexCount;
+		runs.push_back(add);
+	}
+
+	lods.resize(mesh->lodCount);
+	const ZoneCacheLod* lod = GetLods(mesh);
+	for (uint32 j = 0; j < mesh->lodCount; ++j, ++lod)
+	{
+		MeshLod& out = lods[j];
+		const uint16* indices = reinterpret_cast<const uint16*>(mFile.GetData() + lod->indexOffset);
+		out.mDistance = lod->distance;
+		out.mIndices.assign(indices,indices + lod->indexCount);
+		out.mRuns.clear();
+		run = reinterpret_cast<const ZoneCacheRun*>(mFile.GetData() + lod->runOffset);
+		for (uint32 k = 0; k < mesh->runCount; ++k, ++run)
+		{
+			MeshRun add;
+			add.mMaterial = GetString(run->material);
+			add.mIndexStart = run->indexStart;
+			add.mIndexCount = run->indexCount;
+			out.mRuns.push_back(add);
+		}
+	}
+}
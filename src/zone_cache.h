@@ -0,0 +1,170 @@
+
+#ifndef ZEQ_ZONE_CACHE_H
+#define ZEQ_ZONE_CACHE_H
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "zlib.h"
+#include "crc.h"
+#include "type.h"
+#include "mapped_file.h"
+#include "mesh_builder.h"
+
+#define ZEQ_ZONE_CACHE_MAGIC 0x4351455A //"ZEQC"
+//bump whenever anything written to the cache changes, including how meshes or textures are built
+#define ZEQ_ZONE_CACHE_VERSION 4
+//the main and object archives; characters are still loaded from their archive every time
+#define ZEQ_ZONE_CACHE_SOURCES 2
+
+struct ZoneData;
+class ZoneStreamer;
+
+//Everything below is written as is and read back straight out of the mapping, so it is all 4 byte fields
+//Offsets are from the start of the file, names are offsets into the string block
+struct ZoneCacheSource
+{
+	uint32 size; //0 if the archive doesn't exist
+	uint32 mtime;
+	uint32 crc;
+};
+
+struct ZoneCacheHeader
+{
+	uint32 magic;
+	uint32 version;
+	uint32 colourType; //vertex colours are packed for one render system
+	ZoneCacheSource sources[ZEQ_ZONE_CACHE_SOURCES];
+	float minZoneY;
+	float maxZoneY;
+	uint32 textureCount;
+	uint32 textureOffset;
+	uint32 meshCount;
+	uint32 meshOffset;
+	uint32 placementCount;
+	uint32 placementOffset;
+	uint32 lodCount;
+	uint32 lodOffset;
+	uint32 stringOffset;
+	uint32 stringLen;
+};
+
+struct ZoneCacheTexture
+{
+	uint32 name;
+	uint32 width;
+	uint32 height;
+	uint32 depth;
+	uint32 format; //Ogre::PixelFormat
+	uint32 numMipmaps; //stored in the data
+	int32 createMipmaps; //asked of the texture manager
+	uint32 dataOffset;
+	uint32 dataLen;
+};
+
+struct ZoneCacheRun
+{
+	uint32 material;
+	uint32 indexStart;
+	uint32 indexCount;
+};
+
+struct ZoneCacheMesh
+{
+	enum Flags {
+		ZONE = 1 << 0, //part of the zone itself rather than a placed object
+	};
+	uint32 name;
+	uint32 flags;
+	uint32 vertexCount;
+	uint32 vertexOffset;
+	uint32 indexCount;
+	uint32 indexOffset;
+	uint32 runCount;
+	uint32 runOffset;
+	uint32 lodCount;
+	uint32 lodFirst; //index into the level of detail table
+	float bounds[6];
+};
+
+//a reduced index list over its mesh's vertices, with as many runs as the mesh
+struct ZoneCacheLod
+{
+	float distance;
+	uint32 indexCount;
+	uint32 indexOffset;
+	uint32 runOffset;
+};
+
+struct ZoneCachePlacement
+{
+	uint32 mesh;
+	float position[3];
+	float orientation[4]; //w, x, y, z
+	float scale[3];
+};
+
+//Collects a zone as it is built from its archives and writes it out as a cache file
+class ZoneCacheWriter
+{
+public:
+	ZoneCacheWriter(const char* mainPath, const char* objPath, Ogre::VertexElementType colourType);
+	void	AddTexture(const char* name, const Ogre::Image& img, int createMipmaps);
+	void	AddMesh(const char* name, const MeshBuildData& data, bool isZone);
+	void	AddPlacement(const char* mesh, const Ogre::Vector3& pos, const Ogre::Quaternion& rot, const Ogre::Vector3& scale);
+	void	SetZoneHeight(float minY, float maxY);
+	//Returns false if the file could not be written; nothing is left behind in that case
+	bool	Write(const char* path);
+
+	//size, modification time and checksum of an archive, or all 0 if it doesn't exist
+	static void GetSource(const char* path, ZoneCacheSource& out);
+
+private:
+	uint32	AddString(const char* str);
+	uint32	AddData(const void* data, uint32 len);
+
+	ZoneCacheHeader mHeader;
+	std::vector<ZoneCacheTexture> mTextures;
+	std::vector<ZoneCacheMesh> mMeshes;
+	std::vector<ZoneCacheLod> mLods;
+	std::vector<ZoneCachePlacement> mPlacements;
+	std::vector<char> mStrings;
+	std::vector<byte> mData; //offsets in here are relative until Write
+};
+
+//A zone cache file, mapped and checked against the archives it was built from
+class ZoneCache
+{
+public:
+	//Returns false if the cache doesn't exist, is damaged or out of date
+	bool	Open(const char* path, const char* mainPath, const char* objPath, Ogre::VertexElementType colourType);
+	//Creates the zone's textures, materials, meshes and static geometry
+	//Given a streamer, the zone's own meshes and the placements are handed to it instead, and the cache has to stay open
+	void	Load(ZoneData* zone_data, Ogre::SceneManager* sceneMgr, ZoneStreamer* streamer = nullptr);
+	void	Close() { mFile.Close(); }
+
+	//everything below points straight into the mapping, and is only valid once Load has been called
+	const ZoneCacheHeader* GetHeader() const { return mHeader; }
+	const ZoneCacheMesh* GetMesh(uint32 index) const { return reinterpret_cast<const ZoneCacheMesh*>(mFile.GetData() + mHeader->meshOffset) + index; }
+	const ZoneCacheRun* GetRuns(const ZoneCacheMesh* mesh) const { return reinterpret_cast<const ZoneCacheRun*>(mFile.GetData() + mesh->runOffset); }
+	const ZoneCacheLod* GetLods(const ZoneCacheMesh* mesh) const { return reinterpret_cast<const ZoneCacheLod*>(mFile.GetData() + mHeader->lodOffset) + mesh->lodFirst; }
+	//the mesh's runs and levels of detail, copied out of the mapping as the mesh builder wants them
+	void	GetRuns(const ZoneCacheMesh* mesh, std::vector<MeshRun>& runs, std::vector<MeshLod>& lods) const;
+	const MeshVertex* GetVertices(const ZoneCacheMesh* mesh) const { return reinterpret_cast<const MeshVertex*>(mFile.GetData() + mesh->vertexOffset); }
+	const uint16* GetIndices(const ZoneCacheMesh* mesh) const { return reinterpret_cast<const uint16*>(mFile.GetData() + mesh->indexOffset); }
+	const ZoneCachePlacement* GetPlacement(uint32 index) const { return reinterpret_cast<const ZoneCachePlacement*>(mFile.GetData() + mHeader->placementOffset) + index; }
+	const char* GetString(uint32 offset) const { return mStrings + offset; }
+
+private:
+	bool	Validate() const;
+	bool	InBounds(uint32 offset, uint32 len) const { return offset <= mFile.GetLen() && len <= mFile.GetLen() - offset; }
+
+	MappedFile mFile;
+	const ZoneCacheHeader* mHeader;
+	const char* mStrings;
+};
+
+#endif
@@ -3,10 +3,16 @@
 
 ZoneData::ZoneData(Ogre::SceneManager* sceneMgr)
 {
-	mStaticGeometry = sceneMgr->createStaticGeometry("gfaydark_Static");
-	mStaticGeometry->setRenderingDistance(1000.0f);
+	//headless users such as zeq_bench only parse and build on the CPU, and have no scene
+	mStaticGeometry = nullptr;
+	if (sceneMgr)
+	{
+		mStaticGeometry = sceneMgr->createStaticGeometry("gfaydark_Static");
+		mStaticGeometry->setRenderingDistance(1000.0f);
+	}
 	mAnimState = nullptr;
-	mMobInstance = nullptr;
+	mNameData = nullptr;
+	mCacheWriter = nullptr;
 }
 
 void ZoneData::LoadSprites()
@@ -15,40 +21,40 @@ void ZoneData::LoadSprites()
 	//0x30 fragments contains an index to a 0x05 or 0x03 fragment
 	for (auto itr = mTextureListFrags.begin(); itr != mTextureListFrags.end(); itr++)
 	{
-		TextureListFragment* tl = *itr;
+		TextureListView tl(itr->second);
 		std::unordered_map<int16,Sprite*> spriteList;
 
-		for (int32 i = 0; i < tl->mRefCount; ++i)
+		for (int32 i = 0; i < tl.GetRefCount(); ++i)
 		{
-			Fragment* frag = GetFragment(tl->mRefList[i]);
+			Fragment* frag = GetFragment(tl.GetRef(i));
 			if (frag && frag->mType == 0x30)
 			{
-				TextureRefFragment* trf = static_cast<TextureRefFragment*>(frag);
-				frag = GetFragment(trf->mRef);
+				TextureRefView trf(frag);
+				frag = GetFragment(trf.GetRef());
 				if (frag)
 				{
 					switch (frag->mType)
 					{
 						case 0x03:
 						{
-							Sprite* sprite = new Sprite(trf->mFlags,static_cast<TextureBitmapNameFragment*>(frag)->mNameList);
+							Sprite* sprite = new Sprite(trf.GetFlags(),static_cast<TextureBitmapNameFragment*>(frag)->mNameList);
 							spriteList[i] = sprite;
 							break;
 						}
 						case 0x05:
 						{
 							//0x05 fragments refer to 0x04 fragments (otherwise worthless, apparently)
-							frag = GetFragment(static_cast<TextureBitmapRefFragment*>(frag)->mRef);
+							frag = GetFragment(RefView(frag).GetRef());
 							if (frag && frag->mType == 0x04)
 							{
 								//0x04 fragments contain a list of references to 0x03 fragments
 								//and also contain some animation info for animated sprites
 								//FIXME: consider subclassing animated sprites from static sprites
-								TextureBitmapFragment* tbf = static_cast<TextureBitmapFragment*>(frag);
+								TextureBitmapView tbf(frag);
 								std::vector<const char*> textureNames;
-								for (int32 j = 0; j < tbf->mNumRefs; ++j)
+								for (int32 j = 0; j < tbf.GetRefCount(); ++j)
 								{
-									frag = GetFragment(tbf->mRefList[j]);
+									frag = GetFragment(tbf.GetRef(j));
 									if (frag && frag->mType == 0x03)
 									{
 										//assuming frag contains only 1 texture...
@@ -58,7 +64,7 @@ void ZoneData::LoadSprites()
 
 								if (textureNames.size() > 0)
 								{
-									Sprite* sprite = new Sprite(trf->mFlags,textureNames,tbf->mParam[1]);
+									Sprite* sprite = new Sprite(trf.GetFlags(),textureNames,tbf.GetParam(1));
 									spriteList[i] = sprite;
 								}
 							}
@@ -73,160 +79,83 @@ void ZoneData::LoadSprites()
 
 		//insert inner list into main list
 		if (spriteList.size() > 0)
-			mSpriteList[tl->mIndex + 1] = spriteList;
+			mSpriteList[itr->first + 1] = spriteList;
 	}
 	mTextureListFrags.clear();
 }
 
-void ZoneData::BuildMesh(MeshFragment* mesh, Ogre::SceneManager* sceneMgr, const char* model_name)
+void ZoneData::BuildMesh(const MeshFragmentView& mesh, const char* model_name)
 {
 	std::unordered_map<int16,Sprite*>* spriteList;
-	if (mSpriteList.count(mesh->mTextureListing))
-		spriteList = &mSpriteList[mesh->mTextureListing];
+	if (mSpriteList.count(mesh.GetTextureListing()))
+		spriteList = &mSpriteList[mesh.GetTextureListing()];
 	else
 		return;
 
-	//0x31 fragment contains a list of indices to 0x30 fragments
-	//pte contains a list of indices to the 0x31 fragments' lists and shareTextureCount values
-	//when shareTextureCount reaches 0, we get the 0x30 fragment index at pt_index in 0x31's list,
-	//incrementing pt_index by 1 and setting shareTextureCount,
-	//then retrieving the corresponding 0x30 fragment by index from the wld's lookup table
-	//0x30's name is the name of our desired texture from the s3d, which is already loaded
-	//with "_Material" appended to this name
-
-	Ogre::ManualObject* manual = sceneMgr->createManualObject();
-	manual->estimateVertexCount(mesh->mPolyCount * 3);
-	manual->estimateIndexCount(mesh->mPolyCount * 3);
-
-	Vector3* vert = mesh->mVertexList;
-	Vector2* text = mesh->mTextureCoordList;
-	uint32* clr = mesh->mColorList;
-	Vector3* norm = mesh->mNormalList;
-	Ogre::ColourValue cv;
-
-	PolyTextureEntry* pte = mesh->mPolyTextureList;
-	int16 pt_index = 1;
-	PolyTextureEntry& pt = pte[0];
-	int16 shareTextureCount = pt.mCount + 1;
-	manual->begin(spriteList->at(pt.mTextureID)->mTextureNameList[0],Ogre::RenderOperation::OT_TRIANGLE_LIST);
-	uint32 vert_index = 0;
-
-	for (int16 i = 0; i < mesh->mPolyCount; ++i)
+	//every placement of a model the batcher has is merged, so the model never needs an Ogre mesh of its own
+	if (mMeshBuilder.Build(mesh,*spriteList,mMeshBuildData))
 	{
-		if (--shareTextureCount <= 0)
-		{
-			PolyTextureEntry& pt = pte[pt_index++];
-			shareTextureCount = pt.mCount;
-			if (spriteList->count(pt.mTextureID))
-			{
-				manual->end();
-				manual->begin(spriteList->at(pt.mTextureID)->mTextureNameList[0],Ogre::RenderOperation::OT_TRIANGLE_LIST);
-				vert_index = 0;
-			}
-		}
-		ZEQPolygon& p = mesh->mPolyList[i];
-		for (int8 j = 0; j <= 2; ++j)
-		{
-			uint16 idx = p.index[j];
-			manual->position(vert[idx].y,vert[idx].z,vert[idx].x);
-			manual->textureCoord(text[idx].u,text[idx].v);
-			cv.setAsRGBA(clr[idx]);
-			manual->colour(cv);
-			manual->normal(norm[idx].y,norm[idx].z,norm[idx].x);
-		}
-		//necessary to allow conversion to a proper, reusable mesh
-		manual->triangle(vert_index + 2,vert_index + 1,vert_index);
-		vert_index += 3;
+		mTextures.Remap(mMeshBuildData,this,true);
+		mObjectBatcher.AddModel(model_name,mMeshBuildData);
 	}
-
-	manual->end();
-	manual->convertToMesh(model_name);
 }
 
 void ZoneData::BuildZoneMeshes(Ogre::SceneManager* sceneMgr)
 {
 	char name_buf[64];
-	uint32 count = 0;
-	float minZoneX = 999999, minZoneY = 999999, minZoneZ = 999999, maxZoneX = -999999, maxZoneY = -999999, maxZoneZ = -999999;
+	float minZoneY = 999999, maxZoneY = -999999;
 
+	//every mesh is built first, so their levels of detail can be made across the worker pool
+	std::vector<MeshBuildData> meshes;
+	meshes.reserve(mZoneMeshFrags.size());
 	for (auto itr = mZoneMeshFrags.begin(); itr != mZoneMeshFrags.end(); itr++)
 	{
-		MeshFragment* mesh = *itr;
+		MeshFragmentView mesh(*itr);
 
 		std::unordered_map<int16,Sprite*>* spriteList;
-		if (mSpriteList.count(mesh->mTextureListing))
-			spriteList = &mSpriteList[mesh->mTextureListing];
+		if (mSpriteList.count(mesh.GetTextureListing()))
+			spriteList = &mSpriteList[mesh.GetTextureListing()];
 		else
 			continue;
 
-		Ogre::ManualObject* manual = sceneMgr->createManualObject();
-		manual->estimateVertexCount(mesh->mPolyCount * 3);
-		manual->estimateIndexCount(mesh->mPolyCount * 3);
-
-		Vector3* vert = mesh->mVertexList;
-		Vector2* text = mesh->mTextureCoordList;
-		uint32* clr = mesh->mColorList;
-		Vector3* norm = mesh->mNormalList;
-		Ogre::ColourValue cv;
-
-		PolyTextureEntry* pte = mesh->mPolyTextureList;
-		int16 shareTextureCount = pte->mCount + 1;
-		manual->begin(spriteList->at(pte->mTextureID)->mTextureNameList[0],Ogre::RenderOperation::OT_TRIANGLE_LIST);
-		uint32 vert_index = 0;
-
-		for (int16 i = 0; i < mesh->mPolyCount; ++i)
+		meshes.push_back(MeshBuildData());
+		if (!mMeshBuilder.Build(mesh,*spriteList,meshes.back()))
 		{
-			if (--shareTextureCount <= 0)
-			{
-				pte++;
-				shareTextureCount = pte->mCount;
-				if (spriteList->count(pte->mTextureID))
-				{
-					manual->end();
-					manual->begin(spriteList->at(pte->mTextureID)->mTextureNameList[0],Ogre::RenderOperation::OT_TRIANGLE_LIST);
-					vert_index = 0;
-				}
-			}
-			ZEQPolygon& p = mesh->mPolyList[i];
-			for (int8 j = 0; j <= 2; ++j)
-			{
-				uint16 idx = p.index[j];
-				float x = vert[idx].x, y = vert[idx].y, z = vert[idx].z;
-				manual->position(y,z,x);
-				manual->textureCoord(text[idx].u,text[idx].v);
-				cv.setAsRGBA(clr[idx]);
-				manual->colour(cv);
-				manual->normal(norm[idx].y,norm[idx].z,norm[idx].x);
-				/*if (x < minZoneX)
-					minZoneX = x;
-				else if (x > maxZoneX)
-					maxZoneX = x;
-				if (y < minZoneY)
-					minZoneY = y;
-				else if (y > maxZoneY)
-					maxZoneY = y;*/
-				if (z < minZoneZ)
-					minZoneZ = z;
-				else if (z > maxZoneZ)
-					maxZoneZ = z;
-			}
-			//some vertices are reused; we can't take advantage of this with ManualObjects though with how it's set up
-			//need to work with raw vertex and index buffers
-			manual->triangle(vert_index + 2,vert_index + 1,vert_index);
-			vert_index += 3;
+			meshes.pop_back();
+			continue;
 		}
+		mTextures.Remap(meshes.back(),this,true);
+	}
+	MeshSimplifier::SimplifyAll(meshes);
+
+	for (uint32 i = 0; i < meshes.size(); ++i)
+	{
+		MeshBuildData& data = meshes[i];
+		mCollision.AddMesh(data);
+
+		//only the height of the zone matters for the static geometry regions
+		minZoneY = std::min(minZoneY,data.mBounds.getMinimum().y);
+		maxZoneY = std::max(maxZoneY,data.mBounds.getMaximum().y);
 
-		manual->end();
-		snprintf(name_buf,64,"gfaydark%u",count++);
-		Ogre::MeshPtr ptr = manual->convertToMesh(name_buf);
+		snprintf(name_buf,64,"gfaydark%u",i);
+		Ogre::MeshPtr ptr = mMeshBuilder.Upload(data,name_buf);
 		Ogre::Entity* ent = sceneMgr->createEntity(ptr);
 		mStaticGeometry->addEntity(ent,Ogre::Vector3(0,0,0));
+		if (mCacheWriter)
+			mCacheWriter->AddMesh(name_buf,data,true);
 	}
-	mStaticGeometry->setOrigin(Ogre::Vector3(0,minZoneZ - 10,0));
-	mStaticGeometry->setRegionDimensions(Ogre::Vector3(1000,maxZoneZ - minZoneZ + 20,1000));
+	SetZoneHeight(minZoneY,maxZoneY);
+	if (mCacheWriter)
+		mCacheWriter->SetZoneHeight(minZoneY,maxZoneY);
 	mZoneMeshFrags.clear();
 }
 
+void ZoneData::SetZoneHeight(float minY, float maxY)
+{
+	mStaticGeometry->setOrigin(Ogre::Vector3(0,minY - 10,0));
+	mStaticGeometry->setRegionDimensions(Ogre::Vector3(1000,maxY - minY + 20,1000));
+}
+
 void ZoneData::BuildObjectMeshes(Ogre::SceneManager* sceneMgr)
 {
 	//load model data
@@ -237,39 +166,64 @@ void ZoneData::BuildObjectMeshes(Ogre::SceneManager* sceneMgr)
 	//the triangles of the reference copy of the model
 	for (auto itr = mModelFrags.begin(); itr != mModelFrags.end(); itr++)
 	{
-		ModelFragment* model = *itr;
-		if (model->mSize[1] < 1 || !model->mName)
+		ModelView model(*itr);
+		const char* model_name = (*itr)->mName;
+		if (model.GetRefCount() < 1 || !model_name)
 			continue;
 
-		Fragment* frag = GetFragment(model->mRefList[0]);
+		Fragment* frag = GetFragment(model.GetRef(0));
 		if (frag)
 		{
 			if (frag->mType == 0x2D)
 			{
-				frag = GetFragment(static_cast<MeshRefFragment*>(frag)->mRef);
+				frag = GetFragment(RefView(frag).GetRef());
 				if (frag && frag->mType == 0x36)
 				{
-					BuildMesh(static_cast<MeshFragment*>(frag),sceneMgr,model->mName);
+					BuildMesh(MeshFragmentView(frag),model_name);
 				}
 			}
 		}
 	}
 
-	for (auto itr = mObjLocRefFrags.begin(); itr != mObjLocRefFrags.end(); itr++)
+	//placements of models built above are merged by region and material; anything else is still placed on its own
+	SaveObjectPlacements();
+	for (auto itr = mObjectPlacements.begin(); itr != mObjectPlacements.end(); itr++)
 	{
-		ObjectLocRefFragment* obj = *itr;
-		if (obj->mRefName)
+		const char* ref_name = itr->model.c_str();
+		if (mObjectBatcher.HasModel(ref_name))
 		{
-			Ogre::Entity* ent = sceneMgr->createEntity(obj->mRefName);
-			Ogre::Quaternion xrot(Ogre::Degree(obj->mYRotation),Ogre::Vector3::UNIT_X);
-			Ogre::Quaternion yrot(Ogre::Degree(obj->mZRotation),Ogre::Vector3::UNIT_Y);
-			Ogre::Quaternion zrot(Ogre::Degree(obj->mXRotation),Ogre::Vector3::UNIT_Z);
-			mStaticGeometry->addEntity(ent,
-				Ogre::Vector3(obj->mY,obj->mZ,obj->mX),
-				xrot * yrot * zrot,
-				Ogre::Vector3(obj->mYScale,obj->mZScale,obj->mXScale));
+			mObjectBatcher.AddPlacement(ref_name,itr->position,itr->rotation,itr->scale);
+			continue;
 		}
+		Ogre::Entity* ent = sceneMgr->createEntity(ref_name);
+		mStaticGeometry->addEntity(ent,itr->position,itr->rotation,itr->scale);
+		if (mCacheWriter)
+			mCacheWriter->AddPlacement(ref_name,itr->position,itr->rotation,itr->scale);
 	}
+	mObjectPlacements.clear();
+
+	//merged meshes are already in world space, so they go in just like the zone's own meshes
+	char name_buf[64];
+	std::vector<MeshBuildData> batches;
+	mObjectBatcher.Build(batches);
+	MeshSimplifier::SimplifyAll(batches);
+	for (uint32 i = 0; i < batches.size(); ++i)
+	{
+		snprintf(name_buf,64,"gfaydark_obj%u",i);
+		Ogre::MeshPtr ptr = mMeshBuilder.Upload(batches[i],name_buf);
+		Ogre::Entity* ent = sceneMgr->createEntity(ptr);
+		mStaticGeometry->addEntity(ent,Ogre::Vector3(0,0,0));
+		mCollision.AddMesh(batches[i]);
+		if (mCacheWriter)
+			mCacheWriter->AddMesh(name_buf,batches[i],true);
+	}
+	//material names in the models point into this archive's fragments
+	mObjectBatcher.Clear();
+
+	char log[128];
+	snprintf(log,128,"OBJECTS: %u batches merged into %u across %u meshes",
+		mObjectBatcher.GetBatchesBefore(),mObjectBatcher.GetBatchesAfter(),(uint32)batches.size());
+	Ogre::LogManager::getSingleton().logMessage(log);
 }
 
 void ZoneData::BuildMobModelMeshes(Ogre::SceneManager* sceneMgr)
@@ -277,26 +231,28 @@ void ZoneData::BuildMobModelMeshes(Ogre::SceneManager* sceneMgr)
 	int n = 0;
 	for (auto itr = mModelFrags.begin(); itr != mModelFrags.end(); itr++)
 	{
-		ModelFragment* base = *itr;
+		ModelView base(*itr);
+		const char* model_name = (*itr)->mName;
 
-		for (int32 i = 0; i < base->mSize[1]; ++i)
+		for (int32 i = 0; i < base.GetRefCount(); ++i)
 		{
-			Fragment* frag = GetFragment(base->mRefList[i]);
+			Fragment* frag = GetFragment(base.GetRef(i));
 			if (frag && frag->mType == 0x11)
 			{
-				frag = GetFragment(static_cast<AnimationRefFragment*>(frag)->mRef);
+				frag = GetFragment(RefView(frag).GetRef());
 				if (frag && frag->mType == 0x10)
 				{
-					SkeletonTrackSetFragment* track = static_cast<SkeletonTrackSetFragment*>(frag);
+					SkeletonTrackSetView track(frag);
 #ifdef MANUAL_SKELETONS
-					SkeletonSet* skele = ReadMobModelTree(sceneMgr,track,base->mName);
+					SkeletonSet* skele = ReadMobModelTree(sceneMgr,track,model_name);
 					if (n == 10 && i == 0)
 					{
 						//skele->Test(sceneMgr);
-						mMobInstance = new MobInstance(skele,"C05",sceneMgr);
+						for (uint32 k = 0; k < ZEQ_MOB_TEST_COUNT; ++k)
+							SpawnMob(skele,"C05",Ogre::Vector3(k * ZEQ_MOB_TEST_SPACING,0,0),sceneMgr);
 					}
 #else
-					ReadMobModelTree(sceneMgr,track,base->mName,n);
+					ReadMobModelTree(sceneMgr,track,model_name,n);
 #endif
 					n++;
 				}
@@ -308,6 +264,17 @@ void ZoneData::BuildMobModelMeshes(Ogre::SceneManager* sceneMgr)
 #endif
 }
 
+MobInstance* ZoneData::SpawnMob(SkeletonSet* skeleSet, const char* animName, const Ogre::Vector3& pos, Ogre::SceneManager* sceneMgr)
+{
+	PoseCache*& cache = mPoseCaches[skeleSet];
+	if (!cache)
+		cache = new PoseCache(skeleSet);
+	MobInstance* mob = new MobInstance(cache,animName,sceneMgr);
+	mob->GetNode()->setPosition(pos);
+	mMobInstances.push_back(mob);
+	return mob;
+}
+
 #ifndef MANUAL_SKELETONS
 struct TreeEntry
 {
@@ -322,7 +289,7 @@ struct TreeEntry
 	float zTrans;
 };
 
-void ZoneData::ReadMobModelTree(Ogre::SceneManager* sceneMgr, SkeletonTrackSetFragment* track, const char* model_name, uint32 id)
+void ZoneData::ReadMobModelTree(Ogre::SceneManager* sceneMgr, const SkeletonTrackSetView& track, const char* model_name, uint32 id)
 {
 	Ogre::LogManager* logMgr = Ogre::LogManager::getSingletonPtr();
 	char log[128];
@@ -330,7 +297,8 @@ void ZoneData::ReadMobModelTree(Ogre::SceneManager* sceneMgr, SkeletonTrackSetFr
 	Ogre::MeshManager* meshMgr = Ogre::MeshManager::getSingletonPtr();
 
 	std::stack<TreeEntry> stack;
-	SkeletonTrackSet* set = track->mEntries;
+	std::vector<SkeletonTrackEntryView> set;
+	track.GetEntries(set);
 	TreeEntry root;
 	root.index = 0;
 	root.loop_pos = 0;
@@ -339,15 +307,15 @@ void ZoneData::ReadMobModelTree(Ogre::SceneManager* sceneMgr, SkeletonTrackSetFr
 	Ogre::SkeletonPtr skele = Ogre::SkeletonManager::getSingleton().create(model_name,Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
 	Ogre::Animation* anim = skele->createAnimation("base",60.0f);
 
-	std::vector<SkeletonPieceRefFragment*> animSets;
+	std::vector<Fragment*> animSets;
 	Ogre::Bone* root_bone;
 
 	//root piece
-	SkeletonTrackSet* cur_piece = &set[0];
-	Fragment* frag = GetFragment(cur_piece->mRef[0]);
+	const SkeletonTrackEntryView* cur_piece = &set[0];
+	Fragment* frag = GetFragment(cur_piece->GetRef(0));
 	if (frag && frag->mType == 0x13)
 	{
-		SkeletonPieceRefFragment* pr = static_cast<SkeletonPieceRefFragment*>(frag);
+		Fragment* pr = frag;
 		snprintf(log,128,"MODEL ROOT: %s -> %s",model_name ? model_name : "<none>",pr->mName);
 		logMgr->logMessage(log);
 		/*const char* match = pr->mName;
@@ -355,10 +323,10 @@ void ZoneData::ReadMobModelTree(Ogre::SceneManager* sceneMgr, SkeletonTrackSetFr
 		//search for animation keyframe skeletons
 		for (auto itr = mSkelePieceRefFrags.begin(); itr != mSkelePieceRefFrags.end(); itr++)
 		{
-			std::pair<const std::string,SkeletonPieceRefFragment*>& entry = *itr;
+			std::pair<const std::string,Fragment*>& entry = *itr;
 			if (entry.first.find(match) != std::string::npos)
 			{
-				SkeletonPieceRefFragment* next = entry.second;
+				Fragment* next = entry.second;
 				if (!found_cur && entry.first.compare(match) == 0)
 				{
 					found_cur = true; //we're already processing this one, no need to do it twice
@@ -371,39 +339,19 @@ void ZoneData::ReadMobModelTree(Ogre::SceneManager* sceneMgr, SkeletonTrackSetFr
 				}
 			}
 		}*/
-		frag = GetFragment(pr->mRef);
+		frag = GetFragment(RefView(pr).GetRef());
 		if (frag && frag->mType == 0x12)
 		{
-			SkeletonPieceTrackFragment* piece = static_cast<SkeletonPieceTrackFragment*>(frag);
-			float shift_denom;
-			if (piece->mShiftDenominator == 0)
-			{
-				shift_denom = 1.0f;
-				piece->mShiftX = piece->mShiftY = piece->mShiftZ = 0;
-			}
-			else
-			{
-				shift_denom = static_cast<float>(piece->mShiftDenominator);
-			}
-			float rot_denom;
-			if (piece->mRotationDenominator == 0)
-			{
-				rot_denom = 1.0f;
-				piece->mRotationX = piece->mRotationY = piece->mRotationZ = 0;
-			}
-			else
-			{
-				rot_denom = static_cast<float>(piece->mRotationDenominator);
-			}
+			SkeletonPieceTrackView piece(frag);
 			/*Ogre::Bone**/ root_bone = skele->createBone(0);
-			cur_entry.xTrans = piece->mShiftX / shift_denom;
-			cur_entry.yTrans = piece->mShiftY / shift_denom;
-			cur_entry.zTrans = piece->mShiftZ / shift_denom;
+			cur_entry.xTrans = piece.GetShiftX();
+			cur_entry.yTrans = piece.GetShiftY();
+			cur_entry.zTrans = piece.GetShiftZ();
 			Ogre::Vector3 translation(cur_entry.yTrans,cur_entry.zTrans,cur_entry.xTrans);
-			//Ogre::Vector3 translation(piece->mShiftX / shift_denom,piece->mShiftY / shift_denom,piece->mShiftZ / shift_denom);
-			cur_entry.xRot = piece->mRotationX / rot_denom * 3.14159f * 0.5f;
-			cur_entry.yRot = piece->mRotationY / rot_denom * 3.14159f * 0.5f;
-			cur_entry.zRot = piece->mRotationZ / rot_denom * 3.14159f * 0.5f;
+			//Ogre::Vector3 translation(piece.GetShiftX(),piece.GetShiftY(),piece.GetShiftZ());
+			cur_entry.xRot = piece.GetRotationX();
+			cur_entry.yRot = piece.GetRotationY();
+			cur_entry.zRot = piece.GetRotationZ();
 			Ogre::Quaternion xr(Ogre::Radian(cur_entry.yRot),Ogre::Vector3::UNIT_X);
 			Ogre::Quaternion yr(Ogre::Radian(cur_entry.zRot),Ogre::Vector3::UNIT_Y);
 			Ogre::Quaternion zr(Ogre::Radian(cur_entry.xRot),Ogre::Vector3::UNIT_Z);
@@ -424,51 +372,31 @@ void ZoneData::ReadMobModelTree(Ogre::SceneManager* sceneMgr, SkeletonTrackSetFr
 	//tree recursion
 	for (;;)
 	{
-		if (cur_entry.loop_pos < cur_piece->mSize)
+		if (cur_entry.loop_pos < cur_piece->GetSize())
 		{
 			//get next piece
 			TreeEntry next;
-			next.index = cur_piece->mIndexList[cur_entry.loop_pos];
+			next.index = cur_piece->GetIndex(cur_entry.loop_pos);
 			next.loop_pos = 0;
 			cur_piece = &set[next.index];
 			//process new piece
-			frag = GetFragment(cur_piece->mRef[0]);
+			frag = GetFragment(cur_piece->GetRef(0));
 			if (frag && frag->mType == 0x13)
 			{
-				SkeletonPieceRefFragment* pr = static_cast<SkeletonPieceRefFragment*>(frag);
-				frag = GetFragment(pr->mRef);
+				Fragment* pr = frag;
+				frag = GetFragment(RefView(pr).GetRef());
 				if (frag && frag->mType == 0x12)
 				{
-					SkeletonPieceTrackFragment* piece = static_cast<SkeletonPieceTrackFragment*>(frag);
-					float shift_denom;
-					if (piece->mShiftDenominator == 0)
-					{
-						shift_denom = 1.0f;
-						piece->mShiftX = piece->mShiftY = piece->mShiftZ = 0;
-					}
-					else
-					{
-						shift_denom = static_cast<float>(piece->mShiftDenominator);
-					}
-					float rot_denom;
-					if (piece->mRotationDenominator == 0)
-					{
-						rot_denom = 1.0f;
-						piece->mRotationX = piece->mRotationY = piece->mRotationZ = 0;
-					}
-					else
-					{
-						rot_denom = static_cast<float>(piece->mRotationDenominator);
-					}
+					SkeletonPieceTrackView piece(frag);
 					//if the piece has "POINT" in its name, it's an attachment bone
 					Ogre::Bone* add_bone = skele->createBone(next.index);
 					//cur_entry.bone->addChild(add_bone);
 					root_bone->addChild(add_bone);
 
 					//apply parent rotations
-					float xTrans = piece->mShiftX / shift_denom;
-					float yTrans = piece->mShiftY / shift_denom;
-					float x,y,z = piece->mShiftZ / shift_denom;
+					float xTrans = piece.GetShiftX();
+					float yTrans = piece.GetShiftY();
+					float x,y,z = piece.GetShiftZ();
 					//x axis
 					y = (cos(cur_entry.xRot) * yTrans) - (sin(cur_entry.xRot) * z);
 					z = (sin(cur_entry.xRot) * yTrans) + (cos(cur_entry.xRot) * z);
@@ -486,9 +414,9 @@ void ZoneData::ReadMobModelTree(Ogre::SceneManager* sceneMgr, SkeletonTrackSetFr
 					next.zTrans = z + cur_entry.zTrans;
 
 					//apply own rotations (added to parent's)
-					next.xRot = cur_entry.xRot + piece->mRotationX / rot_denom * 3.14159f * 0.5f;
-					next.yRot = cur_entry.yRot + piece->mRotationY / rot_denom * 3.14159f * 0.5f;
-					next.zRot = cur_entry.zRot + piece->mRotationZ / rot_denom * 3.14159f * 0.5f;
+					next.xRot = cur_entry.xRot + piece.GetRotationX();
+					next.yRot = cur_entry.yRot + piece.GetRotationY();
+					next.zRot = cur_entry.zRot + piece.GetRotationZ();
 
 					Ogre::Vector3 translation(next.yTrans,next.zTrans,next.xTrans);
 					Ogre::Quaternion xr(Ogre::Radian(next.yRot),Ogre::Vector3::UNIT_X);
@@ -516,7 +444,7 @@ void ZoneData::ReadMobModelTree(Ogre::SceneManager* sceneMgr, SkeletonTrackSetFr
 			}
 			//put current piece on the stack so we can return to it
 			cur_entry.loop_pos++;
-			if (cur_piece->mSize == 0)
+			if (cur_piece->GetSize() == 0)
 			{
 				//don't bother recursing into the child if we know it is terminal
 				cur_piece = &set[cur_entry.index];
@@ -540,24 +468,26 @@ void ZoneData::ReadMobModelTree(Ogre::SceneManager* sceneMgr, SkeletonTrackSetFr
 
 	MobType* mobType = new MobType;
 	//time to create the geometry and associate vertices to bones
-	for (int32 i = 0; i < track->mSizeB; ++i)
+	for (int32 i = 0; i < track.GetMeshRefCount(); ++i)
 	{
-		frag = GetFragment(track->mRefList[i]);
+		frag = GetFragment(track.GetMeshRef(i));
 		if (frag && frag->mType == 0x2D)
 		{
-			frag = GetFragment(static_cast<MeshRefFragment*>(frag)->mRef);
+			frag = GetFragment(RefView(frag).GetRef());
 			if (frag && frag->mType == 0x36)
 			{
-				MeshFragment* mesh = static_cast<MeshFragment*>(frag);
+				MeshFragmentView mesh(frag);
+				int16 vertexCount = mesh.GetVertexCount();
+				int16 polyCount = mesh.GetPolyCount();
 
 				std::unordered_map<int16,Sprite*>* spriteList;
-				if (mSpriteList.count(mesh->mTextureListing))
-					spriteList = &mSpriteList[mesh->mTextureListing];
+				if (mSpriteList.count(mesh.GetTextureListing()))
+					spriteList = &mSpriteList[mesh.GetTextureListing()];
 				else
 					continue;
 
 				char name_buf[64];
-				snprintf(name_buf,64,"%s",mesh->mName);
+				snprintf(name_buf,64,"%s",frag->mName);
 				Ogre::MeshPtr mainMesh = meshMgr->createManual(name_buf,Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
 
 				//vertex declaration - should store this somewhere and reuse...
@@ -569,9 +499,9 @@ void ZoneData::ReadMobModelTree(Ogre::SceneManager* sceneMgr, SkeletonTrackSetFr
 
 				//create buffers
 				//todo: shove normals into the first buffer (seems to crash DX9?)
-				Ogre::HardwareVertexBufferSharedPtr vbuf = hardwareMgr->createVertexBuffer(decl->getVertexSize(0),mesh->mVertexCount,Ogre::HardwareBuffer::HBU_DYNAMIC);
-				Ogre::HardwareVertexBufferSharedPtr nbuf = hardwareMgr->createVertexBuffer(decl->getVertexSize(1),mesh->mVertexCount,Ogre::HardwareBuffer::HBU_DYNAMIC);
-				Ogre::HardwareVertexBufferSharedPtr tbuf = hardwareMgr->createVertexBuffer(decl->getVertexSize(2),mesh->mVertexCount,Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
+				Ogre::HardwareVertexBufferSharedPtr vbuf = hardwareMgr->createVertexBuffer(decl->getVertexSize(0),vertexCount,Ogre::HardwareBuffer::HBU_DYNAMIC);
+				Ogre::HardwareVertexBufferSharedPtr nbuf = hardwareMgr->createVertexBuffer(decl->getVertexSize(1),vertexCount,Ogre::HardwareBuffer::HBU_DYNAMIC);
+				Ogre::HardwareVertexBufferSharedPtr tbuf = hardwareMgr->createVertexBuffer(decl->getVertexSize(2),vertexCount,Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
 
 				//get data pointers
 				float* vdata = static_cast<float*>(vbuf->lock(Ogre::HardwareBuffer::HBL_WRITE_ONLY));
@@ -579,23 +509,23 @@ void ZoneData::ReadMobModelTree(Ogre::SceneManager* sceneMgr, SkeletonTrackSetFr
 				float* tdata = static_cast<float*>(tbuf->lock(Ogre::HardwareBuffer::HBL_WRITE_ONLY));
 
 				//fill in data
-				Vector3* vert = mesh->mVertexList;
-				Vector3* norm = mesh->mNormalList;
-				Vector2* text = mesh->mTextureCoordList;
 				//the mesh fragment gives us min and max coord information; that information is wrong
 				float minX = 99999, minY = 99999, minZ = 99999, maxX = -99999, maxY = -99999, maxZ = -99999;
 
-				for (int16 j = 0; j < mesh->mVertexCount; ++j)
+				for (int16 j = 0; j < vertexCount; ++j)
 				{
-					float x = vert[j].x, y = vert[j].y, z = vert[j].z;
+					Vector3 vert = mesh.GetVertex(j);
+					Vector3 norm = mesh.GetNormal(j);
+					Vector2 text = mesh.GetTextureCoord(j);
+					float x = vert.x, y = vert.y, z = vert.z;
 					vdata[0] = y;
 					vdata[1] = z;
 					vdata[2] = x;
-					ndata[0] = norm[j].y;
-					ndata[1] = norm[j].z;
-					ndata[2] = norm[j].x;
-					tdata[0] = text[j].u;
-					tdata[1] = -text[j].v;
+					ndata[0] = norm.y;
+					ndata[1] = norm.z;
+					ndata[2] = norm.x;
+					tdata[0] = text.u;
+					tdata[1] = -text.v;
 					vdata += 3;
 					ndata += 3;
 					tdata += 2;
@@ -625,43 +555,44 @@ void ZoneData::ReadMobModelTree(Ogre::SceneManager* sceneMgr, SkeletonTrackSetFr
 
 				Ogre::VertexData* data = new Ogre::VertexData(decl,vbind);
 				mainMesh->sharedVertexData = data;
-				data->vertexCount = mesh->mVertexCount; //are these filled in automatically from the binding?
+				data->vertexCount = vertexCount; //are these filled in automatically from the binding?
 				data->vertexStart = 0;
 
 				//create index buffer
-				Ogre::HardwareIndexBufferSharedPtr ibuf = hardwareMgr->createIndexBuffer(Ogre::HardwareIndexBuffer::IT_16BIT,mesh->mPolyCount * 3,Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
+				Ogre::HardwareIndexBufferSharedPtr ibuf = hardwareMgr->createIndexBuffer(Ogre::HardwareIndexBuffer::IT_16BIT,polyCount * 3,Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
 				uint16* idata = static_cast<uint16*>(ibuf->lock(Ogre::HardwareBuffer::HBL_WRITE_ONLY));
 
 				//create submeshes and fill associated indices
-				PolyTextureEntry* pte = mesh->mPolyTextureList;
-				int16 shareTextureCount = pte->mCount + 1;
+				int16 pt_index = 0;
+				PolyTextureEntry pte = mesh.GetPolyTexture(pt_index);
+				int16 shareTextureCount = pte.mCount + 1;
 
 				Ogre::SubMesh* subMesh = mainMesh->createSubMesh();
-				subMesh->setMaterialName(spriteList->at(pte->mTextureID)->mTextureNameList[0]);
+				subMesh->setMaterialName(mTextures.Require(spriteList->at(pte.mTextureID)->mTextureNameList[0],this));
 				subMesh->useSharedVertices = true;
 				subMesh->indexData->indexBuffer = ibuf;
 				subMesh->indexData->indexStart = 0;
-				subMesh->indexData->indexCount = pte->mCount * 3;
-				uint32 indexOffset = pte->mCount * 3;
+				subMesh->indexData->indexCount = pte.mCount * 3;
+				uint32 indexOffset = pte.mCount * 3;
 
-				for (int16 j = 0; j < mesh->mPolyCount; ++j)
+				for (int16 j = 0; j < polyCount; ++j)
 				{
 					if (--shareTextureCount <= 0)
 					{
-						pte++;
-						shareTextureCount = pte->mCount;
-						if (spriteList->count(pte->mTextureID))
+						pte = mesh.GetPolyTexture(++pt_index);
+						shareTextureCount = pte.mCount;
+						if (spriteList->count(pte.mTextureID))
 						{
 							subMesh = mainMesh->createSubMesh();
-							subMesh->setMaterialName(spriteList->at(pte->mTextureID)->mTextureNameList[0]);
+							subMesh->setMaterialName(mTextures.Require(spriteList->at(pte.mTextureID)->mTextureNameList[0],this));
 							subMesh->useSharedVertices = true;
 							subMesh->indexData->indexBuffer = ibuf;
 							subMesh->indexData->indexStart = indexOffset;
-							subMesh->indexData->indexCount = pte->mCount * 3;
-							indexOffset += pte->mCount * 3;
+							subMesh->indexData->indexCount = pte.mCount * 3;
+							indexOffset += pte.mCount * 3;
 						}
 					}
-					ZEQPolygon& p = mesh->mPolyList[j];
+					ZEQPolygon p = mesh.GetPoly(j);
 					idata[0] = p.index[2];
 					idata[1] = p.index[1];
 					idata[2] = p.index[0];
@@ -675,18 +606,21 @@ void ZoneData::ReadMobModelTree(Ogre::SceneManager* sceneMgr, SkeletonTrackSetFr
 
 				//associate bones with vertices - shared geometry lets us do this independently (thankfully)
 				mainMesh->_notifySkeleton(skele);
-				VertexPiece* vp = mesh->mVertexPieceList;
+				int16 vp_index = 0;
+				VertexPiece vp = mesh.GetVertexPiece(vp_index);
 				uint16 vp_count = 0;
-				for (uint16 v = 0; v < mesh->mVertexCount; ++v)
+				for (uint16 v = 0; v < vertexCount; ++v)
 				{
 					Ogre::VertexBoneAssignment vba;
-					vba.boneIndex = vp->mIndex;
+					vba.boneIndex = vp.mIndex;
 					vba.vertexIndex = v;
 					vba.weight = 1.0f;
 					mainMesh->addBoneAssignment(vba);
-					if (++vp_count == vp->mCount)
+					if (++vp_count == vp.mCount)
 					{
-						vp++;
+						if (++vp_index == mesh.GetVertexPieceCount())
+							break;
+						vp = mesh.GetVertexPiece(vp_index);
 						vp_count = 0;
 					}
 				}
@@ -707,7 +641,7 @@ void ZoneData::LoadBoneAnimations(Ogre::Bone* bone, Ogre::SkeletonPtr& skele, co
 	bool found_cur = false;
 	for (auto itr = mSkelePieceRefFrags.begin(); itr !=  mSkelePieceRefFrags.end(); itr++)
 	{
-		std::pair<const std::string,SkeletonPieceRefFragment*>& entry = *itr;
+		std::pair<const std::string,Fragment*>& entry = *itr;
 
 		if (entry.first.find(name) != std::string::npos)
 		{
@@ -718,7 +652,7 @@ void ZoneData::LoadBoneAnimations(Ogre::Bone* bone, Ogre::SkeletonPtr& skele, co
 			}
 		
 			std::string anim_name = entry.first.substr(0,3);
-			SkeletonPieceRefFragment* pr = entry.second;
+			Fragment* pr = entry.second;
 			float total_duration = 10.0f;//pr->mParam / 1000.0f;
 
 			Ogre::Animation* anim;
@@ -741,35 +675,15 @@ void ZoneData::LoadBoneAnimations(Ogre::Bone* bone, Ogre::SkeletonPtr& skele, co
 
 			//second frame: target position
 			frame = track->createNodeKeyFrame(total_duration / 2.0f);
-			Fragment* frag = GetFragment(pr->mRef);
+			Fragment* frag = GetFragment(RefView(pr).GetRef());
 			if (frag && frag->mType == 0x12)
 			{
-				SkeletonPieceTrackFragment* piece = static_cast<SkeletonPieceTrackFragment*>(frag);
-				float shift_denom;
-				if (piece->mShiftDenominator == 0)
-				{
-					shift_denom = 1.0f;
-					piece->mShiftX = piece->mShiftY = piece->mShiftZ = 0;
-				}
-				else
-				{
-					shift_denom = static_cast<float>(piece->mShiftDenominator);
-				}
-				float rot_denom;
-				if (piece->mRotationDenominator == 0)
-				{
-					rot_denom = 1.0f;
-					piece->mRotationX = piece->mRotationY = piece->mRotationZ = 0;
-				}
-				else
-				{
-					rot_denom = static_cast<float>(piece->mRotationDenominator);
-				}
+				SkeletonPieceTrackView piece(frag);
 				
-				Ogre::Vector3 translation(piece->mShiftY / shift_denom,piece->mShiftZ / shift_denom,piece->mShiftX / shift_denom);
-				Ogre::Quaternion rotation(Ogre::Radian(piece->mRotationY / rot_denom * 3.14159f * 0.5f),Ogre::Vector3::UNIT_X);
-				rotation = rotation * Ogre::Quaternion(Ogre::Radian(piece->mRotationZ / rot_denom * 3.14159f * 0.5f),Ogre::Vector3::UNIT_Y);
-				rotation = rotation * Ogre::Quaternion(Ogre::Radian(piece->mRotationX / rot_denom * 3.14159f * 0.5f),Ogre::Vector3::UNIT_Z);
+				Ogre::Vector3 translation(piece.GetShiftY(),piece.GetShiftZ(),piece.GetShiftX());
+				Ogre::Quaternion rotation(Ogre::Radian(piece.GetRotationY()),Ogre::Vector3::UNIT_X);
+				rotation = rotation * Ogre::Quaternion(Ogre::Radian(piece.GetRotationZ()),Ogre::Vector3::UNIT_Y);
+				rotation = rotation * Ogre::Quaternion(Ogre::Radian(piece.GetRotationX()),Ogre::Vector3::UNIT_Z);
 				frame->setRotation(rotation);
 				frame->setTranslate(translation);
 
@@ -797,7 +711,7 @@ struct TreeEntry
 	Bone* bone;
 };
 
-SkeletonSet* ZoneData::ReadMobModelTree(Ogre::SceneManager* sceneMgr, SkeletonTrackSetFragment* track, const char* model_name)
+SkeletonSet* ZoneData::ReadMobModelTree(Ogre::SceneManager* sceneMgr, const SkeletonTrackSetView& track, const char* model_name)
 {
 	Ogre::LogManager* logMgr = Ogre::LogManager::getSingletonPtr();
 	char log[128];
@@ -805,21 +719,22 @@ SkeletonSet* ZoneData::ReadMobModelTree(Ogre::SceneManager* sceneMgr, SkeletonTr
 	Ogre::MeshManager* meshMgr = Ogre::MeshManager::getSingletonPtr();
 
 	std::stack<TreeEntry> stack;
-	SkeletonTrackSet* set = track->mEntries;
+	std::vector<SkeletonTrackEntryView> set;
+	track.GetEntries(set);
 	TreeEntry root;
 	root.index = 0;
 	root.loop_pos = 0;
 	TreeEntry& cur_entry = root;
 
-	Skeleton* skele = new Skeleton(track->mSizeA);
-	SkeletonSet* meshSkele = new SkeletonSet(skele,track->mSizeB);
+	Skeleton* skele = new Skeleton(track.GetEntryCount());
+	SkeletonSet* meshSkele = new SkeletonSet(skele,track.GetMeshRefCount());
 
 	//root piece
-	SkeletonTrackSet* cur_piece = &set[0];
-	Fragment* frag = GetFragment(cur_piece->mRef[0]);
+	const SkeletonTrackEntryView* cur_piece = &set[0];
+	Fragment* frag = GetFragment(cur_piece->GetRef(0));
 	if (frag && frag->mType == 0x13)
 	{
-		SkeletonPieceRefFragment* pr = static_cast<SkeletonPieceRefFragment*>(frag);
+		Fragment* pr = frag;
 		snprintf(log,128,"MODEL ROOT: %s -> %s",model_name ? model_name : "<none>",pr->mName);
 		logMgr->logMessage(log);
 		/*if (!animation)
@@ -829,10 +744,10 @@ SkeletonSet* ZoneData::ReadMobModelTree(Ogre::SceneManager* sceneMgr, SkeletonTr
 			//search for animation keyframe skeletons
 			for (auto itr = mSkelePieceRefFrags.begin(); itr != mSkelePieceRefFrags.end(); itr++)
 			{
-				std::pair<const std::string,SkeletonPieceRefFragment*>& entry = *itr;
+				std::pair<const std::string,Fragment*>& entry = *itr;
 				if (entry.first.find(match) != std::string::npos)
 				{
-					SkeletonPieceRefFragment* next = entry.second;
+					Fragment* next = entry.second;
 					if (!found_cur && entry.first.compare(match) == 0)
 					{
 						found_cur = true; //we're already processing this one, no need to do it twice
@@ -845,37 +760,17 @@ SkeletonSet* ZoneData::ReadMobModelTree(Ogre::SceneManager* sceneMgr, SkeletonTr
 				}
 			}
 		}*/
-		frag = GetFragment(pr->mRef);
+		frag = GetFragment(RefView(pr).GetRef());
 		if (frag && frag->mType == 0x12)
 		{
-			SkeletonPieceTrackFragment* piece = static_cast<SkeletonPieceTrackFragment*>(frag);
-			float shift_denom;
-			if (piece->mShiftDenominator == 0)
-			{
-				shift_denom = 1.0f;
-				piece->mShiftX = piece->mShiftY = piece->mShiftZ = 0;
-			}
-			else
-			{
-				shift_denom = static_cast<float>(piece->mShiftDenominator);
-			}
-			float rot_denom;
-			if (piece->mRotationDenominator == 0)
-			{
-				rot_denom = 1.0f;
-				piece->mRotationX = piece->mRotationY = piece->mRotationZ = 0;
-			}
-			else
-			{
-				rot_denom = static_cast<float>(piece->mRotationDenominator);
-			}
+			SkeletonPieceTrackView piece(frag);
 			Bone* root_bone = new Bone(
-				piece->mRotationX / rot_denom * 3.14159f * 0.5f,
-				piece->mRotationY / rot_denom * 3.14159f * 0.5f,
-				piece->mRotationZ / rot_denom * 3.14159f * 0.5f,
-				piece->mShiftX / shift_denom,
-				piece->mShiftY / shift_denom,
-				piece->mShiftZ / shift_denom);
+				piece.GetRotationX(),
+				piece.GetRotationY(),
+				piece.GetRotationZ(),
+				piece.GetShiftX(),
+				piece.GetShiftY(),
+				piece.GetShiftZ());
 			cur_entry.bone = root_bone;
 			skele->AddBone(root_bone,0);
 			LoadBoneAnimations(root_bone,skele,meshSkele,pr->mName,0);
@@ -885,50 +780,30 @@ SkeletonSet* ZoneData::ReadMobModelTree(Ogre::SceneManager* sceneMgr, SkeletonTr
 	//tree recursion
 	for (;;)
 	{
-		if (cur_entry.loop_pos < cur_piece->mSize)
+		if (cur_entry.loop_pos < cur_piece->GetSize())
 		{
 			//get next piece
 			TreeEntry next;
-			next.index = cur_piece->mIndexList[cur_entry.loop_pos];
+			next.index = cur_piece->GetIndex(cur_entry.loop_pos);
 			next.loop_pos = 0;
 			cur_piece = &set[next.index];
 			//process new piece
-			frag = GetFragment(cur_piece->mRef[0]);
+			frag = GetFragment(cur_piece->GetRef(0));
 			if (frag && frag->mType == 0x13)
 			{
-				SkeletonPieceRefFragment* pr = static_cast<SkeletonPieceRefFragment*>(frag);
-				frag = GetFragment(pr->mRef);
+				Fragment* pr = frag;
+				frag = GetFragment(RefView(pr).GetRef());
 				if (frag && frag->mType == 0x12)
 				{
-					SkeletonPieceTrackFragment* piece = static_cast<SkeletonPieceTrackFragment*>(frag);
-					float shift_denom;
-					if (piece->mShiftDenominator == 0)
-					{
-						shift_denom = 1.0f;
-						piece->mShiftX = piece->mShiftY = piece->mShiftZ = 0;
-					}
-					else
-					{
-						shift_denom = static_cast<float>(piece->mShiftDenominator);
-					}
-					float rot_denom;
-					if (piece->mRotationDenominator == 0)
-					{
-						rot_denom = 1.0f;
-						piece->mRotationX = piece->mRotationY = piece->mRotationZ = 0;
-					}
-					else
-					{
-						rot_denom = static_cast<float>(piece->mRotationDenominator);
-					}
+					SkeletonPieceTrackView piece(frag);
 					//if the piece has "POINT" in its name, it's an attachment bone
 					Bone* add_bone = new Bone(
-						piece->mRotationX / rot_denom * 3.14159f * 0.5f,
-						piece->mRotationY / rot_denom * 3.14159f * 0.5f,
-						piece->mRotationZ / rot_denom * 3.14159f * 0.5f,
-						piece->mShiftX / shift_denom,
-						piece->mShiftY / shift_denom,
-						piece->mShiftZ / shift_denom,
+						piece.GetRotationX(),
+						piece.GetRotationY(),
+						piece.GetRotationZ(),
+						piece.GetShiftX(),
+						piece.GetShiftY(),
+						piece.GetShiftZ(),
 						cur_entry.bone);
 					next.bone = add_bone;
 					skele->AddBone(add_bone,next.index);
@@ -937,7 +812,7 @@ SkeletonSet* ZoneData::ReadMobModelTree(Ogre::SceneManager* sceneMgr, SkeletonTr
 			}
 			//put current piece on the stack so we can return to it
 			cur_entry.loop_pos++;
-			if (cur_piece->mSize == 0)
+			if (cur_piece->GetSize() == 0)
 			{
 				//don't bother recursing into the child if we know it is terminal
 				cur_piece = &set[cur_entry.index];
@@ -960,24 +835,26 @@ SkeletonSet* ZoneData::ReadMobModelTree(Ogre::SceneManager* sceneMgr, SkeletonTr
 	}
 
 	//time to create the geometry and associate vertices to bones
-	for (int32 i = 0; i < track->mSizeB; ++i)
+	for (int32 i = 0; i < track.GetMeshRefCount(); ++i)
 	{
-		frag = GetFragment(track->mRefList[i]);
+		frag = GetFragment(track.GetMeshRef(i));
 		if (frag && frag->mType == 0x2D)
 		{
-			frag = GetFragment(static_cast<MeshRefFragment*>(frag)->mRef);
+			frag = GetFragment(RefView(frag).GetRef());
 			if (frag && frag->mType == 0x36)
 			{
-				MeshFragment* mesh = static_cast<MeshFragment*>(frag);
+				MeshFragmentView mesh(frag);
+				int16 vertexCount = mesh.GetVertexCount();
+				int16 polyCount = mesh.GetPolyCount();
 
 				std::unordered_map<int16,Sprite*>* spriteList;
-				if (mSpriteList.count(mesh->mTextureListing))
-					spriteList = &mSpriteList[mesh->mTextureListing];
+				if (mSpriteList.count(mesh.GetTextureListing()))
+					spriteList = &mSpriteList[mesh.GetTextureListing()];
 				else
 					continue;
 
 				char name_buf[64];
-				snprintf(name_buf,64,"%s%i",mesh->mName,i);
+				snprintf(name_buf,64,"%s%i",frag->mName,i);
 				Ogre::MeshPtr mainMesh = meshMgr->createManual(name_buf,Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
 
 				//vertex declaration - should store this somewhere and reuse...
@@ -989,35 +866,35 @@ SkeletonSet* ZoneData::ReadMobModelTree(Ogre::SceneManager* sceneMgr, SkeletonTr
 
 				//create buffers
 				//todo: shove normals into the first buffer (seems to crash DX9?)
-				Ogre::HardwareVertexBufferSharedPtr vbuf = hardwareMgr->createVertexBuffer(decl->getVertexSize(0),mesh->mVertexCount,Ogre::HardwareBuffer::HBU_DYNAMIC_WRITE_ONLY_DISCARDABLE);
-				Ogre::HardwareVertexBufferSharedPtr nbuf = hardwareMgr->createVertexBuffer(decl->getVertexSize(1),mesh->mVertexCount,Ogre::HardwareBuffer::HBU_DYNAMIC_WRITE_ONLY_DISCARDABLE);
-				Ogre::HardwareVertexBufferSharedPtr tbuf = hardwareMgr->createVertexBuffer(decl->getVertexSize(2),mesh->mVertexCount,Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
+				Ogre::HardwareVertexBufferSharedPtr vbuf = hardwareMgr->createVertexBuffer(decl->getVertexSize(0),vertexCount,Ogre::HardwareBuffer::HBU_DYNAMIC_WRITE_ONLY_DISCARDABLE);
+				Ogre::HardwareVertexBufferSharedPtr nbuf = hardwareMgr->createVertexBuffer(decl->getVertexSize(1),vertexCount,Ogre::HardwareBuffer::HBU_DYNAMIC_WRITE_ONLY_DISCARDABLE);
+				Ogre::HardwareVertexBufferSharedPtr tbuf = hardwareMgr->createVertexBuffer(decl->getVertexSize(2),vertexCount,Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
 
 				//get data pointers
-				float* vertices = new float[mesh->mVertexCount * 3];
-				float* normals = new float[mesh->mVertexCount * 3];
+				float* vertices = new float[vertexCount * 3];
+				float* normals = new float[vertexCount * 3];
 				float* vdata = vertices;
 				float* ndata = normals;
 				float* tdata = static_cast<float*>(tbuf->lock(Ogre::HardwareBuffer::HBL_WRITE_ONLY));
 
 				//fill in data
-				Vector3* vert = mesh->mVertexList;
-				Vector3* norm = mesh->mNormalList;
-				Vector2* text = mesh->mTextureCoordList;
 				//the mesh fragment gives us min and max coord information; that information is wrong
 				float minX = 99999, minY = 99999, minZ = 99999, maxX = -99999, maxY = -99999, maxZ = -99999;
 
-				for (int16 j = 0; j < mesh->mVertexCount; ++j)
+				for (int16 j = 0; j < vertexCount; ++j)
 				{
-					float x = vert[j].x, y = vert[j].y, z = vert[j].z;
+					Vector3 vert = mesh.GetVertex(j);
+					Vector3 norm = mesh.GetNormal(j);
+					Vector2 text = mesh.GetTextureCoord(j);
+					float x = vert.x, y = vert.y, z = vert.z;
 					*vdata++ = y;
 					*vdata++ = z;
 					*vdata++ = x;
-					*ndata++ = norm[j].y;
-					*ndata++ = norm[j].z;
-					*ndata++ = norm[j].x;
-					*tdata++ = text[j].u;
-					*tdata++ = -text[j].v;
+					*ndata++ = norm.y;
+					*ndata++ = norm.z;
+					*ndata++ = norm.x;
+					*tdata++ = text.u;
+					*tdata++ = -text.v;
 					if (x < minX)
 						minX = x;
 					else if (x > maxX)
@@ -1042,70 +919,90 @@ SkeletonSet* ZoneData::ReadMobModelTree(Ogre::SceneManager* sceneMgr, SkeletonTr
 
 				Ogre::VertexData* data = new Ogre::VertexData(decl,vbind);
 				mainMesh->sharedVertexData = data;
-				data->vertexCount = mesh->mVertexCount; //are these filled in automatically from the binding?
+				data->vertexCount = vertexCount; //are these filled in automatically from the binding?
 				data->vertexStart = 0;
 
 				//create index buffer
-				Ogre::HardwareIndexBufferSharedPtr ibuf = hardwareMgr->createIndexBuffer(Ogre::HardwareIndexBuffer::IT_16BIT,mesh->mPolyCount * 3,Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
-				uint16* idata = static_cast<uint16*>(ibuf->lock(Ogre::HardwareBuffer::HBL_WRITE_ONLY));
+				Ogre::HardwareIndexBufferSharedPtr ibuf = hardwareMgr->createIndexBuffer(Ogre::HardwareIndexBuffer::IT_16BIT,polyCount * 3,Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
+				//indices are kept until the levels of detail have been made from them
+				std::vector<uint16> indices(polyCount * 3);
+				uint16* idata = &indices[0];
 
 				//create submeshes and fill associated indices
-				PolyTextureEntry* pte = mesh->mPolyTextureList;
-				int16 shareTextureCount = pte->mCount + 1;
+				int16 pt_index = 0;
+				PolyTextureEntry pte = mesh.GetPolyTexture(pt_index);
+				int16 shareTextureCount = pte.mCount + 1;
 
 				Ogre::SubMesh* subMesh = mainMesh->createSubMesh();
-				subMesh->setMaterialName(spriteList->at(pte->mTextureID)->mTextureNameList[0]);
+				subMesh->setMaterialName(mTextures.Require(spriteList->at(pte.mTextureID)->mTextureNameList[0],this));
 				subMesh->useSharedVertices = true;
 				subMesh->indexData->indexBuffer = ibuf;
 				subMesh->indexData->indexStart = 0;
-				subMesh->indexData->indexCount = pte->mCount * 3;
-				uint32 indexOffset = pte->mCount * 3;
+				subMesh->indexData->indexCount = pte.mCount * 3;
+				uint32 indexOffset = pte.mCount * 3;
 
-				for (int16 j = 0; j < mesh->mPolyCount; ++j)
+				for (int16 j = 0; j < polyCount; ++j)
 				{
 					if (--shareTextureCount <= 0)
 					{
-						pte++;
-						shareTextureCount = pte->mCount;
-						if (spriteList->count(pte->mTextureID))
+						pte = mesh.GetPolyTexture(++pt_index);
+						shareTextureCount = pte.mCount;
+						if (spriteList->count(pte.mTextureID))
 						{
 							subMesh = mainMesh->createSubMesh();
-							subMesh->setMaterialName(spriteList->at(pte->mTextureID)->mTextureNameList[0]);
+							subMesh->setMaterialName(mTextures.Require(spriteList->at(pte.mTextureID)->mTextureNameList[0],this));
 							subMesh->useSharedVertices = true;
 							subMesh->indexData->indexBuffer = ibuf;
 							subMesh->indexData->indexStart = indexOffset;
-							subMesh->indexData->indexCount = pte->mCount * 3;
-							indexOffset += pte->mCount * 3;
+							subMesh->indexData->indexCount = pte.mCount * 3;
+							indexOffset += pte.mCount * 3;
 						}
 					}
-					ZEQPolygon& p = mesh->mPolyList[j];
+					ZEQPolygon p = mesh.GetPoly(j);
 					*idata++ = p.index[2];
 					*idata++ = p.index[1];
 					*idata++ = p.index[0];
 				}
 
-				ibuf->unlock();
+				ibuf->writeData(0,ibuf->getSizeInBytes(),&indices[0],true);
 
 				mainMesh->_setBounds(Ogre::AxisAlignedBox(minY,minZ,minX,maxY,maxZ,maxX));
 				mainMesh->_setBoundingSphereRadius(std::max(maxX - minX,std::max(maxY - minY,maxZ - minZ)) / 2.0f);
 
 				//associate bones with vertices - shared geometry lets us do this independently (thankfully)
-				VertexPiece* vp = mesh->mVertexPieceList;
 				uint16 vertex_num = 0;
-				while (vertex_num < mesh->mVertexCount)
+				for (int16 v = 0; vertex_num < vertexCount && v < mesh.GetVertexPieceCount(); ++v)
+				{
+					VertexPiece vp = mesh.GetVertexPiece(v);
+					meshSkele->AddBoneAssignment(vp.mIndex,vp.mCount,i);
+					vertex_num += vp.mCount;
+				}
+
+				//reduced from the bind pose; the levels only swap index lists, so skinning is unaffected
+				std::vector<MeshRun> runs;
+				for (uint16 j = 0; j < mainMesh->getNumSubMeshes(); ++j)
 				{
-					meshSkele->AddBoneAssignment(vp->mIndex,vp->mCount,i);
-					vertex_num += vp->mCount;
-					vp++;
+					const Ogre::IndexData* index = mainMesh->getSubMesh(j)->indexData;
+					MeshRun run;
+					run.mMaterial = nullptr;
+					run.mIndexStart = index->indexStart;
+					run.mIndexCount = index->indexCount;
+					runs.push_back(run);
 				}
+				std::vector<MeshLod> lods;
+				mSimplifier.Simplify(reinterpret_cast<const byte*>(vertices),sizeof(float) * 3,vertexCount,&indices[0],runs,lods);
+				MeshBuilder::AttachLods(mainMesh.get(),runs,lods);
 
 				mainMesh->load();
-				meshSkele->AddMesh(mainMesh,i,vertices,normals,mesh->mVertexCount);
+				meshSkele->AddMesh(mainMesh,i,vertices,normals,vertexCount);
 			}
 		}
 	}
 
 	meshSkele->Complete();
+	uint32 baked = meshSkele->Bake();
+	snprintf(log,128,"MODEL %s: %u bytes of baked animation",model_name ? model_name : "<none>",baked);
+	logMgr->logMessage(log);
 	return meshSkele;
 }
 
@@ -1114,7 +1011,7 @@ void ZoneData::LoadBoneAnimations(Bone* bone, Skeleton* skele, SkeletonSet* skel
 	bool found_cur = false;
 	for (auto itr = mSkelePieceRefFrags.begin(); itr !=  mSkelePieceRefFrags.end(); itr++)
 	{
-		std::pair<const std::string,SkeletonPieceRefFragment*>& entry = *itr;
+		std::pair<const std::string,Fragment*>& entry = *itr;
 
 		if (entry.first.find(name) != std::string::npos)
 		{
@@ -1125,7 +1022,7 @@ void ZoneData::LoadBoneAnimations(Bone* bone, Skeleton* skele, SkeletonSet* skel
 			}
 		
 			std::string anim_name = entry.first.substr(0,3);
-			SkeletonPieceRefFragment* pr = entry.second;
+			Fragment* pr = entry.second;
 			float total_duration = 10.0f;//pr->mParam / 1000.0f;
 
 			Skeleton* target_skele;
@@ -1152,49 +1049,29 @@ void ZoneData::LoadBoneAnimations(Bone* bone, Skeleton* skele, SkeletonSet* skel
 			}
 
 			//second frame: target position
-			Fragment* frag = GetFragment(pr->mRef);
+			Fragment* frag = GetFragment(RefView(pr).GetRef());
 			if (frag && frag->mType == 0x12)
 			{
-				SkeletonPieceTrackFragment* piece = static_cast<SkeletonPieceTrackFragment*>(frag);
-				float shift_denom;
-				if (piece->mShiftDenominator == 0)
-				{
-					shift_denom = 1.0f;
-					piece->mShiftX = piece->mShiftY = piece->mShiftZ = 0;
-				}
-				else
-				{
-					shift_denom = static_cast<float>(piece->mShiftDenominator);
-				}
-				float rot_denom;
-				if (piece->mRotationDenominator == 0)
-				{
-					rot_denom = 1.0f;
-					piece->mRotationX = piece->mRotationY = piece->mRotationZ = 0;
-				}
-				else
-				{
-					rot_denom = static_cast<float>(piece->mRotationDenominator);
-				}
+				SkeletonPieceTrackView piece(frag);
 
 				Bone* add_bone = new Bone(
-					piece->mRotationX / rot_denom * 3.14159f * 0.5f,
-					piece->mRotationY / rot_denom * 3.14159f * 0.5f,
-					piece->mRotationZ / rot_denom * 3.14159f * 0.5f,
-					piece->mShiftX / shift_denom,
-					piece->mShiftY / shift_denom,
-					piece->mShiftZ / shift_denom,
+					piece.GetRotationX(),
+					piece.GetRotationY(),
+					piece.GetRotationZ(),
+					piece.GetShiftX(),
+					piece.GetShiftY(),
+					piece.GetShiftZ(),
 					(index == 0) ? nullptr : target_skele->GetBone(parent_index));
 				target_skele->AddBone(add_bone,index);
 
 				/*char log[128];
 				snprintf(log,128,"ANIM BONE %s rot %g, %g, %g shift %g, %g, %g",pr->mName,
-					piece->mRotationX / rot_denom * 3.14159f * 0.5f,
-					piece->mRotationY / rot_denom * 3.14159f * 0.5f,
-					piece->mRotationZ / rot_denom * 3.14159f * 0.5f,
-					piece->mShiftX / shift_denom,
-					piece->mShiftY / shift_denom,
-					piece->mShiftZ / shift_denom);
+					piece.GetRotationX(),
+					piece.GetRotationY(),
+					piece.GetRotationZ(),
+					piece.GetShiftX(),
+					piece.GetShiftY(),
+					piece.GetShiftZ());
 				Ogre::LogManager::getSingleton().logMessage(log);*/
 			}
 		}
@@ -1207,7 +1084,7 @@ Fragment* ZoneData::GetFragment(int32 index)
 	if (index > 0)
 	{
 		uint32 check = static_cast<uint32>(index - 1);
-		if (mFragsByIndex.count(check))
+		if (check < mFragsByIndex.size())
 			return mFragsByIndex[check];
 	}
 	else
@@ -1219,9 +1096,76 @@ Fragment* ZoneData::GetFragment(int32 index)
 	return nullptr;
 }
 
+static bool CompareFragmentName(const std::pair<const char*,Fragment*>& a, const std::pair<const char*,Fragment*>& b)
+{
+	return strcmp(a.first,b.first) < 0;
+}
+
+void ZoneData::SortFragmentNames()
+{
+	//stable so that among fragments sharing a name, the one added last is still last
+	std::stable_sort(mFragsByName.begin(),mFragsByName.end(),CompareFragmentName);
+}
+
 Fragment* ZoneData::GetFragment(const char* name)
 {
-	if (mFragsByName.count(name))
-		return mFragsByName[name];
-	return nullptr;
+	//names can repeat; the last fragment added under a name is the one that counts
+	std::pair<const char*,Fragment*> key(name,nullptr);
+	auto itr = std::upper_bound(mFragsByName.begin(),mFragsByName.end(),key,CompareFragmentName);
+	if (itr == mFragsByName.begin())
+		return nullptr;
+	--itr;
+	if (strcmp(itr->first,name) != 0)
+		return nullptr;
+	return itr->second;
+}
+
+void ZoneData::SaveObjectPlacements()
+{
+	for (auto itr = mObjLocRefFrags.begin(); itr != mObjLocRefFrags.end(); itr++)
+	{
+		ObjectLocRefView obj(*itr);
+		const char* ref_name = obj.GetRefName();
+		if (!ref_name)
+			continue;
+		Ogre::Quaternion xrot(Ogre::Degree(obj.GetYRotation()),Ogre::Vector3::UNIT_X);
+		Ogre::Quaternion yrot(Ogre::Degree(obj.GetZRotation()),Ogre::Vector3::UNIT_Y);
+		Ogre::Quaternion zrot(Ogre::Degree(obj.GetXRotation()),Ogre::Vector3::UNIT_Z);
+		ObjectPlacement place;
+		place.model = ref_name;
+		place.position = Ogre::Vector3(obj.GetY(),obj.GetZ(),obj.GetX());
+		place.rotation = xrot * yrot * zrot;
+		place.scale = Ogre::Vector3(obj.GetYScale(),obj.GetZScale(),obj.GetXScale());
+		mObjectPlacements.push_back(place);
+	}
+	mObjLocRefFrags.clear();
+}
+
+void ZoneData::ClearFragments()
+{
+	SaveObjectPlacements();
+	mFragsByIndex.clear();
+	mFragsByName.clear();
+	mZoneMeshFrags.clear();
+	mTextureListFrags.clear();
+	//sprites point at the names held by the 0x03 fragments, and are keyed by this archive's fragment indices
+	for (auto itr = mSpriteList.begin(); itr != mSpriteList.end(); itr++)
+	{
+		for (auto sprite = itr->second.begin(); sprite != itr->second.end(); sprite++)
+		{
+			delete sprite->second;
+		}
+	}
+	mSpriteList.clear();
+	for (auto itr = mBitmapNameFrags.begin(); itr != mBitmapNameFrags.end(); itr++)
+	{
+		delete *itr;
+	}
+	mBitmapNameFrags.clear();
+	mObjLocRefFrags.clear();
+	mModelFrags.clear();
+	mAnimMeshFrags.clear();
+	mSkelePieceRefFrags.clear();
+	mFragRecords.clear();
+	mNameData = nullptr;
 }
@@ -6,52 +6,96 @@
 
 #include "type.h"
 #include "fragment.h"
+#include "fragment_view.h"
+#include "mesh_builder.h"
+#include "mesh_simplify.h"
+#include "zone_cache.h"
+#include "texture_registry.h"
+#include "object_batcher.h"
+#include "zone_bvh.h"
 #include "sprite.h"
 #include "skeleton.h"
+#include "pose_cache.h"
 #include "mob_manager.h"
 #include <vector>
+#include <list>
 #include <unordered_map>
 #include <unordered_set>
 #include <stack>
 #include <algorithm>
 #include <math.h>
 
+//copies of the test mob spawned side by side; all on the same frame, they share one skinning pass
+#define ZEQ_MOB_TEST_COUNT 16
+#define ZEQ_MOB_TEST_SPACING 10.0f
+
+//A 0x15 placement, copied out of its fragment so it outlives the archive it came from
+struct ObjectPlacement
+{
+	std::string model;
+	Ogre::Vector3 position;
+	Ogre::Quaternion rotation;
+	Ogre::Vector3 scale;
+};
+
 struct ZoneData
 {
 	ZoneData(Ogre::SceneManager* sceneMgr);
 	void LoadSprites();
-	void BuildMesh(MeshFragment* mesh, Ogre::SceneManager* sceneMgr, const char* model_name = nullptr);
+	void BuildMesh(const MeshFragmentView& mesh, const char* model_name = nullptr);
 	void BuildZoneMeshes(Ogre::SceneManager* sceneMgr);
+	//static geometry regions span the whole height of the zone
+	void SetZoneHeight(float minY, float maxY);
 	void BuildObjectMeshes(Ogre::SceneManager* sceneMgr);
 	void BuildMobModelMeshes(Ogre::SceneManager* sceneMgr);
+	//every instance of a skeleton set draws its frames from the set's one PoseCache
+	MobInstance* SpawnMob(SkeletonSet* skeleSet, const char* animName, const Ogre::Vector3& pos, Ogre::SceneManager* sceneMgr);
 #ifdef MANUAL_SKELETONS
-	SkeletonSet* ReadMobModelTree(Ogre::SceneManager* sceneMgr, SkeletonTrackSetFragment* track, const char* model_name);
+	SkeletonSet* ReadMobModelTree(Ogre::SceneManager* sceneMgr, const SkeletonTrackSetView& track, const char* model_name);
 	void LoadBoneAnimations(Bone* bone, Skeleton* skele, SkeletonSet* skeleSet, const char* name, uint16 index, uint16 parent_index = 0);
 #else
-	void ReadMobModelTree(Ogre::SceneManager* sceneMgr, SkeletonTrackSetFragment* track, const char* model_name, uint32 id);
+	void ReadMobModelTree(Ogre::SceneManager* sceneMgr, const SkeletonTrackSetView& track, const char* model_name, uint32 id);
 	void LoadBoneAnimations(Ogre::Bone* bone, Ogre::SkeletonPtr& skele, const char* name, uint16 index);
 #endif
 
 	Fragment* GetFragment(int32 index);
 	Fragment* GetFragment(const char* name);
+	//called once a WLD's fragments have all been added, before any lookups by name
+	void SortFragmentNames();
+	//copies the 0x15 placements of the archive just loaded into mObjectPlacements; the main archive's objects.wld
+	//places models that are only built once the _obj archive is loaded
+	void SaveObjectPlacements();
+	//drops every fragment of the archive just loaded, keeping its placements; must be done before its WLD buffers are released
+	void ClearFragments();
 
-	byte* mNameData; //raw fragment name block, fragments point to entries in here so we need to maintain it
-	std::unordered_map<uint32,Fragment*> mFragsByIndex;
-	std::unordered_map<std::string,Fragment*> mFragsByName;
+	byte* mNameData; //fragment name block of the last WLD loaded, decoded in place in the WLD buffer
+	std::list<std::vector<Fragment>> mFragRecords; //one block of records per WLD, reserved up front so pointers into them stay valid
+	std::vector<Fragment*> mFragsByIndex; //by fragment number; types we don't load are nullptr
+	std::vector<std::pair<const char*,Fragment*>> mFragsByName; //sorted by name, in insertion order within the same name
 	std::unordered_map<uint32,std::unordered_map<int16,Sprite*>> mSpriteList;
 	std::unordered_map<std::string,MeshFragment*> mModelMeshList;
-	std::vector<MeshFragment*> mZoneMeshFrags;
-	//std::vector<MeshFragment*> mObjMeshFrags;
-	std::vector<TextureListFragment*> mTextureListFrags;
-	std::vector<ObjectLocRefFragment*> mObjLocRefFrags;
-	std::vector<ModelFragment*> mModelFrags;
-	std::vector<AnimatedMeshRefFragment*> mAnimMeshFrags;
-	std::unordered_map<std::string,SkeletonPieceRefFragment*> mSkelePieceRefFrags;
+	std::vector<Fragment*> mZoneMeshFrags;
+	//std::vector<Fragment*> mObjMeshFrags;
+	std::vector<std::pair<uint32,Fragment*>> mTextureListFrags; //paired with their fragment index
+	std::vector<TextureBitmapNameFragment*> mBitmapNameFrags; //textures referenced by the WLDs of the archive being loaded
+	std::vector<Fragment*> mObjLocRefFrags;
+	std::vector<ObjectPlacement> mObjectPlacements; //waiting for BuildObjectMeshes
+	std::vector<Fragment*> mModelFrags;
+	std::vector<Fragment*> mAnimMeshFrags;
+	std::unordered_map<std::string,Fragment*> mSkelePieceRefFrags;
 
+	ZoneCacheWriter* mCacheWriter; //set while building a zone that should be written out to its cache
+	TextureRegistry mTextures;
+	ObjectBatcher mObjectBatcher;
+	ZoneBVH mCollision; //every static triangle of the zone, in world space; built once the zone and its objects are in
+	MeshBuilder mMeshBuilder;
+	MeshSimplifier mSimplifier;
+	MeshBuildData mMeshBuildData; //reused between object models so its buffers only grow
 	Ogre::StaticGeometry* mStaticGeometry;
 	MobManager mMobManager;
 	Ogre::AnimationState* mAnimState;
-	MobInstance* mMobInstance;
+	std::unordered_map<SkeletonSet*,PoseCache*> mPoseCaches; //made when a set's first instance is spawned
+	std::vector<MobInstance*> mMobInstances;
 };
 
 #endif
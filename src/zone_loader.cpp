@@ -3,38 +3,67 @@
 
 ZoneLoader::ZoneLoader()
 {
-
+	mZoneData = nullptr;
+	mStreamer = nullptr;
 }
 
 void ZoneLoader::Load(const char* shortname)
 {
 	mZoneData = new ZoneData(mSceneMgr);
 	char name_buf[256];
+	char main_path[256];
+	char obj_path[256];
+	char cache_path[256];
+	snprintf(main_path,256,"%s.s3d",shortname);
+	snprintf(obj_path,256,"%s_obj.s3d",shortname);
+	snprintf(cache_path,256,"%s.zcache",shortname);
+
+	//the zone itself comes from its cache when that is still up to date with the archives
+	Ogre::VertexElementType colourType = mZoneData->mMeshBuilder.GetColourType();
+	bool cached = mCache.Open(cache_path,main_path,obj_path,colourType);
+	if (cached)
+	{
+#ifdef ZEQ_ZONE_STREAMING
+		//only a cache can be streamed from; a zone without one is built in full, and streamed from the cache it writes next time
+		mStreamer = new ZoneStreamer(&mCache,mZoneData,mSceneMgr);
+		mCache.Load(mZoneData,mSceneMgr,mStreamer);
+		mStreamer->Start();
+#else
+		mCache.Load(mZoneData,mSceneMgr);
+		mCache.Close();
+#endif
+	}
 
 	//check if there is a main S3D file (original flavor zones)
-	snprintf(name_buf,256,"%s.s3d",shortname);
-	FILE* fp = fopen(name_buf,"rb");
-	if (fp) {
-		S3D mainS3D(fp,mZoneData,mSceneMgr,true);
-		fclose(fp);
-		snprintf(name_buf,256,"%s_obj.s3d",shortname);
-		fp = fopen(name_buf,"rb");
-		if (fp) {
-			S3D objS3D(fp,mZoneData,mSceneMgr,false,true);
-			fclose(fp);
+	//the archives stay open until the whole zone is built, since later stages may still refer to their contents
+	S3DArchive mainArchive, objArchive, chrArchive;
+	if (cached || mainArchive.Open(main_path)) {
+		if (!cached) {
+			ZoneCacheWriter writer(main_path,obj_path,colourType);
+			mZoneData->mCacheWriter = &writer;
+			S3D mainS3D(&mainArchive,mZoneData,mSceneMgr,true);
+			if (objArchive.Open(obj_path)) {
+				S3D objS3D(&objArchive,mZoneData,mSceneMgr,false,true);
+			}
+			mZoneData->mCacheWriter = nullptr;
+			writer.Write(cache_path);
 		}
+
+		//the tree only covers the zone and its static objects; characters are added after and move around
+		mZoneData->mCollision.Build();
+		snprintf(name_buf,256,"COLLISION: %u triangles in %u nodes",mZoneData->mCollision.GetTriangleCount(),mZoneData->mCollision.GetNodeCount());
+		Ogre::LogManager::getSingleton().logMessage(name_buf);
 		snprintf(name_buf,256,"%s_chr.s3d",shortname);
-		fp = fopen(name_buf,"rb");
-		if (fp) {
-			S3D chrS3D(fp,mZoneData,mSceneMgr);
-			fclose(fp);
+		if (chrArchive.Open(name_buf)) {
+			S3D chrS3D(&chrArchive,mZoneData,mSceneMgr);
 		}
 	}
 }
 
 ZoneLoader::~ZoneLoader()
 {
-
+	//before the cache it streams from is closed
+	delete mStreamer;
 }
 
 void ZoneLoader::createCamera()
@@ -62,6 +91,8 @@ void ZoneLoader::createScene()
 	mSceneMgr->setAmbientLight(Ogre::ColourValue(1.0,1.0,1.0));
 
 	mZoneData->mStaticGeometry->build();
+	if (mStreamer)
+		mStreamer->Prime(mCamera->getPosition(),ZEQ_STREAM_PRIME_RADIUS);
 
 	//pointless as nothing is reflective
 	/*Ogre::Light* light = mSceneMgr->createLight("MainLight");
@@ -87,6 +118,9 @@ bool ZoneLoader::frameRenderingQueued(const Ogre::FrameEvent& evt)
 	//Need to capture/update each device
 	mInputContext.capture();
 
+	if (mStreamer)
+		mStreamer->Update(mCamera->getDerivedPosition());
+
     mTrayMgr->frameRenderingQueued(evt);
 
     if (!mTrayMgr->isDialogVisible())
@@ -106,10 +140,19 @@ bool ZoneLoader::frameRenderingQueued(const Ogre::FrameEvent& evt)
 
 	//if (mZoneData->mAnimState)
 	//	mZoneData->mAnimState->addTime(evt.timeSinceLastFrame);
-	if (mZoneData->mMobInstance)
-		mZoneData->mMobInstance->AddAnimTime(evt.timeSinceLastFrame);
+	for (auto itr = mZoneData->mMobInstances.begin(); itr != mZoneData->mMobInstances.end(); itr++)
+	{
+		(*itr)->AddAnimTime(evt.timeSinceLastFrame);
+	}
+
+	mNetwork.Dispatch([this](uint32 session, uint16 opcode, const byte* data, uint32 len) { HandlePacket(session,opcode,data,len); });
 
 	Sleep(10);
 
     return true;
-}
\ No newline at end of file
+}
+
+void ZoneLoader::HandlePacket(uint32, uint16 opcode, const byte* data, uint32 len)
+{
+	mOpcodes.Dispatch(opcode,data,len);
+}
@@ -11,9 +11,18 @@
 #include "gfx_loaders.h"
 #include "fragment.h"
 #include "zone_data.h"
+#include "zone_cache.h"
+#include "zone_streamer.h"
+#include "network_thread.h"
+#include "opcode_dispatch.h"
 
 #include "TutorialFramework.h"
 
+//page a cached zone in around the camera instead of building all of it before the first frame
+#define ZEQ_ZONE_STREAMING
+//cells within this distance of the camera are loaded before the first frame
+#define ZEQ_STREAM_PRIME_RADIUS 500.0f
+
 class ZoneLoader : public BaseApplication
 {
 public:
@@ -25,7 +34,13 @@ public:
 	void createViewports() override;
 	bool frameRenderingQueued(const Ogre::FrameEvent& evt) override;
 private:
+	void HandlePacket(uint32 session, uint16 opcode, const byte* data, uint32 len);
+
 	ZoneData* mZoneData;
+	ZoneCache mCache; //stays open while streaming from it
+	ZoneStreamer* mStreamer; //nullptr unless the zone is streamed
+	NetworkThread mNetwork;
+	OpcodeDispatcher mOpcodes; //application packets from every session, until they need tables of their own
 };
 
 #endif
@@ -0,0 +1,320 @@
+
+#include "zone_streamer.h"
+#include "zone_data.h"
+
+ZoneStreamer::ZoneStreamer(ZoneCache* cache, ZoneData* zone_data, Ogre::SceneManager* sceneMgr)
+{
+	mCache = cache;
+	mZoneData = zone_data;
+	mSceneMgr = sceneMgr;
+	mBudget = ZEQ_STREAM_BUDGET;
+	mCommitted = 0;
+	mResidentCount = 0;
+	mRadius = ZEQ_STREAM_RADIUS;
+	mThread = nullptr;
+	mShutdown = false;
+}
+
+ZoneStreamer::~ZoneStreamer()
+{
+	if (mThread)
+	{
+		{
+			boost::lock_guard<boost::mutex> lock(mMutex);
+			mShutdown = true;
+		}
+		mWake.notify_all();
+		mThread->join();
+		delete mThread;
+	}
+
+	boost::lock_guard<boost::mutex> lock(mMutex);
+	for (auto itr = mCells.begin(); itr != mCells.end(); itr++)
+	{
+		if (itr->state == CELL_RESIDENT)
+			Evict(*itr);
+	}
+}
+
+ZoneStreamer::Cell& ZoneStreamer::GetCell(float x, float z)
+{
+	int32 cx = (int32)floor(x / ZEQ_STREAM_CELL_SIZE);
+	int32 cz = (int32)floor(z / ZEQ_STREAM_CELL_SIZE);
+	uint64 key = ((uint64)(uint32)cx << 32) | (uint32)cz;
+	auto itr = mCellIndex.find(key);
+	if (itr != mCellIndex.end())
+		return mCells[itr->second];
+
+	mCellIndex[key] = mCells.size();
+	mCells.push_back(Cell());
+	Cell& cell = mCells.back();
+	cell.x = cx;
+	cell.z = cz;
+	cell.bytes = 0;
+	cell.distance = FLT_MAX;
+	cell.state = CELL_UNLOADED;
+	cell.geometry = nullptr;
+	return cell;
+}
+
+void ZoneStreamer::AddMesh(uint32 index)
+{
+	//a mesh goes wherever its centre is, just as the static geometry would place it
+	const ZoneCacheMesh* mesh = mCache->GetMesh(index);
+	Cell& cell = GetCell((mesh->bounds[0] + mesh->bounds[3]) * 0.5f,(mesh->bounds[2] + mesh->bounds[5]) * 0.5f);
+	cell.meshes.push_back(index);
+	uint32 indexCount = mesh->indexCount;
+	const ZoneCacheLod* lod = mCache->GetLods(mesh);
+	for (uint32 i = 0; i < mesh->lodCount; ++i, ++lod)
+	{
+		indexCount += lod->indexCount;
+	}
+	cell.bytes += (mesh->vertexCount * sizeof(MeshVertex) + indexCount * sizeof(uint16)) * 2;
+}
+
+void ZoneStreamer::AddPlacement(uint32 index)
+{
+	//placed meshes are loaded up front, so a placement only costs its share of the static geometry
+	const ZoneCachePlacement* place = mCache->GetPlacement(index);
+	Cell& cell = GetCell(place->position[0],place->position[2]);
+	cell.placements.push_back(index);
+}
+
+void ZoneStreamer::Start()
+{
+	mThread = new boost::thread(&ZoneStreamer::ThreadLoop,this);
+
+	char log[128];
+	snprintf(log,128,"STREAMING: %u cells, budget %u bytes",(uint32)mCells.size(),mBudget);
+	Ogre::LogManager::getSingleton().logMessage(log);
+}
+
+void ZoneStreamer::UpdateDistances(const Ogre::Vector3& pos)
+{
+	//distance across the ground to the nearest edge of the cell, 0 inside it
+	for (auto itr = mCells.begin(); itr != mCells.end(); itr++)
+	{
+		float minX = itr->x * ZEQ_STREAM_CELL_SIZE;
+		float minZ = itr->z * ZEQ_STREAM_CELL_SIZE;
+		float dx = std::max(std::max(minX - pos.x,pos.x - (minX + ZEQ_STREAM_CELL_SIZE)),0.0f);
+		float dz = std::max(std::max(minZ - pos.z,pos.z - (minZ + ZEQ_STREAM_CELL_SIZE)),0.0f);
+		itr->distance = sqrtf(dx * dx + dz * dz);
+	}
+}
+
+void ZoneStreamer::Update(const Ogre::Vector3& pos)
+{
+	UpdateDistances(pos);
+	{
+		boost::lock_guard<boost::mutex> lock(mMutex);
+		for (auto itr = mCells.begin(); itr != mCells.end(); itr++)
+		{
+			if (itr->state == CELL_RESIDENT && itr->distance > mRadius + ZEQ_STREAM_HYSTERESIS)
+				Evict(*itr);
+		}
+	}
+	Request(mRadius);
+	UploadReady(ZEQ_STREAM_UPLOADS_PER_FRAME);
+}
+
+void ZoneStreamer::Prime(const Ogre::Vector3& pos, float radius)
+{
+	UpdateDistances(pos);
+	Request(radius);
+	for (;;)
+	{
+		{
+			boost::unique_lock<boost::mutex> lock(mMutex);
+			bool pending = false;
+			for (auto itr = mCells.begin(); itr != mCells.end() && !pending; itr++)
+			{
+				pending = itr->distance <= radius && itr->state != CELL_UNLOADED && itr->state != CELL_RESIDENT;
+			}
+			if (!pending)
+				return;
+			while (mReady.empty())
+				mStaged.wait(lock);
+		}
+		UploadReady(0xFFFFFFFF);
+	}
+}
+
+void ZoneStreamer::Request(float radius)
+{
+	mOrder.clear();
+	for (uint32 i = 0; i < mCells.size(); ++i)
+	{
+		if (mCells[i].distance <= radius)
+			mOrder.push_back(i);
+	}
+	std::vector<Cell>& cells = mCells;
+	std::sort(mOrder.begin(),mOrder.end(),[&cells](uint32 a, uint32 b) { return cells[a].distance < cells[b].distance; });
+
+	boost::lock_guard<boost::mutex> lock(mMutex);
+	//whatever the thread hasn't started on yet is queued again from scratch, so the queue follows the camera
+	for (auto itr = mRequests.begin(); itr != mRequests.end(); itr++)
+	{
+		Cell& cell = mCells[*itr];
+		cell.state = CELL_UNLOADED;
+		mCommitted -= cell.bytes;
+	}
+	mRequests.clear();
+
+	for (auto itr = mOrder.begin(); itr != mOrder.end(); itr++)
+	{
+		Cell& cell = mCells[*itr];
+		if (cell.state != CELL_UNLOADED)
+			continue;
+
+		//make room by dropping the furthest cells in memory, but never one nearer than this
+		while (mCommitted + cell.bytes > mBudget)
+		{
+			Cell* furthest = nullptr;
+			for (auto other = mCells.begin(); other != mCells.end(); other++)
+			{
+				if (other->state == CELL_RESIDENT && other->distance > cell.distance && (!furthest || other->distance > furthest->distance))
+					furthest = &(*other);
+			}
+			if (!furthest)
+				break;
+			Evict(*furthest);
+		}
+		if (mCommitted + cell.bytes > mBudget)
+			break;
+
+		cell.state = CELL_QUEUED;
+		mCommitted += cell.bytes;
+		mRequests.push_back(*itr);
+	}
+	if (!mRequests.empty())
+		mWake.notify_one();
+}
+
+uint32 ZoneStreamer::UploadReady(uint32 max)
+{
+	uint32 done = 0;
+	while (done < max)
+	{
+		uint32 index;
+		{
+			boost::lock_guard<boost::mutex> lock(mMutex);
+			if (mReady.empty())
+				break;
+			index = mReady.front();
+			mReady.pop_front();
+		}
+
+		//ready cells belong to the render thread, so this can go on without the lock
+		Cell& cell = mCells[index];
+		Upload(cell);
+		{
+			boost::lock_guard<boost::mutex> lock(mMutex);
+			cell.state = CELL_RESIDENT;
+		}
+		mResidentCount++;
+		done++;
+	}
+	return done;
+}
+
+void ZoneStreamer::Upload(Cell& cell)
+{
+	//one region covering exactly the cell
+	const ZoneCacheHeader* header = mCache->GetHeader();
+	char name[64];
+	snprintf(name,64,"zeq_cell_%d_%d",cell.x,cell.z);
+	Ogre::StaticGeometry* geometry = mSceneMgr->createStaticGeometry(name);
+	geometry->setRenderingDistance(mZoneData->mStaticGeometry->getRenderingDistance());
+	geometry->setOrigin(Ogre::Vector3(cell.x * ZEQ_STREAM_CELL_SIZE,header->minZoneY - 10,cell.z * ZEQ_STREAM_CELL_SIZE));
+	geometry->setRegionDimensions(Ogre::Vector3(ZEQ_STREAM_CELL_SIZE,header->maxZoneY - header->minZoneY + 20,ZEQ_STREAM_CELL_SIZE));
+
+	std::vector<Ogre::Entity*> entities;
+	for (auto itr = cell.staged.begin(); itr != cell.staged.end(); itr++)
+	{
+		const ZoneCacheMesh* mesh = mCache->GetMesh(itr->mesh);
+		Ogre::AxisAlignedBox bounds(mesh->bounds[0],mesh->bounds[1],mesh->bounds[2],mesh->bounds[3],mesh->bounds[4],mesh->bounds[5]);
+		Ogre::MeshPtr ptr = mZoneData->mMeshBuilder.Upload(&itr->vertices[0],itr->vertices.size(),&itr->indices[0],itr->indices.size(),
+			itr->runs,itr->lods,bounds,mCache->GetString(mesh->name));
+		Ogre::Entity* ent = mSceneMgr->createEntity(ptr);
+		geometry->addEntity(ent,Ogre::Vector3(0,0,0));
+		entities.push_back(ent);
+	}
+
+	for (auto itr = cell.placements.begin(); itr != cell.placements.end(); itr++)
+	{
+		const ZoneCachePlacement* place = mCache->GetPlacement(*itr);
+		Ogre::Entity* ent = mSceneMgr->createEntity(mCache->GetString(place->mesh));
+		geometry->addEntity(ent,
+			Ogre::Vector3(place->position[0],place->position[1],place->position[2]),
+			Ogre::Quaternion(place->orientation[0],place->orientation[1],place->orientation[2],place->orientation[3]),
+			Ogre::Vector3(place->scale[0],place->scale[1],place->scale[2]));
+		entities.push_back(ent);
+	}
+
+	//the static geometry keeps its own copy, so neither the entities nor the staged data are needed after this
+	geometry->build();
+	for (auto itr = entities.begin(); itr != entities.end(); itr++)
+	{
+		mSceneMgr->destroyEntity(*itr);
+	}
+	std::vector<StagedMesh>().swap(cell.staged);
+	cell.geometry = geometry;
+}
+
+void ZoneStreamer::Evict(Cell& cell)
+{
+	//called with mMutex held, and only ever on resident cells
+	mSceneMgr->destroyStaticGeometry(cell.geometry);
+	cell.geometry = nullptr;
+	Ogre::MeshManager& meshMgr = Ogre::MeshManager::getSingleton();
+	for (auto itr = cell.meshes.begin(); itr != cell.meshes.end(); itr++)
+	{
+		meshMgr.remove(mCache->GetString(mCache->GetMesh(*itr)->name));
+	}
+	cell.state = CELL_UNLOADED;
+	mCommitted -= cell.bytes;
+	mResidentCount--;
+}
+
+void ZoneStreamer::ThreadLoop()
+{
+	for (;;)
+	{
+		uint32 index;
+		{
+			boost::unique_lock<boost::mutex> lock(mMutex);
+			while (mRequests.empty() && !mShutdown)
+				mWake.wait(lock);
+			if (mShutdown)
+				return;
+			index = mRequests.front();
+			mRequests.pop_front();
+			mCells[index].state = CELL_LOADING;
+		}
+
+		Stage(mCells[index]);
+		{
+			boost::lock_guard<boost::mutex> lock(mMutex);
+			mCells[index].state = CELL_READY;
+			mReady.push_back(index);
+		}
+		mStaged.notify_all();
+	}
+}
+
+void ZoneStreamer::Stage(Cell& cell)
+{
+	//copying out of the mapping is what actually reads the cell from disk, which is why it is done here
+	cell.staged.resize(cell.meshes.size());
+	for (uint32 i = 0; i < cell.meshes.size(); ++i)
+	{
+		StagedMesh& staged = cell.staged[i];
+		const ZoneCacheMesh* mesh = mCache->GetMesh(cell.meshes[i]);
+		const MeshVertex* vertices = mCache->GetVertices(mesh);
+		const uint16* indices = mCache->GetIndices(mesh);
+		staged.mesh = cell.meshes[i];
+		staged.vertices.assign(vertices,vertices + mesh->vertexCount);
+		staged.indices.assign(indices,indices + mesh->indexCount);
+		mCache->GetRuns(mesh,staged.runs,staged.lods);
+	}
+}
@@ -0,0 +1,127 @@
+
+#ifndef ZEQ_ZONE_STREAMER_H
+#define ZEQ_ZONE_STREAMER_H
+
+#include <math.h>
+#include <stdio.h>
+#include <float.h>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <algorithm>
+#include <boost/thread.hpp>
+#include "type.h"
+#include "mesh_builder.h"
+#include "zone_cache.h"
+
+//matches the static geometry's regions, so each cell compiles into exactly one of them
+#define ZEQ_STREAM_CELL_SIZE 1000.0f
+//cells are brought in once the camera is this close to them; a cell's geometry is drawn from 1000 units away
+#define ZEQ_STREAM_RADIUS 2000.0f
+//resident cells are only dropped without need once the camera is this much further than the radius from them,
+//so walking back and forth along a cell edge doesn't keep reloading it
+#define ZEQ_STREAM_HYSTERESIS ZEQ_STREAM_CELL_SIZE
+//geometry kept in memory at once, in bytes; the nearest cells are loaded first when they don't all fit
+#define ZEQ_STREAM_BUDGET (192 * 1024 * 1024)
+//static geometry builds are done on the render thread, so only this many cells are finished per frame
+#define ZEQ_STREAM_UPLOADS_PER_FRAME 1
+
+struct ZoneData;
+
+//Pages the zone's geometry in and out in square cells around the camera, straight out of the zone's cache
+//Cells are read into system memory on a background thread; the render thread then uploads them and compiles
+//each into its own static geometry, a cell per frame. Textures, object models and collision are still loaded up
+//front, as they are needed wherever the camera goes
+class ZoneStreamer
+{
+public:
+	//cache must stay open, and have been loaded, for as long as the streamer exists
+	ZoneStreamer(ZoneCache* cache, ZoneData* zone_data, Ogre::SceneManager* sceneMgr);
+	//Stops the background thread and drops every cell still in memory
+	~ZoneStreamer();
+	//Files a mesh or placement of the cache under the cell it falls in; only before Start
+	void	AddMesh(uint32 index);
+	void	AddPlacement(uint32 index);
+	//Starts the background thread, once everything has been added
+	void	Start();
+
+	void	SetBudget(uint32 bytes) { mBudget = bytes; }
+	void	SetPrefetchRadius(float radius) { mRadius = radius; }
+	//Called every frame with the camera's position: drops cells too far away, queues the ones coming into range,
+	//nearest first, and compiles the ones that have finished loading
+	void	Update(const Ogre::Vector3& pos);
+	//Loads and compiles every cell within radius of pos before returning, so there is something to draw on the first frame
+	void	Prime(const Ogre::Vector3& pos, float radius);
+
+	uint32	GetCellCount() const { return mCells.size(); }
+	uint32	GetResidentCount() const { return mResidentCount; }
+	//bytes of every cell queued, loading or in memory, which is what is held against the budget
+	uint32	GetCommittedBytes() const { return mCommitted; }
+
+private:
+	enum CellState
+	{
+		CELL_UNLOADED,
+		CELL_QUEUED,
+		CELL_LOADING, //being read on the background thread
+		CELL_READY, //read, waiting for the render thread
+		CELL_RESIDENT
+	};
+
+	struct StagedMesh
+	{
+		uint32 mesh;
+		std::vector<MeshVertex> vertices;
+		std::vector<uint16> indices;
+		std::vector<MeshRun> runs;
+		std::vector<MeshLod> lods;
+	};
+
+	struct Cell
+	{
+		int32 x;
+		int32 z;
+		std::vector<uint32> meshes;
+		std::vector<uint32> placements;
+		uint32 bytes; //vertices and indices of every level, counted twice as the static geometry keeps its own copy
+		float distance; //from the camera, as of the last update
+		CellState state; //only changed with mMutex held
+		std::vector<StagedMesh> staged; //filled by the background thread, emptied once uploaded
+		Ogre::StaticGeometry* geometry;
+	};
+
+	//not copyable
+	ZoneStreamer(const ZoneStreamer&);
+	ZoneStreamer& operator=(const ZoneStreamer&);
+
+	Cell&	GetCell(float x, float z);
+	void	UpdateDistances(const Ogre::Vector3& pos);
+	//Queues the unloaded cells within radius, nearest first, making room by dropping further ones as needed
+	void	Request(float radius);
+	//Compiles at most max cells that have finished loading and returns how many were
+	uint32	UploadReady(uint32 max);
+	void	Upload(Cell& cell);
+	void	Evict(Cell& cell);
+	void	ThreadLoop();
+	void	Stage(Cell& cell);
+
+	ZoneCache* mCache;
+	ZoneData* mZoneData;
+	Ogre::SceneManager* mSceneMgr;
+	std::vector<Cell> mCells; //not resized once the thread is started
+	std::unordered_map<uint64,uint32> mCellIndex; //cell coordinates to their place in mCells
+	std::deque<uint32> mRequests; //cells waiting for the background thread, nearest first
+	std::deque<uint32> mReady; //cells waiting for the render thread
+	std::vector<uint32> mOrder; //scratch for sorting cells by distance
+	uint32	mBudget;
+	uint32	mCommitted;
+	uint32	mResidentCount;
+	float	mRadius;
+	boost::thread* mThread;
+	boost::mutex mMutex;
+	boost::condition_variable mWake;
+	boost::condition_variable mStaged;
+	bool	mShutdown;
+};
+
+#endif